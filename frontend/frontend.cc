@@ -0,0 +1,142 @@
+// Copyright (c) 2021 PeachLab. All Rights Reserved.
+// Author : goat.zhou@qq.com (Yang Zhou)
+
+#include "frontend/frontend.h"
+
+namespace kaldi {
+
+XvectorFrontend::XvectorFrontend(const XvectorFrontendOptions &opts):
+    opts_(opts), mfcc_(opts.mfcc_opts) {
+  opts_.cmn_opts.Check();
+  KALDI_ASSERT(opts_.vad_opts.vad_frames_context >= 0);
+  KALDI_ASSERT(opts_.vad_opts.vad_proportion_threshold > 0.0 &&
+               opts_.vad_opts.vad_proportion_threshold < 1.0);
+}
+
+// As ComputeVadEnergy(), with the context window slid over the frames
+// instead of recounted for each one.
+int32 XvectorFrontend::ComputeVoicedFrames() {
+  const VadEnergyOptions &vad_opts = opts_.vad_opts;
+  int32 num_frames = mfcc_buf_.NumRows(),
+      context = vad_opts.vad_frames_context;
+  log_energy_.Resize(num_frames, kUndefined);
+  log_energy_.CopyColFromMat(mfcc_buf_, 0);  // C0 is the log-energy.
+  BaseFloat energy_threshold = vad_opts.vad_energy_threshold;
+  if (vad_opts.vad_energy_mean_scale != 0.0) {
+    KALDI_ASSERT(vad_opts.vad_energy_mean_scale > 0.0);
+    energy_threshold += vad_opts.vad_energy_mean_scale *
+        log_energy_.Sum() / num_frames;
+  }
+  const BaseFloat *log_energy = log_energy_.Data();
+  voiced_.resize(num_frames);
+  int32 num_above = 0, num_voiced = 0;
+  // num_above counts the frames above the threshold in
+  // [t - context, t + context], clipped to the utterance.
+  for (int32 t = 0; t < context && t < num_frames; t++)
+    if (log_energy[t] > energy_threshold) num_above++;
+  for (int32 t = 0; t < num_frames; t++) {
+    if (t + context < num_frames && log_energy[t + context] > energy_threshold)
+      num_above++;
+    if (t - context - 1 >= 0 && log_energy[t - context - 1] > energy_threshold)
+      num_above--;
+    int32 num_in_window = std::min(t + context, num_frames - 1) -
+        std::max(t - context, 0) + 1;
+    voiced_[t] = (num_above >=
+                  num_in_window * vad_opts.vad_proportion_threshold);
+    if (voiced_[t]) num_voiced++;
+  }
+  return num_voiced;
+}
+
+// As SlidingWindowCmnInternal() without variance normalization: the window
+// sum is kept up to date for every frame, but only the kept frames are
+// normalized.
+template<class Keep>
+void XvectorFrontend::NormalizeFrames(const Keep &keep,
+                                      MatrixBase<BaseFloat> *features) {
+  const SlidingWindowCmnOptions &cmn_opts = opts_.cmn_opts;
+  int32 num_frames = mfcc_buf_.NumRows(), dim = mfcc_buf_.NumCols(),
+      last_window_start = -1, last_window_end = -1;
+  Vector<double> cur_sum(dim);
+  double *sum = cur_sum.Data();
+  for (int32 t = 0, r = 0; t < num_frames; t++) {
+    int32 window_start, window_end;  // window_end is one past the end.
+    if (cmn_opts.center) {
+      window_start = t - (cmn_opts.cmn_window / 2);
+      window_end = window_start + cmn_opts.cmn_window;
+    } else {
+      window_start = t - cmn_opts.cmn_window;
+      window_end = t + 1;
+    }
+    if (window_start < 0) {
+      window_end -= window_start;
+      window_start = 0;
+    }
+    if (!cmn_opts.center) {
+      if (window_end > t)
+        window_end = std::max(t + 1, cmn_opts.min_window);
+    }
+    if (window_end > num_frames) {
+      window_start -= (window_end - num_frames);
+      window_end = num_frames;
+      if (window_start < 0) window_start = 0;
+    }
+    if (last_window_start == -1) {
+      for (int32 s = window_start; s < window_end; s++) {
+        const BaseFloat *frame = mfcc_buf_.RowData(s);
+        for (int32 d = 0; d < dim; d++) sum[d] += frame[d];
+      }
+    } else {
+      if (window_start > last_window_start) {
+        const BaseFloat *frame = mfcc_buf_.RowData(last_window_start);
+        for (int32 d = 0; d < dim; d++) sum[d] -= frame[d];
+      }
+      if (window_end > last_window_end) {
+        const BaseFloat *frame = mfcc_buf_.RowData(last_window_end);
+        for (int32 d = 0; d < dim; d++) sum[d] += frame[d];
+      }
+    }
+    last_window_start = window_start;
+    last_window_end = window_end;
+    if (!keep(t)) continue;
+    double scale = -1.0 / (window_end - window_start);
+    const BaseFloat *in = mfcc_buf_.RowData(t);
+    BaseFloat *out = features->RowData(r++);
+    for (int32 d = 0; d < dim; d++)
+      out[d] = in[d] + scale * sum[d];
+  }
+}
+
+void XvectorFrontend::ComputeFeatures(const VectorBase<BaseFloat> &waveform,
+                                      BaseFloat sample_freq,
+                                      Matrix<BaseFloat> *features) {
+  BaseFloat vtln_warp = 1.0;
+  mfcc_.ComputeFeatures(waveform, sample_freq, vtln_warp, &mfcc_buf_);
+  int32 num_frames = mfcc_buf_.NumRows(), dim = mfcc_buf_.NumCols();
+  if (num_frames == 0) {
+    features->Resize(0, 0);
+    return;
+  }
+  // VAD looks at the log-energy (C0) before normalization.
+  int32 num_voiced = opts_.apply_vad ? ComputeVoicedFrames() : num_frames;
+  if (num_voiced == 0) {
+    features->Resize(0, 0);
+    return;
+  }
+  if (features->NumRows() != num_voiced || features->NumCols() != dim)
+    features->Resize(num_voiced, dim, kUndefined);
+  if (opts_.cmn_opts.normalize_variance) {
+    // Not used by the x-vector recipes; normalize every frame, then select.
+    Matrix<BaseFloat> normalized(num_frames, dim, kUndefined);
+    SlidingWindowCmn(opts_.cmn_opts, mfcc_buf_, &normalized);
+    for (int32 t = 0, r = 0; t < num_frames; t++)
+      if (!opts_.apply_vad || voiced_[t])
+        features->Row(r++).CopyFromVec(normalized.Row(t));
+  } else if (opts_.apply_vad) {
+    NormalizeFrames([this](int32 t) { return voiced_[t]; }, features);
+  } else {
+    NormalizeFrames([](int32 t) { return true; }, features);
+  }
+}
+
+}  // namespace kaldi
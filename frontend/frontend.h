@@ -1,3 +1,83 @@
 // Copyright (c) 2021 PeachLab. All Rights Reserved.
 // Author : goat.zhou@qq.com (Yang Zhou)
 
+#ifndef KALDI_FRONTEND_FRONTEND_H_
+#define KALDI_FRONTEND_FRONTEND_H_
+
+#include <vector>
+
+#include "base/kaldi-common.h"
+#include "feat/feature-functions.h"
+#include "feat/feature-mfcc.h"
+#include "frontend/voice-activity-detection.h"
+#include "matrix/matrix-lib.h"
+#include "util/options-itf.h"
+
+namespace kaldi {
+
+/// The offline x-vector frontend, as in the Kaldi x-vector recipes: MFCC,
+/// sliding-window mean normalization (centered, 300 frames), then energy VAD
+/// to drop the unvoiced frames.
+struct XvectorFrontendOptions {
+  MfccOptions mfcc_opts;
+  SlidingWindowCmnOptions cmn_opts;
+  VadEnergyOptions vad_opts;
+  bool apply_vad;
+
+  XvectorFrontendOptions(): apply_vad(true) {
+    cmn_opts.cmn_window = 300;
+    cmn_opts.center = true;
+  }
+
+  void Register(OptionsItf *opts) {
+    mfcc_opts.Register(opts);
+    cmn_opts.Register(opts);
+    vad_opts.Register(opts);
+    opts->Register("apply-vad", &apply_vad, "If true, keep only the frames "
+                   "that energy VAD marks as voiced.");
+  }
+};
+
+/// Turns a waveform into the features the x-vector network expects.  Not
+/// thread-safe (the MFCC computer keeps buffers), but cheap to copy, so
+/// give each thread its own copy.
+///
+/// The VAD decisions are made from C0 of the raw MFCCs, before the mean
+/// normalization, which is then applied in one pass that writes only the
+/// voiced frames, straight into "features": unvoiced frames are normalized
+/// and copied nowhere.  The result is that of SlidingWindowCmn() followed by
+/// selecting the voiced rows.
+class XvectorFrontend {
+ public:
+  explicit XvectorFrontend(const XvectorFrontendOptions &opts);
+
+  /// "waveform" is one channel at "sample_freq" Hz, which is resampled if it
+  /// is not the rate in the MFCC options.  "features" is empty if the
+  /// waveform is too short for a frame or has no voiced frame.  Its memory
+  /// is reused if it already has the right size.
+  void ComputeFeatures(const VectorBase<BaseFloat> &waveform,
+                       BaseFloat sample_freq,
+                       Matrix<BaseFloat> *features);
+
+  int32 Dim() const { return mfcc_.Dim(); }
+
+ private:
+  // Sets voiced_ from C0 of mfcc_buf_; returns the number of voiced frames.
+  int32 ComputeVoicedFrames();
+
+  // Writes the normalized rows t of mfcc_buf_ with keep(t) to successive
+  // rows of "features".
+  template<class Keep>
+  void NormalizeFrames(const Keep &keep, MatrixBase<BaseFloat> *features);
+
+  XvectorFrontendOptions opts_;
+  Mfcc mfcc_;
+  // Buffers kept between calls.
+  Matrix<BaseFloat> mfcc_buf_;
+  Vector<BaseFloat> log_energy_;
+  std::vector<bool> voiced_;
+};
+
+}  // namespace kaldi
+
+#endif  // KALDI_FRONTEND_FRONTEND_H_
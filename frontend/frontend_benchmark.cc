@@ -0,0 +1,132 @@
+// Copyright (c) 2021 PeachLab. All Rights Reserved.
+// Author : goat.zhou@qq.com (Yang Zhou)
+
+// Time of XvectorFrontend::ComputeFeatures() against the unfused frontend
+// (MFCC, SlidingWindowCmn() and ComputeVadEnergy() on the whole utterance,
+// then a copy of the voiced rows), on synthetic utterances with pauses, and
+// the largest difference between the two.
+
+#include <algorithm>
+
+#include "base/kaldi-common.h"
+#include "base/timer.h"
+#include "frontend/frontend.h"
+#include "util/parse-options.h"
+
+namespace kaldi {
+
+// The frontend as it was before VAD and CMN were fused.
+static void ReferenceFeatures(const XvectorFrontendOptions &opts,
+                              const VectorBase<BaseFloat> &waveform,
+                              BaseFloat sample_freq, Mfcc *mfcc_computer,
+                              Matrix<BaseFloat> *features) {
+  Matrix<BaseFloat> mfcc;
+  mfcc_computer->ComputeFeatures(waveform, sample_freq, 1.0, &mfcc);
+  if (mfcc.NumRows() == 0) {
+    features->Resize(0, 0);
+    return;
+  }
+  Matrix<BaseFloat> normalized(mfcc.NumRows(), mfcc.NumCols(), kUndefined);
+  SlidingWindowCmn(opts.cmn_opts, mfcc, &normalized);
+  if (!opts.apply_vad) {
+    features->Swap(&normalized);
+    return;
+  }
+  Vector<BaseFloat> voiced;
+  ComputeVadEnergy(opts.vad_opts, mfcc, &voiced);
+  int32 num_voiced = 0;
+  for (int32 t = 0; t < voiced.Dim(); t++)
+    if (voiced(t) != 0.0) num_voiced++;
+  features->Resize(num_voiced, normalized.NumCols(), kUndefined);
+  for (int32 t = 0, r = 0; t < voiced.Dim(); t++)
+    if (voiced(t) != 0.0) features->Row(r++).CopyFromVec(normalized.Row(t));
+}
+
+// Bursts of loud noise ("speech") separated by quiet pauses, "speech_ratio"
+// of the time loud.
+static void MakeWaveform(BaseFloat seconds, BaseFloat sample_freq,
+                         BaseFloat speech_ratio, Vector<BaseFloat> *waveform) {
+  waveform->Resize(static_cast<int32>(seconds * sample_freq));
+  int32 i = 0;
+  while (i < waveform->Dim()) {
+    bool speech = RandUniform() < speech_ratio;
+    int32 len = static_cast<int32>((0.2 + RandUniform()) * sample_freq);
+    BaseFloat amplitude = speech ? 3000.0 : 10.0;
+    for (int32 end = std::min(i + len, waveform->Dim()); i < end; i++)
+      (*waveform)(i) = amplitude * RandGauss();
+  }
+}
+
+}  // namespace kaldi
+
+int main(int argc, char *argv[]) {
+  using namespace kaldi;
+  try {
+    const char *usage =
+        "Measures XvectorFrontend::ComputeFeatures() against the unfused\n"
+        "frontend on synthetic utterances, and checks they agree.\n"
+        "Usage:  frontend-benchmark [options]\n";
+    ParseOptions po(usage);
+    XvectorFrontendOptions frontend_opts;
+    int32 num_utts = 20;
+    BaseFloat utt_seconds = 10.0, speech_ratio = 0.6;
+    // Without dithering the two frontends see the same MFCCs.
+    frontend_opts.mfcc_opts.frame_opts.dither = 0.0;
+    frontend_opts.Register(&po);
+    po.Register("num-utts", &num_utts, "Number of utterances.");
+    po.Register("utt-seconds", &utt_seconds, "Length of the utterances.");
+    po.Register("speech-ratio", &speech_ratio, "Proportion of each "
+                "utterance that is loud.");
+    po.Read(argc, argv);
+    if (po.NumArgs() != 0) {
+      po.PrintUsage();
+      exit(1);
+    }
+
+    BaseFloat sample_freq = frontend_opts.mfcc_opts.frame_opts.samp_freq;
+    std::vector<Vector<BaseFloat> > waveforms(num_utts);
+    for (int32 i = 0; i < num_utts; i++)
+      MakeWaveform(utt_seconds, sample_freq, speech_ratio, &(waveforms[i]));
+
+    XvectorFrontend frontend(frontend_opts);
+    Mfcc mfcc_computer(frontend_opts.mfcc_opts);
+    Matrix<BaseFloat> features, reference;
+    double max_diff = 0.0, fused_time = 0.0, reference_time = 0.0,
+        mfcc_time = 0.0;
+    int64 num_frames = 0, num_voiced = 0;
+    for (int32 i = 0; i < num_utts; i++) {
+      Timer timer;
+      mfcc_computer.ComputeFeatures(waveforms[i], sample_freq, 1.0,
+                                    &reference);
+      mfcc_time += timer.Elapsed();
+      timer.Reset();
+      ReferenceFeatures(frontend_opts, waveforms[i], sample_freq,
+                        &mfcc_computer, &reference);
+      reference_time += timer.Elapsed();
+      timer.Reset();
+      frontend.ComputeFeatures(waveforms[i], sample_freq, &features);
+      fused_time += timer.Elapsed();
+      if (features.NumRows() != reference.NumRows())
+        KALDI_ERR << "Utterance " << i << ": " << features.NumRows()
+                  << " voiced frames, expected " << reference.NumRows();
+      if (features.NumRows() > 0) {
+        features.AddMat(-1.0, reference);
+        max_diff = std::max<double>(max_diff, features.LargestAbsElem());
+      }
+      num_voiced += reference.NumRows();
+      num_frames += NumFrames(waveforms[i].Dim(),
+                              frontend_opts.mfcc_opts.frame_opts);
+    }
+    KALDI_LOG << num_utts << " utterances of " << utt_seconds << " s, "
+              << 100.0 * num_voiced / num_frames << "% of frames voiced.";
+    KALDI_LOG << "Unfused frontend: " << 1000.0 * reference_time / num_utts
+              << " ms per utterance; fused: " << 1000.0 * fused_time / num_utts
+              << " ms; of which MFCC " << 1000.0 * mfcc_time / num_utts
+              << " ms.";
+    KALDI_LOG << "Largest difference " << max_diff;
+    return 0;
+  } catch(const std::exception &e) {
+    std::cerr << e.what();
+    return -1;
+  }
+}
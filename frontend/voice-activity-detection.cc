@@ -18,7 +18,7 @@
 // limitations under the License.
 
 
-#include "speaker_verification/voice-activity-detection.h"
+#include "frontend/voice-activity-detection.h"
 #include "matrix/matrix-functions.h"
 
 
@@ -0,0 +1,134 @@
+// Copyright (c) 2021 PeachLab. All Rights Reserved.
+// Author : goat.zhou@qq.com (Yang Zhou)
+
+#include "inference/random_tdnn_nnet_computer.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace goat {
+
+using kaldi::kNoTrans;
+using kaldi::kTrans;
+using kaldi::SubVector;
+
+static void SetRandGauss(BaseFloat scale, kaldi::RandomState* state,
+                         kaldi::MatrixBase<BaseFloat>* m) {
+  for (int32 r = 0; r < m->NumRows(); r++) {
+    BaseFloat* row = m->RowData(r);
+    for (int32 c = 0; c < m->NumCols(); c++)
+      row[c] = scale * kaldi::RandGauss(state);
+  }
+}
+
+RandomTdnnNnetComputer::RandomTdnnNnetComputer(const RandomTdnnOptions& opts)
+    : opts_(opts) {
+  KALDI_ASSERT(opts_.feat_dim > 0 && opts_.hidden_dim > 0 &&
+               opts_.stats_dim > 0 && opts_.xvector_dim > 0);
+  kaldi::RandomState state;
+  state.seed = opts_.seed + 27437;
+  const int32 offsets0[] = { -2, -1, 0, 1, 2 }, offsets1[] = { -2, 0, 2 },
+      offsets2[] = { -3, 0, 3 }, offsets3[] = { 0 };
+  layers_.resize(5);
+  InitLayer(std::vector<int32>(offsets0, offsets0 + 5), opts_.feat_dim,
+            opts_.hidden_dim, &state, &(layers_[0]));
+  InitLayer(std::vector<int32>(offsets1, offsets1 + 3), opts_.hidden_dim,
+            opts_.hidden_dim, &state, &(layers_[1]));
+  InitLayer(std::vector<int32>(offsets2, offsets2 + 3), opts_.hidden_dim,
+            opts_.hidden_dim, &state, &(layers_[2]));
+  InitLayer(std::vector<int32>(offsets3, offsets3 + 1), opts_.hidden_dim,
+            opts_.hidden_dim, &state, &(layers_[3]));
+  InitLayer(std::vector<int32>(offsets3, offsets3 + 1), opts_.hidden_dim,
+            opts_.stats_dim, &state, &(layers_[4]));
+  embedding_linear_.Resize(2 * opts_.stats_dim, opts_.xvector_dim,
+                           kUndefined);
+  SetRandGauss(1.0 / std::sqrt(2.0 * opts_.stats_dim), &state,
+               &embedding_linear_);
+  embedding_bias_.Resize(opts_.xvector_dim);
+}
+
+void RandomTdnnNnetComputer::InitLayer(const std::vector<int32>& offsets,
+                                       int32 input_dim, int32 output_dim,
+                                       kaldi::RandomState* state,
+                                       TdnnLayer* layer) {
+  layer->offsets = offsets;
+  layer->linear.resize(offsets.size());
+  // He initialization keeps the activations of the ReLU stack at about the
+  // same scale from layer to layer.
+  BaseFloat scale = std::sqrt(2.0 / (offsets.size() * input_dim));
+  for (size_t i = 0; i < offsets.size(); i++) {
+    layer->linear[i].Resize(input_dim, output_dim, kUndefined);
+    SetRandGauss(scale, state, &(layer->linear[i]));
+  }
+  layer->bias.Resize(output_dim);
+  for (int32 i = 0; i < output_dim; i++)
+    layer->bias(i) = 0.1 * kaldi::RandGauss(state);
+}
+
+int32 RandomTdnnNnetComputer::LeftContext() const {
+  int32 context = 0;
+  for (size_t i = 0; i < layers_.size(); i++)
+    context -= *std::min_element(layers_[i].offsets.begin(),
+                                 layers_[i].offsets.end());
+  return context;
+}
+
+int32 RandomTdnnNnetComputer::RightContext() const {
+  int32 context = 0;
+  for (size_t i = 0; i < layers_.size(); i++)
+    context += *std::max_element(layers_[i].offsets.begin(),
+                                 layers_[i].offsets.end());
+  return context;
+}
+
+void RandomTdnnNnetComputer::FeedForward(const Matrix<BaseFloat>& features,
+                                         Vector<BaseFloat>* inference) {
+  if (features.NumCols() != opts_.feat_dim) {
+    KALDI_ERR << "The stand-in network takes " << opts_.feat_dim
+              << "-dimensional features, got " << features.NumCols();
+  }
+  if (features.NumRows() <= LeftContext() + RightContext()) {
+    KALDI_ERR << "A chunk of " << features.NumRows() << " frames is shorter "
+              << "than the network's context of "
+              << LeftContext() + RightContext() + 1 << " frames.";
+  }
+  // Each layer drops the frames it has no context for.
+  Matrix<BaseFloat> activations[2];
+  const Matrix<BaseFloat>* input = &features;
+  for (size_t l = 0; l < layers_.size(); l++) {
+    const TdnnLayer& layer = layers_[l];
+    int32 first = *std::min_element(layer.offsets.begin(),
+                                    layer.offsets.end()),
+        last = *std::max_element(layer.offsets.begin(), layer.offsets.end()),
+        num_frames = input->NumRows() - (last - first);
+    Matrix<BaseFloat>* output = &(activations[l % 2]);
+    output->Resize(num_frames, layer.bias.Dim(), kUndefined);
+    output->CopyRowsFromVec(layer.bias);
+    for (size_t i = 0; i < layer.offsets.size(); i++) {
+      output->AddMatMat(1.0, input->RowRange(layer.offsets[i] - first,
+                                             num_frames),
+                        kNoTrans, layer.linear[i], kNoTrans, 1.0);
+    }
+    output->ApplyFloor(0.0);
+    input = output;
+  }
+
+  // Mean and standard deviation over the frames.
+  Matrix<BaseFloat>& frames = activations[(layers_.size() - 1) % 2];
+  int32 num_frames = frames.NumRows(), stats_dim = frames.NumCols();
+  Vector<BaseFloat> stats(2 * stats_dim);
+  SubVector<BaseFloat> mean(stats, 0, stats_dim),
+      stddev(stats, stats_dim, stats_dim);
+  mean.AddRowSumMat(1.0 / num_frames, frames, 0.0);
+  frames.ApplyPow(2.0);
+  stddev.AddRowSumMat(1.0 / num_frames, frames, 0.0);
+  stddev.AddVecVec(-1.0, mean, mean, 1.0);
+  stddev.ApplyFloor(1.0e-10);
+  stddev.ApplyPow(0.5);
+
+  inference->Resize(opts_.xvector_dim, kUndefined);
+  inference->CopyFromVec(embedding_bias_);
+  inference->AddMatVec(1.0, embedding_linear_, kTrans, stats, 1.0);
+}
+
+}  // namespace goat
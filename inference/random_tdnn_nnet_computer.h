@@ -0,0 +1,81 @@
+// Copyright (c) 2021 PeachLab. All Rights Reserved.
+// Author : goat.zhou@qq.com (Yang Zhou)
+
+#ifndef RANDOM_TDNN_NNET_COMPUTER_H_
+#define RANDOM_TDNN_NNET_COMPUTER_H_
+
+#include <vector>
+
+#include "base/kaldi-common.h"
+#include "interface/nnet_computer_interface.h"
+#include "util/options-itf.h"
+
+namespace goat {
+
+struct RandomTdnnOptions {
+  int32 feat_dim;  // Not registered: must be that of the frontend.
+  int32 hidden_dim;
+  int32 stats_dim;
+  int32 xvector_dim;
+  int32 seed;
+
+  RandomTdnnOptions(): feat_dim(30), hidden_dim(512), stats_dim(1500),
+                       xvector_dim(512), seed(0) { }
+
+  void Register(kaldi::OptionsItf *opts) {
+    opts->Register("nnet-hidden-dim", &hidden_dim, "Dimension of the frame "
+                   "layers of the stand-in network.");
+    opts->Register("nnet-stats-dim", &stats_dim, "Dimension of the layer "
+                   "that is pooled.");
+    opts->Register("nnet-xvector-dim", &xvector_dim, "Dimension of the "
+                   "x-vectors it outputs.");
+    opts->Register("nnet-seed", &seed, "Seed of its weights.");
+  }
+};
+
+// A stand-in network with the shape and cost of the Kaldi x-vector TDNN:
+// frame layers with contexts {-2..2}, {-2,0,2}, {-3,0,3}, {0}, {0} and
+// ReLUs, mean+stddev pooling and an affine embedding layer.  The weights are
+// random but fixed by the seed, so the outputs are deterministic.  It runs
+// in-tree without a model file, for benchmarks and tests of everything
+// around the network; its x-vectors carry no speaker information.
+class RandomTdnnNnetComputer : public NnetComputerInterface {
+  public:
+   explicit RandomTdnnNnetComputer(
+       const RandomTdnnOptions& opts = RandomTdnnOptions());
+   // The weights come from the options; the model is not read.
+   void Init(const std::string& nnet_model) { }
+   void InitFromBuffer(const char* data, size_t size) { }
+   void FeedForward(const Matrix<BaseFloat>& features,
+                    Vector<BaseFloat>* inference);
+   SubMatrix<BaseFloat> BatchInput(int32 num_chunks, int32 chunk_frames,
+                                   int32 feat_dim) {
+     return batch_.Input(num_chunks, chunk_frames, feat_dim);
+   }
+   SubMatrix<BaseFloat> RunBatch() { return batch_.Run(this); }
+
+   // Frames the frame layers consume on each side of a chunk.
+   int32 LeftContext() const;
+   int32 RightContext() const;
+
+  private:
+   struct TdnnLayer {
+     std::vector<int32> offsets;
+     // One input_dim x output_dim block per offset.
+     std::vector<Matrix<BaseFloat> > linear;
+     Vector<BaseFloat> bias;
+   };
+   void InitLayer(const std::vector<int32>& offsets, int32 input_dim,
+                  int32 output_dim, kaldi::RandomState* state,
+                  TdnnLayer* layer);
+
+   RandomTdnnOptions opts_;
+   std::vector<TdnnLayer> layers_;
+   Matrix<BaseFloat> embedding_linear_;  // 2 * stats_dim x xvector_dim.
+   Vector<BaseFloat> embedding_bias_;
+   CopyingBatch batch_;
+};
+
+}  // namespace goat
+
+#endif  // RANDOM_TDNN_NNET_COMPUTER_H_
@@ -2,35 +2,309 @@
 
 #include "tensorflow/lite/c/common.h"
 
+#include <algorithm>
 #include <memory>
+#include <set>
+#include <string>
 
-TFliteNnetComputer::Init(const std::string& nnet_model) {
+namespace goat {
+
+TFliteNnetComputer::TFliteNnetComputer(const TFliteNnetComputerOptions& opts)
+    : opts_(opts), input_rank_(0), num_uses_(0), batch_interpreter_(nullptr),
+      batch_chunks_(0) {
+  KALDI_ASSERT(opts_.max_interpreters > 0);
+  if (!kaldi::SplitStringToIntegers(opts_.frame_buckets, ",", true,
+                                    &frame_buckets_)) {
+    KALDI_ERR << "Bad --frame-buckets: " << opts_.frame_buckets;
+  }
+  std::sort(frame_buckets_.begin(), frame_buckets_.end());
+}
+
+void TFliteNnetComputer::Init(const std::string& nnet_model) {
   model_ =  tflite::FlatBufferModel::BuildFromFile(nnet_model.c_str());
-  tflite::ops::builtin::BuiltinOpResolver resolver;
-  builder_.reset(new tflite::InterpreterBuilder(*model_, resolver));
-  (*builder_)(&interpreter_);
-}
-
-void XvectorExtractor::XvectorCompute(const kaldi::MatrixBase<BaseFloat>& features,
-                                      Vector<BaseFloat>* xvector) {
-  KALDI_LOG << " feature number rows: " << features.NumRows() << 
-	             " " << features.NumCols();
-  Timer time;
-	xvector->reverse();
-  int32 input_idx = interpreter_->inputs()[0];
-  BaseFloat* input_pointer = interpreter_->typed_input_tensor<float>(0);
-  TfLiteTensor* input_tensor = interpreter_->tensor(input_idx);
-  // fill the input data, rewrite
-  memcpy(input_pointer, features.Data(), input_tensor->bytes);
-
-  interpreter_->Invoke();
-  BaseFloat* output = interpreter_->typed_output_tensor<float>(0);
-  int32 output_idx = interpreter_->outputs()[0];
-  int32 output_bytes = interpreter_->tensor(output_idx)->bytes;
-  int32 output_dim = output_bytes / sizeof(float);
-  xvector->Resize(output_dim);
-  memcpy(xvector->Data(), output, output_bytes);
-  float second = time.Elapsed();
-  KALDI_LOG << "nnet compute time: " << second;
+  if (model_ == nullptr) {
+    KALDI_ERR << "Could not build the network from " << nnet_model;
+  }
+  BuildInterpreters();
+}
+
+void TFliteNnetComputer::InitFromBuffer(const char* data, size_t size) {
+  model_ = tflite::FlatBufferModel::BuildFromBuffer(data, size);
+  if (model_ == nullptr) {
+    KALDI_ERR << "Could not build the network from a " << size
+              << "-byte buffer.";
+  }
+  BuildInterpreters();
+}
+
+void TFliteNnetComputer::BuildInterpreters() {
+  interpreters_.clear();
+  batch_interpreter_ = nullptr;
+  // The model's own input shape is the first entry of the cache.
+  std::unique_ptr<tflite::Interpreter> interpreter;
+  tflite::InterpreterBuilder(*model_, resolver_)(&interpreter);
+  if (interpreter == nullptr ||
+      interpreter->AllocateTensors() != kTfLiteOk) {
+    KALDI_ERR << "Could not build an interpreter for the network.";
+  }
+  const TfLiteIntArray* dims = interpreter->input_tensor(0)->dims;
+  input_rank_ = dims->size;
+  if (input_rank_ != 2 && input_rank_ != 3) {
+    KALDI_ERR << "The network's input has " << input_rank_ << " dimensions; "
+              << "expected [frames, dim] or [batch, frames, dim].";
+  }
+  std::vector<int32> shape(dims->data, dims->data + dims->size);
+  ShapeInterpreter& entry = interpreters_[shape];
+  entry.interpreter = std::move(interpreter);
+  entry.last_use = num_uses_++;
+}
+
+tflite::Interpreter* TFliteNnetComputer::GetInterpreter(
+    const std::vector<int32>& shape) {
+  TFliteShapeStats& stats = shape_stats_[shape];
+  stats.shape = shape;
+  stats.num_calls++;
+  auto iter = interpreters_.find(shape);
+  if (iter != interpreters_.end()) {
+    stats.num_hits++;
+    iter->second.last_use = num_uses_++;
+    return iter->second.interpreter.get();
+  }
+  kaldi::Timer timer;
+  if (interpreters_.size() >= static_cast<size_t>(opts_.max_interpreters)) {
+    // The interpreter of an open batch (see BatchInput()) is pinned; with
+    // nothing else to evict, the cache holds one more for a while.
+    auto lru = interpreters_.end();
+    for (auto it = interpreters_.begin(); it != interpreters_.end(); ++it) {
+      if (it->second.interpreter.get() == batch_interpreter_) continue;
+      if (lru == interpreters_.end() ||
+          it->second.last_use < lru->second.last_use)
+        lru = it;
+    }
+    if (lru != interpreters_.end()) interpreters_.erase(lru);
+  }
+  ShapeInterpreter& entry = interpreters_[shape];
+  tflite::InterpreterBuilder(*model_, resolver_)(&entry.interpreter);
+  if (entry.interpreter == nullptr ||
+      entry.interpreter->ResizeInputTensor(entry.interpreter->inputs()[0],
+                                           shape) != kTfLiteOk ||
+      entry.interpreter->AllocateTensors() != kTfLiteOk) {
+    interpreters_.erase(shape);
+    KALDI_ERR << "Could not allocate the network's tensors for an input of "
+              << "shape [" << shape[0] << ", " << shape[1]
+              << (shape.size() == 3 ? ", " + std::to_string(shape[2]) : "")
+              << "].";
+  }
+  entry.last_use = num_uses_++;
+  stats.allocate_seconds += timer.Elapsed();
+  return entry.interpreter.get();
+}
+
+void TFliteNnetComputer::Invoke(const std::vector<int32>& shape,
+                                tflite::Interpreter* interpreter) {
+  kaldi::Timer timer;
+  if (interpreter->Invoke() != kTfLiteOk) {
+    KALDI_ERR << "The network failed to run.";
+  }
+  shape_stats_[shape].invoke_seconds += timer.Elapsed();
+}
+
+int32 TFliteNnetComputer::BucketFrames(int32 num_frames) const {
+  auto iter = std::lower_bound(frame_buckets_.begin(), frame_buckets_.end(),
+                               num_frames);
+  return iter == frame_buckets_.end() ? num_frames : *iter;
+}
+
+void TFliteNnetComputer::FeedForward(const Matrix<BaseFloat>& features,
+                                     Vector<BaseFloat>* xvector) {
+  int32 num_frames = features.NumRows(),
+      max_frames = frame_buckets_.empty() ? 0 : frame_buckets_.back();
+  if (num_frames == 0) {
+    // Nothing to pad a bucket from; callers skip empty x-vectors.
+    xvector->Resize(0);
+    return;
+  }
+  if (max_frames == 0 || num_frames <= max_frames) {
+    FeedForwardBucket(features, xvector);
+    return;
+  }
+  // Longer than the largest bucket: a shape of its own would evict the
+  // warmed ones, so it runs in even pieces that fit the buckets, and the
+  // output is their frame-weighted average, as XvectorExtractor averages
+  // its chunks.
+  int32 num_pieces = (num_frames + max_frames - 1) / max_frames;
+  Vector<BaseFloat> piece_xvector;
+  for (int32 i = 0; i < num_pieces; ++i) {
+    int32 begin = static_cast<int64>(i) * num_frames / num_pieces,
+        end = static_cast<int64>(i + 1) * num_frames / num_pieces;
+    FeedForwardBucket(features.RowRange(begin, end - begin), &piece_xvector);
+    if (i == 0) xvector->Resize(piece_xvector.Dim());
+    xvector->AddVec(static_cast<BaseFloat>(end - begin) / num_frames,
+                    piece_xvector);
+  }
+}
+
+void TFliteNnetComputer::FeedForwardBucket(
+    const kaldi::MatrixBase<BaseFloat>& features, Vector<BaseFloat>* xvector) {
+  int32 num_frames = features.NumRows(), feat_dim = features.NumCols(),
+      bucket_frames = BucketFrames(num_frames);
+  std::vector<int32> shape;
+  if (input_rank_ == 3) shape.push_back(1);
+  shape.push_back(bucket_frames);
+  shape.push_back(feat_dim);
+  tflite::Interpreter* interpreter = GetInterpreter(shape);
+  float* input = interpreter->typed_input_tensor<float>(0);
+  // An open batch of one chunk of this shape shares the interpreter; its
+  // input is put back after the run.
+  std::vector<float> batch_input;
+  if (interpreter == batch_interpreter_)
+    batch_input.assign(input, input + bucket_frames * feat_dim);
+
+  // Pad to the bucket by repeating the edge frames, as XvectorExtractor
+  // pads short chunks.
+  int32 left_context = (bucket_frames - num_frames) / 2;
+  for (int32 t = 0; t < bucket_frames; ++t) {
+    int32 r = std::min(std::max(t - left_context, 0), num_frames - 1);
+    memcpy(input + t * feat_dim, features.RowData(r),
+           feat_dim * sizeof(float));
+  }
+  Invoke(shape, interpreter);
+
+  const TfLiteTensor* output_tensor = interpreter->output_tensor(0);
+  int32 output_dim = output_tensor->bytes / sizeof(float);
+  xvector->Resize(output_dim, kUndefined);
+  memcpy(xvector->Data(), output_tensor->data.f, output_dim * sizeof(float));
+  if (!batch_input.empty())
+    std::copy(batch_input.begin(), batch_input.end(), input);
+}
+
+int32 TFliteNnetComputer::BatchSize(int32 num_chunks) const {
+  if (!opts_.round_batch_size) return num_chunks;
+  int32 batch_size = 1;
+  while (batch_size < num_chunks) batch_size *= 2;
+  return batch_size;
+}
+
+tflite::Interpreter* TFliteNnetComputer::GetBatchInterpreter(
+    int32 num_chunks, int32 chunk_frames, int32 feat_dim,
+    std::vector<int32>* shape) {
+  *shape = { BatchSize(num_chunks), chunk_frames, feat_dim };
+  tflite::Interpreter* interpreter = GetInterpreter(*shape);
+  // The padding chunks are computed and dropped; zeros keep them cheap.
+  int32 chunk_size = chunk_frames * feat_dim;
+  memset(interpreter->typed_input_tensor<float>(0) + num_chunks * chunk_size,
+         0, ((*shape)[0] - num_chunks) * chunk_size * sizeof(float));
+  return interpreter;
+}
+
+SubMatrix<BaseFloat> TFliteNnetComputer::BatchOutput(
+    tflite::Interpreter* interpreter, int32 batch_size,
+    int32 num_chunks) const {
+  TfLiteTensor* output_tensor = interpreter->output_tensor(0);
+  int32 output_dim = output_tensor->bytes / sizeof(float) / batch_size;
+  return SubMatrix<BaseFloat>(output_tensor->data.f, num_chunks, output_dim,
+                              output_dim);
+}
+
+void TFliteNnetComputer::FeedForwardBatch(const Matrix<BaseFloat>& features,
+                                          int32 num_chunks,
+                                          Matrix<BaseFloat>* inferences) {
+  if (input_rank_ != 3) {
+    NnetComputerInterface::FeedForwardBatch(features, num_chunks, inferences);
+    return;
+  }
+  int32 chunk_frames = features.NumRows() / num_chunks;
+  int32 feat_dim = features.NumCols();
+  std::vector<int32> shape;
+  // As in FeedForward(), an open batch of this shape gets its input back.
+  std::vector<float> batch_input;
+  if (batch_interpreter_ != nullptr && batch_shape_ == std::vector<int32>(
+          { BatchSize(num_chunks), chunk_frames, feat_dim })) {
+    const float* input = batch_interpreter_->typed_input_tensor<float>(0);
+    batch_input.assign(input, input + batch_shape_[0] * chunk_frames *
+                       feat_dim);
+  }
+  tflite::Interpreter* interpreter = GetBatchInterpreter(
+      num_chunks, chunk_frames, feat_dim, &shape);
+  // Row by row: "features" may have a stride larger than its width.
+  SubMatrix<BaseFloat>(interpreter->typed_input_tensor<float>(0),
+                       features.NumRows(), feat_dim, feat_dim)
+      .CopyFromMat(features);
+  Invoke(shape, interpreter);
+
+  SubMatrix<BaseFloat> outputs = BatchOutput(interpreter, shape[0],
+                                             num_chunks);
+  inferences->Resize(num_chunks, outputs.NumCols(), kUndefined);
+  inferences->CopyFromMat(outputs);
+  if (!batch_input.empty()) {
+    std::copy(batch_input.begin(), batch_input.end(),
+              interpreter->typed_input_tensor<float>(0));
+  }
+}
+
+SubMatrix<BaseFloat> TFliteNnetComputer::BatchInput(int32 num_chunks,
+                                                    int32 chunk_frames,
+                                                    int32 feat_dim) {
+  if (input_rank_ != 3) {
+    return copying_batch_.Input(num_chunks, chunk_frames, feat_dim);
+  }
+  batch_interpreter_ = GetBatchInterpreter(num_chunks, chunk_frames, feat_dim,
+                                           &batch_shape_);
+  batch_chunks_ = num_chunks;
+  return SubMatrix<BaseFloat>(batch_interpreter_->typed_input_tensor<float>(0),
+                              num_chunks * chunk_frames, feat_dim, feat_dim);
+}
+
+SubMatrix<BaseFloat> TFliteNnetComputer::RunBatch() {
+  if (input_rank_ != 3) return copying_batch_.Run(this);
+  if (batch_interpreter_ == nullptr) {
+    KALDI_ERR << "RunBatch() without a BatchInput() before it.";
+  }
+  tflite::Interpreter* interpreter = batch_interpreter_;
+  Invoke(batch_shape_, interpreter);
+  // The batch is closed; the view is valid until the next call.
+  batch_interpreter_ = nullptr;
+  return BatchOutput(interpreter, batch_shape_[0], batch_chunks_);
+}
+
+void TFliteNnetComputer::Warmup(int32 chunk_frames, int32 feat_dim,
+                                int32 max_batch_size) {
+  std::set<std::vector<int32> > shapes;
+  if (input_rank_ == 3 && max_batch_size > 0) {
+    if (opts_.round_batch_size) {
+      for (int32 batch_size = 1; ; batch_size *= 2) {
+        shapes.insert({ batch_size, chunk_frames, feat_dim });
+        if (batch_size >= max_batch_size) break;
+      }
+    } else {
+      // Full batches; the last, partial one of a call is allocated on use.
+      shapes.insert({ max_batch_size, chunk_frames, feat_dim });
+    }
+  }
+  for (size_t i = 0; i < frame_buckets_.size(); ++i) {
+    std::vector<int32> shape;
+    if (input_rank_ == 3) shape.push_back(1);
+    shape.push_back(frame_buckets_[i]);
+    shape.push_back(feat_dim);
+    shapes.insert(shape);
+  }
+  if (shapes.size() > static_cast<size_t>(opts_.max_interpreters)) {
+    KALDI_ERR << "Warming up " << shapes.size() << " input shapes, but "
+              << "--max-interpreters=" << opts_.max_interpreters
+              << " keeps fewer: they would evict each other.  Raise it, or "
+              << "use fewer --frame-buckets or a smaller batch size.";
+  }
+  for (auto iter = shapes.begin(); iter != shapes.end(); ++iter)
+    GetInterpreter(*iter);
+  // Warmup is not traffic.
+  shape_stats_.clear();
+}
+
+void TFliteNnetComputer::GetShapeStats(
+    std::vector<TFliteShapeStats>* stats) const {
+  stats->clear();
+  for (auto iter = shape_stats_.begin(); iter != shape_stats_.end(); ++iter)
+    stats->push_back(iter->second);
 }
 
+}  // namespace goat
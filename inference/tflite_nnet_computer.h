@@ -1,8 +1,11 @@
 #ifndef TFLITE_NNET_COMPUTER_H_
 #define TFLITE_NNET_COMPUTER_H_
 
+#include <map>
+#include <vector>
+
 #include "base/kaldi-common.h"
-#include "interface/nnet_inference_interface.h"
+#include "interface/nnet_computer_interface.h"
 #include "tensorflow/lite/interpreter.h"
 #include "tensorflow/lite/model.h"
 #include "tensorflow/lite/kernels/register.h"
@@ -13,17 +16,119 @@ using kaldi::Vector;
 
 namespace goat {
 
-class TFliteNnetComputer::NnetComputerInterface {
+struct TFliteNnetComputerOptions {
+  std::string frame_buckets;
+  bool round_batch_size;
+  int32 max_interpreters;
+
+  TFliteNnetComputerOptions(): round_batch_size(true), max_interpreters(16) { }
+
+  void Register(kaldi::OptionsItf *opts) {
+    opts->Register("frame-buckets", &frame_buckets, "Comma-separated frame "
+                   "counts; FeedForward() pads an input to the smallest one "
+                   "it fits (repeating its edge frames), so that few input "
+                   "shapes are ever used; longer inputs are split into "
+                   "pieces that fit, and their outputs averaged.  The "
+                   "padding changes the output slightly.  Empty for no "
+                   "padding.");
+    opts->Register("round-batch-size", &round_batch_size, "Pad batches to a "
+                   "power of two chunks; the padding chunks are dropped, so "
+                   "the outputs are unchanged.");
+    opts->Register("max-interpreters", &max_interpreters, "Number of input "
+                   "shapes kept allocated; the least recently used goes.");
+  }
+};
+
+// Counters of one input shape, since the computer was created.
+struct TFliteShapeStats {
+  std::vector<int32> shape;  // Of the input tensor.
+  int64 num_calls = 0;
+  // Calls that found an interpreter allocated for the shape; the others
+  // paid for ResizeInputTensor() and AllocateTensors().
+  int64 num_hits = 0;
+  double allocate_seconds = 0.0;
+  double invoke_seconds = 0.0;
+};
+
+// Not thread-safe: give each thread its own (XvectorExtractor does).
+class TFliteNnetComputer : public NnetComputerInterface {
   public:
-   TFliteNnetComputer();
+   explicit TFliteNnetComputer(
+       const TFliteNnetComputerOptions& opts = TFliteNnetComputerOptions());
 	 void Init(const std::string& nnet_model);
-   bool FeedForward(const Matrix<BaseFloat>& features, 
-	                  Vector<BaseFloat>* inference) const = 0;
+   // The flatbuffer is used in place, not copied.
+   void InitFromBuffer(const char* data, size_t size);
+   // An input of no frames gives an empty output.
+   void FeedForward(const Matrix<BaseFloat>& features,
+	                  Vector<BaseFloat>* inference);
+   // Runs all chunks in one Invoke() by resizing the batch dimension of the
+   // input tensor; models whose input has no batch dimension fall back to
+   // one call per chunk.
+   void FeedForwardBatch(const Matrix<BaseFloat>& features, int32 num_chunks,
+                         Matrix<BaseFloat>* inferences);
+   // Views of the interpreter's own input and output tensors, so the batch
+   // is written and the outputs are read in place (copied for models
+   // without a batch dimension).  The batch's interpreter is pinned from
+   // BatchInput() to RunBatch(), so other calls in between (e.g.
+   // FeedForward()) don't evict it.  Each view is valid only until the next
+   // call on this object.
+   SubMatrix<BaseFloat> BatchInput(int32 num_chunks, int32 chunk_frames,
+                                   int32 feat_dim);
+   SubMatrix<BaseFloat> RunBatch();
+   // Allocates the shapes FeedForwardBatch() will use for chunks of
+   // "chunk_frames" frames, up to "max_batch_size" of them, and those
+   // FeedForward() will use for the frame buckets.  Fails if they are more
+   // than --max-interpreters.
+   void Warmup(int32 chunk_frames, int32 feat_dim, int32 max_batch_size);
+   // One entry per input shape used so far.
+   void GetShapeStats(std::vector<TFliteShapeStats>* stats) const;
 
   private:
+   // An interpreter whose input tensor is allocated for one shape.
+   struct ShapeInterpreter {
+     std::unique_ptr<tflite::Interpreter> interpreter;
+     int64 last_use;
+   };
+   void BuildInterpreters();
+   // Returns the interpreter for "shape", allocating it if needed.
+   tflite::Interpreter* GetInterpreter(const std::vector<int32>& shape);
+   // The batch dimension for "num_chunks" chunks (see --round-batch-size).
+   int32 BatchSize(int32 num_chunks) const;
+   // Returns the interpreter for a batch of "num_chunks" chunks and its
+   // input shape, with the padding chunks (see --round-batch-size) zeroed.
+   tflite::Interpreter* GetBatchInterpreter(int32 num_chunks,
+                                            int32 chunk_frames,
+                                            int32 feat_dim,
+                                            std::vector<int32>* shape);
+   // The first "num_chunks" rows of the output of a batch run.
+   SubMatrix<BaseFloat> BatchOutput(tflite::Interpreter* interpreter,
+                                    int32 batch_size, int32 num_chunks) const;
+   // Runs the interpreter and updates the counters of "shape".
+   void Invoke(const std::vector<int32>& shape,
+               tflite::Interpreter* interpreter);
+   // FeedForward() of a non-empty input that fits the frame buckets (or of
+   // any non-empty input, without buckets).
+   void FeedForwardBucket(const kaldi::MatrixBase<BaseFloat>& features,
+                          Vector<BaseFloat>* inference);
+   // The smallest frame bucket >= num_frames, or num_frames if none.
+   int32 BucketFrames(int32 num_frames) const;
+
+   TFliteNnetComputerOptions opts_;
+   std::vector<int32> frame_buckets_;  // Sorted.
    std::unique_ptr<tflite::FlatBufferModel> model_;
-   std::unique_ptr<tflite::Interpreter> interpreter_;
-   std::unique_ptr<tflite::InterpreterBuilder> builder_;
+   tflite::ops::builtin::BuiltinOpResolver resolver_;
+   // Rank of the model's input: 3 with a batch dimension, 2 without.
+   int32 input_rank_;
+   std::map<std::vector<int32>, ShapeInterpreter> interpreters_;
+   std::map<std::vector<int32>, TFliteShapeStats> shape_stats_;
+   int64 num_uses_;
+   // The batch between BatchInput() and RunBatch(); NULL when none is
+   // open.  Its interpreter is never evicted.
+   tflite::Interpreter* batch_interpreter_;
+   std::vector<int32> batch_shape_;
+   int32 batch_chunks_;
+   // The batch of models without a batch dimension.
+   CopyingBatch copying_batch_;
 };
 
 }  // namespace goat
@@ -1,14 +1,95 @@
 // Copyright (c) 2021 PeachLab. All Rights Reserved.
 // Author : goat.zhou@qq.com (Yang Zhou)
 
+#ifndef NNET_COMPUTER_INTERFACE_H_
+#define NNET_COMPUTER_INTERFACE_H_
+
+#include <string>
+
+#include "base/kaldi-error.h"
+#include "matrix/kaldi-matrix.h"
+
 namespace goat {
 
+using kaldi::BaseFloat;
+using kaldi::int32;
+using kaldi::Matrix;
+using kaldi::SubMatrix;
+using kaldi::Vector;
+using kaldi::kUndefined;
+
+// Not thread-safe: running the network may change the backend's state
+// (e.g. a TFLite interpreter), so the calls are not const; give each thread
+// its own backend.
 class NnetComputerInterface {
  public:
   virtual ~NnetComputerInterface() {}
   virtual void Init(const std::string& model) = 0;
+  // Initializes from a model already in memory (e.g. a ModelBundle
+  // section), which must stay valid while this object is used.  Backends
+  // that cannot run from memory fail.
+  virtual void InitFromBuffer(const char* data, size_t size) {
+    KALDI_ERR << "This network backend can only be loaded from a file.";
+  }
   virtual void FeedForward(const Matrix<BaseFloat>& features,
-	                         Vector<BaseFloat>* inference) const = 0;
+	                         Vector<BaseFloat>* inference) = 0;
+  // Runs "num_chunks" equal-length chunks, stacked in the rows of "features",
+  // as one batch and outputs one row per chunk.  Backends that can take a
+  // batch dimension should override this; the default runs the chunks one
+  // at a time.
+  virtual void FeedForwardBatch(const Matrix<BaseFloat>& features,
+                                int32 num_chunks,
+                                Matrix<BaseFloat>* inferences) {
+    int32 chunk_frames = features.NumRows() / num_chunks;
+    for (int32 i = 0; i < num_chunks; i++) {
+      Matrix<BaseFloat> chunk(features.RowRange(i * chunk_frames,
+                                                chunk_frames));
+      Vector<BaseFloat> inference;
+      FeedForward(chunk, &inference);
+      if (i == 0) inferences->Resize(num_chunks, inference.Dim(), kUndefined);
+      inferences->Row(i).CopyFromVec(inference);
+    }
+  }
+  // Prepares, ahead of the first call, whatever FeedForwardBatch() needs for
+  // chunks of "chunk_frames" frames, up to "max_batch_size" at a time (0
+  // for no limit), so that the first requests are not slower.  Backends
+  // with nothing to prepare need not override this.
+  virtual void Warmup(int32 chunk_frames, int32 feat_dim,
+                      int32 max_batch_size) { }
+  // FeedForwardBatch() without copying the batch in and the outputs out:
+  // the caller fills the rows BatchInput() returns, "num_chunks" chunks of
+  // "chunk_frames" frames, then RunBatch() returns one output row per chunk.
+  // Both views are stride-compact and valid only until the next call on
+  // this object.  Backends that cannot run on their own tensors in place
+  // implement them with a CopyingBatch.
+  virtual SubMatrix<BaseFloat> BatchInput(int32 num_chunks,
+                                          int32 chunk_frames,
+                                          int32 feat_dim) = 0;
+  virtual SubMatrix<BaseFloat> RunBatch() = 0;
+};
+
+// BatchInput() and RunBatch() through FeedForwardBatch(), with buffers of
+// its own.
+class CopyingBatch {
+ public:
+  SubMatrix<BaseFloat> Input(int32 num_chunks, int32 chunk_frames,
+                             int32 feat_dim) {
+    num_chunks_ = num_chunks;
+    input_.Resize(num_chunks * chunk_frames, feat_dim, kUndefined,
+                  kaldi::kStrideEqualNumCols);
+    return input_.RowRange(0, input_.NumRows());
+  }
+  SubMatrix<BaseFloat> Run(NnetComputerInterface* computer) {
+    computer->FeedForwardBatch(input_, num_chunks_, &output_);
+    return output_.RowRange(0, output_.NumRows());
+  }
+
+ private:
+  int32 num_chunks_ = 0;
+  Matrix<BaseFloat> input_;
+  Matrix<BaseFloat> output_;
 };
 
 };
+
+#endif  // NNET_COMPUTER_INTERFACE_H_
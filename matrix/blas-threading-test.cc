@@ -0,0 +1,115 @@
+// matrix/blas-threading-test.cc
+
+// Copyright (c) 2021 PeachLab. All Rights Reserved.
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "matrix/matrix-lib.h"
+#include "matrix/blas-threading.h"
+#include "util/kaldi-thread.h"
+
+namespace kaldi {
+
+void UnitTestBlasThreadsPolicy() {
+  SetBlasDefaultNumThreads(4);
+  KALDI_ASSERT(GetBlasNumThreads() == 0);
+  KALDI_ASSERT(BlasNumThreadsForCall() == 4);
+  {
+    BlasThreadsScope scope(2);
+    KALDI_ASSERT(BlasNumThreadsForCall() == 2);
+    {
+      BlasThreadsScope inner(1);
+      KALDI_ASSERT(BlasNumThreadsForCall() == 1);
+    }
+    KALDI_ASSERT(BlasNumThreadsForCall() == 2);
+  }
+  KALDI_ASSERT(GetBlasNumThreads() == 0);
+  {
+    BlasWorkerScope worker;
+    KALDI_ASSERT(InBlasWorkerThread());
+    KALDI_ASSERT(BlasNumThreadsForCall() == 1);
+    // An explicit setting overrides the automatic policy.
+    BlasThreadsScope scope(3);
+    KALDI_ASSERT(BlasNumThreadsForCall() == 3);
+  }
+  KALDI_ASSERT(!InBlasWorkerThread());
+  KALDI_ASSERT(BlasNumThreadsForCall() == 4);
+}
+
+void UnitTestBlasCallStats() {
+  SetBlasDefaultNumThreads(4);
+  Matrix<BaseFloat> A(20, 30), B(30, 10), C(20, 10);
+  A.SetRandn();
+  B.SetRandn();
+  ResetBlasCallStats();
+  C.AddMatMat(1.0, A, kNoTrans, B, kNoTrans, 0.0);
+  BlasCallStats stats = GetBlasCallStats();
+  KALDI_ASSERT(stats.num_calls == 1 && stats.num_multithreaded_calls == 1);
+  {
+    BlasThreadsScope scope(1);
+    C.AddMatMat(1.0, A, kNoTrans, B, kNoTrans, 0.0);
+  }
+  stats = GetBlasCallStats();
+  KALDI_ASSERT(stats.num_calls == 2 && stats.num_multithreaded_calls == 1);
+  ResetBlasCallStats();
+  stats = GetBlasCallStats();
+  KALDI_ASSERT(stats.num_calls == 0 && stats.num_multithreaded_calls == 0);
+}
+
+class BlasWorkerTask: public MultiThreadable {
+ public:
+  BlasWorkerTask(const Matrix<BaseFloat> *A, std::vector<int32> *num_threads):
+      A_(A), num_threads_seen_(num_threads) { }
+  void operator() () {
+    Matrix<BaseFloat> C(A_->NumRows(), A_->NumRows());
+    C.AddMatMat(1.0, *A_, kNoTrans, *A_, kTrans, 0.0);
+    (*num_threads_seen_)[thread_id_] = BlasNumThreadsForCall();
+  }
+ private:
+  const Matrix<BaseFloat> *A_;
+  std::vector<int32> *num_threads_seen_;
+};
+
+void UnitTestBlasWorkerThreads() {
+  SetBlasDefaultNumThreads(4);
+  Matrix<BaseFloat> A(50, 40);
+  A.SetRandn();
+  int32 num_threads = 3;
+  std::vector<int32> num_threads_seen(num_threads, 0);
+  ResetBlasCallStats();
+  {
+    BlasWorkerTask task(&A, &num_threads_seen);
+    MultiThreader<BlasWorkerTask> m(num_threads, task);
+  }
+  for (int32 i = 0; i < num_threads; i++)
+    KALDI_ASSERT(num_threads_seen[i] == 1);
+  BlasCallStats stats = GetBlasCallStats();
+  KALDI_ASSERT(stats.num_calls == num_threads &&
+               stats.num_multithreaded_calls == 0);
+  // Back at top level once the workers are done.
+  KALDI_ASSERT(BlasNumThreadsForCall() == 4);
+}
+
+}  // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  UnitTestBlasThreadsPolicy();
+  UnitTestBlasCallStats();
+  UnitTestBlasWorkerThreads();
+  KALDI_LOG << "Tests succeeded.";
+  return 0;
+}
@@ -0,0 +1,207 @@
+// matrix/blas-threading.cc
+
+// Copyright (c) 2021 PeachLab. All Rights Reserved.
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <set>
+
+#include "matrix/blas-threading.h"
+#include "matrix/kaldi-blas.h"
+
+namespace kaldi {
+
+namespace {
+
+// Per-thread state.
+thread_local int32 tls_num_threads = 0;  // 0 means automatic.
+thread_local int32 tls_worker_depth = 0;
+#if defined(HAVE_MKL)
+// The thread count most recently passed to a per-thread library (MKL).
+thread_local int32 tls_applied_num_threads = 0;
+#endif
+
+// Number of BlasWorkerScope objects alive in the process.
+std::atomic<int32> g_num_active_workers(0);
+
+// Top-level thread count for the automatic policy; 0 until first use.
+std::atomic<int32> g_default_num_threads(0);
+
+// The thread count most recently passed to the BLAS library (process-wide
+// libraries only), so we only call into it when the count changes.
+std::atomic<int32> g_applied_num_threads(0);
+std::mutex g_apply_mutex;
+
+// Call counters.  Each thread counts into its own ThreadCallCounts, so that
+// concurrent calls do not contend for one cache line; GetBlasCallStats() sums
+// them.  Counts of exited threads go to g_exited_counts, and
+// ResetBlasCallStats() records the sum it should subtract in g_reset_counts.
+struct CallCounts {
+  std::atomic<int64> num_calls;
+  std::atomic<int64> num_multithreaded_calls;
+  CallCounts(): num_calls(0), num_multithreaded_calls(0) { }
+};
+
+std::mutex g_counts_mutex;
+std::set<const CallCounts*> g_thread_counts;
+BlasCallStats g_exited_counts;
+BlasCallStats g_reset_counts;
+
+// Sum of the counts of all threads, past and present.  Requires
+// g_counts_mutex.
+BlasCallStats SumCallCounts() {
+  BlasCallStats stats = g_exited_counts;
+  for (auto iter = g_thread_counts.begin(); iter != g_thread_counts.end();
+       ++iter) {
+    stats.num_calls += (*iter)->num_calls.load(std::memory_order_relaxed);
+    stats.num_multithreaded_calls +=
+        (*iter)->num_multithreaded_calls.load(std::memory_order_relaxed);
+  }
+  return stats;
+}
+
+class ThreadCallCounts {
+ public:
+  ThreadCallCounts() {
+    std::lock_guard<std::mutex> lock(g_counts_mutex);
+    g_thread_counts.insert(&counts_);
+  }
+  ~ThreadCallCounts() {
+    std::lock_guard<std::mutex> lock(g_counts_mutex);
+    g_exited_counts.num_calls +=
+        counts_.num_calls.load(std::memory_order_relaxed);
+    g_exited_counts.num_multithreaded_calls +=
+        counts_.num_multithreaded_calls.load(std::memory_order_relaxed);
+    g_thread_counts.erase(&counts_);
+  }
+  // Only the owning thread writes, so a plain load and store is enough.
+  void Count(bool multithreaded) {
+    Increment(&counts_.num_calls);
+    if (multithreaded) Increment(&counts_.num_multithreaded_calls);
+  }
+ private:
+  static void Increment(std::atomic<int64> *counter) {
+    counter->store(counter->load(std::memory_order_relaxed) + 1,
+                   std::memory_order_relaxed);
+  }
+  CallCounts counts_;
+};
+
+thread_local ThreadCallCounts tls_call_counts;
+
+int32 LibraryNumThreads() {
+#if defined(HAVE_OPENBLAS)
+  return openblas_get_num_threads();
+#elif defined(HAVE_MKL)
+  return mkl_get_max_threads();
+#else
+  return 1;
+#endif
+}
+
+void ApplyNumThreads(int32 num_threads) {
+#if defined(HAVE_OPENBLAS)
+  if (g_applied_num_threads.load(std::memory_order_relaxed) == num_threads)
+    return;
+  std::lock_guard<std::mutex> lock(g_apply_mutex);
+  if (g_applied_num_threads.load(std::memory_order_relaxed) != num_threads) {
+    openblas_set_num_threads(num_threads);
+    g_applied_num_threads.store(num_threads, std::memory_order_relaxed);
+  }
+#elif defined(HAVE_MKL)
+  if (tls_applied_num_threads != num_threads) {
+    mkl_set_num_threads_local(num_threads);
+    tls_applied_num_threads = num_threads;
+  }
+#endif
+}
+
+}  // namespace
+
+
+void SetBlasNumThreads(int32 num_threads) {
+  KALDI_ASSERT(num_threads >= 0);
+  tls_num_threads = num_threads;
+}
+
+int32 GetBlasNumThreads() {
+  return tls_num_threads;
+}
+
+void SetBlasDefaultNumThreads(int32 num_threads) {
+  KALDI_ASSERT(num_threads > 0);
+  g_default_num_threads.store(num_threads, std::memory_order_relaxed);
+}
+
+int32 BlasDefaultNumThreads() {
+  int32 num_threads = g_default_num_threads.load(std::memory_order_relaxed);
+  if (num_threads == 0) {
+    int32 library_threads = std::max<int32>(1, LibraryNumThreads());
+    // Another thread may have set it meanwhile; keep whichever came first.
+    if (g_default_num_threads.compare_exchange_strong(num_threads,
+                                                      library_threads)) {
+      num_threads = library_threads;
+      g_applied_num_threads.store(library_threads);
+    }
+  }
+  return num_threads;
+}
+
+int32 BlasNumThreadsForCall() {
+  if (tls_num_threads != 0) return tls_num_threads;
+  if (tls_worker_depth > 0 ||
+      g_num_active_workers.load(std::memory_order_relaxed) > 0)
+    return 1;
+  return BlasDefaultNumThreads();
+}
+
+void PrepareBlasCall() {
+  int32 num_threads = BlasNumThreadsForCall();
+  ApplyNumThreads(num_threads);
+  tls_call_counts.Count(num_threads > 1);
+}
+
+BlasWorkerScope::BlasWorkerScope() {
+  tls_worker_depth++;
+  g_num_active_workers.fetch_add(1, std::memory_order_relaxed);
+}
+
+BlasWorkerScope::~BlasWorkerScope() {
+  g_num_active_workers.fetch_sub(1, std::memory_order_relaxed);
+  tls_worker_depth--;
+}
+
+bool InBlasWorkerThread() {
+  return tls_worker_depth > 0;
+}
+
+BlasCallStats GetBlasCallStats() {
+  std::lock_guard<std::mutex> lock(g_counts_mutex);
+  BlasCallStats stats = SumCallCounts();
+  stats.num_calls -= g_reset_counts.num_calls;
+  stats.num_multithreaded_calls -= g_reset_counts.num_multithreaded_calls;
+  return stats;
+}
+
+void ResetBlasCallStats() {
+  std::lock_guard<std::mutex> lock(g_counts_mutex);
+  g_reset_counts = SumCallCounts();
+}
+
+}  // namespace kaldi
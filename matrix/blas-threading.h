@@ -0,0 +1,119 @@
+// matrix/blas-threading.h
+
+// Copyright (c) 2021 PeachLab. All Rights Reserved.
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_MATRIX_BLAS_THREADING_H_
+#define KALDI_MATRIX_BLAS_THREADING_H_ 1
+
+#include "base/kaldi-common.h"
+
+namespace kaldi {
+
+/// \addtogroup matrix_group
+/// @{
+
+// This header controls how many threads the BLAS library may use for the
+// level-2 and level-3 calls made through matrix/cblas-wrappers.h (gemm, gemv,
+// symm, syrk).  The point is to avoid oversubscribing the machine when our own
+// worker threads (e.g. MultiThreader in util/kaldi-thread.h) each call into a
+// multi-threaded BLAS.
+//
+// Each thread has a BLAS thread count, which is either an explicit number set
+// by SetBlasNumThreads() / BlasThreadsScope, or 0 meaning "automatic".  The
+// automatic policy is:
+//   - inside a worker thread (one that holds a BlasWorkerScope), use 1 thread;
+//   - at top level, use BlasDefaultNumThreads(), except while any worker
+//     scope is active anywhere in the process, in which case use 1.
+// The second exception exists because OpenBLAS only has a process-wide thread
+// count, so a top-level call cannot raise it without also affecting the
+// workers running at the same time.  With MKL the count is per-thread
+// (mkl_set_num_threads_local) and the exception is harmless.  With other BLAS
+// libraries the thread count is not controlled, only counted.
+
+/// Sets the BLAS thread count for calls made from the calling thread;
+/// 0 selects the automatic policy (the default).
+void SetBlasNumThreads(int32 num_threads);
+
+/// Returns the value set by SetBlasNumThreads() for the calling thread
+/// (0 if automatic).
+int32 GetBlasNumThreads();
+
+/// Sets the number of threads used by top-level calls under the automatic
+/// policy.  The default is whatever the BLAS library reported at first use
+/// (for OpenBLAS this honours OPENBLAS_NUM_THREADS).
+void SetBlasDefaultNumThreads(int32 num_threads);
+
+int32 BlasDefaultNumThreads();
+
+/// Returns the number of threads a BLAS call made now from the calling thread
+/// would be allowed to use.
+int32 BlasNumThreadsForCall();
+
+/// Applies BlasNumThreadsForCall() to the BLAS library and updates the call
+/// counters.  Called by the wrappers in cblas-wrappers.h before each call
+/// they dispatch; you should not normally need to call it yourself.
+void PrepareBlasCall();
+
+/// Sets the calling thread's BLAS thread count for the lifetime of the
+/// object, restoring the previous value on destruction.
+class BlasThreadsScope {
+ public:
+  explicit BlasThreadsScope(int32 num_threads):
+      saved_num_threads_(GetBlasNumThreads()) {
+    SetBlasNumThreads(num_threads);
+  }
+  ~BlasThreadsScope() { SetBlasNumThreads(saved_num_threads_); }
+ private:
+  int32 saved_num_threads_;
+  KALDI_DISALLOW_COPY_AND_ASSIGN(BlasThreadsScope);
+};
+
+/// Marks the calling thread as a worker thread for the lifetime of the
+/// object, so the automatic policy gives it single-threaded BLAS.  Scopes
+/// may be nested.  MultiThreader creates one in each of its threads.
+class BlasWorkerScope {
+ public:
+  BlasWorkerScope();
+  ~BlasWorkerScope();
+ private:
+  KALDI_DISALLOW_COPY_AND_ASSIGN(BlasWorkerScope);
+};
+
+/// Returns true if the calling thread is inside a BlasWorkerScope.
+bool InBlasWorkerThread();
+
+struct BlasCallStats {
+  /// Number of BLAS calls dispatched through PrepareBlasCall().
+  int64 num_calls;
+  /// Number of those calls that were allowed more than one thread.  (The
+  /// BLAS library may still choose to run a small call single-threaded.)
+  int64 num_multithreaded_calls;
+  BlasCallStats(): num_calls(0), num_multithreaded_calls(0) { }
+};
+
+/// Returns the call counters of all threads, summed, since the last
+/// ResetBlasCallStats().
+BlasCallStats GetBlasCallStats();
+
+void ResetBlasCallStats();
+
+/// @} end of \addtogroup matrix_group
+
+}  // namespace kaldi
+
+#endif  // KALDI_MATRIX_BLAS_THREADING_H_
@@ -27,6 +27,7 @@
 #include "matrix/kaldi-matrix.h"
 #include "matrix/matrix-functions.h"
 #include "matrix/kaldi-blas.h"
+#include "matrix/blas-threading.h"
 
 // Do not include this file directly.  It is to be included
 // by .cc files in this directory.
@@ -163,6 +164,7 @@ inline void cblas_Xgemv(MatrixTransposeType trans, MatrixIndexT num_rows,
                         MatrixIndexT num_cols, float alpha, const float *Mdata,
                         MatrixIndexT stride, const float *xdata,
                         MatrixIndexT incX, float beta, float *ydata, MatrixIndexT incY) {
+  PrepareBlasCall();
   cblas_sgemv(CblasRowMajor, static_cast<CBLAS_TRANSPOSE>(trans), num_rows,
               num_cols, alpha, Mdata, stride, xdata, incX, beta, ydata, incY);
 }
@@ -170,6 +172,7 @@ inline void cblas_Xgemv(MatrixTransposeType trans, MatrixIndexT num_rows,
                         MatrixIndexT num_cols, double alpha, const double *Mdata,
                         MatrixIndexT stride, const double *xdata,
                         MatrixIndexT incX, double beta, double *ydata, MatrixIndexT incY) {
+  PrepareBlasCall();
   cblas_dgemv(CblasRowMajor, static_cast<CBLAS_TRANSPOSE>(trans), num_rows,
               num_cols, alpha, Mdata, stride, xdata, incX, beta, ydata, incY);
 }
@@ -230,6 +233,7 @@ inline void cblas_Xgemm(const float alpha,
                         const float beta,
                         float *Mdata, 
                         MatrixIndexT num_rows, MatrixIndexT num_cols,MatrixIndexT stride) {
+  PrepareBlasCall();
   cblas_sgemm(CblasRowMajor, static_cast<CBLAS_TRANSPOSE>(transA), 
               static_cast<CBLAS_TRANSPOSE>(transB),
               num_rows, num_cols, transA == kNoTrans ? a_num_cols : a_num_rows,
@@ -245,6 +249,7 @@ inline void cblas_Xgemm(const double alpha,
                         const double beta,
                         double *Mdata, 
                         MatrixIndexT num_rows, MatrixIndexT num_cols,MatrixIndexT stride) {
+  PrepareBlasCall();
   cblas_dgemm(CblasRowMajor, static_cast<CBLAS_TRANSPOSE>(transA), 
               static_cast<CBLAS_TRANSPOSE>(transB),
               num_rows, num_cols, transA == kNoTrans ? a_num_cols : a_num_rows,
@@ -259,6 +264,7 @@ inline void cblas_Xsymm(const float alpha,
                         const float *Bdata,MatrixIndexT b_stride,
                         const float beta,
                         float *Mdata, MatrixIndexT stride) {
+  PrepareBlasCall();
   cblas_ssymm(CblasRowMajor, CblasLeft, CblasLower, sz, sz, alpha, Adata,
               a_stride, Bdata, b_stride, beta, Mdata, stride);
 }
@@ -268,6 +274,7 @@ inline void cblas_Xsymm(const double alpha,
                         const double *Bdata,MatrixIndexT b_stride,
                         const double beta,
                         double *Mdata, MatrixIndexT stride) {
+  PrepareBlasCall();
   cblas_dsymm(CblasRowMajor, CblasLeft, CblasLower, sz, sz, alpha, Adata,
               a_stride, Bdata, b_stride, beta, Mdata, stride);
 }
@@ -297,6 +304,7 @@ inline void cblas_Xsyrk (
     const MatrixIndexT other_dim_a, const float alpha, const float *A,
     const MatrixIndexT a_stride, const float beta, float *C,
     const MatrixIndexT c_stride) {
+  PrepareBlasCall();
   cblas_ssyrk(CblasRowMajor, CblasLower, static_cast<CBLAS_TRANSPOSE>(trans),
               dim_c, other_dim_a, alpha, A, a_stride, beta, C, c_stride);
 }
@@ -306,6 +314,7 @@ inline void cblas_Xsyrk(
     const MatrixIndexT other_dim_a, const double alpha, const double *A,
     const MatrixIndexT a_stride, const double beta, double *C,
     const MatrixIndexT c_stride) {
+  PrepareBlasCall();
   cblas_dsyrk(CblasRowMajor, CblasLower, static_cast<CBLAS_TRANSPOSE>(trans),
               dim_c, other_dim_a, alpha, A, a_stride, beta, C, c_stride);
 }
@@ -450,6 +459,33 @@ void inline clapack_Xsptrf(KaldiBlasInt *num_rows, double *Mdata,
                            KaldiBlasInt *ipiv, KaldiBlasInt *result) {
   dsptrf_(const_cast<char *>("U"), num_rows, Mdata, ipiv, result);
 }
+//
+inline void clapack_Xsyevr(char *jobz, char *range, char *uplo,
+                           KaldiBlasInt *num_rows, float *Mdata,
+                           KaldiBlasInt *stride, float *vl, float *vu,
+                           KaldiBlasInt *il, KaldiBlasInt *iu, float *abstol,
+                           KaldiBlasInt *num_found, float *w, float *Zdata,
+                           KaldiBlasInt *zstride, KaldiBlasInt *isuppz,
+                           float *p_work, KaldiBlasInt *l_work,
+                           KaldiBlasInt *p_iwork, KaldiBlasInt *l_iwork,
+                           KaldiBlasInt *result) {
+  ssyevr_(jobz, range, uplo, num_rows, Mdata, stride, vl, vu, il, iu, abstol,
+          num_found, w, Zdata, zstride, isuppz, p_work, l_work,
+          p_iwork, l_iwork, result);
+}
+inline void clapack_Xsyevr(char *jobz, char *range, char *uplo,
+                           KaldiBlasInt *num_rows, double *Mdata,
+                           KaldiBlasInt *stride, double *vl, double *vu,
+                           KaldiBlasInt *il, KaldiBlasInt *iu, double *abstol,
+                           KaldiBlasInt *num_found, double *w, double *Zdata,
+                           KaldiBlasInt *zstride, KaldiBlasInt *isuppz,
+                           double *p_work, KaldiBlasInt *l_work,
+                           KaldiBlasInt *p_iwork, KaldiBlasInt *l_iwork,
+                           KaldiBlasInt *result) {
+  dsyevr_(jobz, range, uplo, num_rows, Mdata, stride, vl, vu, il, iu, abstol,
+          num_found, w, Zdata, zstride, isuppz, p_work, l_work,
+          p_iwork, l_iwork, result);
+}
 #else
 inline void clapack_Xgetrf(MatrixIndexT num_rows, MatrixIndexT num_cols,
                            float *Mdata, MatrixIndexT stride, 
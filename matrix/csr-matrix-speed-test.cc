@@ -0,0 +1,145 @@
+// matrix/csr-matrix-speed-test.cc
+
+// Copyright (c) 2021 PeachLab. All Rights Reserved.
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "matrix/matrix-lib.h"
+#include "matrix/csr-matrix.h"
+#include "base/timer.h"
+
+namespace kaldi {
+
+template<typename Real> static void CsvResult(std::string test, int dim,
+                                              BaseFloat measure,
+                                              std::string units) {
+  std::cout << test << "," << (sizeof(Real) == 8 ? "double" : "float")
+            << "," << dim << "," << measure << "," << units << "\n";
+}
+
+// Compares y = A x with A stored as a SparseMatrix (one SparseVector per row,
+// via VecSvec) against the CSR kernel, single- and multi-threaded.
+template<typename Real>
+static void UnitTestSpMVSpeed() {
+  std::vector<MatrixIndexT> sizes;
+  sizes.push_back(1024);
+  sizes.push_back(4096);
+  sizes.push_back(8192);
+  BaseFloat zero_prob = 0.95, time_in_secs = 0.1;
+  for (size_t i = 0; i < sizes.size(); i++) {
+    MatrixIndexT size = sizes[i];
+    SparseMatrix<Real> smat(size, size);
+    smat.SetRandn(zero_prob);
+    CsrMatrix<Real> csr(smat);
+    Vector<Real> x(size), y(size);
+    x.SetRandn();
+    BaseFloat nnz = smat.NumElements();
+    {
+      int32 iter = 0;
+      Timer t;
+      for (; t.Elapsed() < time_in_secs; iter++)
+        for (MatrixIndexT r = 0; r < size; r++)
+          y(r) = VecSvec(x, smat.Row(r));
+      CsvResult<Real>("SpMV SparseMatrix", size,
+                      (2.0 * nnz * iter) / (t.Elapsed() * 1.0e+09),
+                      "gigaflops");
+    }
+    for (int32 num_threads = 1; num_threads <= 4; num_threads *= 2) {
+      int32 iter = 0;
+      Timer t;
+      for (; t.Elapsed() < time_in_secs; iter++)
+        AddCsrVec<Real>(1.0, csr, kNoTrans, x, 0.0, &y, num_threads);
+      std::ostringstream name;
+      name << "SpMV CsrMatrix threads=" << num_threads;
+      CsvResult<Real>(name.str(), size,
+                      (2.0 * nnz * iter) / (t.Elapsed() * 1.0e+09),
+                      "gigaflops");
+    }
+  }
+}
+
+// Compares C = A B with A stored as a SparseMatrix (MatrixBase::AddSmatMat)
+// against the CSR kernel, for a dense block B of 'block' columns.
+template<typename Real>
+static void UnitTestSpMMSpeed() {
+  std::vector<MatrixIndexT> sizes;
+  sizes.push_back(1024);
+  sizes.push_back(4096);
+  MatrixIndexT block = 64;
+  BaseFloat zero_prob = 0.95, time_in_secs = 0.1;
+  for (size_t i = 0; i < sizes.size(); i++) {
+    MatrixIndexT size = sizes[i];
+    SparseMatrix<Real> smat(size, size);
+    smat.SetRandn(zero_prob);
+    CsrMatrix<Real> csr(smat);
+    Matrix<Real> B(size, block), C(size, block);
+    B.SetRandn();
+    BaseFloat flops = 2.0 * smat.NumElements() * block;
+    {
+      int32 iter = 0;
+      Timer t;
+      for (; t.Elapsed() < time_in_secs; iter++)
+        C.AddSmatMat(1.0, smat, kNoTrans, B, 0.0);
+      CsvResult<Real>("SpMM SparseMatrix", size,
+                      (flops * iter) / (t.Elapsed() * 1.0e+09), "gigaflops");
+    }
+    for (int32 num_threads = 1; num_threads <= 4; num_threads *= 2) {
+      int32 iter = 0;
+      Timer t;
+      for (; t.Elapsed() < time_in_secs; iter++)
+        AddCsrMat<Real>(1.0, csr, B, kNoTrans, 0.0, &C, num_threads);
+      std::ostringstream name;
+      name << "SpMM CsrMatrix threads=" << num_threads;
+      CsvResult<Real>(name.str(), size,
+                      (flops * iter) / (t.Elapsed() * 1.0e+09), "gigaflops");
+    }
+  }
+}
+
+template<typename Real>
+static void UnitTestCsrConversionSpeed() {
+  MatrixIndexT size = 4096;
+  SparseMatrix<Real> smat(size, size);
+  smat.SetRandn(0.95);
+  Timer t;
+  CsrMatrix<Real> csr(smat);
+  CsvResult<Real>("SparseMatrix to CsrMatrix", size, t.Elapsed(), "seconds");
+  Timer t1;
+  CsrMatrix<Real> csc(smat, kTrans);
+  CsvResult<Real>("SparseMatrix to CscMatrix", size, t1.Elapsed(), "seconds");
+  Timer t2;
+  SparseMatrix<Real> smat2;
+  csr.CopyToSmat(&smat2);
+  CsvResult<Real>("CsrMatrix to SparseMatrix", size, t2.Elapsed(), "seconds");
+}
+
+template<typename Real> static void CsrMatrixUnitSpeedTest() {
+  UnitTestSpMVSpeed<Real>();
+  UnitTestSpMMSpeed<Real>();
+  UnitTestCsrConversionSpeed<Real>();
+}
+
+}  // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  Timer t;
+  KALDI_LOG << "Starting, Single precision";
+  kaldi::CsrMatrixUnitSpeedTest<float>();
+  KALDI_LOG << "Starting, Double precision";
+  kaldi::CsrMatrixUnitSpeedTest<double>();
+  KALDI_LOG << "Tests succeeded, total duration " << t.Elapsed() << " seconds.";
+}
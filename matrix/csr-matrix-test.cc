@@ -0,0 +1,173 @@
+// matrix/csr-matrix-test.cc
+
+// Copyright (c) 2021 PeachLab. All Rights Reserved.
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <limits>
+
+#include "matrix/matrix-lib.h"
+#include "matrix/csr-matrix.h"
+
+namespace kaldi {
+
+template <typename Real>
+void UnitTestCsrMatrixConversion() {
+  for (int32 i = 0; i < 10; i++) {
+    MatrixIndexT row = RandInt(1, 40), col = RandInt(1, 50);
+
+    SparseMatrix<Real> smat(row, col);
+    smat.SetRandn(0.8);
+    Matrix<Real> mat(row, col);
+    smat.CopyToMat(&mat);
+
+    // SparseMatrix -> CsrMatrix -> SparseMatrix must be lossless.
+    CsrMatrix<Real> csr(smat);
+    KALDI_ASSERT(csr.NumElements() == smat.NumElements());
+    SparseMatrix<Real> smat2;
+    csr.CopyToSmat(&smat2);
+    Matrix<Real> mat2(row, col);
+    mat2.SetRandn();
+    smat2.CopyToMat(&mat2);
+    AssertEqual(mat, mat2, 0.0);
+
+    // The CSC form (CSR of the transpose) must agree with the full matrix.
+    CsrMatrix<Real> csc(smat, kTrans);
+    Matrix<Real> mat_trans(col, row);
+    csc.CopyToMat(&mat_trans);
+    Matrix<Real> mat3(row, col);
+    mat3.CopyFromMat(mat_trans, kTrans);
+    AssertEqual(mat, mat3, 0.0);
+
+    CsrMatrix<Real> csr2(mat);
+    KALDI_ASSERT(csr2.NumElements() == csr.NumElements());
+    Matrix<Real> mat4(row, col);
+    csr2.CopyToMat(&mat4);
+    AssertEqual(mat, mat4, 0.0);
+  }
+}
+
+template <typename Real>
+void UnitTestCsrMatrixAddToMat() {
+  for (int32 i = 0; i < 10; i++) {
+    MatrixIndexT row = 10 + Rand() % 40;
+    MatrixIndexT col = 10 + Rand() % 50;
+
+    SparseMatrix<Real> smat(row, col);
+    smat.SetRandn(0.8);
+    CsrMatrix<Real> csr(smat);
+
+    Matrix<Real> other_mat1(col, row);
+    other_mat1.SetRandn();
+    Matrix<Real> other_mat2 = other_mat1;
+
+    csr.AddToMat(0.7, &other_mat1, kTrans);
+    smat.AddToMat(0.7, &other_mat2, kTrans);
+    AssertEqual(other_mat1, other_mat2, 0.00001);
+  }
+}
+
+template <typename Real>
+void UnitTestAddCsrVec() {
+  for (int32 i = 0; i < 10; i++) {
+    MatrixIndexT row = 10 + Rand() % 100;
+    MatrixIndexT col = 10 + Rand() % 100;
+    MatrixTransposeType trans = (RandInt(0, 1) == 0 ? kTrans : kNoTrans);
+    int32 num_threads = RandInt(1, 4);
+
+    SparseMatrix<Real> smat(row, col);
+    smat.SetRandn(0.7);
+    Matrix<Real> mat(row, col);
+    smat.CopyToMat(&mat);
+    CsrMatrix<Real> csr(smat);
+
+    Vector<Real> x(trans == kNoTrans ? col : row),
+        y1(trans == kNoTrans ? row : col);
+    x.SetRandn();
+    y1.SetRandn();
+    Vector<Real> y2(y1);
+    Real alpha = 0.333, beta = (i % 2 == 0 ? 0.0 : 1.764);
+    // beta == 0 must overwrite y, NaN included.
+    if (beta == 0.0) y1(0) = std::numeric_limits<Real>::quiet_NaN();
+
+    AddCsrVec(alpha, csr, trans, x, beta, &y1, num_threads);
+    y2.AddMatVec(alpha, mat, trans, x, beta);
+    AssertEqual(y1, y2, 0.0001);
+  }
+}
+
+template <typename Real>
+void UnitTestAddCsrMat() {
+  for (int32 i = 0; i < 10; i++) {
+    MatrixIndexT m = RandInt(10, 60), n = RandInt(10, 60), o = RandInt(1, 30);
+    MatrixTransposeType Btrans = (RandInt(0, 1) == 0 ? kTrans : kNoTrans);
+    int32 num_threads = RandInt(1, 4);
+
+    SparseMatrix<Real> smat(m, n);
+    smat.SetRandn(0.7);
+    Matrix<Real> A(m, n);
+    smat.CopyToMat(&A);
+    CsrMatrix<Real> csr(smat);
+
+    Matrix<Real> B(Btrans == kNoTrans ? n : o, Btrans == kNoTrans ? o : n);
+    B.SetRandn();
+    Matrix<Real> C1(m, o);
+    C1.SetRandn();
+    Matrix<Real> C2(C1);
+    Real alpha = 0.333, beta = (i % 3 == 0 ? 0.0 : 1.764);
+
+    AddCsrMat(alpha, csr, B, Btrans, beta, &C1, num_threads);
+    C2.AddMatMat(alpha, A, kNoTrans, B, Btrans, beta);
+    AssertEqual(C1, C2, 0.0001);
+  }
+}
+
+template <typename Real>
+void UnitTestCsrMatrixPartitionRows() {
+  for (int32 i = 0; i < 10; i++) {
+    MatrixIndexT row = RandInt(1, 50), col = RandInt(1, 50);
+    int32 num_parts = RandInt(1, 8);
+    SparseMatrix<Real> smat(row, col);
+    smat.SetRandn(0.9);
+    CsrMatrix<Real> csr(smat);
+    std::vector<MatrixIndexT> boundaries;
+    csr.PartitionRows(num_parts, &boundaries);
+    KALDI_ASSERT(boundaries.size() >= 2 &&
+                 boundaries.size() <= static_cast<size_t>(num_parts + 1));
+    KALDI_ASSERT(boundaries.front() == 0 && boundaries.back() == row);
+    for (size_t p = 0; p + 1 < boundaries.size(); p++)
+      KALDI_ASSERT(boundaries[p] <= boundaries[p + 1]);
+  }
+}
+
+template <typename Real>
+void CsrMatrixUnitTest() {
+  UnitTestCsrMatrixConversion<Real>();
+  UnitTestCsrMatrixAddToMat<Real>();
+  UnitTestAddCsrVec<Real>();
+  UnitTestAddCsrMat<Real>();
+  UnitTestCsrMatrixPartitionRows<Real>();
+}
+
+}  // namespace kaldi
+
+int main() {
+  kaldi::SetVerboseLevel(5);
+  kaldi::CsrMatrixUnitTest<float>();
+  kaldi::CsrMatrixUnitTest<double>();
+  KALDI_LOG << "Tests succeeded.";
+  return 0;
+}
@@ -0,0 +1,347 @@
+// matrix/csr-matrix.cc
+
+// Copyright (c) 2021 PeachLab. All Rights Reserved.
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+#include "matrix/csr-matrix.h"
+#include "matrix/blas-threading.h"
+#include "matrix/cblas-wrappers.h"
+
+namespace kaldi {
+
+template <typename Real>
+void CsrMatrix<Real>::CopyFromSmat(const SparseMatrix<Real> &smat,
+                                   MatrixTransposeType trans) {
+  MatrixIndexT smat_rows = smat.NumRows(), smat_cols = smat.NumCols(),
+      num_elements = smat.NumElements();
+  col_indexes_.resize(num_elements);
+  values_.resize(num_elements);
+  if (trans == kNoTrans) {
+    num_rows_ = smat_rows;
+    num_cols_ = smat_cols;
+    row_offsets_.resize(num_rows_ + 1);
+    MatrixIndexT offset = 0;
+    for (MatrixIndexT r = 0; r < smat_rows; r++) {
+      row_offsets_[r] = offset;
+      const SparseVector<Real> &row = smat.Row(r);
+      const std::pair<MatrixIndexT, Real> *sdata = row.Data();
+      MatrixIndexT n = row.NumElements();
+      for (MatrixIndexT e = 0; e < n; e++, offset++) {
+        col_indexes_[offset] = sdata[e].first;
+        values_[offset] = sdata[e].second;
+      }
+    }
+    row_offsets_[num_rows_] = offset;
+  } else {
+    // Counting sort by column: first count the elements of each column, then
+    // scatter.  Rows of smat are visited in order so the column indexes of
+    // *this come out sorted.
+    num_rows_ = smat_cols;
+    num_cols_ = smat_rows;
+    row_offsets_.assign(num_rows_ + 1, 0);
+    for (MatrixIndexT r = 0; r < smat_rows; r++) {
+      const SparseVector<Real> &row = smat.Row(r);
+      const std::pair<MatrixIndexT, Real> *sdata = row.Data();
+      MatrixIndexT n = row.NumElements();
+      for (MatrixIndexT e = 0; e < n; e++)
+        row_offsets_[sdata[e].first + 1]++;
+    }
+    for (MatrixIndexT c = 0; c < num_rows_; c++)
+      row_offsets_[c + 1] += row_offsets_[c];
+    std::vector<MatrixIndexT> next(row_offsets_.begin(),
+                                   row_offsets_.end() - 1);
+    for (MatrixIndexT r = 0; r < smat_rows; r++) {
+      const SparseVector<Real> &row = smat.Row(r);
+      const std::pair<MatrixIndexT, Real> *sdata = row.Data();
+      MatrixIndexT n = row.NumElements();
+      for (MatrixIndexT e = 0; e < n; e++) {
+        MatrixIndexT pos = next[sdata[e].first]++;
+        col_indexes_[pos] = r;
+        values_[pos] = sdata[e].second;
+      }
+    }
+  }
+}
+
+template <typename Real>
+void CsrMatrix<Real>::CopyFromMat(const MatrixBase<Real> &mat,
+                                  MatrixTransposeType trans) {
+  if (trans == kNoTrans) {
+    num_rows_ = mat.NumRows();
+    num_cols_ = mat.NumCols();
+  } else {
+    num_rows_ = mat.NumCols();
+    num_cols_ = mat.NumRows();
+  }
+  row_offsets_.resize(num_rows_ + 1);
+  col_indexes_.clear();
+  values_.clear();
+  for (MatrixIndexT r = 0; r < num_rows_; r++) {
+    row_offsets_[r] = values_.size();
+    for (MatrixIndexT c = 0; c < num_cols_; c++) {
+      Real val = (trans == kNoTrans ? mat(r, c) : mat(c, r));
+      if (val != 0.0) {
+        col_indexes_.push_back(c);
+        values_.push_back(val);
+      }
+    }
+  }
+  row_offsets_[num_rows_] = values_.size();
+}
+
+template <typename Real>
+void CsrMatrix<Real>::CopyToSmat(SparseMatrix<Real> *smat) const {
+  smat->Resize(num_rows_, num_cols_);
+  std::vector<std::pair<MatrixIndexT, Real> > pairs;
+  for (MatrixIndexT r = 0; r < num_rows_; r++) {
+    MatrixIndexT begin = row_offsets_[r], end = row_offsets_[r + 1];
+    pairs.resize(end - begin);
+    for (MatrixIndexT i = begin; i < end; i++)
+      pairs[i - begin] = std::make_pair(col_indexes_[i], values_[i]);
+    smat->SetRow(r, SparseVector<Real>(num_cols_, pairs));
+  }
+}
+
+template <typename Real>
+void CsrMatrix<Real>::CopyToMat(MatrixBase<Real> *mat,
+                                MatrixTransposeType trans) const {
+  mat->SetZero();
+  AddToMat(1.0, mat, trans);
+}
+
+template <typename Real>
+void CsrMatrix<Real>::AddToMat(Real alpha, MatrixBase<Real> *other,
+                               MatrixTransposeType trans) const {
+  Real *data = other->Data();
+  MatrixIndexT stride = other->Stride();
+  if (trans == kNoTrans) {
+    KALDI_ASSERT(other->NumRows() == num_rows_ &&
+                 other->NumCols() == num_cols_);
+    for (MatrixIndexT r = 0; r < num_rows_; r++) {
+      Real *row_data = data + r * stride;
+      for (MatrixIndexT i = row_offsets_[r]; i < row_offsets_[r + 1]; i++)
+        row_data[col_indexes_[i]] += alpha * values_[i];
+    }
+  } else {
+    KALDI_ASSERT(other->NumRows() == num_cols_ &&
+                 other->NumCols() == num_rows_);
+    for (MatrixIndexT r = 0; r < num_rows_; r++) {
+      Real *col_data = data + r;
+      for (MatrixIndexT i = row_offsets_[r]; i < row_offsets_[r + 1]; i++)
+        col_data[col_indexes_[i] * stride] += alpha * values_[i];
+    }
+  }
+}
+
+template <typename Real>
+void CsrMatrix<Real>::PartitionRows(
+    int32 num_parts, std::vector<MatrixIndexT> *boundaries) const {
+  KALDI_ASSERT(num_parts > 0);
+  if (num_parts > num_rows_) num_parts = std::max<int32>(num_rows_, 1);
+  boundaries->resize(num_parts + 1);
+  (*boundaries)[0] = 0;
+  MatrixIndexT num_elements = NumElements();
+  for (int32 p = 1; p < num_parts; p++) {
+    // first row whose start offset reaches this part's share of elements.
+    MatrixIndexT target = static_cast<MatrixIndexT>(
+        (static_cast<int64>(num_elements) * p) / num_parts);
+    MatrixIndexT row = std::lower_bound(row_offsets_.begin(),
+                                        row_offsets_.end() - 1, target) -
+        row_offsets_.begin();
+    (*boundaries)[p] = std::max(row, (*boundaries)[p - 1]);
+  }
+  (*boundaries)[num_parts] = num_rows_;
+}
+
+template <typename Real>
+void CsrMatrix<Real>::Swap(CsrMatrix<Real> *other) {
+  std::swap(num_rows_, other->num_rows_);
+  std::swap(num_cols_, other->num_cols_);
+  row_offsets_.swap(other->row_offsets_);
+  col_indexes_.swap(other->col_indexes_);
+  values_.swap(other->values_);
+}
+
+
+// Computes rows [row_begin, row_end) of y = alpha * A * x + beta * y.
+template <typename Real>
+static void CsrVecRowRange(Real alpha, const MatrixIndexT *row_offsets,
+                           const MatrixIndexT *col_indexes,
+                           const Real *values, const Real *x, Real beta,
+                           Real *y, MatrixIndexT row_begin,
+                           MatrixIndexT row_end) {
+  for (MatrixIndexT r = row_begin; r < row_end; r++) {
+    MatrixIndexT i = row_offsets[r], end = row_offsets[r + 1];
+    // Four independent accumulators break the dependency chain on the
+    // running sum and let the compiler vectorize the gathers.
+    Real sum0 = 0.0, sum1 = 0.0, sum2 = 0.0, sum3 = 0.0;
+    for (; i + 4 <= end; i += 4) {
+      sum0 += values[i] * x[col_indexes[i]];
+      sum1 += values[i + 1] * x[col_indexes[i + 1]];
+      sum2 += values[i + 2] * x[col_indexes[i + 2]];
+      sum3 += values[i + 3] * x[col_indexes[i + 3]];
+    }
+    for (; i < end; i++)
+      sum0 += values[i] * x[col_indexes[i]];
+    Real sum = (sum0 + sum1) + (sum2 + sum3);
+    y[r] = alpha * sum + (beta == 0.0 ? 0.0 : beta * y[r]);
+  }
+}
+
+// Computes rows [row_begin, row_end) of C = alpha * A * op(B) + beta * C.
+template <typename Real>
+static void CsrMatRowRange(Real alpha, const MatrixIndexT *row_offsets,
+                           const MatrixIndexT *col_indexes,
+                           const Real *values, const MatrixBase<Real> &B,
+                           MatrixTransposeType transB, Real beta,
+                           MatrixBase<Real> *C, MatrixIndexT row_begin,
+                           MatrixIndexT row_end) {
+  MatrixIndexT num_cols = C->NumCols(), b_stride = B.Stride();
+  const Real *b_data = B.Data();
+  for (MatrixIndexT r = row_begin; r < row_end; r++) {
+    Real *c_row = C->RowData(r);
+    if (beta == 0.0)
+      std::fill(c_row, c_row + num_cols, static_cast<Real>(0.0));
+    else if (beta != 1.0)
+      cblas_Xscal(num_cols, beta, c_row, 1);
+    for (MatrixIndexT i = row_offsets[r]; i < row_offsets[r + 1]; i++) {
+      MatrixIndexT k = col_indexes[i];
+      if (transB == kNoTrans)
+        cblas_Xaxpy(num_cols, alpha * values[i], b_data + k * b_stride, 1,
+                    c_row, 1);
+      else
+        cblas_Xaxpy(num_cols, alpha * values[i], b_data + k, b_stride,
+                    c_row, 1);
+    }
+  }
+}
+
+// Runs row_range(boundaries[p], boundaries[p + 1]) for each part p on a
+// thread of its own.  The threads hold a BlasWorkerScope, as MultiThreader's
+// do (util/ can't be used from matrix/), so their BLAS calls don't
+// oversubscribe the machine.
+template <typename RowRange>
+static void RunRowRanges(const std::vector<MatrixIndexT> &boundaries,
+                         const RowRange &row_range) {
+  std::vector<std::thread> threads;
+  threads.reserve(boundaries.size() - 1);
+  for (size_t p = 0; p + 1 < boundaries.size(); p++) {
+    MatrixIndexT row_begin = boundaries[p], row_end = boundaries[p + 1];
+    threads.push_back(std::thread([&row_range, row_begin, row_end]() {
+      BlasWorkerScope worker_scope;
+      row_range(row_begin, row_end);
+    }));
+  }
+  for (size_t p = 0; p < threads.size(); p++)
+    threads[p].join();
+}
+
+template <typename Real>
+void AddCsrVec(Real alpha, const CsrMatrix<Real> &A,
+               MatrixTransposeType transA, const VectorBase<Real> &x,
+               Real beta, VectorBase<Real> *y, int32 num_threads) {
+  const MatrixIndexT *row_offsets = A.RowOffsets(),
+      *col_indexes = A.ColIndexes();
+  const Real *values = A.Values();
+  if (transA == kNoTrans) {
+    KALDI_ASSERT(A.NumCols() == x.Dim() && A.NumRows() == y->Dim());
+    std::vector<MatrixIndexT> boundaries;
+    A.PartitionRows(num_threads, &boundaries);
+    int32 num_parts = boundaries.size() - 1;
+    if (num_parts <= 1) {
+      CsrVecRowRange(alpha, row_offsets, col_indexes, values, x.Data(),
+                     beta, y->Data(), 0, A.NumRows());
+      return;
+    }
+    const Real *x_data = x.Data();
+    Real *y_data = y->Data();
+    RunRowRanges(boundaries, [&](MatrixIndexT row_begin,
+                                 MatrixIndexT row_end) {
+      CsrVecRowRange(alpha, row_offsets, col_indexes, values, x_data, beta,
+                     y_data, row_begin, row_end);
+    });
+  } else {
+    KALDI_ASSERT(A.NumRows() == x.Dim() && A.NumCols() == y->Dim());
+    // As in BLAS, beta == 0 overwrites y, even where it holds NaN or inf.
+    if (beta == 0.0)
+      y->SetZero();
+    else
+      y->Scale(beta);
+    const Real *x_data = x.Data();
+    Real *y_data = y->Data();
+    for (MatrixIndexT r = 0; r < A.NumRows(); r++) {
+      Real x_r = alpha * x_data[r];
+      if (x_r == 0.0) continue;
+      for (MatrixIndexT i = row_offsets[r]; i < row_offsets[r + 1]; i++)
+        y_data[col_indexes[i]] += x_r * values[i];
+    }
+  }
+}
+
+template <typename Real>
+void AddCsrMat(Real alpha, const CsrMatrix<Real> &A,
+               const MatrixBase<Real> &B, MatrixTransposeType transB,
+               Real beta, MatrixBase<Real> *C, int32 num_threads) {
+  KALDI_ASSERT(A.NumRows() == C->NumRows());
+  if (transB == kNoTrans)
+    KALDI_ASSERT(A.NumCols() == B.NumRows() && B.NumCols() == C->NumCols());
+  else
+    KALDI_ASSERT(A.NumCols() == B.NumCols() && B.NumRows() == C->NumCols());
+  KALDI_ASSERT(&B != C);
+  const MatrixIndexT *row_offsets = A.RowOffsets(),
+      *col_indexes = A.ColIndexes();
+  const Real *values = A.Values();
+  std::vector<MatrixIndexT> boundaries;
+  A.PartitionRows(num_threads, &boundaries);
+  int32 num_parts = boundaries.size() - 1;
+  if (num_parts <= 1) {
+    CsrMatRowRange(alpha, row_offsets, col_indexes, values, B, transB, beta,
+                   C, 0, A.NumRows());
+    return;
+  }
+  RunRowRanges(boundaries, [&](MatrixIndexT row_begin,
+                               MatrixIndexT row_end) {
+    CsrMatRowRange(alpha, row_offsets, col_indexes, values, B, transB, beta,
+                   C, row_begin, row_end);
+  });
+}
+
+template
+void AddCsrVec(float alpha, const CsrMatrix<float> &A,
+               MatrixTransposeType transA, const VectorBase<float> &x,
+               float beta, VectorBase<float> *y, int32 num_threads);
+template
+void AddCsrVec(double alpha, const CsrMatrix<double> &A,
+               MatrixTransposeType transA, const VectorBase<double> &x,
+               double beta, VectorBase<double> *y, int32 num_threads);
+template
+void AddCsrMat(float alpha, const CsrMatrix<float> &A,
+               const MatrixBase<float> &B, MatrixTransposeType transB,
+               float beta, MatrixBase<float> *C, int32 num_threads);
+template
+void AddCsrMat(double alpha, const CsrMatrix<double> &A,
+               const MatrixBase<double> &B, MatrixTransposeType transB,
+               double beta, MatrixBase<double> *C, int32 num_threads);
+
+template class CsrMatrix<float>;
+template class CsrMatrix<double>;
+
+}  // namespace kaldi
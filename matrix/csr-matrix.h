@@ -0,0 +1,145 @@
+// matrix/csr-matrix.h
+
+// Copyright (c) 2021 PeachLab. All Rights Reserved.
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_MATRIX_CSR_MATRIX_H_
+#define KALDI_MATRIX_CSR_MATRIX_H_ 1
+
+#include <vector>
+
+#include "matrix/matrix-common.h"
+#include "matrix/kaldi-matrix.h"
+#include "matrix/kaldi-vector.h"
+#include "matrix/sparse-matrix.h"
+
+namespace kaldi {
+
+
+/// \addtogroup matrix_group
+/// @{
+
+/// CsrMatrix stores a sparse matrix in compressed-sparse-row form: one
+/// contiguous array of column indexes and one of values, plus an array of
+/// NumRows() + 1 offsets giving where each row starts.  It is meant for the
+/// multiplication kernels (AddCsrVec(), AddCsrMat()), which walk the arrays
+/// linearly instead of chasing one std::vector per row as SparseMatrix does.
+/// Compressed-sparse-column form is obtained by constructing from the
+/// transpose (trans == kTrans), i.e. the CSC form of M is the CSR form of M^T.
+/// Conversion from and to SparseMatrix is lossless.
+template <typename Real>
+class CsrMatrix {
+ public:
+  MatrixIndexT NumRows() const { return num_rows_; }
+
+  MatrixIndexT NumCols() const { return num_cols_; }
+
+  /// Returns the number of stored (nonzero) elements.
+  MatrixIndexT NumElements() const { return values_.size(); }
+
+  /// Array of NumRows() + 1 offsets; the elements of row r are those with
+  /// index RowOffsets()[r] <= i < RowOffsets()[r + 1].
+  const MatrixIndexT *RowOffsets() const { return &(row_offsets_[0]); }
+
+  /// Column index of each stored element (sorted within each row), or NULL
+  /// if empty.
+  const MatrixIndexT *ColIndexes() const {
+    return col_indexes_.empty() ? NULL : &(col_indexes_[0]);
+  }
+
+  /// Value of each stored element, or NULL if empty.
+  const Real *Values() const {
+    return values_.empty() ? NULL : &(values_[0]);
+  }
+
+  /// Copies from a SparseMatrix; if trans == kTrans, *this becomes the
+  /// transpose of 'smat' (equivalently, the CSC form of 'smat').
+  void CopyFromSmat(const SparseMatrix<Real> &smat,
+                    MatrixTransposeType trans = kNoTrans);
+
+  /// Copies from a full matrix, keeping only the nonzero elements.
+  void CopyFromMat(const MatrixBase<Real> &mat,
+                   MatrixTransposeType trans = kNoTrans);
+
+  /// Copies to a SparseMatrix, which is resized.
+  void CopyToSmat(SparseMatrix<Real> *smat) const;
+
+  /// Copy to matrix.  It must already have the correct size.
+  void CopyToMat(MatrixBase<Real> *mat,
+                 MatrixTransposeType trans = kNoTrans) const;
+
+  /// Does *other = *other + alpha * *this [or its transpose].
+  void AddToMat(Real alpha, MatrixBase<Real> *other,
+                MatrixTransposeType trans = kNoTrans) const;
+
+  /// Partitions the rows into at most 'num_parts' contiguous ranges with
+  /// roughly equal numbers of elements, so that the work of a kernel is
+  /// balanced even when row lengths vary.  On exit, (*boundaries)[p] and
+  /// (*boundaries)[p + 1] are the begin and end rows of part p.
+  void PartitionRows(int32 num_parts,
+                     std::vector<MatrixIndexT> *boundaries) const;
+
+  void Swap(CsrMatrix<Real> *other);
+
+  CsrMatrix(): num_rows_(0), num_cols_(0), row_offsets_(1, 0) { }
+
+  explicit CsrMatrix(const SparseMatrix<Real> &smat,
+                     MatrixTransposeType trans = kNoTrans) {
+    CopyFromSmat(smat, trans);
+  }
+
+  explicit CsrMatrix(const MatrixBase<Real> &mat,
+                     MatrixTransposeType trans = kNoTrans) {
+    CopyFromMat(mat, trans);
+  }
+
+ private:
+  MatrixIndexT num_rows_;
+  MatrixIndexT num_cols_;
+  std::vector<MatrixIndexT> row_offsets_;  // dimension num_rows_ + 1.
+  std::vector<MatrixIndexT> col_indexes_;
+  std::vector<Real> values_;
+};
+
+
+/// Sparse matrix-vector product (SpMV):
+///   y = alpha * op(A) * x + beta * y.
+/// If num_threads > 1 and transA == kNoTrans, the rows of A are split into
+/// element-balanced ranges (see CsrMatrix::PartitionRows()) that are computed
+/// in parallel; each thread writes a disjoint range of y.  With transA ==
+/// kTrans the product scatters into y and is always computed in one thread.
+template <typename Real>
+void AddCsrVec(Real alpha, const CsrMatrix<Real> &A,
+               MatrixTransposeType transA, const VectorBase<Real> &x,
+               Real beta, VectorBase<Real> *y, int32 num_threads = 1);
+
+/// Sparse times dense-block product (SpMM):
+///   C = alpha * A * op(B) + beta * C.
+/// Each nonzero A(i, k) is applied as one BLAS axpy of row (or column) k of B
+/// into row i of C, so the inner loop is contiguous and vectorized when transB
+/// == kNoTrans.  Rows of C are partitioned over 'num_threads' threads as in
+/// AddCsrVec().
+template <typename Real>
+void AddCsrMat(Real alpha, const CsrMatrix<Real> &A,
+               const MatrixBase<Real> &B, MatrixTransposeType transB,
+               Real beta, MatrixBase<Real> *C, int32 num_threads = 1);
+
+/// @} end of \addtogroup matrix_group
+
+}  // namespace kaldi
+
+#endif  // KALDI_MATRIX_CSR_MATRIX_H_
@@ -21,6 +21,8 @@
 // (*) incorporates, with permission, FFT code from his book
 // "Signal Processing with Lapped Transforms", Artech, 1992.
 
+#include <algorithm>
+
 #include "matrix/matrix-functions.h"
 #include "matrix/sp-matrix.h"
 
@@ -770,4 +772,160 @@ void AddOuterProductPlusMinus<double>(double alpha,
                                       MatrixBase<double> *minus);
 
 
+// Number of rows per block in ApplyAffineTransformToRows(); a block of the
+// output is produced by one GEMM and then length-normalized while it is still
+// in cache.
+static const MatrixIndexT kAffineBlockRows = 64;
+
+template<typename Real>
+void ApplyAffineTransformToRows(const MatrixBase<Real> &transform,
+                                const MatrixBase<Real> &in,
+                                bool normalize_length,
+                                MatrixBase<Real> *out) {
+  MatrixIndexT num_rows = in.NumRows(), in_dim = in.NumCols(),
+      out_dim = transform.NumRows();
+  KALDI_ASSERT(out->NumRows() == num_rows && out->NumCols() == out_dim);
+  bool has_offset = false;
+  if (transform.NumCols() == in_dim) {
+    has_offset = false;
+  } else if (transform.NumCols() == in_dim + 1) {
+    has_offset = true;
+  } else {
+    KALDI_ERR << "Dimension mismatch: input has dimension " << in_dim
+              << " and transform has " << transform.NumCols() << " columns.";
+  }
+  SubMatrix<Real> linear(transform, 0, out_dim, 0, in_dim);
+  Vector<Real> offset;
+  if (has_offset) {
+    offset.Resize(out_dim, kUndefined);
+    offset.CopyColFromMat(transform, in_dim);
+  }
+  for (MatrixIndexT r = 0; r < num_rows; r += kAffineBlockRows) {
+    MatrixIndexT block_rows = std::min(kAffineBlockRows, num_rows - r);
+    SubMatrix<Real> in_block(in, r, block_rows, 0, in_dim),
+        out_block(*out, r, block_rows, 0, out_dim);
+    if (has_offset)
+      out_block.CopyRowsFromVec(offset);
+    out_block.AddMatMat(1.0, in_block, kNoTrans, linear, kTrans,
+                        has_offset ? 1.0 : 0.0);
+    if (normalize_length)
+      NormalizeRowLengths<Real>(NULL, &out_block);
+  }
+}
+
+template<typename Real>
+void ApplyAffineTransformToRows(const MatrixBase<Real> &transform,
+                                const std::vector<Vector<Real> > &in,
+                                bool normalize_length,
+                                std::vector<Vector<Real> > *out) {
+  out->resize(in.size());
+  if (in.empty()) return;
+  MatrixIndexT num_rows = in.size(), in_dim = in[0].Dim();
+  Matrix<Real> in_mat(num_rows, in_dim, kUndefined),
+      out_mat(num_rows, transform.NumRows(), kUndefined);
+  for (MatrixIndexT r = 0; r < num_rows; r++)
+    in_mat.Row(r).CopyFromVec(in[r]);
+  ApplyAffineTransformToRows(transform, in_mat, normalize_length, &out_mat);
+  for (MatrixIndexT r = 0; r < num_rows; r++) {
+    (*out)[r].Resize(out_mat.NumCols(), kUndefined);
+    (*out)[r].CopyFromVec(out_mat.Row(r));
+  }
+}
+
+template<typename Real>
+void NormalizeRowLengths(const VectorBase<Real> *inv_covar,
+                         MatrixBase<Real> *mat,
+                         VectorBase<Real> *scales) {
+  MatrixIndexT num_rows = mat->NumRows(), num_cols = mat->NumCols();
+  KALDI_ASSERT(inv_covar == NULL || inv_covar->Dim() == num_cols);
+  KALDI_ASSERT(scales == NULL || scales->Dim() == num_rows);
+  const Real *w = (inv_covar == NULL ? NULL : inv_covar->Data());
+  for (MatrixIndexT r = 0; r < num_rows; r++) {
+    Real *row = mat->RowData(r);
+    Real sumsq = 0.0;
+    if (w == NULL) {
+      for (MatrixIndexT c = 0; c < num_cols; c++)
+        sumsq += row[c] * row[c];
+    } else {
+      for (MatrixIndexT c = 0; c < num_cols; c++)
+        sumsq += w[c] * row[c] * row[c];
+    }
+    Real scale = 1.0;
+    if (sumsq == 0.0) {
+      KALDI_WARN << "Zero vector in row " << r << ", not normalizing it.";
+    } else {
+      scale = std::sqrt(num_cols / sumsq);
+      for (MatrixIndexT c = 0; c < num_cols; c++)
+        row[c] *= scale;
+    }
+    if (scales != NULL)
+      (*scales)(r) = scale;
+  }
+}
+
+template<typename Real>
+void AddRowDotProducts(Real alpha,
+                       const MatrixBase<Real> &A,
+                       const VectorBase<Real> *w,
+                       const MatrixBase<Real> &B,
+                       Real beta,
+                       VectorBase<Real> *dots) {
+  MatrixIndexT num_rows = A.NumRows(), num_cols = A.NumCols();
+  KALDI_ASSERT(B.NumRows() == num_rows && B.NumCols() == num_cols &&
+               dots->Dim() == num_rows);
+  if (w == NULL) {
+    dots->AddDiagMatMat(alpha, A, kNoTrans, B, kTrans, beta);
+    return;
+  }
+  KALDI_ASSERT(w->Dim() == num_cols);
+  const Real *wdata = w->Data();
+  Real *ddata = dots->Data();
+  for (MatrixIndexT r = 0; r < num_rows; r++) {
+    const Real *arow = A.RowData(r), *brow = B.RowData(r);
+    Real sum = 0.0;
+    for (MatrixIndexT c = 0; c < num_cols; c++)
+      sum += arow[c] * wdata[c] * brow[c];
+    ddata[r] = (beta == 0.0 ? 0.0 : beta * ddata[r]) + alpha * sum;
+  }
+}
+
+template
+void ApplyAffineTransformToRows(const MatrixBase<float> &transform,
+                                const MatrixBase<float> &in,
+                                bool normalize_length,
+                                MatrixBase<float> *out);
+template
+void ApplyAffineTransformToRows(const MatrixBase<double> &transform,
+                                const MatrixBase<double> &in,
+                                bool normalize_length,
+                                MatrixBase<double> *out);
+template
+void ApplyAffineTransformToRows(const MatrixBase<float> &transform,
+                                const std::vector<Vector<float> > &in,
+                                bool normalize_length,
+                                std::vector<Vector<float> > *out);
+template
+void ApplyAffineTransformToRows(const MatrixBase<double> &transform,
+                                const std::vector<Vector<double> > &in,
+                                bool normalize_length,
+                                std::vector<Vector<double> > *out);
+template
+void NormalizeRowLengths(const VectorBase<float> *inv_covar,
+                         MatrixBase<float> *mat,
+                         VectorBase<float> *scales);
+template
+void NormalizeRowLengths(const VectorBase<double> *inv_covar,
+                         MatrixBase<double> *mat,
+                         VectorBase<double> *scales);
+template
+void AddRowDotProducts(float alpha, const MatrixBase<float> &A,
+                       const VectorBase<float> *w,
+                       const MatrixBase<float> &B, float beta,
+                       VectorBase<float> *dots);
+template
+void AddRowDotProducts(double alpha, const MatrixBase<double> &A,
+                       const VectorBase<double> *w,
+                       const MatrixBase<double> &B, double beta,
+                       VectorBase<double> *dots);
+
 } // end namespace kaldi
@@ -157,6 +157,54 @@ void AddOuterProductPlusMinus(Real alpha,
                               MatrixBase<Real> *plus,
                               MatrixBase<Real> *minus);
 
+/// Batched operations on row-stacked vectors.  These replace a loop of small
+/// per-vector AddMatVec() calls (e.g. transforming many x-vectors) with one
+/// GEMM, followed by per-row epilogues that run while each block of rows is
+/// still in cache.
+
+/// Applies an affine transform to each row of "in":
+///   out.Row(r) = T * in.Row(r) + b.
+/// "transform" is either of dimension D_out x D_in, in which case b = 0, or
+/// D_out x (D_in + 1), in which case its last column is b (the convention
+/// used by LDA transforms).  "out" must be in.NumRows() x D_out.  If
+/// normalize_length == true, each output row is then scaled as by
+/// NormalizeRowLengths(NULL, ...), i.e. to have 2-norm sqrt(D_out).
+template<typename Real>
+void ApplyAffineTransformToRows(const MatrixBase<Real> &transform,
+                                const MatrixBase<Real> &in,
+                                bool normalize_length,
+                                MatrixBase<Real> *out);
+
+/// Version of ApplyAffineTransformToRows() that takes an array of vectors;
+/// they are stacked into one matrix internally.  "out" is resized.
+template<typename Real>
+void ApplyAffineTransformToRows(const MatrixBase<Real> &transform,
+                                const std::vector<Vector<Real> > &in,
+                                bool normalize_length,
+                                std::vector<Vector<Real> > *out);
+
+/// Scales each row x of *mat so that x^T diag(inv_covar) x equals
+/// mat->NumCols(); if inv_covar is NULL it is taken to be all ones, so each
+/// row gets 2-norm sqrt(NumCols()).  Rows that are all zero are left as they
+/// are, with a warning.  If "scales" is non-NULL it must have dimension
+/// NumRows() and receives the factor each row was multiplied by.
+template<typename Real>
+void NormalizeRowLengths(const VectorBase<Real> *inv_covar,
+                         MatrixBase<Real> *mat,
+                         VectorBase<Real> *scales = NULL);
+
+/// (*dots)(r) = beta * (*dots)(r) + alpha * sum_i A(r, i) w(i) B(r, i), i.e.
+/// the (weighted) dot product of corresponding rows of A and B.  If w is NULL
+/// this is the plain dot product, the same as
+/// dots->AddDiagMatMat(alpha, A, kNoTrans, B, kTrans, beta).
+template<typename Real>
+void AddRowDotProducts(Real alpha,
+                       const MatrixBase<Real> &A,
+                       const VectorBase<Real> *w,
+                       const MatrixBase<Real> &B,
+                       Real beta,
+                       VectorBase<Real> *dots);
+
 template<typename Real1, typename Real2>
 inline void AssertSameDim(const MatrixBase<Real1> &mat1, const MatrixBase<Real2> &mat2) {
   KALDI_ASSERT(mat1.NumRows() == mat2.NumRows()
@@ -0,0 +1,474 @@
+// matrix/matrix-lib-benchmark.cc
+
+// Copyright (c) 2021 PeachLab. All Rights Reserved.
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+// Micro-benchmarks for kaldi-matrix.  Unlike matrix-lib-speed-test.cc, which
+// times each operation once, every benchmark here is warmed up and then
+// sampled repeatedly; we report the median and 95th percentile of the time
+// per call, as JSON.  Given --baseline=<file> (the JSON written by an earlier
+// run), benchmarks whose median got slower by more than --tolerance are
+// reported as regressions and the program exits with status 1.
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "base/kaldi-common.h"
+#include "base/timer.h"
+#include "matrix/blas-threading.h"
+#include "matrix/csr-matrix.h"
+#include "matrix/matrix-lib.h"
+#include "matrix/srfft.h"
+#include "util/parse-options.h"
+
+namespace kaldi {
+
+struct BenchmarkOptions {
+  int32 num_warmup;
+  int32 num_repeats;
+  BaseFloat min_sample_ms;
+  int32 pin_cpu;
+  int32 blas_threads;
+  std::string precision;
+  std::string filter;
+  std::string output;
+  std::string baseline;
+  BaseFloat tolerance;
+
+  BenchmarkOptions(): num_warmup(2), num_repeats(11), min_sample_ms(5.0),
+                      pin_cpu(0), blas_threads(1), precision("both"),
+                      output("-"), tolerance(0.1) { }
+
+  void Register(OptionsItf *opts) {
+    opts->Register("num-warmup", &num_warmup, "Number of untimed samples "
+                   "taken before the timed ones.");
+    opts->Register("num-repeats", &num_repeats, "Number of timed samples per "
+                   "benchmark; the median and p95 are taken over these.");
+    opts->Register("min-sample-ms", &min_sample_ms, "Each sample repeats the "
+                   "operation until it takes at least this many milliseconds.");
+    opts->Register("pin-cpu", &pin_cpu, "Pin the benchmark thread to this CPU "
+                   "(Linux only); -1 to not pin.");
+    opts->Register("blas-threads", &blas_threads, "Number of BLAS threads; "
+                   "0 leaves the BLAS library's default.");
+    opts->Register("precision", &precision, "Which precisions to run: "
+                   "\"float\", \"double\" or \"both\".");
+    opts->Register("filter", &filter, "If nonempty, only run benchmarks whose "
+                   "name contains this string.");
+    opts->Register("output", &output, "Where to write the JSON results; "
+                   "\"-\" for stdout.");
+    opts->Register("baseline", &baseline, "JSON results of an earlier run to "
+                   "compare against.");
+    opts->Register("tolerance", &tolerance, "Relative slowdown of the median "
+                   "above which a benchmark is flagged as a regression.");
+  }
+};
+
+struct BenchmarkResult {
+  std::string name;
+  int64 iters_per_sample;
+  double median_us;
+  double p95_us;
+  double gflops;  // 0 if not meaningful for this benchmark.
+};
+
+class BenchmarkRunner {
+ public:
+  explicit BenchmarkRunner(const BenchmarkOptions &opts): opts_(opts) { }
+
+  /// Times 'func', recording the result under 'name' unless it is filtered
+  /// out.  'flops' is the number of floating point operations per call, or
+  /// zero.
+  void Run(const std::string &name, const std::function<void()> &func,
+           double flops = 0.0);
+
+  const std::vector<BenchmarkResult> &Results() const { return results_; }
+
+  void WriteJson(std::ostream &os) const;
+
+  /// Compares with the JSON file written by an earlier run, logging every
+  /// benchmark present in both.  Returns the number of regressions.
+  int32 CompareToBaseline(const std::string &filename) const;
+
+ private:
+  const BenchmarkOptions &opts_;
+  std::vector<BenchmarkResult> results_;
+};
+
+void BenchmarkRunner::Run(const std::string &name,
+                          const std::function<void()> &func, double flops) {
+  if (!opts_.filter.empty() && name.find(opts_.filter) == std::string::npos)
+    return;
+  // Find how many calls make up one sample.  This also serves as the first
+  // part of the warmup.
+  double min_sample_secs = opts_.min_sample_ms / 1000.0;
+  int64 iters = 1;
+  while (true) {
+    Timer timer;
+    for (int64 i = 0; i < iters; i++) func();
+    double elapsed = timer.Elapsed();
+    if (elapsed >= min_sample_secs) break;
+    iters *= (elapsed < min_sample_secs / 10.0 ? 10 : 2);
+  }
+  for (int32 w = 0; w < opts_.num_warmup; w++)
+    for (int64 i = 0; i < iters; i++) func();
+
+  std::vector<double> samples(std::max<int32>(1, opts_.num_repeats));
+  for (size_t s = 0; s < samples.size(); s++) {
+    Timer timer;
+    for (int64 i = 0; i < iters; i++) func();
+    samples[s] = timer.Elapsed() * 1.0e+06 / iters;
+  }
+  std::sort(samples.begin(), samples.end());
+  size_t n = samples.size();
+  BenchmarkResult result;
+  result.name = name;
+  result.iters_per_sample = iters;
+  result.median_us = (n % 2 == 1 ? samples[n / 2] :
+                      0.5 * (samples[n / 2 - 1] + samples[n / 2]));
+  size_t p95_index = static_cast<size_t>(std::ceil(0.95 * n)) - 1;
+  result.p95_us = samples[std::min(p95_index, n - 1)];
+  result.gflops = (flops > 0.0 ? flops / (result.median_us * 1.0e+03) : 0.0);
+  KALDI_LOG << name << ": median " << result.median_us << " us, p95 "
+            << result.p95_us << " us"
+            << (flops > 0.0 ? ", " : "")
+            << (flops > 0.0 ? std::to_string(result.gflops) + " GFLOPS" : "");
+  results_.push_back(result);
+}
+
+void BenchmarkRunner::WriteJson(std::ostream &os) const {
+  // One result per line, so that CompareToBaseline() can read the file
+  // back without a general JSON parser.
+  os << "{\n  \"results\": [\n";
+  for (size_t i = 0; i < results_.size(); i++) {
+    const BenchmarkResult &r = results_[i];
+    os << "    {\"name\": \"" << r.name << "\", \"iters_per_sample\": "
+       << r.iters_per_sample << ", \"median_us\": " << r.median_us
+       << ", \"p95_us\": " << r.p95_us << ", \"gflops\": " << r.gflops
+       << "}" << (i + 1 < results_.size() ? "," : "") << "\n";
+  }
+  os << "  ]\n}\n";
+}
+
+// Extracts the value of "key" from a line written by WriteJson(); returns
+// false if it is not there.
+static bool ExtractJsonField(const std::string &line, const std::string &key,
+                             std::string *value) {
+  std::string pattern = "\"" + key + "\": ";
+  size_t pos = line.find(pattern);
+  if (pos == std::string::npos) return false;
+  pos += pattern.size();
+  if (pos < line.size() && line[pos] == '"') {
+    size_t end = line.find('"', pos + 1);
+    if (end == std::string::npos) return false;
+    *value = line.substr(pos + 1, end - pos - 1);
+  } else {
+    size_t end = line.find_first_of(",}", pos);
+    *value = line.substr(pos, end - pos);
+  }
+  return true;
+}
+
+int32 BenchmarkRunner::CompareToBaseline(const std::string &filename) const {
+  std::ifstream is(filename.c_str());
+  if (!is.good())
+    KALDI_ERR << "Could not open baseline file " << filename;
+  std::map<std::string, double> baseline;
+  std::string line;
+  while (std::getline(is, line)) {
+    std::string name, median;
+    if (ExtractJsonField(line, "name", &name) &&
+        ExtractJsonField(line, "median_us", &median))
+      baseline[name] = std::atof(median.c_str());
+  }
+  int32 num_compared = 0, num_regressions = 0;
+  for (size_t i = 0; i < results_.size(); i++) {
+    const BenchmarkResult &r = results_[i];
+    std::map<std::string, double>::const_iterator iter =
+        baseline.find(r.name);
+    if (iter == baseline.end() || iter->second <= 0.0) continue;
+    num_compared++;
+    double ratio = r.median_us / iter->second;
+    if (ratio > 1.0 + opts_.tolerance) {
+      num_regressions++;
+      KALDI_WARN << "REGRESSION " << r.name << ": median " << r.median_us
+                 << " us vs. baseline " << iter->second << " us ("
+                 << ratio << "x)";
+    } else {
+      KALDI_LOG << r.name << ": " << ratio << "x baseline";
+    }
+  }
+  KALDI_LOG << "Compared " << num_compared << " benchmarks with " << filename
+            << ": " << num_regressions << " regression(s) beyond tolerance "
+            << opts_.tolerance;
+  return num_regressions;
+}
+
+static void PinToCpu(int32 cpu) {
+  if (cpu < 0) return;
+#ifdef __linux__
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+    KALDI_WARN << "Could not pin to CPU " << cpu;
+#else
+  KALDI_WARN << "Thread pinning is only supported on Linux.";
+#endif
+}
+
+template<typename Real> static std::string BenchName(const std::string &op,
+                                                     const std::string &shape) {
+  return op + (sizeof(Real) == 8 ? "<double>/" : "<float>/") + shape;
+}
+
+static std::string ShapeName(MatrixIndexT a, MatrixIndexT b,
+                             MatrixIndexT c = -1) {
+  std::ostringstream os;
+  os << a << "x" << b;
+  if (c >= 0) os << "x" << c;
+  return os.str();
+}
+
+template<typename Real>
+static void BenchmarkGemm(BenchmarkRunner *runner) {
+  // (M, K, N) shapes: square ones, plus the tall-skinny shapes of the x-vector
+  // network layers.
+  MatrixIndexT shapes[][3] = { {64, 64, 64}, {256, 256, 256},
+                               {512, 512, 512}, {1024, 1024, 1024},
+                               {200, 512, 1500}, {200, 1500, 512},
+                               {1, 512, 512} };
+  for (size_t i = 0; i < sizeof(shapes) / sizeof(shapes[0]); i++) {
+    MatrixIndexT m = shapes[i][0], k = shapes[i][1], n = shapes[i][2];
+    Matrix<Real> A(m, k), B(k, n), C(m, n), Bt(n, k);
+    A.SetRandn();
+    B.SetRandn();
+    Bt.SetRandn();
+    double flops = 2.0 * m * k * n;
+    runner->Run(BenchName<Real>("AddMatMat", ShapeName(m, k, n)), [&]() {
+        C.AddMatMat(1.0, A, kNoTrans, B, kNoTrans, 0.0); }, flops);
+    runner->Run(BenchName<Real>("AddMatMatTransB", ShapeName(m, k, n)), [&]() {
+        C.AddMatMat(1.0, A, kNoTrans, Bt, kTrans, 0.0); }, flops);
+  }
+}
+
+template<typename Real>
+static void BenchmarkGemv(BenchmarkRunner *runner) {
+  MatrixIndexT shapes[][2] = { {512, 512}, {1500, 512}, {512, 1500},
+                               {4096, 4096} };
+  for (size_t i = 0; i < sizeof(shapes) / sizeof(shapes[0]); i++) {
+    MatrixIndexT m = shapes[i][0], n = shapes[i][1];
+    Matrix<Real> A(m, n);
+    A.SetRandn();
+    Vector<Real> x(n), y(m), xt(m), yt(n);
+    x.SetRandn();
+    xt.SetRandn();
+    double flops = 2.0 * m * n;
+    runner->Run(BenchName<Real>("AddMatVec", ShapeName(m, n)), [&]() {
+        y.AddMatVec(1.0, A, kNoTrans, x, 0.0); }, flops);
+    runner->Run(BenchName<Real>("AddMatVecTrans", ShapeName(m, n)), [&]() {
+        yt.AddMatVec(1.0, A, kTrans, xt, 0.0); }, flops);
+  }
+}
+
+template<typename Real>
+static void BenchmarkElementwise(BenchmarkRunner *runner) {
+  // ApplyLog/ApplyExp/ApplyPow are timed together with a copy from a fixed
+  // source, so that repeated application does not drift into inf or NaN; the
+  // CopyFromMat benchmark gives the cost of the copy alone.
+  MatrixIndexT sizes[] = { 256, 1024 };
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    MatrixIndexT dim = sizes[i];
+    Matrix<Real> src(dim, dim), M(dim, dim);
+    src.SetRandUniform();
+    src.Add(0.1);  // keep it positive for ApplyLog.
+    std::string shape = ShapeName(dim, dim);
+    runner->Run(BenchName<Real>("CopyFromMat", shape), [&]() {
+        M.CopyFromMat(src); });
+    runner->Run(BenchName<Real>("ApplyLog", shape), [&]() {
+        M.CopyFromMat(src);
+        M.ApplyLog(); });
+    runner->Run(BenchName<Real>("ApplyExp", shape), [&]() {
+        M.CopyFromMat(src);
+        M.ApplyExp(); });
+    runner->Run(BenchName<Real>("ApplyPow", shape), [&]() {
+        M.CopyFromMat(src);
+        M.ApplyPow(1.5); });
+  }
+}
+
+template<typename Real>
+static void BenchmarkCompressedMatrix(BenchmarkRunner *runner) {
+  // Feature-like (frames x dim) and embedding-like shapes.
+  MatrixIndexT shapes[][2] = { {1000, 40}, {100, 512} };
+  CompressionMethod methods[] = { kSpeechFeature, kTwoByteAuto,
+                                  kOneByteAuto };
+  const char *method_names[] = { "SpeechFeature", "TwoByteAuto",
+                                 "OneByteAuto" };
+  for (size_t i = 0; i < sizeof(shapes) / sizeof(shapes[0]); i++) {
+    MatrixIndexT rows = shapes[i][0], cols = shapes[i][1];
+    Matrix<Real> M(rows, cols), M2(rows, cols);
+    M.SetRandn();
+    for (size_t j = 0; j < sizeof(methods) / sizeof(methods[0]); j++) {
+      CompressionMethod method = methods[j];
+      std::string shape = ShapeName(rows, cols);
+      CompressedMatrix cmat;
+      runner->Run(BenchName<Real>(std::string("Compress") + method_names[j],
+                                  shape), [&]() {
+          cmat.CopyFromMat(M, method); });
+      cmat.CopyFromMat(M, method);
+      runner->Run(BenchName<Real>(std::string("Decompress") + method_names[j],
+                                  shape), [&]() {
+          cmat.CopyToMat(&M2); });
+    }
+  }
+}
+
+template<typename Real>
+static void BenchmarkSpMatrix(BenchmarkRunner *runner) {
+  MatrixIndexT sizes[] = { 64, 128, 256, 512, 1024 };
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    MatrixIndexT dim = sizes[i];
+    SpMatrix<Real> S(dim), S2(dim);
+    Matrix<Real> R(dim, dim);
+    R.SetRandn();
+    S.AddMat2(1.0, R, kNoTrans, 0.0);  // positive definite.
+    Vector<Real> s(dim);
+    Matrix<Real> P(dim, dim);
+    std::string shape = ShapeName(dim, dim);
+    runner->Run(BenchName<Real>("SpEig", shape), [&]() {
+        S.Eig(&s, &P); });
+    runner->Run(BenchName<Real>("SpEigNoVectors", shape), [&]() {
+        S.Eig(&s); });
+    // The symmetric QR method, which Eig() falls back to without LAPACK.
+    runner->Run(BenchName<Real>("SpQrEig", shape), [&]() {
+        S.QrEig(&s, &P); });
+    runner->Run(BenchName<Real>("SpQrEigNoVectors", shape), [&]() {
+        S.QrEig(&s); });
+    runner->Run(BenchName<Real>("SpInvert", shape), [&]() {
+        S2.CopyFromSp(S);
+        S2.Invert(); });
+  }
+}
+
+template<typename Real>
+static void BenchmarkSparse(BenchmarkRunner *runner) {
+  MatrixIndexT size = 4096, block = 64;
+  SparseMatrix<Real> smat(size, size);
+  smat.SetRandn(0.95);
+  CsrMatrix<Real> csr(smat);
+  Vector<Real> x(size), y(size);
+  x.SetRandn();
+  Matrix<Real> B(size, block), C(size, block);
+  B.SetRandn();
+  double nnz = smat.NumElements();
+  std::string shape = ShapeName(size, size);
+  runner->Run(BenchName<Real>("CsrSpMV", shape), [&]() {
+      AddCsrVec<Real>(1.0, csr, kNoTrans, x, 0.0, &y); }, 2.0 * nnz);
+  runner->Run(BenchName<Real>("CsrSpMVTrans", shape), [&]() {
+      AddCsrVec<Real>(1.0, csr, kTrans, x, 0.0, &y); }, 2.0 * nnz);
+  shape = ShapeName(size, size, block);
+  runner->Run(BenchName<Real>("AddSmatMat", shape), [&]() {
+      C.AddSmatMat(1.0, smat, kNoTrans, B, 0.0); }, 2.0 * nnz * block);
+  runner->Run(BenchName<Real>("CsrSpMM", shape), [&]() {
+      AddCsrMat<Real>(1.0, csr, B, kNoTrans, 0.0, &C); }, 2.0 * nnz * block);
+}
+
+template<typename Real>
+static void BenchmarkFft(BenchmarkRunner *runner) {
+  MatrixIndexT sizes[] = { 256, 512, 1024 };
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    MatrixIndexT dim = sizes[i];
+    std::ostringstream shape;
+    shape << dim;
+    Vector<Real> v(dim);
+    v.SetRandn();
+    SplitRadixRealFft<Real> srfft(dim);
+    runner->Run(BenchName<Real>("SplitRadixRealFft", shape.str()), [&]() {
+        srfft.Compute(v.Data(), true); });
+    runner->Run(BenchName<Real>("RealFft", shape.str()), [&]() {
+        RealFft(&v, true); });
+  }
+}
+
+template<typename Real>
+static void RunAllBenchmarks(BenchmarkRunner *runner) {
+  BenchmarkGemm<Real>(runner);
+  BenchmarkGemv<Real>(runner);
+  BenchmarkElementwise<Real>(runner);
+  BenchmarkCompressedMatrix<Real>(runner);
+  BenchmarkSpMatrix<Real>(runner);
+  BenchmarkSparse<Real>(runner);
+  BenchmarkFft<Real>(runner);
+}
+
+}  // namespace kaldi
+
+int main(int argc, char *argv[]) {
+  using namespace kaldi;
+  try {
+    const char *usage =
+        "Micro-benchmarks for kaldi-matrix, written as JSON.\n"
+        "Usage:  matrix-lib-benchmark [options]\n"
+        "e.g.:\n"
+        "  matrix-lib-benchmark --output=baseline.json\n"
+        "  matrix-lib-benchmark --baseline=baseline.json --tolerance=0.05\n";
+    ParseOptions po(usage);
+    BenchmarkOptions opts;
+    opts.Register(&po);
+    po.Read(argc, argv);
+    if (po.NumArgs() != 0) {
+      po.PrintUsage();
+      exit(1);
+    }
+    if (opts.precision != "float" && opts.precision != "double" &&
+        opts.precision != "both")
+      KALDI_ERR << "Invalid --precision=" << opts.precision;
+
+    PinToCpu(opts.pin_cpu);
+    if (opts.blas_threads > 0) SetBlasDefaultNumThreads(opts.blas_threads);
+
+    BenchmarkRunner runner(opts);
+    if (opts.precision != "double") RunAllBenchmarks<float>(&runner);
+    if (opts.precision != "float") RunAllBenchmarks<double>(&runner);
+
+    if (opts.output == "-") {
+      runner.WriteJson(std::cout);
+    } else {
+      std::ofstream os(opts.output.c_str());
+      runner.WriteJson(os);
+      if (!os.good())
+        KALDI_ERR << "Error writing benchmark results to " << opts.output;
+    }
+    if (!opts.baseline.empty() &&
+        runner.CompareToBaseline(opts.baseline) > 0)
+      return 1;
+    return 0;
+  } catch(const std::exception &e) {
+    std::cerr << e.what();
+    return -1;
+  }
+}
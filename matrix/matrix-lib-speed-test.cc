@@ -108,6 +108,46 @@ static void UnitTestSvdSpeed() {
   CsvResult<Real>(__func__, sizes.size(), t.Elapsed(), "seconds");
 }
 
+// Compares SpMatrix::Eig (LAPACK ?syevr when available) with the in-tree
+// Householder + QR path, SpMatrix::QrEig.
+template<typename Real>
+static void UnitTestEigSpeed() {
+  Timer t;
+  std::vector<MatrixIndexT> sizes;
+  sizes.push_back(128);
+  sizes.push_back(256);
+  sizes.push_back(512);
+  sizes.push_back(1024);
+  for (size_t i = 0; i < sizes.size(); i++) {
+    MatrixIndexT size = sizes[i];
+    SpMatrix<Real> S(size);
+    S.SetRandn();
+    Vector<Real> l(size);
+    Matrix<Real> P(size, size);
+    {
+      Timer t1;
+      S.Eig(&l, &P);
+      CsvResult<Real>("Eig with eigenvectors", size, t1.Elapsed(), "seconds");
+    }
+    {
+      Timer t1;
+      S.QrEig(&l, &P);
+      CsvResult<Real>("QrEig with eigenvectors", size, t1.Elapsed(), "seconds");
+    }
+    {
+      Timer t1;
+      S.Eig(&l);
+      CsvResult<Real>("Eig w/o eigenvectors", size, t1.Elapsed(), "seconds");
+    }
+    {
+      Timer t1;
+      S.QrEig(&l);
+      CsvResult<Real>("QrEig w/o eigenvectors", size, t1.Elapsed(), "seconds");
+    }
+  }
+  CsvResult<Real>(__func__, sizes.size(), t.Elapsed(), "seconds");
+}
+
 template<typename Real>
 static void UnitTestAddMatMatSpeed() {
   Timer t;
@@ -258,6 +298,7 @@ template<typename Real> static void MatrixUnitSpeedTest() {
   UnitTestRealFftSpeed<Real>();
   UnitTestSplitRadixRealFftSpeed<Real>();
   UnitTestSvdSpeed<Real>();
+  UnitTestEigSpeed<Real>();
   UnitTestAddMatMatSpeed<Real>();
   UnitTestAddRowSumMatSpeed<Real>();
   UnitTestAddColSumMatSpeed<Real>();
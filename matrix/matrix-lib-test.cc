@@ -1133,6 +1133,86 @@ template<typename Real> static void UnitTestHeaviside() {
 }
 
 
+template<typename Real> static void UnitTestApplyAffineTransformToRows() {
+  for (MatrixIndexT iter = 0; iter < 10; iter++) {
+    MatrixIndexT num_rows = 1 + Rand() % 150, in_dim = 5 + Rand() % 20,
+        out_dim = 5 + Rand() % 20;
+    bool has_offset = (iter % 2 == 0), normalize_length = (iter % 3 != 0);
+    Matrix<Real> transform(out_dim, in_dim + (has_offset ? 1 : 0)),
+        in(num_rows, in_dim), out(num_rows, out_dim);
+    transform.SetRandn();
+    in.SetRandn();
+    ApplyAffineTransformToRows(transform, in, normalize_length, &out);
+
+    SubMatrix<Real> linear(transform, 0, out_dim, 0, in_dim);
+    for (MatrixIndexT r = 0; r < num_rows; r++) {
+      Vector<Real> v(out_dim);
+      if (has_offset) v.CopyColFromMat(transform, in_dim);
+      v.AddMatVec(1.0, linear, kNoTrans, in.Row(r), 1.0);
+      if (normalize_length) v.Scale(std::sqrt(out_dim) / v.Norm(2.0));
+      SubVector<Real> out_row(out, r);
+      AssertEqual(v, out_row);
+    }
+
+    std::vector<Vector<Real> > in_vecs(num_rows), out_vecs;
+    for (MatrixIndexT r = 0; r < num_rows; r++)
+      in_vecs[r] = in.Row(r);
+    ApplyAffineTransformToRows(transform, in_vecs, normalize_length,
+                               &out_vecs);
+    KALDI_ASSERT(out_vecs.size() == static_cast<size_t>(num_rows));
+    for (MatrixIndexT r = 0; r < num_rows; r++) {
+      SubVector<Real> out_row(out, r);
+      AssertEqual(out_vecs[r], out_row);
+    }
+  }
+}
+
+template<typename Real> static void UnitTestNormalizeRowLengths() {
+  for (MatrixIndexT iter = 0; iter < 10; iter++) {
+    MatrixIndexT num_rows = 1 + Rand() % 20, num_cols = 1 + Rand() % 20;
+    Matrix<Real> M(num_rows, num_cols);
+    M.SetRandn();
+    Vector<Real> inv_covar(num_cols), scales(num_rows);
+    inv_covar.SetRandn();
+    inv_covar.ApplyPow(2.0);
+    inv_covar.Add(0.1);
+    bool use_covar = (iter % 2 == 0);
+    Matrix<Real> M2(M);
+    NormalizeRowLengths(use_covar ? &inv_covar : NULL, &M2, &scales);
+    for (MatrixIndexT r = 0; r < num_rows; r++) {
+      Vector<Real> row(M2.Row(r)), row_sq(row);
+      row_sq.ApplyPow(2.0);
+      Real prod = (use_covar ? VecVec(row_sq, inv_covar) : row_sq.Sum());
+      AssertEqual(prod, static_cast<Real>(num_cols));
+      row.Scale(1.0 / scales(r));
+      SubVector<Real> orig_row(M, r);
+      AssertEqual(row, orig_row);
+    }
+  }
+}
+
+template<typename Real> static void UnitTestAddRowDotProducts() {
+  for (MatrixIndexT iter = 0; iter < 10; iter++) {
+    MatrixIndexT num_rows = 1 + Rand() % 20, num_cols = 1 + Rand() % 20;
+    Matrix<Real> A(num_rows, num_cols), B(num_rows, num_cols);
+    A.SetRandn();
+    B.SetRandn();
+    Vector<Real> w(num_cols), dots(num_rows), dots2(num_rows);
+    w.SetRandn();
+    dots.SetRandn();
+    dots2.CopyFromVec(dots);
+    Real alpha = 0.5, beta = (iter % 2 == 0 ? 0.0 : 2.0);
+    bool use_w = (iter % 3 != 0);
+    AddRowDotProducts(alpha, A, use_w ? &w : NULL, B, beta, &dots);
+    for (MatrixIndexT r = 0; r < num_rows; r++) {
+      Vector<Real> a(A.Row(r));
+      if (use_w) a.MulElements(w);
+      dots2(r) = beta * dots2(r) + alpha * VecVec(a, B.Row(r));
+    }
+    AssertEqual(dots, dots2);
+  }
+}
+
 template<typename Real> static void UnitTestAddOuterProductPlusMinus() {
   for (MatrixIndexT iter = 0; iter < 10; iter++) {
     MatrixIndexT dimM = 10 + Rand() % 10;
@@ -1546,6 +1626,40 @@ static Real NonOrthogonality(const MatrixBase<Real> &M, MatrixTransposeType tran
   return max;
 }
 
+template<typename Real> static void UnitTestEigSpPaths() {
+  // Checks that the LAPACK and in-tree (QR) eigensolvers both reconstruct S
+  // and agree on the (sorted) eigenvalues.
+  for (MatrixIndexT iter = 0; iter < 20; iter++) {
+    MatrixIndexT dimM = 1 + (Rand() % 40);
+    SpMatrix<Real> S(dimM);
+    if (iter % 4 != 1) S.SetRandn();  // iter % 4 == 1 gives the zero matrix.
+    bool want_vecs = (iter % 3 != 2);
+    Vector<Real> s_qr(dimM);
+    Matrix<Real> P_qr(dimM, dimM);
+    S.QrEig(&s_qr, want_vecs ? &P_qr : NULL);
+#if !defined(HAVE_ATLAS) && !defined(USE_KALDI_EIG)
+    Vector<Real> s_lapack(dimM);
+    Matrix<Real> P_lapack(dimM, dimM);
+    KALDI_ASSERT(S.LapackEig(&s_lapack, want_vecs ? &P_lapack : NULL));
+    if (want_vecs) {
+      KALDI_ASSERT(NonOrthogonality(P_lapack, kNoTrans) < 1.0e-04);
+      SpMatrix<Real> S2(dimM);
+      S2.AddMat2Vec(1.0, P_lapack, kNoTrans, s_lapack, 0.0);
+      KALDI_ASSERT(S.ApproxEqual(S2, 1.0e-04f));
+    }
+    std::sort(s_lapack.Data(), s_lapack.Data() + dimM);
+    Vector<Real> s_sorted(s_qr);
+    std::sort(s_sorted.Data(), s_sorted.Data() + dimM);
+    AssertEqual(s_sorted, s_lapack, 1.0e-04);
+#endif
+    if (want_vecs) {
+      SpMatrix<Real> S2(dimM);
+      S2.AddMat2Vec(1.0, P_qr, kNoTrans, s_qr, 0.0);
+      KALDI_ASSERT(S.ApproxEqual(S2, 1.0e-04f));
+    }
+  }
+}
+
 template<typename Real>
 static Real NonDiagonalness(const SpMatrix<Real> &S) {
   Real max_diag = 0.0, max_offdiag = 0.0;
@@ -4611,6 +4725,7 @@ template<typename Real> static void MatrixUnitTest(bool full_test) {
   UnitTestComplexPower<Real>();
   UnitTestEig<Real>();
   UnitTestEigSp<Real>();
+  UnitTestEigSpPaths<Real>();
   // commenting these out for now-- they test the speed, but take a while.
   // UnitTestSplitRadixRealFftSpeed<Real>();
   // UnitTestRealFftSpeed<Real>();   // won't exit!/
@@ -4658,6 +4773,9 @@ template<typename Real> static void MatrixUnitTest(bool full_test) {
   UnitTestDeterminantSign<Real>();
   UnitTestSger<Real>();
   UnitTestAddOuterProductPlusMinus<Real>();
+  UnitTestApplyAffineTransformToRows<Real>();
+  UnitTestNormalizeRowLengths<Real>();
+  UnitTestAddRowDotProducts<Real>();
   UnitTestTraceProduct<Real>();
   UnitTestTransposeScatter<Real>();
   UnitTestRankNUpdate<Real>();
@@ -31,6 +31,7 @@
 #include "matrix/srfft.h"
 #include "matrix/compressed-matrix.h"
 #include "matrix/sparse-matrix.h"
+#include "matrix/csr-matrix.h"
 #include "matrix/optimization.h"
 
 #endif
@@ -18,6 +18,7 @@
 // limitations under the License.
 
 #include <limits>
+#include <vector>
 
 #include "matrix/sp-matrix.h"
 #include "matrix/kaldi-vector.h"
@@ -431,6 +432,16 @@ void SpMatrix<Real>::Qr(MatrixBase<Real> *Q) {
 
 template<typename Real>
 void SpMatrix<Real>::Eig(VectorBase<Real> *s, MatrixBase<Real> *P) const {
+#if !defined(HAVE_ATLAS) && !defined(USE_KALDI_EIG)
+  if (LapackEig(s, P)) return;
+  KALDI_WARN << "LAPACK eigenvalue decomposition failed to converge, "
+             << "falling back to the symmetric QR algorithm.";
+#endif
+  QrEig(s, P);
+}
+
+template<typename Real>
+void SpMatrix<Real>::QrEig(VectorBase<Real> *s, MatrixBase<Real> *P) const {
   MatrixIndexT dim = this->NumRows();
   KALDI_ASSERT(s->Dim() == dim);
   KALDI_ASSERT(P == NULL || (P->NumRows() == dim && P->NumCols() == dim));
@@ -449,6 +460,58 @@ void SpMatrix<Real>::Eig(VectorBase<Real> *s, MatrixBase<Real> *P) const {
   s->CopyDiagFromPacked(A);
 }
 
+#if !defined(HAVE_ATLAS) && !defined(USE_KALDI_EIG)
+template<typename Real>
+bool SpMatrix<Real>::LapackEig(VectorBase<Real> *s, MatrixBase<Real> *P) const {
+  MatrixIndexT dim = this->NumRows();
+  KALDI_ASSERT(s->Dim() == dim);
+  KALDI_ASSERT(P == NULL || (P->NumRows() == dim && P->NumCols() == dim));
+  if (dim == 0) return true;
+
+  // ?syevr destroys its input, so work on a full copy.  A symmetric matrix
+  // is the same in row-major and column-major order, so no transpose needed.
+  Matrix<Real> A(dim, dim, kUndefined);
+  A.CopyFromSp(*this);
+  Vector<Real> w(dim, kUndefined);
+  // LAPACK writes the eigenvectors as the columns of a column-major matrix,
+  // i.e. as the rows of our row-major one; like QrEig() we transpose at exit.
+  Matrix<Real> Z;
+  if (P == NULL) Z.Resize(1, 1);
+
+  KaldiBlasInt n = dim, a_stride = A.Stride(), il = 0, iu = 0,
+      num_found = 0, result = 0,
+      z_stride = (P == NULL ? 1 : P->Stride());
+  Real vl = 0.0, vu = 0.0,
+      abstol = 0.0;  // zero means LAPACK's default tolerance.
+  Real *z_data = (P == NULL ? Z.Data() : P->Data());
+  std::vector<KaldiBlasInt> isuppz(2 * dim);
+  char jobz = (P == NULL ? 'N' : 'V'), range = 'A', uplo = 'U';
+
+  // Workspace query.
+  KaldiBlasInt l_work = -1, l_iwork = -1, iwork_size = 0;
+  Real work_size = 0.0;
+  clapack_Xsyevr(&jobz, &range, &uplo, &n, A.Data(), &a_stride, &vl, &vu,
+                 &il, &iu, &abstol, &num_found, w.Data(), z_data, &z_stride,
+                 &(isuppz[0]), &work_size, &l_work, &iwork_size, &l_iwork,
+                 &result);
+  KALDI_ASSERT(result == 0 && "Call to CLAPACK ?syevr_ workspace query failed");
+  l_work = static_cast<KaldiBlasInt>(work_size);
+  l_iwork = iwork_size;
+  std::vector<Real> work(l_work);
+  std::vector<KaldiBlasInt> iwork(l_iwork);
+
+  clapack_Xsyevr(&jobz, &range, &uplo, &n, A.Data(), &a_stride, &vl, &vu,
+                 &il, &iu, &abstol, &num_found, w.Data(), z_data, &z_stride,
+                 &(isuppz[0]), &(work[0]), &l_work, &(iwork[0]), &l_iwork,
+                 &result);
+  KALDI_ASSERT(result >= 0 && "Call to CLAPACK ?syevr_ called with wrong arguments");
+  if (result != 0 || num_found != dim) return false;
+  s->CopyFromVec(w);
+  if (P != NULL) P->Transpose();
+  return true;
+}
+#endif
+
 
 template<typename Real>
 void SpMatrix<Real>::TopEigs(VectorBase<Real> *s, MatrixBase<Real> *P,
@@ -561,6 +624,18 @@ void SpMatrix<float>::Eig(VectorBase<float>*, MatrixBase<float>*) const;
 template
 void SpMatrix<double>::Eig(VectorBase<double>*, MatrixBase<double>*) const;
 
+template
+void SpMatrix<float>::QrEig(VectorBase<float>*, MatrixBase<float>*) const;
+template
+void SpMatrix<double>::QrEig(VectorBase<double>*, MatrixBase<double>*) const;
+
+#if !defined(HAVE_ATLAS) && !defined(USE_KALDI_EIG)
+template
+bool SpMatrix<float>::LapackEig(VectorBase<float>*, MatrixBase<float>*) const;
+template
+bool SpMatrix<double>::LapackEig(VectorBase<double>*, MatrixBase<double>*) const;
+#endif
+
 template
 void SpMatrix<float>::TopEigs(VectorBase<float>*, MatrixBase<float>*, MatrixIndexT) const;
 template
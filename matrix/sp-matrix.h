@@ -161,13 +161,27 @@ class SpMatrix : public PackedMatrix<Real> {
                         Real tolerance = 0.001) const;
 
   /// Solves the symmetric eigenvalue problem: at end we should have (*this) = P
-  /// * diag(s) * P^T.  We solve the problem using the symmetric QR method.
-  /// P may be NULL.
+  /// * diag(s) * P^T.  P may be NULL.  When LAPACK is available this calls
+  /// LapackEig() (blocked tridiagonalization followed by the MRRR algorithm);
+  /// otherwise, or if LAPACK fails, it uses the symmetric QR method (QrEig()).
   /// Implemented in qr.cc.
-  /// If you need the eigenvalues sorted, the function SortSvd declared in
-  /// kaldi-matrix is suitable.
+  /// The order of the eigenvalues is not specified.  If you need them sorted,
+  /// the function SortSvd declared in kaldi-matrix is suitable.
   void Eig(VectorBase<Real> *s, MatrixBase<Real> *P = NULL) const;
 
+  /// The in-tree eigensolver: Householder tridiagonalization followed by the
+  /// symmetric QR algorithm.  Same interface as Eig(); this is what Eig() uses
+  /// when LAPACK is not available.
+  void QrEig(VectorBase<Real> *s, MatrixBase<Real> *P = NULL) const;
+
+#if !defined(HAVE_ATLAS) && !defined(USE_KALDI_EIG)
+  // Should be private but used directly in testing routines.
+  /// Eigenvalue decomposition via LAPACK ?syevr.  Same interface as Eig(),
+  /// except that the eigenvalues come out in increasing order.  Returns false
+  /// (leaving s and P undefined) if LAPACK reports a convergence failure.
+  bool LapackEig(VectorBase<Real> *s, MatrixBase<Real> *P = NULL) const;
+#endif
+
   /// This function gives you, approximately, the largest eigenvalues of the
   /// symmetric matrix and the corresponding eigenvectors.  (largest meaning,
   /// further from zero).  It does this by doing a SVD within the Krylov
@@ -0,0 +1,187 @@
+// speaker_verification/batch_verifier.cc
+
+// Copyright (c) 2021 PeachLab. All Rights Reserved.
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <thread>
+
+#include "feat/wave-reader.h"
+#include "speaker_verification/batch_verifier.h"
+#include "util/kaldi-io.h"
+#include "util/kaldi-thread.h"
+
+namespace kaldi {
+
+namespace {
+
+// One worker of BatchVerifier::ExtractXvectors(); MultiThreader gives each
+// thread its own copy, and so its own frontend.
+class ExtractXvectorsTask: public MultiThreadable {
+ public:
+  ExtractXvectorsTask(const XvectorFrontendOptions &frontend_opts,
+                      const SpeakerModel *model,
+                      const BatchVerifier::WaveformLoader *loader,
+                      int32 num_utts, int32 batch_size,
+                      std::atomic<int32> *next_utt,
+                      std::atomic<int32> *num_xvectors,
+                      std::vector<Vector<BaseFloat> > *xvectors):
+      frontend_(frontend_opts), model_(model), loader_(loader),
+      num_utts_(num_utts), batch_size_(batch_size), next_utt_(next_utt),
+      num_xvectors_(num_xvectors), xvectors_(xvectors) { }
+
+  void operator() () {
+    std::vector<Matrix<BaseFloat> > features;
+    std::vector<Vector<BaseFloat> > batch_xvectors;
+    Vector<BaseFloat> waveform;
+    while (true) {
+      int32 begin = next_utt_->fetch_add(batch_size_);
+      if (begin >= num_utts_) break;
+      int32 end = std::min(begin + batch_size_, num_utts_);
+      features.resize(end - begin);
+      for (int32 utt = begin; utt < end; utt++) {
+        Matrix<BaseFloat> &utt_features = features[utt - begin];
+        BaseFloat sample_freq;
+        if ((*loader_)(utt, &waveform, &sample_freq))
+          frontend_.ComputeFeatures(waveform, sample_freq, &utt_features);
+        else
+          utt_features.Resize(0, 0);
+      }
+      *num_xvectors_ += model_->ExtractXvectors(features, &batch_xvectors);
+      for (int32 utt = begin; utt < end; utt++)
+        (*xvectors_)[utt].Swap(&batch_xvectors[utt - begin]);
+    }
+  }
+
+ private:
+  XvectorFrontend frontend_;
+  const SpeakerModel *model_;
+  const BatchVerifier::WaveformLoader *loader_;
+  int32 num_utts_;
+  int32 batch_size_;
+  std::atomic<int32> *next_utt_;
+  std::atomic<int32> *num_xvectors_;
+  std::vector<Vector<BaseFloat> > *xvectors_;
+};
+
+}  // namespace
+
+BatchVerifier::BatchVerifier(const BatchVerifierOptions &opts,
+                             const XvectorFrontendOptions &frontend_opts,
+                             std::shared_ptr<const SpeakerModel> model):
+    opts_(opts), frontend_opts_(frontend_opts), model_(model) {
+  KALDI_ASSERT(model_ != nullptr && opts_.num_threads >= 0 &&
+               opts_.batch_size > 0);
+}
+
+int32 BatchVerifier::NumThreads(int32 num_utts) const {
+  int32 num_threads = opts_.num_threads;
+  if (num_threads == 0)
+    num_threads = std::max<int32>(1, std::thread::hardware_concurrency());
+  int32 num_batches = (num_utts + opts_.batch_size - 1) / opts_.batch_size;
+  return std::max(1, std::min(num_threads, num_batches));
+}
+
+int32 BatchVerifier::ExtractXvectors(
+    int32 num_utts, const WaveformLoader &loader,
+    std::vector<Vector<BaseFloat> > *xvectors) const {
+  xvectors->clear();
+  xvectors->resize(num_utts);
+  if (num_utts == 0) return 0;
+  std::atomic<int32> next_utt(0), num_xvectors(0);
+  ExtractXvectorsTask task(frontend_opts_, model_.get(), &loader, num_utts,
+                           opts_.batch_size, &next_utt, &num_xvectors,
+                           xvectors);
+  {
+    MultiThreader<ExtractXvectorsTask> threader(NumThreads(num_utts), task);
+  }
+  return num_xvectors;
+}
+
+int32 BatchVerifier::ExtractXvectors(
+    const std::vector<SubVector<BaseFloat> > &waveforms,
+    BaseFloat sample_freq,
+    std::vector<Vector<BaseFloat> > *xvectors) const {
+  WaveformLoader loader = [&waveforms, sample_freq](
+      int32 utt, Vector<BaseFloat> *waveform, BaseFloat *utt_sample_freq) {
+    *waveform = waveforms[utt];
+    *utt_sample_freq = sample_freq;
+    return true;
+  };
+  return ExtractXvectors(waveforms.size(), loader, xvectors);
+}
+
+int32 BatchVerifier::ExtractXvectors(
+    const std::vector<std::string> &wav_filenames,
+    std::vector<Vector<BaseFloat> > *xvectors) const {
+  WaveformLoader loader = [&wav_filenames](
+      int32 utt, Vector<BaseFloat> *waveform, BaseFloat *sample_freq) {
+    Input input;
+    if (!input.Open(wav_filenames[utt])) {
+      KALDI_WARN << "Could not open wav file " << wav_filenames[utt];
+      return false;
+    }
+    try {
+      WaveData wave;
+      wave.Read(input.Stream());
+      waveform->Resize(wave.Data().NumCols(), kUndefined);
+      waveform->CopyRowFromMat(wave.Data(), 0);
+      *sample_freq = wave.SampFreq();
+      return true;
+    } catch (const std::exception &) {
+      KALDI_WARN << "Could not read wav file " << wav_filenames[utt];
+      return false;
+    }
+  };
+  return ExtractXvectors(wav_filenames.size(), loader, xvectors);
+}
+
+int32 BatchVerifier::ScoreXvectors(
+    const std::vector<Vector<BaseFloat> > &xvectors,
+    const SpeakerGallery &gallery, int32 speaker_id,
+    BaseFloat *scores) const {
+  std::vector<Vector<BaseFloat> > nonempty_xvectors;
+  std::vector<int32> utts;
+  for (size_t i = 0; i < xvectors.size(); i++) {
+    if (xvectors[i].Dim() != 0) {
+      nonempty_xvectors.push_back(xvectors[i]);
+      utts.push_back(i);
+    } else {
+      scores[i] = -std::numeric_limits<BaseFloat>::infinity();
+    }
+  }
+  Matrix<double> plda_inputs;
+  model_->XvectorsToPldaInputs(nonempty_xvectors, &plda_inputs);
+  Vector<double> utt_scores;
+  if (!gallery.ScoreSpeaker(speaker_id, plda_inputs, &utt_scores)) return -1;
+  for (size_t k = 0; k < utts.size(); k++)
+    scores[utts[k]] = utt_scores(k);
+  return utts.size();
+}
+
+int32 BatchVerifier::ComputeEnrollment(
+    const std::vector<Vector<BaseFloat> > &xvectors,
+    Vector<double> *plda_input) const {
+  std::vector<Vector<BaseFloat> > nonempty_xvectors;
+  for (size_t i = 0; i < xvectors.size(); i++)
+    if (xvectors[i].Dim() != 0) nonempty_xvectors.push_back(xvectors[i]);
+  return model_->XvectorsToPldaInput(nonempty_xvectors, plda_input);
+}
+
+}  // namespace kaldi
@@ -0,0 +1,117 @@
+// speaker_verification/batch_verifier.h
+
+// Copyright (c) 2021 PeachLab. All Rights Reserved.
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_SPEAKER_VERIFICATION_BATCH_VERIFIER_H_
+#define KALDI_SPEAKER_VERIFICATION_BATCH_VERIFIER_H_
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "base/kaldi-common.h"
+#include "frontend/frontend.h"
+#include "matrix/matrix-lib.h"
+#include "speaker_verification/speaker_service.h"
+#include "util/options-itf.h"
+
+namespace kaldi {
+
+struct BatchVerifierOptions {
+  int32 num_threads;
+  int32 batch_size;
+
+  BatchVerifierOptions(): num_threads(0), batch_size(16) { }
+
+  void Register(OptionsItf *opts) {
+    opts->Register("num-threads", &num_threads, "Number of worker threads; "
+                   "0 means one per core.");
+    opts->Register("batch-size", &batch_size, "Number of utterances a worker "
+                   "takes at a time and runs through the network together.");
+  }
+};
+
+/// BatchVerifier processes many utterances at once, for offline work such as
+/// re-verifying an archive.  Worker threads take batch_size utterances at a
+/// time from a shared counter; each worker loads them, runs its own copy of
+/// the frontend, and sends the batch through the network in one call
+/// (SpeakerModel::ExtractXvectors(), which gives each worker its own
+/// extractor).  BLAS is single-threaded inside the workers (see
+/// matrix/blas-threading.h), so the threads, not BLAS, use the cores.  The
+/// x-vectors are then transformed together with one GEMM and scored.
+class BatchVerifier {
+ public:
+  /// Called from the worker threads to get utterance "utt"; returns false if
+  /// it cannot be read, in which case the utterance gets no x-vector.
+  typedef std::function<bool(int32 utt, Vector<BaseFloat> *waveform,
+                             BaseFloat *sample_freq)> WaveformLoader;
+
+  BatchVerifier(const BatchVerifierOptions &opts,
+                const XvectorFrontendOptions &frontend_opts,
+                std::shared_ptr<const SpeakerModel> model);
+
+  /// Outputs one x-vector per utterance, empty for utterances that could not
+  /// be read or were too short (or silent) to give one.  Returns the number
+  /// of non-empty x-vectors.
+  int32 ExtractXvectors(int32 num_utts, const WaveformLoader &loader,
+                        std::vector<Vector<BaseFloat> > *xvectors) const;
+
+  /// As above, for waveforms in memory, all at "sample_freq" Hz.
+  int32 ExtractXvectors(const std::vector<SubVector<BaseFloat> > &waveforms,
+                        BaseFloat sample_freq,
+                        std::vector<Vector<BaseFloat> > *xvectors) const;
+
+  /// As above, for wav files (the first channel is used).
+  int32 ExtractXvectors(const std::vector<std::string> &wav_filenames,
+                        std::vector<Vector<BaseFloat> > *xvectors) const;
+
+  /// Sets scores[i] to the score of xvectors[i], taken as an utterance of
+  /// its own, against speaker "speaker_id" of "gallery", as
+  /// SpeakerGallery::Score() gives it (normalized if the gallery has a
+  /// cohort), with the test side for all utterances in one go.  Empty
+  /// x-vectors get -infinity.  Returns the number of utterances scored, or
+  /// -1 if the speaker is not enrolled.
+  int32 ScoreXvectors(const std::vector<Vector<BaseFloat> > &xvectors,
+                      const SpeakerGallery &gallery, int32 speaker_id,
+                      BaseFloat *scores) const;
+
+  /// Averages the non-empty x-vectors into one enrollment, as
+  /// SpeakerModel::XvectorsToPldaInput(); returns the number averaged.
+  int32 ComputeEnrollment(const std::vector<Vector<BaseFloat> > &xvectors,
+                          Vector<double> *plda_input) const;
+
+  /// The sampling rate the frontend expects.
+  BaseFloat SampleFrequency() const {
+    return frontend_opts_.mfcc_opts.frame_opts.samp_freq;
+  }
+
+  /// The number of worker threads used for "num_utts" utterances.
+  int32 NumThreads(int32 num_utts) const;
+
+ private:
+  BatchVerifierOptions opts_;
+  XvectorFrontendOptions frontend_opts_;
+  std::shared_ptr<const SpeakerModel> model_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(BatchVerifier);
+};
+
+}  // namespace kaldi
+
+#endif  // KALDI_SPEAKER_VERIFICATION_BATCH_VERIFIER_H_
@@ -0,0 +1,158 @@
+// speaker_verification/batch_verifier_benchmark.cc
+
+// Copyright (c) 2021 PeachLab. All Rights Reserved.
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+// Verification throughput of BatchVerifier against a loop that handles one
+// utterance at a time, as each VerifySpeaker() call does.
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <limits>
+#include <thread>
+
+#include "base/kaldi-common.h"
+#include "base/timer.h"
+#include "feat/wave-reader.h"
+#include "speaker_verification/batch_verifier.h"
+#include "speaker_verification/tflite_nnet_factory.h"
+#include "util/kaldi-io.h"
+#include "util/parse-options.h"
+
+namespace kaldi {
+
+static void ReadWaveform(const std::string &filename,
+                         Vector<BaseFloat> *waveform,
+                         BaseFloat *sample_freq) {
+  Input input(filename);
+  WaveData wave;
+  wave.Read(input.Stream());
+  waveform->Resize(wave.Data().NumCols(), kUndefined);
+  waveform->CopyRowFromMat(wave.Data(), 0);
+  *sample_freq = wave.SampFreq();
+}
+
+}  // namespace kaldi
+
+int main(int argc, char *argv[]) {
+  using namespace kaldi;
+  try {
+    const char *usage =
+        "Scores every wav file in a list against a speaker enrolled from the\n"
+        "first one, once utterance by utterance and then with BatchVerifier\n"
+        "on 1, 2, 4, ... threads, and prints the throughput of each.\n"
+        "<model-dir> holds final.raw, plda, transform.mat and mean.vec, as\n"
+        "for SpeakerVerificationInitModel().\n"
+        "Usage:  batch-verifier-benchmark [options] <model-dir> <wav-list>\n";
+    ParseOptions po(usage);
+    XvectorFrontendOptions frontend_opts;
+    int32 batch_size = 16, max_threads = 0;
+    frontend_opts.Register(&po);
+    po.Register("batch-size", &batch_size, "Utterances per worker batch.");
+    po.Register("max-threads", &max_threads, "Largest number of threads to "
+                "try; 0 means one per core.");
+    po.Read(argc, argv);
+    if (po.NumArgs() != 2) {
+      po.PrintUsage();
+      exit(1);
+    }
+    std::string model_dir = po.GetArg(1), wav_list = po.GetArg(2);
+    if (max_threads == 0)
+      max_threads = std::max<int32>(1, std::thread::hardware_concurrency());
+
+    Vector<BaseFloat> mean;
+    ReadKaldiObject(model_dir + "/mean.vec", &mean);
+    Matrix<BaseFloat> transform;
+    ReadKaldiObject(model_dir + "/transform.mat", &transform);
+    Plda plda;
+    ReadKaldiObject(model_dir + "/plda", &plda);
+    std::shared_ptr<const SpeakerModel> model(
+        new SpeakerModel(TFliteNnetFactory(model_dir + "/final.raw"), mean,
+                         transform, plda));
+
+    std::vector<std::string> wav_filenames;
+    {
+      std::ifstream is(wav_list.c_str());
+      std::string line;
+      while (std::getline(is, line))
+        if (!line.empty()) wav_filenames.push_back(line);
+    }
+    int32 num_utts = wav_filenames.size();
+    if (num_utts == 0) KALDI_ERR << "No wav files in " << wav_list;
+
+    // One utterance at a time.
+    XvectorFrontend frontend(frontend_opts);
+    Vector<BaseFloat> waveform;
+    BaseFloat sample_freq;
+    std::vector<Matrix<BaseFloat> > features(1);
+    std::vector<Vector<BaseFloat> > xvectors;
+    ReadWaveform(wav_filenames[0], &waveform, &sample_freq);
+    frontend.ComputeFeatures(waveform, sample_freq, &features[0]);
+    Vector<double> enroll_plda_input;
+    if (model->ExtractXvectors(features, &xvectors) == 0 ||
+        model->XvectorsToPldaInput(xvectors, &enroll_plda_input) == 0)
+      KALDI_ERR << wav_filenames[0] << " is too short to enroll from.";
+    SpeakerGallery gallery(plda);
+    int32 speaker_id = gallery.Enroll(-1, enroll_plda_input, 1);
+
+    std::vector<BaseFloat> loop_scores(num_utts);
+    Timer timer;
+    for (int32 utt = 0; utt < num_utts; utt++) {
+      ReadWaveform(wav_filenames[utt], &waveform, &sample_freq);
+      frontend.ComputeFeatures(waveform, sample_freq, &features[0]);
+      Vector<double> plda_input, scores;
+      if (model->ExtractXvectors(features, &xvectors) == 0 ||
+          model->XvectorsToPldaInput(xvectors, &plda_input) == 0) {
+        loop_scores[utt] = -std::numeric_limits<BaseFloat>::infinity();
+        continue;
+      }
+      gallery.Score(plda_input, &scores);
+      loop_scores[utt] = scores(0);
+    }
+    double loop_time = timer.Elapsed();
+    KALDI_LOG << "One at a time: " << num_utts / loop_time << " utt/s.";
+
+    std::vector<BaseFloat> batch_scores(num_utts);
+    for (int32 num_threads = 1; ; num_threads *= 2) {
+      num_threads = std::min(num_threads, max_threads);
+      BatchVerifierOptions opts;
+      opts.num_threads = num_threads;
+      opts.batch_size = batch_size;
+      BatchVerifier verifier(opts, frontend_opts, model);
+      timer.Reset();
+      verifier.ExtractXvectors(wav_filenames, &xvectors);
+      verifier.ScoreXvectors(xvectors, gallery, speaker_id,
+                             batch_scores.data());
+      double batch_time = timer.Elapsed();
+      double max_diff = 0.0;
+      for (int32 utt = 0; utt < num_utts; utt++)
+        if (loop_scores[utt] != batch_scores[utt])
+          max_diff = std::max<double>(max_diff, std::abs(loop_scores[utt] -
+                                                         batch_scores[utt]));
+      KALDI_LOG << "Batch, " << num_threads << " threads: "
+                << num_utts / batch_time << " utt/s, "
+                << loop_time / batch_time << " times the loop; largest score "
+                << "difference " << max_diff;
+      if (num_threads == max_threads) break;
+    }
+    return 0;
+  } catch(const std::exception &e) {
+    std::cerr << e.what();
+    return -1;
+  }
+}
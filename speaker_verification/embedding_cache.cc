@@ -0,0 +1,141 @@
+// speaker_verification/embedding_cache.cc
+
+// Copyright (c) 2021 PeachLab. All Rights Reserved.
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "speaker_verification/embedding_cache.h"
+#include "util/kaldi-io.h"
+
+namespace kaldi {
+
+bool HashModelFiles(const std::vector<std::string> &rxfilenames,
+                    uint64 *version) {
+  uint64 hash = 0;
+  std::vector<char> buffer(1 << 20);
+  for (size_t i = 0; i < rxfilenames.size(); i++) {
+    Input ki;
+    // Binary mode, and no Kaldi header is consumed: the bytes are hashed as
+    // they are on disk.
+    if (!ki.Open(rxfilenames[i])) {
+      KALDI_WARN << "Could not open " << PrintableRxfilename(rxfilenames[i])
+                 << " to hash it.";
+      return false;
+    }
+    std::istream &is = ki.Stream();
+    // Chained through the seed, so that the order of the files matters.
+    hash = HashBytes(NULL, 0, hash);
+    while (is.read(&(buffer[0]), buffer.size()) || is.gcount() > 0)
+      hash = HashBytes(&(buffer[0]), is.gcount(), hash);
+    if (is.bad()) {
+      KALDI_WARN << "Error reading " << PrintableRxfilename(rxfilenames[i]);
+      return false;
+    }
+  }
+  *version = hash;
+  return true;
+}
+
+EmbeddingCache::EmbeddingCache(const EmbeddingCacheOptions &opts):
+    shards_(std::max<int32>(std::min(opts.num_shards, opts.capacity), 1)) {
+  KALDI_ASSERT(opts.capacity >= 0);
+  // The remainder goes one each to the first shards, so that the shards
+  // hold "capacity" vectors in total and none (unless it is 0) holds none.
+  int32 num_shards = shards_.size();
+  for (int32 s = 0; s < num_shards; s++) {
+    shards_[s].capacity = opts.capacity / num_shards +
+        (s < opts.capacity % num_shards ? 1 : 0);
+  }
+}
+
+uint64 EmbeddingCache::Key(const void *pcm, size_t num_bytes,
+                           BaseFloat sample_freq, uint64 model_version) {
+  double freq = sample_freq;
+  uint64 seed = HashBytes(&freq, sizeof(freq), model_version);
+  return HashBytes(pcm, num_bytes, seed);
+}
+
+bool EmbeddingCache::Lookup(uint64 key, Vector<BaseFloat> *plda_input) {
+  Shard &shard = ShardOf(key);
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  std::unordered_map<uint64, std::list<Entry>::iterator>::iterator iter =
+      shard.index.find(key);
+  if (iter == shard.index.end()) {
+    shard.num_misses++;
+    return false;
+  }
+  shard.num_hits++;
+  shard.lru.splice(shard.lru.begin(), shard.lru, iter->second);
+  const Vector<BaseFloat> &cached = iter->second->plda_input;
+  plda_input->Resize(cached.Dim(), kUndefined);
+  plda_input->CopyFromVec(cached);
+  return true;
+}
+
+void EmbeddingCache::Insert(uint64 key,
+                            const VectorBase<BaseFloat> &plda_input) {
+  Shard &shard = ShardOf(key);
+  if (shard.capacity == 0) return;
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  std::unordered_map<uint64, std::list<Entry>::iterator>::iterator iter =
+      shard.index.find(key);
+  std::list<Entry>::iterator entry;
+  if (iter != shard.index.end()) {
+    // Another request computed the same utterance concurrently.
+    entry = iter->second;
+    shard.lru.splice(shard.lru.begin(), shard.lru, entry);
+  } else if (static_cast<int32>(shard.index.size()) < shard.capacity) {
+    shard.lru.push_front(Entry());
+    entry = shard.lru.begin();
+    shard.index[key] = entry;
+  } else {
+    // Reuse the least recently used node, and its vector's memory.
+    entry = --shard.lru.end();
+    shard.index.erase(entry->key);
+    shard.lru.splice(shard.lru.begin(), shard.lru, entry);
+    shard.index[key] = entry;
+    shard.num_evictions++;
+  }
+  shard.num_insertions++;
+  entry->key = key;
+  if (entry->plda_input.Dim() != plda_input.Dim())
+    entry->plda_input.Resize(plda_input.Dim(), kUndefined);
+  entry->plda_input.CopyFromVec(plda_input);
+}
+
+void EmbeddingCache::Clear() {
+  for (size_t s = 0; s < shards_.size(); s++) {
+    std::lock_guard<std::mutex> lock(shards_[s].mutex);
+    shards_[s].lru.clear();
+    shards_[s].index.clear();
+  }
+}
+
+EmbeddingCacheStats EmbeddingCache::Stats() const {
+  EmbeddingCacheStats stats;
+  for (size_t s = 0; s < shards_.size(); s++) {
+    const Shard &shard = shards_[s];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    stats.num_hits += shard.num_hits;
+    stats.num_misses += shard.num_misses;
+    stats.num_insertions += shard.num_insertions;
+    stats.num_evictions += shard.num_evictions;
+    stats.num_entries += shard.index.size();
+  }
+  return stats;
+}
+
+}  // namespace kaldi
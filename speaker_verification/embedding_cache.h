@@ -0,0 +1,144 @@
+// speaker_verification/embedding_cache.h
+
+// Copyright (c) 2021 PeachLab. All Rights Reserved.
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_SPEAKER_VERIFICATION_EMBEDDING_CACHE_H_
+#define KALDI_SPEAKER_VERIFICATION_EMBEDDING_CACHE_H_
+
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "base/kaldi-common.h"
+#include "matrix/matrix-lib.h"
+#include "speaker_verification/hash.h"
+#include "util/options-itf.h"
+
+namespace kaldi {
+
+/// The hash of the contents of each file in "rxfilenames", in order, for use
+/// as a model version: it changes whenever any of the model files does.
+/// Returns false (with a warning) if a file cannot be read.
+bool HashModelFiles(const std::vector<std::string> &rxfilenames,
+                    uint64 *version);
+
+struct EmbeddingCacheOptions {
+  int32 capacity;
+  int32 num_shards;
+
+  EmbeddingCacheOptions(): capacity(4096), num_shards(16) { }
+
+  void Register(OptionsItf *opts) {
+    opts->Register("cache-capacity", &capacity, "Largest number of test "
+                   "vectors kept by the embedding cache (0 disables it).");
+    opts->Register("cache-num-shards", &num_shards, "Number of independently "
+                   "locked parts the embedding cache is split into.");
+  }
+};
+
+struct EmbeddingCacheStats {
+  int64 num_hits;
+  int64 num_misses;
+  int64 num_insertions;
+  int64 num_evictions;
+  int32 num_entries;
+  EmbeddingCacheStats(): num_hits(0), num_misses(0), num_insertions(0),
+                         num_evictions(0), num_entries(0) { }
+  BaseFloat HitRate() const {
+    int64 num_lookups = num_hits + num_misses;
+    return num_lookups == 0 ? 0.0 : num_hits / static_cast<BaseFloat>(
+        num_lookups);
+  }
+};
+
+/// EmbeddingCache remembers the PLDA-ready test vector (the output of the
+/// x-vector post-processing, see CompiledXvectorTransform) of recent
+/// utterances, keyed by a hash of their PCM bytes and of the model version,
+/// so that a retried or repeated utterance skips the frontend, the network
+/// and the post-processing and only pays for the hash and the scoring.
+///
+/// Keys are 64-bit hashes: two different utterances of the same length get
+/// the same key with probability about 2^-64, which is far below anything
+/// else that can go wrong in scoring, so the audio is not kept to compare.
+///
+/// Eviction is least-recently-used.  The cache is split into shards by key,
+/// each with its own lock and LRU list, so concurrent requests rarely wait
+/// on each other; the lock is held only to move a list node and copy one
+/// vector.  Capacity is divided between the shards, which hold at most
+/// "capacity" vectors in total; there are no more shards than that.
+///
+/// This class is thread-safe.
+class EmbeddingCache {
+ public:
+  explicit EmbeddingCache(const EmbeddingCacheOptions &opts);
+
+  /// The key of "num_bytes" bytes of PCM audio at "sample_freq", for a
+  /// model whose version (see HashModelFiles()) is "model_version".
+  static uint64 Key(const void *pcm, size_t num_bytes, BaseFloat sample_freq,
+                    uint64 model_version);
+
+  /// If "key" is cached, copies its vector to "plda_input", marks it most
+  /// recently used and returns true.
+  bool Lookup(uint64 key, Vector<BaseFloat> *plda_input);
+
+  /// Caches "plda_input" under "key" (replacing any vector there), evicting
+  /// the least recently used vector of the shard if it is full.
+  void Insert(uint64 key, const VectorBase<BaseFloat> &plda_input);
+
+  /// Removes all vectors, e.g. when the model changes; the counters are
+  /// kept.
+  void Clear();
+
+  /// Counters since construction, summed over the shards.
+  EmbeddingCacheStats Stats() const;
+
+ private:
+  struct Entry {
+    uint64 key;
+    Vector<BaseFloat> plda_input;
+  };
+  struct Shard {
+    mutable std::mutex mutex;
+    /// Most recently used first.
+    std::list<Entry> lru;
+    std::unordered_map<uint64, std::list<Entry>::iterator> index;
+    int64 num_hits;
+    int64 num_misses;
+    int64 num_insertions;
+    int64 num_evictions;
+    int32 capacity;
+    Shard(): num_hits(0), num_misses(0), num_insertions(0),
+             num_evictions(0), capacity(0) { }
+  };
+
+  Shard &ShardOf(uint64 key) {
+    // The low bits pick the bucket inside the shard's hash map, so the
+    // shard is taken from the high bits.
+    return shards_[(key >> 40) % shards_.size()];
+  }
+
+  std::vector<Shard> shards_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(EmbeddingCache);
+};
+
+}  // namespace kaldi
+
+#endif  // KALDI_SPEAKER_VERIFICATION_EMBEDDING_CACHE_H_
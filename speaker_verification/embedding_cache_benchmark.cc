@@ -0,0 +1,172 @@
+// speaker_verification/embedding_cache_benchmark.cc
+
+// Copyright (c) 2021 PeachLab. All Rights Reserved.
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+// Cost of a cache hit (hashing the audio and copying the vector out) and
+// hit rate of EmbeddingCache on a synthetic stream of requests in which some
+// are retries of recent ones, from several threads at once.
+
+#include <algorithm>
+#include <thread>
+
+#include "base/kaldi-common.h"
+#include "base/timer.h"
+#include "speaker_verification/embedding_cache.h"
+#include "util/parse-options.h"
+
+namespace kaldi {
+
+struct RequestStream {
+  int32 num_requests;
+  int32 retry_window;
+  BaseFloat retry_prob;
+};
+
+// Runs "stream" against "cache" with utterances of "utt" (whose first 8
+// bytes are overwritten with the utterance number); a miss "extracts" by
+// filling a vector.  Returns the number of misses.
+static int64 RunRequests(const RequestStream &stream, int32 thread_index,
+                         int32 dim, std::vector<int16> utt,
+                         EmbeddingCache *cache) {
+  struct RandomState rand_state;
+  rand_state.seed = 17 + thread_index;
+  int64 next_utt = static_cast<int64>(thread_index) << 40, num_misses = 0;
+  Vector<BaseFloat> plda_input(dim);
+  for (int32 r = 0; r < stream.num_requests; r++) {
+    int64 utt_id = next_utt;
+    if (next_utt != (static_cast<int64>(thread_index) << 40) &&
+        RandUniform(&rand_state) < stream.retry_prob) {
+      int64 back = RandInt(1, stream.retry_window, &rand_state);
+      utt_id = std::max(next_utt - back,
+                        static_cast<int64>(thread_index) << 40);
+    } else {
+      next_utt++;
+    }
+    std::copy(reinterpret_cast<const int16*>(&utt_id),
+              reinterpret_cast<const int16*>(&utt_id) + 4, utt.begin());
+    uint64 key = EmbeddingCache::Key(&(utt[0]), utt.size() * sizeof(int16),
+                                     16000, 1);
+    if (!cache->Lookup(key, &plda_input)) {
+      num_misses++;
+      plda_input.Set(utt_id);
+      cache->Insert(key, plda_input);
+    } else {
+      KALDI_ASSERT(plda_input(0) == static_cast<BaseFloat>(utt_id));
+    }
+  }
+  return num_misses;
+}
+
+}  // namespace kaldi
+
+int main(int argc, char *argv[]) {
+  using namespace kaldi;
+  try {
+    const char *usage =
+        "Measures the cost of hashing utterances and of EmbeddingCache\n"
+        "look-ups, and the hit rate on a stream of requests with retries.\n"
+        "Usage:  embedding-cache-benchmark [options]\n";
+    ParseOptions po(usage);
+    EmbeddingCacheOptions cache_opts;
+    RequestStream stream;
+    stream.num_requests = 200000;
+    stream.retry_window = 1000;
+    stream.retry_prob = 0.2;
+    int32 dim = 128, num_threads = 4;
+    BaseFloat utt_seconds = 5.0;
+    cache_opts.Register(&po);
+    po.Register("dim", &dim, "Dimension of the cached PLDA inputs.");
+    po.Register("num-threads", &num_threads, "Number of threads sending "
+                "requests.");
+    po.Register("num-requests", &stream.num_requests, "Requests per thread.");
+    po.Register("retry-prob", &stream.retry_prob, "Probability that a "
+                "request repeats one of the thread's recent utterances.");
+    po.Register("retry-window", &stream.retry_window, "Retries repeat one of "
+                "this many most recent utterances.");
+    po.Register("utt-seconds", &utt_seconds, "Length of the utterances (16 "
+                "kHz, 16 bits).");
+    po.Read(argc, argv);
+    if (po.NumArgs() != 0) {
+      po.PrintUsage();
+      exit(1);
+    }
+
+    std::vector<int16> utt(static_cast<size_t>(utt_seconds * 16000));
+    for (size_t i = 0; i < utt.size(); i++)
+      utt[i] = RandInt(-32768, 32767);
+    size_t num_bytes = utt.size() * sizeof(int16);
+    Timer timer;
+    int32 num_hashes = std::max<int32>(1, (1 << 30) / num_bytes);
+    uint64 sum = 0;
+    for (int32 i = 0; i < num_hashes; i++)
+      sum += HashBytes(&(utt[0]), num_bytes, i);
+    double hash_time = timer.Elapsed() / num_hashes;
+    KALDI_LOG << "Hashing a " << utt_seconds << " s utterance: "
+              << 1.0e+06 * hash_time << " us ("
+              << num_bytes / hash_time * 1.0e-09 << " GB/s).";
+    KALDI_VLOG(2) << "Checksum " << sum;
+
+    if (cache_opts.capacity > 0) {
+      // Hit cost on its own: every request is for the same utterance.
+      EmbeddingCache hit_cache(cache_opts);
+      Vector<BaseFloat> plda_input(dim);
+      uint64 key = EmbeddingCache::Key(&(utt[0]), num_bytes, 16000, 1);
+      hit_cache.Insert(key, plda_input);
+      timer.Reset();
+      for (int32 i = 0; i < num_hashes; i++) {
+        key = EmbeddingCache::Key(&(utt[0]), num_bytes, 16000, 1);
+        if (!hit_cache.Lookup(key, &plda_input))
+          KALDI_ERR << "Lost the entry.";
+      }
+      KALDI_LOG << "Cache hit (hash and look-up): "
+                << 1.0e+06 * timer.Elapsed() / num_hashes << " us.";
+    }
+
+    EmbeddingCache cache(cache_opts);
+
+    std::vector<int64> num_misses(num_threads);
+    std::vector<std::thread> threads;
+    timer.Reset();
+    for (int32 t = 0; t < num_threads; t++)
+      threads.push_back(std::thread([&, t]() {
+        num_misses[t] = RunRequests(stream, t, dim, utt, &cache);
+      }));
+    for (int32 t = 0; t < num_threads; t++)
+      threads[t].join();
+    double run_time = timer.Elapsed();
+    EmbeddingCacheStats stats = cache.Stats();
+    int64 total_requests = static_cast<int64>(num_threads) *
+        stream.num_requests;
+    int64 total_misses = 0;
+    for (int32 t = 0; t < num_threads; t++)
+      total_misses += num_misses[t];
+    KALDI_ASSERT(total_misses == stats.num_misses);
+    KALDI_LOG << num_threads << " threads, " << total_requests
+              << " requests (" << 100.0 * stream.retry_prob
+              << "% retries of the last " << stream.retry_window << "), "
+              << "capacity " << cache_opts.capacity << " in "
+              << cache_opts.num_shards << " shards: hit rate "
+              << 100.0 * stats.HitRate() << "%, " << stats.num_evictions
+              << " evictions, " << 1.0e+06 * run_time / total_requests
+              << " us per request.";
+    return 0;
+  } catch(const std::exception &e) {
+    std::cerr << e.what();
+    return -1;
+  }
+}
@@ -0,0 +1,91 @@
+// speaker_verification/extractor_pool.cc
+
+// Copyright (c) 2021 PeachLab. All Rights Reserved.
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <utility>
+
+#include "speaker_verification/extractor_pool.h"
+
+namespace kaldi {
+
+ExtractorPool::ExtractorPool(const NnetComputerFactory &nnet_factory,
+                             const XvectorExtractorOptions &opts,
+                             int32 max_extractors):
+    nnet_factory_(nnet_factory), opts_(opts), max_extractors_(max_extractors),
+    num_extractors_(0) {
+  KALDI_ASSERT(nnet_factory_ && max_extractors_ >= 0);
+}
+
+std::unique_ptr<XvectorExtractor> ExtractorPool::Acquire() {
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    released_.wait(lock, [this]() {
+      return !idle_.empty() || max_extractors_ == 0 ||
+          num_extractors_ < max_extractors_;
+    });
+    if (!idle_.empty()) {
+      std::unique_ptr<XvectorExtractor> extractor = std::move(idle_.back());
+      idle_.pop_back();
+      return extractor;
+    }
+    num_extractors_++;
+  }
+  // Loading the network is slow, so it is done outside the lock.
+  try {
+    return std::unique_ptr<XvectorExtractor>(
+        new XvectorExtractor(nnet_factory_(), opts_));
+  } catch (...) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    num_extractors_--;
+    released_.notify_one();
+    throw;
+  }
+}
+
+void ExtractorPool::Release(std::unique_ptr<XvectorExtractor> extractor) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (max_extractors_ != 0 && num_extractors_ > max_extractors_) {
+      num_extractors_--;
+      extractor.reset();
+    } else {
+      idle_.push_back(std::move(extractor));
+    }
+  }
+  released_.notify_one();
+}
+
+void ExtractorPool::SetMaxExtractors(int32 max_extractors) {
+  KALDI_ASSERT(max_extractors >= 0);
+  std::lock_guard<std::mutex> lock(mutex_);
+  max_extractors_ = max_extractors;
+  while (max_extractors_ != 0 && num_extractors_ > max_extractors_ &&
+         !idle_.empty()) {
+    idle_.pop_back();
+    num_extractors_--;
+  }
+  released_.notify_all();
+}
+
+int32 ExtractorPool::NumExtractors() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return num_extractors_;
+}
+
+}  // namespace kaldi
@@ -0,0 +1,73 @@
+// speaker_verification/extractor_pool.h
+
+// Copyright (c) 2021 PeachLab. All Rights Reserved.
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef KALDI_SPEAKER_VERIFICATION_EXTRACTOR_POOL_H_
+#define KALDI_SPEAKER_VERIFICATION_EXTRACTOR_POOL_H_
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "base/kaldi-common.h"
+#include "speaker_verification/nnet_computer_factory.h"
+#include "speaker_verification/xvector_extractor.h"
+
+namespace kaldi {
+
+/// Replicas of one network for the threads that share it.  The network's
+/// interpreter keeps per-call state, so each call borrows an extractor of
+/// its own; idle ones are kept for later calls.  Thread-safe.
+class ExtractorPool {
+ public:
+  /// A replica, with a backend from "nnet_factory", is created when all
+  /// are in use.  At most "max_extractors" exist at a time (0 for no
+  /// limit): Acquire() waits for one to be released past that.
+  ExtractorPool(const NnetComputerFactory &nnet_factory,
+                const XvectorExtractorOptions &opts,
+                int32 max_extractors = 0);
+
+  const XvectorExtractorOptions &Options() const { return opts_; }
+
+  std::unique_ptr<XvectorExtractor> Acquire();
+  void Release(std::unique_ptr<XvectorExtractor> extractor);
+
+  /// Changes the limit; replicas already created past it are dropped as
+  /// they are released.
+  void SetMaxExtractors(int32 max_extractors);
+
+  /// Number of replicas created and not dropped.
+  int32 NumExtractors() const;
+
+ private:
+  NnetComputerFactory nnet_factory_;
+  XvectorExtractorOptions opts_;
+  mutable std::mutex mutex_;
+  std::condition_variable released_;
+  int32 max_extractors_;
+  int32 num_extractors_;
+  std::vector<std::unique_ptr<XvectorExtractor> > idle_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(ExtractorPool);
+};
+
+}  // namespace kaldi
+
+#endif  // KALDI_SPEAKER_VERIFICATION_EXTRACTOR_POOL_H_
@@ -0,0 +1,99 @@
+// speaker_verification/hash.cc
+
+// Copyright (c) 2021 PeachLab. All Rights Reserved.
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cstring>
+
+#include "speaker_verification/hash.h"
+
+namespace kaldi {
+
+static const uint64 kPrime1 = 11400714785074694791ULL;
+static const uint64 kPrime2 = 14029467366897019727ULL;
+static const uint64 kPrime3 = 1609587929392839161ULL;
+static const uint64 kPrime4 = 9650029242287828579ULL;
+static const uint64 kPrime5 = 2870177450012600261ULL;
+
+static inline uint64 RotateLeft(uint64 x, int r) {
+  return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64 Read64(const uint8 *p) {
+  uint64 x;
+  std::memcpy(&x, p, sizeof(x));
+  return x;
+}
+
+static inline uint32 Read32(const uint8 *p) {
+  uint32 x;
+  std::memcpy(&x, p, sizeof(x));
+  return x;
+}
+
+static inline uint64 Round(uint64 acc, uint64 input) {
+  acc += input * kPrime2;
+  return RotateLeft(acc, 31) * kPrime1;
+}
+
+static inline uint64 MergeRound(uint64 acc, uint64 val) {
+  acc ^= Round(0, val);
+  return acc * kPrime1 + kPrime4;
+}
+
+uint64 HashBytes(const void *data, size_t size, uint64 seed) {
+  const uint8 *p = static_cast<const uint8*>(data), *end = p + size;
+  uint64 hash;
+  if (size >= 32) {
+    // Four independent lanes of 8 bytes, so the multiplies overlap.
+    uint64 v1 = seed + kPrime1 + kPrime2, v2 = seed + kPrime2, v3 = seed,
+        v4 = seed - kPrime1;
+    const uint8 *limit = end - 32;
+    do {
+      v1 = Round(v1, Read64(p));
+      v2 = Round(v2, Read64(p + 8));
+      v3 = Round(v3, Read64(p + 16));
+      v4 = Round(v4, Read64(p + 24));
+      p += 32;
+    } while (p <= limit);
+    hash = RotateLeft(v1, 1) + RotateLeft(v2, 7) + RotateLeft(v3, 12) +
+        RotateLeft(v4, 18);
+    hash = MergeRound(hash, v1);
+    hash = MergeRound(hash, v2);
+    hash = MergeRound(hash, v3);
+    hash = MergeRound(hash, v4);
+  } else {
+    hash = seed + kPrime5;
+  }
+  hash += static_cast<uint64>(size);
+  for (; p + 8 <= end; p += 8)
+    hash = RotateLeft(hash ^ Round(0, Read64(p)), 27) * kPrime1 + kPrime4;
+  if (p + 4 <= end) {
+    hash = RotateLeft(hash ^ (Read32(p) * kPrime1), 23) * kPrime2 + kPrime3;
+    p += 4;
+  }
+  for (; p < end; p++)
+    hash = RotateLeft(hash ^ (*p * kPrime5), 11) * kPrime1;
+  hash ^= hash >> 33;
+  hash *= kPrime2;
+  hash ^= hash >> 29;
+  hash *= kPrime3;
+  hash ^= hash >> 32;
+  return hash;
+}
+
+}  // namespace kaldi
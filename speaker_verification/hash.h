@@ -0,0 +1,36 @@
+// speaker_verification/hash.h
+
+// Copyright (c) 2021 PeachLab. All Rights Reserved.
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_SPEAKER_VERIFICATION_HASH_H_
+#define KALDI_SPEAKER_VERIFICATION_HASH_H_
+
+#include <cstddef>
+
+#include "base/kaldi-types.h"
+
+namespace kaldi {
+
+/// A 64-bit hash of "size" bytes (the xxHash64 algorithm), fast enough
+/// (several GB/s) that hashing an utterance or a model costs next to nothing
+/// beside what is done with it.  Not meant to resist deliberate collisions.
+uint64 HashBytes(const void *data, size_t size, uint64 seed = 0);
+
+}  // namespace kaldi
+
+#endif  // KALDI_SPEAKER_VERIFICATION_HASH_H_
@@ -0,0 +1,89 @@
+// speaker_verification/kmeans.cc
+
+// Copyright (c) 2021 PeachLab. All Rights Reserved.
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+
+#include "speaker_verification/kmeans.h"
+
+namespace kaldi {
+
+// Rows of data are processed in blocks of this many when computing the
+// distances to a set of centroids, to bound the size of the temporary.
+static const int32 kAssignBlockRows = 1024;
+
+void AssignToCentroids(const MatrixBase<double> &data,
+                       const MatrixBase<double> &centroids,
+                       const VectorBase<double> &half_norms,
+                       std::vector<int32> *assignment) {
+  int32 num_rows = data.NumRows(), num_clusters = centroids.NumRows();
+  assignment->resize(num_rows);
+  Matrix<double> dots;
+  for (int32 start = 0; start < num_rows; start += kAssignBlockRows) {
+    int32 block = std::min(kAssignBlockRows, num_rows - start);
+    // The nearest centroid maximizes x.c - 0.5 |c|^2.
+    dots.Resize(block, num_clusters, kUndefined);
+    dots.CopyRowsFromVec(half_norms);
+    dots.AddMatMat(1.0, data.RowRange(start, block), kNoTrans,
+                   centroids, kTrans, -1.0);
+    for (int32 r = 0; r < block; r++) {
+      const double *row = dots.RowData(r);
+      (*assignment)[start + r] =
+          std::max_element(row, row + num_clusters) - row;
+    }
+  }
+}
+
+void ComputeHalfNorms(const MatrixBase<double> &centroids,
+                      Vector<double> *half_norms) {
+  half_norms->Resize(centroids.NumRows(), kUndefined);
+  half_norms->AddDiagMat2(0.5, centroids, kNoTrans, 0.0);
+}
+
+void KMeans(const MatrixBase<double> &data, int32 num_clusters,
+            int32 num_iters, Matrix<double> *centroids) {
+  int32 num_rows = data.NumRows(), dim = data.NumCols();
+  KALDI_ASSERT(num_clusters > 0 && num_clusters <= num_rows);
+  centroids->Resize(num_clusters, dim, kUndefined);
+  std::vector<int32> rows(num_rows);
+  for (int32 i = 0; i < num_rows; i++) rows[i] = i;
+  for (int32 k = 0; k < num_clusters; k++) {
+    std::swap(rows[k], rows[RandInt(k, num_rows - 1)]);
+    centroids->Row(k).CopyFromVec(data.Row(rows[k]));
+  }
+  Vector<double> half_norms, counts(num_clusters);
+  std::vector<int32> assignment;
+  for (int32 iter = 0; iter < num_iters; iter++) {
+    ComputeHalfNorms(*centroids, &half_norms);
+    AssignToCentroids(data, *centroids, half_norms, &assignment);
+    centroids->SetZero();
+    counts.SetZero();
+    for (int32 i = 0; i < num_rows; i++) {
+      centroids->Row(assignment[i]).AddVec(1.0, data.Row(i));
+      counts(assignment[i]) += 1.0;
+    }
+    for (int32 k = 0; k < num_clusters; k++) {
+      if (counts(k) == 0.0)
+        centroids->Row(k).CopyFromVec(data.Row(RandInt(0, num_rows - 1)));
+      else
+        centroids->Row(k).Scale(1.0 / counts(k));
+    }
+  }
+}
+
+}  // namespace kaldi
@@ -0,0 +1,48 @@
+// speaker_verification/kmeans.h
+
+// Copyright (c) 2021 PeachLab. All Rights Reserved.
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_SPEAKER_VERIFICATION_KMEANS_H_
+#define KALDI_SPEAKER_VERIFICATION_KMEANS_H_
+
+#include <vector>
+
+#include "base/kaldi-common.h"
+#include "matrix/matrix-lib.h"
+
+namespace kaldi {
+
+/// Sets (*assignment)[i] to the index of the centroid nearest (in Euclidean
+/// distance) to row i of "data".  half_norms(k) must be 0.5 * |centroid k|^2.
+void AssignToCentroids(const MatrixBase<double> &data,
+                       const MatrixBase<double> &centroids,
+                       const VectorBase<double> &half_norms,
+                       std::vector<int32> *assignment);
+
+/// Sets (*half_norms)(k) to 0.5 * |row k of centroids|^2.
+void ComputeHalfNorms(const MatrixBase<double> &centroids,
+                      Vector<double> *half_norms);
+
+/// Plain k-means (Lloyd's algorithm) on the rows of "data", initialized from
+/// randomly chosen rows.  Empty clusters are re-seeded with a random row.
+void KMeans(const MatrixBase<double> &data, int32 num_clusters,
+            int32 num_iters, Matrix<double> *centroids);
+
+}  // namespace kaldi
+
+#endif  // KALDI_SPEAKER_VERIFICATION_KMEANS_H_
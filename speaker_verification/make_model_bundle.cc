@@ -0,0 +1,119 @@
+// speaker_verification/make_model_bundle.cc
+
+// Copyright (c) 2021 PeachLab. All Rights Reserved.
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <fstream>
+#include <sstream>
+
+#include "base/kaldi-common.h"
+#include "speaker_verification/model_bundle.h"
+#include "speaker_verification/xvector_transform.h"
+#include "util/common-utils.h"
+
+namespace kaldi {
+
+// Returns the contents of "filename" (a plain file, as the network backend
+// itself only reads plain files).
+static std::string ReadWholeFile(const std::string &filename) {
+  std::ifstream is(filename.c_str(), std::ios::binary);
+  if (!is.good())
+    KALDI_ERR << "Could not open " << filename;
+  std::ostringstream os;
+  os << is.rdbuf();
+  if (is.bad())
+    KALDI_ERR << "Error reading " << filename;
+  return os.str();
+}
+
+}  // namespace kaldi
+
+int main(int argc, char *argv[]) {
+  using namespace kaldi;
+  try {
+    const char *usage =
+        "Writes a speaker-verification model as one memory-mappable,\n"
+        "checksummed bundle: the network, the mean, LDA and PLDA transforms\n"
+        "merged into one compiled transform, the PLDA model, the decision\n"
+        "threshold and (optionally) the frontend options.\n"
+        "Usage:  make-model-bundle [options] <nnet-file> <mean-rxfilename> "
+        "<transform-rxfilename> <plda-rxfilename> <bundle-out>\n"
+        "e.g.: make-model-bundle --threshold=-2.5 --frontend-config=conf/"
+        "frontend.conf final.raw mean.vec transform.mat plda model.bundle\n";
+    ParseOptions po(usage);
+    PldaConfig plda_config;
+    float threshold = 0.0;
+    bool normalize_lda_length = true;
+    std::string frontend_config;
+    plda_config.Register(&po);
+    po.Register("threshold", &threshold, "Decision threshold on the "
+                "verification score.");
+    po.Register("normalize-lda-length", &normalize_lda_length, "Length-"
+                "normalize the x-vectors after LDA, before PLDA.");
+    po.Register("frontend-config", &frontend_config, "File of frontend "
+                "options (--name=value lines, as for --config) to store; "
+                "by default the loader uses the built-in defaults.");
+    po.Read(argc, argv);
+    if (po.NumArgs() != 5) {
+      po.PrintUsage();
+      exit(1);
+    }
+    std::string nnet_filename = po.GetArg(1),
+        mean_rxfilename = po.GetArg(2),
+        transform_rxfilename = po.GetArg(3),
+        plda_rxfilename = po.GetArg(4),
+        bundle_wxfilename = po.GetArg(5);
+
+    Vector<BaseFloat> mean;
+    ReadKaldiObject(mean_rxfilename, &mean);
+    Matrix<BaseFloat> transform;
+    ReadKaldiObject(transform_rxfilename, &transform);
+    Plda plda;
+    ReadKaldiObject(plda_rxfilename, &plda);
+    // Stored in double; float loaders convert when reading.
+    CompiledXvectorTransform<double> xvector_transform;
+    xvector_transform.Compile(mean, transform, normalize_lda_length, plda,
+                              plda_config);
+
+    ModelBundleWriter writer;
+    writer.AddSection(kBundleNnet, ReadWholeFile(nnet_filename));
+    writer.AddObject(kBundleXvectorTransform, xvector_transform);
+    writer.AddObject(kBundlePlda, plda);
+    {
+      std::ostringstream os;
+      WriteBasicType(os, true, threshold);
+      writer.AddSection(kBundleThreshold, os.str());
+    }
+    if (!frontend_config.empty())
+      writer.AddSection(kBundleFrontendConfig,
+                        ReadWholeFile(frontend_config));
+    if (!writer.Write(bundle_wxfilename))
+      KALDI_ERR << "Could not write " << bundle_wxfilename;
+
+    ModelBundle bundle;
+    if (!bundle.Open(bundle_wxfilename))
+      KALDI_ERR << "Could not read back " << bundle_wxfilename;
+    KALDI_LOG << "Wrote model bundle " << bundle_wxfilename << " (model "
+              << "version " << std::hex << bundle.ContentHash() << std::dec
+              << ") from " << nnet_filename << ", " << mean_rxfilename
+              << ", " << transform_rxfilename << " and " << plda_rxfilename;
+    return 0;
+  } catch(const std::exception &e) {
+    std::cerr << e.what();
+    return -1;
+  }
+}
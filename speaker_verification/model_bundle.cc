@@ -0,0 +1,270 @@
+// speaker_verification/model_bundle.cc
+
+// Copyright (c) 2021 PeachLab. All Rights Reserved.
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#include "speaker_verification/hash.h"
+#include "speaker_verification/model_bundle.h"
+
+namespace kaldi {
+
+static const char kModelBundleMagic[8] = { 'K', 'S', 'V', 'B', 'U', 'N',
+                                           'D', 'L' };
+static const uint32 kModelBundleFormat = 1;
+static const size_t kModelBundleAlignment = 64;
+static const size_t kMaxSectionName = 32;
+
+struct ModelBundle::Header {
+  char magic[8];
+  uint32 format;
+  uint32 num_sections;
+  uint64 file_size;
+  uint64 table_checksum;  // of the section table.
+  char padding[32];
+};
+
+struct ModelBundle::SectionEntry {
+  char name[kMaxSectionName];  // NUL-terminated.
+  uint64 offset;
+  uint64 size;
+  uint64 checksum;  // HashBytes() of the section.
+  uint64 reserved;
+};
+
+static size_t RoundUpToAlignment(size_t size) {
+  return (size + kModelBundleAlignment - 1) / kModelBundleAlignment *
+      kModelBundleAlignment;
+}
+
+void ModelBundleWriter::AddSection(const std::string &name,
+                                   const std::string &data) {
+  KALDI_ASSERT(!name.empty() && name.size() < kMaxSectionName);
+  for (size_t i = 0; i < names_.size(); i++)
+    KALDI_ASSERT(names_[i] != name && "Duplicate section in model bundle.");
+  names_.push_back(name);
+  sections_.push_back(data);
+}
+
+bool ModelBundleWriter::Write(const std::string &filename) const {
+  KALDI_ASSERT(sizeof(ModelBundle::Header) == kModelBundleAlignment);
+  int32 num_sections = names_.size();
+  std::vector<ModelBundle::SectionEntry> table(num_sections);
+  size_t offset = RoundUpToAlignment(
+      sizeof(ModelBundle::Header) +
+      num_sections * sizeof(ModelBundle::SectionEntry));
+  for (int32 i = 0; i < num_sections; i++) {
+    memset(&(table[i]), 0, sizeof(table[i]));
+    memcpy(table[i].name, names_[i].c_str(), names_[i].size());
+    table[i].offset = offset;
+    table[i].size = sections_[i].size();
+    table[i].checksum = HashBytes(sections_[i].data(), sections_[i].size());
+    offset = RoundUpToAlignment(offset + sections_[i].size());
+  }
+  ModelBundle::Header header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, kModelBundleMagic, sizeof(header.magic));
+  header.format = kModelBundleFormat;
+  header.num_sections = num_sections;
+  header.file_size = offset;
+  header.table_checksum = HashBytes(table.data(),
+                                    table.size() * sizeof(table[0]));
+
+  std::string tmp_filename = filename + ".tmp";
+  {
+    std::ofstream os(tmp_filename.c_str(), std::ios::binary);
+    os.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    os.write(reinterpret_cast<const char*>(table.data()),
+             table.size() * sizeof(table[0]));
+    const char zeros[kModelBundleAlignment] = { 0 };
+    size_t written = sizeof(header) + table.size() * sizeof(table[0]);
+    for (int32 i = 0; i < num_sections; i++) {
+      os.write(zeros, table[i].offset - written);
+      os.write(sections_[i].data(), sections_[i].size());
+      written = table[i].offset + table[i].size;
+    }
+    os.write(zeros, header.file_size - written);
+    os.flush();
+    if (!os.good()) {
+      KALDI_WARN << "Could not write model bundle " << tmp_filename;
+      unlink(tmp_filename.c_str());
+      return false;
+    }
+  }
+  if (rename(tmp_filename.c_str(), filename.c_str()) != 0) {
+    KALDI_WARN << "Could not rename " << tmp_filename << " to " << filename
+               << ": " << strerror(errno);
+    unlink(tmp_filename.c_str());
+    return false;
+  }
+  return true;
+}
+
+ModelBundle::ModelBundle(): data_(NULL), size_(0) { }
+
+void ModelBundle::Close() {
+  if (data_ != NULL) munmap(data_, size_);
+  data_ = NULL;
+  size_ = 0;
+}
+
+const ModelBundle::Header *ModelBundle::GetHeader() const {
+  return reinterpret_cast<const Header*>(data_);
+}
+
+bool ModelBundle::IsBundleFile(const std::string &filename) {
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0) return false;
+  char magic[sizeof(kModelBundleMagic)];
+  bool ans = (read(fd, magic, sizeof(magic)) == sizeof(magic) &&
+              memcmp(magic, kModelBundleMagic, sizeof(magic)) == 0);
+  close(fd);
+  return ans;
+}
+
+bool ModelBundle::Open(const std::string &filename, bool verify_checksums) {
+  Close();
+  filename_ = filename;
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0) {
+    KALDI_WARN << "Could not open model bundle " << filename << ": "
+               << strerror(errno);
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    KALDI_WARN << "Could not stat " << filename << ": " << strerror(errno);
+    close(fd);
+    return false;
+  }
+  if (static_cast<size_t>(st.st_size) < sizeof(Header)) {
+    KALDI_WARN << "Model bundle " << filename << " is truncated.";
+    close(fd);
+    return false;
+  }
+  void *data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);  // The mapping keeps the file open.
+  if (data == MAP_FAILED) {
+    KALDI_WARN << "Could not mmap " << filename << ": " << strerror(errno);
+    return false;
+  }
+  data_ = static_cast<char*>(data);
+  size_ = st.st_size;
+
+  const Header *header = GetHeader();
+  if (memcmp(header->magic, kModelBundleMagic, sizeof(header->magic)) != 0 ||
+      header->format != kModelBundleFormat) {
+    KALDI_WARN << filename << " is not a model bundle of format "
+               << kModelBundleFormat << ".";
+    Close();
+    return false;
+  }
+  size_t table_size = header->num_sections * sizeof(SectionEntry);
+  if (header->file_size != size_ || sizeof(Header) + table_size > size_) {
+    KALDI_WARN << "Model bundle " << filename << " has size " << size_
+               << " but its header says " << header->file_size << ".";
+    Close();
+    return false;
+  }
+  const SectionEntry *table =
+      reinterpret_cast<const SectionEntry*>(data_ + sizeof(Header));
+  if (HashBytes(table, table_size) != header->table_checksum) {
+    KALDI_WARN << "Checksum mismatch in the section table of " << filename;
+    Close();
+    return false;
+  }
+  for (uint32 i = 0; i < header->num_sections; i++) {
+    const SectionEntry &entry = table[i];
+    if (entry.name[kMaxSectionName - 1] != '\0' ||
+        entry.offset % kModelBundleAlignment != 0 ||
+        entry.offset > size_ || entry.size > size_ - entry.offset) {
+      KALDI_WARN << "Bad section " << i << " in model bundle " << filename;
+      Close();
+      return false;
+    }
+    if (verify_checksums &&
+        HashBytes(data_ + entry.offset, entry.size) != entry.checksum) {
+      KALDI_WARN << "Checksum mismatch for section " << entry.name
+                 << " of model bundle " << filename;
+      Close();
+      return false;
+    }
+  }
+  return true;
+}
+
+const ModelBundle::SectionEntry *ModelBundle::FindSection(
+    const std::string &name) const {
+  KALDI_ASSERT(IsOpen());
+  const SectionEntry *table =
+      reinterpret_cast<const SectionEntry*>(data_ + sizeof(Header));
+  for (uint32 i = 0; i < GetHeader()->num_sections; i++)
+    if (name == table[i].name) return &(table[i]);
+  return NULL;
+}
+
+bool ModelBundle::HasSection(const std::string &name) const {
+  return FindSection(name) != NULL;
+}
+
+bool ModelBundle::GetSection(const std::string &name, const char **data,
+                             size_t *size) const {
+  const SectionEntry *entry = FindSection(name);
+  if (entry == NULL) return false;
+  *data = data_ + entry->offset;
+  *size = entry->size;
+  return true;
+}
+
+uint64 ModelBundle::ContentHash() const {
+  KALDI_ASSERT(IsOpen());
+  // The table holds every name and checksum (and nothing else that varies
+  // between equal models), so its checksum is the content hash.
+  return GetHeader()->table_checksum;
+}
+
+BundleSectionInput::SectionBuf BundleSectionInput::MakeBuf(
+    const ModelBundle &bundle, const std::string &name) {
+  const char *data;
+  size_t size;
+  if (!bundle.GetSection(name, &data, &size))
+    KALDI_ERR << "Model bundle " << bundle.Filename() << " has no section "
+              << name;
+  return SectionBuf(data, size);
+}
+
+BundleSectionInput::BundleSectionInput(const ModelBundle &bundle,
+                                       const std::string &name):
+    buf_(MakeBuf(bundle, name)), stream_(&buf_) { }
+
+void ReadBundleOptions(const ModelBundle &bundle, const std::string &name,
+                       ParseOptions *po) {
+  if (!bundle.HasSection(name)) return;
+  BundleSectionInput input(bundle, name);
+  po->ReadConfigStream(input.Stream(), bundle.Filename() + ":" + name);
+}
+
+}  // namespace kaldi
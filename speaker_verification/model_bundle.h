@@ -0,0 +1,163 @@
+// speaker_verification/model_bundle.h
+
+// Copyright (c) 2021 PeachLab. All Rights Reserved.
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_SPEAKER_VERIFICATION_MODEL_BUNDLE_H_
+#define KALDI_SPEAKER_VERIFICATION_MODEL_BUNDLE_H_
+
+#include <istream>
+#include <sstream>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+#include "base/kaldi-common.h"
+#include "util/parse-options.h"
+
+namespace kaldi {
+
+/// The sections of a speaker-verification bundle, as make-model-bundle
+/// writes them.
+///  - the x-vector network, as the TFLite flatbuffer, used in place;
+const char kBundleNnet[] = "nnet";
+///  - CompiledXvectorTransform: mean, LDA and PLDA transform, merged;
+const char kBundleXvectorTransform[] = "xvector_transform";
+///  - the PLDA model, for scoring;
+const char kBundlePlda[] = "plda";
+///  - the decision threshold, a binary float;
+const char kBundleThreshold[] = "threshold";
+///  - the frontend options, as the lines of a --config file (optional).
+const char kBundleFrontendConfig[] = "frontend_config";
+
+/// ModelBundleWriter collects named sections and writes them as one bundle
+/// file (see ModelBundle for the layout).
+class ModelBundleWriter {
+ public:
+  /// Section names are at most 31 characters and must be unique.
+  void AddSection(const std::string &name, const std::string &data);
+
+  /// Adds a Kaldi object, written in binary (without the binary-mode
+  /// header), as ReadBundleObject() expects.
+  template<class C> void AddObject(const std::string &name, const C &c) {
+    std::ostringstream os;
+    c.Write(os, true);
+    AddSection(name, os.str());
+  }
+
+  /// Writes the bundle to a temporary file and renames it over "filename",
+  /// so that a process opening "filename" sees the old or the new bundle.
+  /// Returns false (with a warning) on failure.
+  bool Write(const std::string &filename) const;
+
+ private:
+  std::vector<std::string> names_;
+  std::vector<std::string> sections_;
+};
+
+/// ModelBundle is a read-only, memory-mapped model file: a 64-byte header,
+/// a table of sections (64 bytes each: name, offset, size, checksum) and the
+/// sections, each at a 64-byte aligned offset.  Opening it maps the file and
+/// checks the header, the table and (by default) each section's checksum;
+/// nothing is parsed or copied, so a section such as the network can be used
+/// in place and its pages are shared by all processes that map the bundle.
+///
+/// This class is thread-safe once opened.
+class ModelBundle {
+ public:
+  ModelBundle();
+  ~ModelBundle() { Close(); }
+
+  /// Returns false (with a warning) if the file cannot be mapped or is not
+  /// a valid bundle.  With "verify_checksums" every section is read once to
+  /// check its contents; otherwise only the header and table are checked.
+  bool Open(const std::string &filename, bool verify_checksums = true);
+
+  void Close();
+
+  bool IsOpen() const { return data_ != NULL; }
+
+  /// Returns true if "filename" exists and starts with the bundle's magic.
+  static bool IsBundleFile(const std::string &filename);
+
+  const std::string &Filename() const { return filename_; }
+
+  bool HasSection(const std::string &name) const;
+
+  /// Points "data" into the mapping (64-byte aligned, valid until Close())
+  /// and sets "size"; returns false if there is no such section.
+  bool GetSection(const std::string &name, const char **data,
+                  size_t *size) const;
+
+  /// A hash of all the sections' names and checksums: it changes whenever
+  /// any part of the model does, so it can serve as the model version.
+  uint64 ContentHash() const;
+
+ private:
+  friend class ModelBundleWriter;
+  struct Header;
+  struct SectionEntry;
+
+  const Header *GetHeader() const;
+  const SectionEntry *FindSection(const std::string &name) const;
+
+  std::string filename_;
+  char *data_;
+  size_t size_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(ModelBundle);
+};
+
+/// An std::istream over one section of a bundle, reading it in place.
+class BundleSectionInput {
+ public:
+  /// Throws if the bundle has no section "name".
+  BundleSectionInput(const ModelBundle &bundle, const std::string &name);
+
+  std::istream &Stream() { return stream_; }
+
+ private:
+  struct SectionBuf: public std::streambuf {
+    SectionBuf(const char *data, size_t size) {
+      char *begin = const_cast<char*>(data);
+      setg(begin, begin, begin + size);
+    }
+  };
+  static SectionBuf MakeBuf(const ModelBundle &bundle,
+                            const std::string &name);
+
+  SectionBuf buf_;
+  std::istream stream_;
+};
+
+/// Reads a Kaldi object from a section written by
+/// ModelBundleWriter::AddObject().
+template<class C> void ReadBundleObject(const ModelBundle &bundle,
+                                        const std::string &name, C *c) {
+  BundleSectionInput input(bundle, name);
+  c->Read(input.Stream(), true);
+}
+
+/// Sets the options registered with "po" from a section holding the lines
+/// of a --config file ("--name=value", "#" starts a comment).  Does nothing
+/// if there is no such section.
+void ReadBundleOptions(const ModelBundle &bundle, const std::string &name,
+                       ParseOptions *po);
+
+}  // namespace kaldi
+
+#endif  // KALDI_SPEAKER_VERIFICATION_MODEL_BUNDLE_H_
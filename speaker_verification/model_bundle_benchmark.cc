@@ -0,0 +1,241 @@
+// speaker_verification/model_bundle_benchmark.cc
+
+// Copyright (c) 2021 PeachLab. All Rights Reserved.
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+// Cold-start time and memory of loading a speaker-verification model from a
+// ModelBundle against the four separate files, each load in a freshly
+// started process (this program, run again with --load).  The network is a
+// random blob of the same size as a real one: both paths hand it to the
+// backend as a mapped file, so what differs is everything around it, and
+// the bundle's checksum pass over it.
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+#include "base/kaldi-common.h"
+#include "base/timer.h"
+#include "speaker_verification/model_bundle.h"
+#include "speaker_verification/xvector_transform.h"
+#include "util/common-utils.h"
+
+namespace kaldi {
+
+struct LoadStats {
+  double seconds;
+  double anon_kb;  // private memory added by the load
+  double file_kb;  // file-backed (shareable) memory added by the load
+};
+
+// Reads a "Name:   123 kB" line of /proc/self/status.
+static double ProcStatusKb(const std::string &name) {
+  std::ifstream is("/proc/self/status");
+  std::string line;
+  while (std::getline(is, line)) {
+    if (line.compare(0, name.size() + 1, name + ":") == 0)
+      return atof(line.c_str() + name.size() + 1);
+  }
+  return 0.0;
+}
+
+// Runs this program again with --load=<path> and parses what it prints.
+static LoadStats RunLoad(const std::string &exe, int32 path,
+                         const std::string &dir) {
+  std::ostringstream cmd;
+  cmd << exe << " --load=" << path << " " << dir;
+  FILE *pipe = popen(cmd.str().c_str(), "r");
+  if (pipe == NULL) KALDI_ERR << "Could not run " << cmd.str();
+  LoadStats stats;
+  int num_read = fscanf(pipe, "%lf %lf %lf", &stats.seconds, &stats.anon_kb,
+                        &stats.file_kb);
+  if (pclose(pipe) != 0 || num_read != 3)
+    KALDI_ERR << "The loading process failed: " << cmd.str();
+  return stats;
+}
+
+// Maps the network file and reads its first page, as the backend does when
+// it builds the model.
+static void MapNnet(const std::string &filename) {
+  int fd = open(filename.c_str(), O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0) KALDI_ERR << "Cannot open " << filename;
+  void *data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) KALDI_ERR << "Cannot map " << filename;
+  volatile char c = *static_cast<const char*>(data);
+  (void)c;
+}
+
+}  // namespace kaldi
+
+int main(int argc, char *argv[]) {
+  using namespace kaldi;
+  try {
+    const char *usage =
+        "Measures the cold-start time and memory of loading a model from a\n"
+        "bundle against loading the network, mean, transform and PLDA files\n"
+        "separately (each load in a new process).  Synthetic model files are\n"
+        "written to <work-dir>.\n"
+        "Usage:  model-bundle-benchmark [options] <work-dir>\n";
+    ParseOptions po(usage);
+    int32 xvector_dim = 512, lda_dim = 128, nnet_mb = 20, num_loads = 10,
+        load = -1;
+    bool text_models = false;
+    po.Register("xvector-dim", &xvector_dim, "Dimension of the x-vectors.");
+    po.Register("lda-dim", &lda_dim, "Dimension after LDA.");
+    po.Register("nnet-mb", &nnet_mb, "Size of the network in MB.");
+    po.Register("num-loads", &num_loads, "Number of loads timed per path.");
+    po.Register("text-models", &text_models, "Write the mean, transform and "
+                "PLDA in text form, as some recipes leave them.");
+    po.Register("load", &load, "Internal: load the model in <work-dir> by "
+                "path 0 (files), 1 (bundle) or 2 (bundle, with checksums), "
+                "print the time and memory taken and exit.");
+    po.Read(argc, argv);
+    if (po.NumArgs() != 1) {
+      po.PrintUsage();
+      exit(1);
+    }
+    std::string dir = po.GetArg(1);
+    std::string nnet_file = dir + "/final.raw", mean_file = dir + "/mean.vec",
+        transform_file = dir + "/transform.mat", plda_file = dir + "/plda",
+        bundle_file = dir + "/model.bundle";
+
+    // The separate files, as SpeakerVerificationClient::Init() loads them.
+    // The loaded objects are not freed: they are measured after the load,
+    // and would live as long as the process.
+    auto load_files = [&]() {
+      Vector<BaseFloat> mean;
+      ReadKaldiObject(mean_file, &mean);
+      Matrix<BaseFloat> transform;
+      ReadKaldiObject(transform_file, &transform);
+      Plda *plda = new Plda();
+      ReadKaldiObject(plda_file, plda);
+      CompiledXvectorTransform<BaseFloat> *xvector_transform =
+          new CompiledXvectorTransform<BaseFloat>();
+      xvector_transform->Compile(mean, transform, true, *plda, PldaConfig());
+      MapNnet(nnet_file);
+    };
+    auto load_bundle = [&](bool verify) {
+      ModelBundle *bundle = new ModelBundle();
+      if (!bundle->Open(bundle_file, verify))
+        KALDI_ERR << "Could not open " << bundle_file;
+      Plda *plda = new Plda();
+      ReadBundleObject(*bundle, kBundlePlda, plda);
+      CompiledXvectorTransform<BaseFloat> *xvector_transform =
+          new CompiledXvectorTransform<BaseFloat>();
+      ReadBundleObject(*bundle, kBundleXvectorTransform, xvector_transform);
+      const char *nnet_data;
+      size_t nnet_size;
+      bundle->GetSection(kBundleNnet, &nnet_data, &nnet_size);
+      volatile char c = *nnet_data;
+      (void)c;
+    };
+
+    if (load >= 0) {
+      double anon = ProcStatusKb("RssAnon"), file = ProcStatusKb("RssFile");
+      Timer timer;
+      if (load == 0) load_files();
+      else load_bundle(load == 2);
+      double seconds = timer.Elapsed();
+      printf("%g %g %g\n", seconds, ProcStatusKb("RssAnon") - anon,
+             ProcStatusKb("RssFile") - file);
+      return 0;
+    }
+
+    {
+      std::string nnet(static_cast<size_t>(nnet_mb) << 20, '\0');
+      for (size_t i = 0; i < nnet.size(); i += 4) nnet[i] = RandInt(0, 255);
+      std::ofstream os(nnet_file.c_str(), std::ios::binary);
+      os.write(nnet.data(), nnet.size());
+    }
+    Vector<BaseFloat> mean(xvector_dim);
+    mean.SetRandn();
+    Matrix<BaseFloat> transform(lda_dim, xvector_dim + 1);
+    transform.SetRandn();
+    WriteKaldiObject(mean, mean_file, !text_models);
+    WriteKaldiObject(transform, transform_file, !text_models);
+    {
+      // A PLDA model with a random transform, through its own Read().
+      Vector<double> plda_mean(lda_dim), psi(lda_dim);
+      Matrix<double> plda_transform(lda_dim, lda_dim);
+      plda_mean.SetRandn();
+      plda_transform.SetRandn();
+      psi.SetRandUniform();
+      std::sort(psi.Data(), psi.Data() + lda_dim, std::greater<double>());
+      std::ostringstream os;
+      WriteToken(os, true, "<Plda>");
+      plda_mean.Write(os, true);
+      plda_transform.Write(os, true);
+      psi.Write(os, true);
+      WriteToken(os, true, "</Plda>");
+      std::istringstream is(os.str());
+      Plda plda;
+      plda.Read(is, true);
+      WriteKaldiObject(plda, plda_file, !text_models);
+    }
+    {
+      // What make-model-bundle does.
+      Plda plda;
+      ReadKaldiObject(plda_file, &plda);
+      CompiledXvectorTransform<double> xvector_transform;
+      xvector_transform.Compile(mean, transform, true, plda, PldaConfig());
+      std::ifstream is(nnet_file.c_str(), std::ios::binary);
+      std::ostringstream nnet;
+      nnet << is.rdbuf();
+      ModelBundleWriter writer;
+      writer.AddSection(kBundleNnet, nnet.str());
+      writer.AddObject(kBundleXvectorTransform, xvector_transform);
+      writer.AddObject(kBundlePlda, plda);
+      if (!writer.Write(bundle_file))
+        KALDI_ERR << "Could not write " << bundle_file;
+    }
+
+    char exe[4096];
+    ssize_t exe_len = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+    if (exe_len <= 0) KALDI_ERR << "Cannot find this program's path.";
+    exe[exe_len] = '\0';
+    const char *names[] = { "separate files", "bundle, header checked",
+                            "bundle, all checksums" };
+    for (int32 path = 0; path < 3; path++) {
+      LoadStats total;
+      total.seconds = total.anon_kb = total.file_kb = 0.0;
+      double best = 1.0e+10;
+      for (int32 i = 0; i < num_loads; i++) {
+        LoadStats stats = RunLoad(exe, path, dir);
+        total.seconds += stats.seconds;
+        total.anon_kb += stats.anon_kb;
+        total.file_kb += stats.file_kb;
+        best = std::min(best, stats.seconds);
+      }
+      KALDI_LOG << names[path] << ": " << 1000.0 * total.seconds / num_loads
+                << " ms (best " << 1000.0 * best << " ms), private memory +"
+                << total.anon_kb / num_loads << " kB, file-backed +"
+                << total.file_kb / num_loads << " kB.";
+    }
+    return 0;
+  } catch(const std::exception &e) {
+    std::cerr << e.what();
+    return -1;
+  }
+}
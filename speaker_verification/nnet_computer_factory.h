@@ -0,0 +1,40 @@
+// speaker_verification/nnet_computer_factory.h
+
+// Copyright (c) 2021 PeachLab. All Rights Reserved.
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef KALDI_SPEAKER_VERIFICATION_NNET_COMPUTER_FACTORY_H_
+#define KALDI_SPEAKER_VERIFICATION_NNET_COMPUTER_FACTORY_H_
+
+#include <functional>
+#include <memory>
+
+#include "interface/nnet_computer_interface.h"
+
+namespace kaldi {
+
+/// Creates a network backend, initialized and ready to run.  SpeakerModel
+/// calls it for each replica of the network it needs, so neither it nor
+/// XvectorExtractor depends on a backend; the application picks one (e.g.
+/// TFliteNnetFactory() in tflite_nnet_factory.h).
+typedef std::function<std::unique_ptr<goat::NnetComputerInterface>()>
+    NnetComputerFactory;
+
+}  // namespace kaldi
+
+#endif  // KALDI_SPEAKER_VERIFICATION_NNET_COMPUTER_FACTORY_H_
@@ -19,6 +19,13 @@
 // limitations under the License.
 
 #include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
 #include "speaker_verification/plda.h"
 
 namespace kaldi {
@@ -148,6 +155,37 @@ float Plda::TransformIvector(const PldaConfig &config,
 }
 
 
+void Plda::TransformIvectors(const PldaConfig &config,
+                             const MatrixBase<double> &ivectors,
+                             int32 num_examples,
+                             MatrixBase<double> *transformed_ivectors,
+                             VectorBase<double> *normalization_factors) const {
+  KALDI_ASSERT(ivectors.NumCols() == Dim() &&
+               transformed_ivectors->NumRows() == ivectors.NumRows() &&
+               transformed_ivectors->NumCols() == Dim());
+  KALDI_ASSERT(num_examples > 0);
+  transformed_ivectors->CopyRowsFromVec(offset_);
+  transformed_ivectors->AddMatMat(1.0, ivectors, kNoTrans,
+                                  transform_, kTrans, 1.0);
+  // inv_covar is 1.0 / (\Psi + I/num_examples), as in
+  // GetNormalizationFactor(); NULL means the simple length normalization.
+  Vector<double> inv_covar;
+  if (!config.simple_length_norm) {
+    inv_covar = psi_;
+    inv_covar.Add(1.0 / num_examples);
+    inv_covar.InvertElements();
+  }
+  const VectorBase<double> *weights =
+      (config.simple_length_norm ? NULL : &inv_covar);
+  if (config.normalize_length) {
+    NormalizeRowLengths(weights, transformed_ivectors, normalization_factors);
+  } else if (normalization_factors != NULL) {
+    Matrix<double> tmp(*transformed_ivectors);
+    NormalizeRowLengths(weights, &tmp, normalization_factors);
+  }
+}
+
+
 // There is an extended comment within this file, referencing a paper by
 // Ioffe, that may clarify what this function is doing.
 double Plda::LogLikelihoodRatio(
@@ -192,6 +230,255 @@ double Plda::LogLikelihoodRatio(
 }
 
 
+// The scoring of PldaScorerTpl: for each k in "indexes"
+// (or each k < num_rows if "indexes" is NULL), scores[i] is
+// -0.5 * (params_k . stats + offsets[k]) + test_term.  The generic version
+// is a GEMV (or dot products); with AVX2 or NEON the float one is a SIMD
+// kernel, since BLAS sgemv on row-major matrices is often no faster than
+// dgemv.
+template<typename Real>
+static void ScoreParamRows(const MatrixBase<Real> &params,
+                           const VectorBase<Real> &offsets,
+                           const VectorBase<Real> &stats, Real test_term,
+                           const std::vector<int32> *indexes,
+                           VectorBase<Real> *scores) {
+  if (indexes == NULL) {
+    scores->CopyFromVec(offsets);
+    scores->AddMatVec(-0.5, params, kNoTrans, stats, -0.5);
+    scores->Add(test_term);
+  } else {
+    for (size_t i = 0; i < indexes->size(); i++) {
+      int32 k = (*indexes)[i];
+      (*scores)(i) = -0.5 * (VecVec(params.Row(k), stats) + offsets(k)) +
+          test_term;
+    }
+  }
+}
+
+#if defined(__AVX2__) || defined(__ARM_NEON)
+// Returns the dot product of "a" and "b", with four independent
+// accumulators so that the loop runs at the speed of the loads.
+static inline float DotFloat(const float *a, const float *b, int32 dim) {
+  int32 d = 0;
+#if defined(__AVX2__)
+  __m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps(),
+      acc2 = _mm256_setzero_ps(), acc3 = _mm256_setzero_ps();
+  for (; d + 32 <= dim; d += 32) {
+    acc0 = _mm256_add_ps(acc0, _mm256_mul_ps(_mm256_loadu_ps(a + d),
+                                             _mm256_loadu_ps(b + d)));
+    acc1 = _mm256_add_ps(acc1, _mm256_mul_ps(_mm256_loadu_ps(a + d + 8),
+                                             _mm256_loadu_ps(b + d + 8)));
+    acc2 = _mm256_add_ps(acc2, _mm256_mul_ps(_mm256_loadu_ps(a + d + 16),
+                                             _mm256_loadu_ps(b + d + 16)));
+    acc3 = _mm256_add_ps(acc3, _mm256_mul_ps(_mm256_loadu_ps(a + d + 24),
+                                             _mm256_loadu_ps(b + d + 24)));
+  }
+  for (; d + 8 <= dim; d += 8)
+    acc0 = _mm256_add_ps(acc0, _mm256_mul_ps(_mm256_loadu_ps(a + d),
+                                             _mm256_loadu_ps(b + d)));
+  acc0 = _mm256_add_ps(_mm256_add_ps(acc0, acc1), _mm256_add_ps(acc2, acc3));
+  __m128 sum4 = _mm_add_ps(_mm256_castps256_ps128(acc0),
+                           _mm256_extractf128_ps(acc0, 1));
+  sum4 = _mm_hadd_ps(sum4, sum4);
+  sum4 = _mm_hadd_ps(sum4, sum4);
+  float sum = _mm_cvtss_f32(sum4);
+#else
+  float32x4_t acc0 = vdupq_n_f32(0.0f), acc1 = vdupq_n_f32(0.0f),
+      acc2 = vdupq_n_f32(0.0f), acc3 = vdupq_n_f32(0.0f);
+  for (; d + 16 <= dim; d += 16) {
+    acc0 = vmlaq_f32(acc0, vld1q_f32(a + d), vld1q_f32(b + d));
+    acc1 = vmlaq_f32(acc1, vld1q_f32(a + d + 4), vld1q_f32(b + d + 4));
+    acc2 = vmlaq_f32(acc2, vld1q_f32(a + d + 8), vld1q_f32(b + d + 8));
+    acc3 = vmlaq_f32(acc3, vld1q_f32(a + d + 12), vld1q_f32(b + d + 12));
+  }
+  for (; d + 4 <= dim; d += 4)
+    acc0 = vmlaq_f32(acc0, vld1q_f32(a + d), vld1q_f32(b + d));
+  float32x4_t sum4 = vaddq_f32(vaddq_f32(acc0, acc1), vaddq_f32(acc2, acc3));
+  float32x2_t pair = vadd_f32(vget_low_f32(sum4), vget_high_f32(sum4));
+  float sum = vget_lane_f32(vpadd_f32(pair, pair), 0);
+#endif
+  for (; d < dim; d++) sum += a[d] * b[d];
+  return sum;
+}
+
+static void ScoreParamRows(const MatrixBase<float> &params,
+                           const VectorBase<float> &offsets,
+                           const VectorBase<float> &stats, float test_term,
+                           const std::vector<int32> *indexes,
+                           VectorBase<float> *scores) {
+  int32 num_scores = scores->Dim(), dim = stats.Dim();
+  KALDI_ASSERT(params.NumCols() == dim);
+  const float *stats_data = stats.Data();
+  float *score_data = scores->Data();
+  for (int32 i = 0; i < num_scores; i++) {
+    int32 k = (indexes == NULL ? i : (*indexes)[i]);
+    score_data[i] = -0.5f * (DotFloat(params.RowData(k), stats_data, dim) +
+                             offsets(k)) + test_term;
+  }
+}
+#endif  // defined(__AVX2__) || defined(__ARM_NEON)
+
+template<typename Real>
+PldaScorerTpl<Real>::PldaScorerTpl(const Plda &plda):
+    psi_(plda.psi_), num_speakers_(0) {
+  Vector<double> without_class_var(psi_);
+  without_class_var.Add(1.0);  // I + \Psi.
+  without_class_logdet_ = without_class_var.SumLog();
+  without_class_var.InvertElements();
+  without_class_inv_var_.Resize(without_class_var.Dim());
+  without_class_inv_var_.CopyFromVec(without_class_var);
+}
+
+template<typename Real>
+int32 PldaScorerTpl<Real>::AddSpeaker(
+    const VectorBase<Real> &transformed_enroll_ivector,
+    int32 num_enroll_utts) {
+  int32 dim = Dim();
+  if (num_speakers_ == speaker_params_.NumRows()) {
+    // Grow geometrically so that enrolling N speakers costs O(N) copies.
+    int32 new_capacity = std::max<int32>(16, 2 * num_speakers_);
+    speaker_params_.Resize(new_capacity, 2 * dim, kCopyData);
+    speaker_offsets_.Resize(new_capacity, kCopyData);
+  }
+  num_speakers_++;
+  SetSpeaker(num_speakers_ - 1, transformed_enroll_ivector, num_enroll_utts);
+  return num_speakers_ - 1;
+}
+
+template<typename Real>
+void PldaScorerTpl<Real>::SetSpeaker(
+    int32 index, const VectorBase<Real> &transformed_enroll_ivector,
+    int32 n) {
+  int32 dim = Dim();
+  KALDI_ASSERT(index >= 0 && index < num_speakers_ && n > 0);
+  KALDI_ASSERT(transformed_enroll_ivector.Dim() == dim);
+  // Same quantities as in Plda::LogLikelihoodRatio(), in double whatever
+  // Real is.
+  SubVector<Real> inv_var(speaker_params_.Row(index), 0, dim),
+      scaled_mean(speaker_params_.Row(index), dim, dim);
+  double logdet = 0.0, offset = 0.0;
+  for (int32 i = 0; i < dim; i++) {
+    double mean = n * psi_(i) / (n * psi_(i) + 1.0)
+        * transformed_enroll_ivector(i),
+        variance = 1.0 + psi_(i) / (n * psi_(i) + 1.0);
+    logdet += Log(variance);
+    inv_var(i) = 1.0 / variance;
+    scaled_mean(i) = -2.0 * mean / variance;
+    offset += mean * mean / variance;
+  }
+  speaker_offsets_(index) = offset + logdet;
+}
+
+template<typename Real>
+Real PldaScorerTpl<Real>::ComputeTestStats(
+    const VectorBase<Real> &transformed_test_ivector,
+    Vector<Real> *test_stats) const {
+  int32 dim = Dim();
+  KALDI_ASSERT(transformed_test_ivector.Dim() == dim);
+  test_stats->Resize(2 * dim, kUndefined);
+  SubVector<Real> test_sq(*test_stats, 0, dim);
+  test_sq.CopyFromVec(transformed_test_ivector);
+  test_sq.ApplyPow(2.0);
+  test_stats->Range(dim, dim).CopyFromVec(transformed_test_ivector);
+  double loglike_without_class = -0.5 * (without_class_logdet_ +
+      VecVec(test_sq, without_class_inv_var_));
+  return -loglike_without_class;
+}
+
+template<typename Real>
+void PldaScorerTpl<Real>::Score(
+    const VectorBase<Real> &transformed_test_ivector,
+    VectorBase<Real> *scores) const {
+  KALDI_ASSERT(scores->Dim() == num_speakers_);
+  if (num_speakers_ == 0) return;
+  Vector<Real> test_stats;
+  Real test_term = ComputeTestStats(transformed_test_ivector, &test_stats);
+  // scores = -0.5 * (params * test_stats + offsets) + test_term.
+  SubMatrix<Real> params(speaker_params_, 0, num_speakers_,
+                         0, test_stats.Dim());
+  ScoreParamRows(params, speaker_offsets_.Range(0, num_speakers_), test_stats,
+                 test_term, NULL, scores);
+}
+
+template<typename Real>
+void PldaScorerTpl<Real>::ScoreSubset(
+    const VectorBase<Real> &transformed_test_ivector,
+    const std::vector<int32> &indexes, VectorBase<Real> *scores) const {
+  KALDI_ASSERT(scores->Dim() == static_cast<int32>(indexes.size()));
+  for (size_t i = 0; i < indexes.size(); i++)
+    KALDI_ASSERT(indexes[i] >= 0 && indexes[i] < num_speakers_);
+  if (indexes.empty()) return;
+  Vector<Real> test_stats;
+  Real test_term = ComputeTestStats(transformed_test_ivector, &test_stats);
+  ScoreParamRows(speaker_params_, speaker_offsets_, test_stats, test_term,
+                 &indexes, scores);
+}
+
+template<typename Real>
+void PldaScorerTpl<Real>::ComputeTestStats(
+    const MatrixBase<Real> &transformed_test_ivectors,
+    Matrix<Real> *test_stats, Vector<Real> *test_terms) const {
+  int32 num_tests = transformed_test_ivectors.NumRows(), dim = Dim();
+  KALDI_ASSERT(transformed_test_ivectors.NumCols() == dim);
+  test_stats->Resize(num_tests, 2 * dim, kUndefined);
+  SubMatrix<Real> test_sq(*test_stats, 0, num_tests, 0, dim);
+  test_sq.CopyFromMat(transformed_test_ivectors);
+  test_sq.ApplyPow(2.0);
+  test_stats->ColRange(dim, dim).CopyFromMat(transformed_test_ivectors);
+  // The test-only term, as in ComputeTestStats() for one iVector.
+  test_terms->Resize(num_tests, kUndefined);
+  test_terms->Set(0.5 * without_class_logdet_);
+  test_terms->AddMatVec(0.5, test_sq, kNoTrans, without_class_inv_var_, 1.0);
+}
+
+template<typename Real>
+void PldaScorerTpl<Real>::ScoreTestStats(const MatrixBase<Real> &test_stats,
+                                         const VectorBase<Real> &test_terms,
+                                         MatrixBase<Real> *scores) const {
+  int32 num_tests = test_stats.NumRows();
+  KALDI_ASSERT(test_stats.NumCols() == 2 * Dim() &&
+               test_terms.Dim() == num_tests &&
+               scores->NumRows() == num_tests &&
+               scores->NumCols() == num_speakers_);
+  if (num_speakers_ == 0 || num_tests == 0) return;
+  SubMatrix<Real> params(speaker_params_, 0, num_speakers_,
+                         0, 2 * Dim());
+  // scores = -0.5 * (test_stats * params^T + offsets) + test_terms.
+  scores->CopyRowsFromVec(speaker_offsets_.Range(0, num_speakers_));
+  scores->AddMatMat(-0.5, test_stats, kNoTrans, params, kTrans, -0.5);
+  scores->AddVecToCols(1.0, test_terms);
+}
+
+template<typename Real>
+void PldaScorerTpl<Real>::ScoreBatch(
+    const MatrixBase<Real> &transformed_test_ivectors,
+    MatrixBase<Real> *scores) const {
+  Matrix<Real> test_stats;
+  Vector<Real> test_terms;
+  ComputeTestStats(transformed_test_ivectors, &test_stats, &test_terms);
+  ScoreTestStats(test_stats, test_terms, scores);
+}
+
+template<typename Real>
+void PldaScorerTpl<Real>::ScoreSpeaker(
+    int32 index, const MatrixBase<Real> &transformed_test_ivectors,
+    VectorBase<Real> *scores) const {
+  KALDI_ASSERT(index >= 0 && index < num_speakers_ &&
+               scores->Dim() == transformed_test_ivectors.NumRows());
+  if (scores->Dim() == 0) return;
+  Matrix<Real> test_stats;
+  Vector<Real> test_terms;
+  ComputeTestStats(transformed_test_ivectors, &test_stats, &test_terms);
+  // scores = -0.5 * (test_stats * params + offset) + test_terms.
+  scores->CopyFromVec(test_terms);
+  scores->AddMatVec(-0.5, test_stats, kNoTrans, speaker_params_.Row(index),
+                    1.0);
+  scores->Add(-0.5 * speaker_offsets_(index));
+}
+
+template class PldaScorerTpl<float>;
+template class PldaScorerTpl<double>;
+
 void Plda::SmoothWithinClassCovariance(double smoothing_factor) {
   KALDI_ASSERT(smoothing_factor >= 0.0 && smoothing_factor <= 1.0);
   // smoothing_factor > 1.0 is possible but wouldn't really make sense.
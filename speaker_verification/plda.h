@@ -107,6 +107,19 @@ class Plda {
                          int32 num_enroll_examples,
                          VectorBase<float> *transformed_ivector) const;
 
+  /// Batched version of TransformIvector(): each row of "ivectors" is one
+  /// iVector, all averaged over "num_examples" utterances.  The transform is
+  /// done as one matrix multiplication, and the length normalization as a
+  /// per-row epilogue.  "transformed_ivectors" must have the same size as
+  /// "ivectors".  If "normalization_factors" is non-NULL it receives the
+  /// factor for each row (computed even if config.normalize_length == false).
+  void TransformIvectors(const PldaConfig &config,
+                         const MatrixBase<double> &ivectors,
+                         int32 num_examples,
+                         MatrixBase<double> *transformed_ivectors,
+                         VectorBase<double> *normalization_factors = NULL)
+                         const;
+
   /// Returns the log-likelihood ratio
   /// log (p(test_ivector | same) / p(test_ivector | different)).
   /// transformed_enroll_ivector is an average over utterances for
@@ -141,6 +154,10 @@ class Plda {
   void ComputeDerivedVars(); // computes offset_.
   friend class PldaEstimator;
   friend class PldaUnsupervisedAdaptor;
+  template<typename Real> friend class PldaScorerTpl;
+  friend class PldaPairScorer;
+  friend class QuantizedSpeakerStore;
+  template<typename Real> friend class CompiledXvectorTransform;
 
   Vector<double> mean_;  // mean of samples in original space.
   Matrix<double> transform_; // of dimension Dim() by Dim();
@@ -165,6 +182,107 @@ class Plda {
 
 };
 
+
+/// PldaScorerTpl computes Plda::LogLikelihoodRatio() of one test iVector
+/// against many enrolled speakers at once, for 1:N identification.  Writing
+/// w for the inverse of the per-speaker variance I + \Psi/(n \Psi + I) and m
+/// for the per-speaker mean, the log-likelihood ratio expands to
+///   -0.5 [ w . t^2 - 2 (w * m) . t + (w . m^2 + logdet) ] + (test-only terms)
+/// where t is the test iVector.  Everything in brackets except t depends only
+/// on the enrolled speaker, so it is computed once in AddSpeaker(), and the
+/// scores for all speakers are one matrix-vector product with [t^2, t]
+/// followed by a vector epilogue.  Scores agree with LogLikelihoodRatio() up
+/// to floating-point roundoff.
+///
+/// The per-speaker terms are always computed in double; Real is the
+/// precision they are stored and scored in.  PldaScorerTpl<float> halves the
+/// memory traffic of the GEMV and doubles its SIMD width, which is all that
+/// scoring costs; its scores differ from the double ones by about 1e-4
+/// (plda-scorer-benchmark measures this, on real trials if given them).
+template<typename Real>
+class PldaScorerTpl {
+ public:
+  explicit PldaScorerTpl(const Plda &plda);
+
+  /// Adds a speaker given its transformed, averaged iVector (as passed to
+  /// LogLikelihoodRatio()) and the number of utterances it was averaged over.
+  /// Returns the index of the speaker, which is NumSpeakers() - 1.
+  int32 AddSpeaker(const VectorBase<Real> &transformed_enroll_ivector,
+                   int32 num_enroll_utts);
+
+  /// Replaces speaker "index" (which must be < NumSpeakers()).
+  void SetSpeaker(int32 index,
+                  const VectorBase<Real> &transformed_enroll_ivector,
+                  int32 num_enroll_utts);
+
+  int32 NumSpeakers() const { return num_speakers_; }
+
+  int32 Dim() const { return psi_.Dim(); }
+
+  void Clear() { num_speakers_ = 0; }
+
+  /// Sets (*scores)(k) to the log-likelihood ratio of the test iVector against
+  /// speaker k; "scores" must have dimension NumSpeakers().
+  void Score(const VectorBase<Real> &transformed_test_ivector,
+             VectorBase<Real> *scores) const;
+
+  /// As Score(), but only for the speakers listed in "indexes": (*scores)(i)
+  /// is the score against speaker indexes[i].  Used for re-scoring a short
+  /// list of candidates.
+  void ScoreSubset(const VectorBase<Real> &transformed_test_ivector,
+                   const std::vector<int32> &indexes,
+                   VectorBase<Real> *scores) const;
+
+  /// Scores many test iVectors (the rows of "transformed_test_ivectors")
+  /// against all speakers with one matrix-matrix product: (*scores)(i, k) is
+  /// the score of test i against speaker k.  "scores" must be
+  /// NumRows() by NumSpeakers().
+  void ScoreBatch(const MatrixBase<Real> &transformed_test_ivectors,
+                  MatrixBase<Real> *scores) const;
+
+  /// Scores many test iVectors against speaker "index" alone, with one
+  /// matrix-vector product: (*scores)(i) is the score of test i.  "scores"
+  /// must have dimension NumRows().  Used for verifying a batch of
+  /// utterances against one claimed speaker.
+  void ScoreSpeaker(int32 index,
+                    const MatrixBase<Real> &transformed_test_ivectors,
+                    VectorBase<Real> *scores) const;
+
+  /// The test-side part of ScoreBatch(), for test iVectors that are scored
+  /// again and again (e.g. a cohort, against each new speaker): row i of
+  /// "test_stats" is [t_i^2, t_i] and (*test_terms)(i) the test-only term.
+  void ComputeTestStats(const MatrixBase<Real> &transformed_test_ivectors,
+                        Matrix<Real> *test_stats,
+                        Vector<Real> *test_terms) const;
+
+  /// As ScoreBatch(), from the output of ComputeTestStats().
+  void ScoreTestStats(const MatrixBase<Real> &test_stats,
+                      const VectorBase<Real> &test_terms,
+                      MatrixBase<Real> *scores) const;
+
+ private:
+  /// Sets *test_stats to [t^2, t] and returns the test-only part of the
+  /// score, i.e. minus the log-likelihood without class (up to the 2 pi
+  /// terms, which cancel).
+  Real ComputeTestStats(const VectorBase<Real> &transformed_test_ivector,
+                        Vector<Real> *test_stats) const;
+
+  Vector<double> psi_;
+  /// 0.5 * logdet(I + \Psi) - 0.5 * logdet is added to every score; the
+  /// speaker's own logdet is folded into speaker_offsets_.
+  double without_class_logdet_;
+  Vector<Real> without_class_inv_var_;  // 1 / (1 + \Psi).
+
+  int32 num_speakers_;
+  /// Row k is [w_k, -2 w_k * m_k]; only the first num_speakers_ rows are in
+  /// use, the rest is capacity.
+  Matrix<Real> speaker_params_;
+  /// Element k is w_k . m_k^2 + logdet(variance_k).
+  Vector<Real> speaker_offsets_;
+};
+
+typedef PldaScorerTpl<double> PldaScorer;
+
 }  // namespace kaldi
 
 #endif
@@ -0,0 +1,343 @@
+// speaker_verification/plda_clustering.cc
+
+// Copyright (c) 2021 PeachLab. All Rights Reserved.
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <thread>
+
+#include "speaker_verification/plda_clustering.h"
+#include "util/kaldi-thread.h"
+
+namespace kaldi {
+
+namespace {
+
+// One worker of PldaPairScorer::ScoreAllPairs().  The lower triangle of the
+// score matrix is cut into square blocks, numbered row by row, and workers
+// take the next block from a shared counter; blocks do not overlap, so they
+// write to the packed matrix without locking.
+class PairScoresTask: public MultiThreadable {
+ public:
+  PairScoresTask(const MatrixBase<double> *plda_inputs,
+                 const MatrixBase<double> *scaled_inputs,
+                 const Vector<double> *row_terms, double offset,
+                 int32 block_size, std::atomic<int32> *next_block,
+                 SpMatrix<float> *scores):
+      plda_inputs_(plda_inputs), scaled_inputs_(scaled_inputs),
+      row_terms_(row_terms), offset_(offset), block_size_(block_size),
+      next_block_(next_block), scores_(scores) { }
+
+  void operator() () {
+    int32 num_rows = plda_inputs_->NumRows(),
+        num_row_blocks = (num_rows + block_size_ - 1) / block_size_,
+        num_blocks = num_row_blocks * (num_row_blocks + 1) / 2;
+    Matrix<double> products(block_size_, block_size_, kUndefined);
+    const double *row_terms = row_terms_->Data();
+    float *data = scores_->Data();
+    while (true) {
+      int32 block = next_block_->fetch_add(1);
+      if (block >= num_blocks) break;
+      // Block "block" is (row_block, col_block), col_block <= row_block.
+      int32 row_block = 0;
+      while ((row_block + 1) * (row_block + 2) / 2 <= block) row_block++;
+      int32 col_block = block - row_block * (row_block + 1) / 2;
+      int32 row_begin = row_block * block_size_,
+          col_begin = col_block * block_size_,
+          this_num_rows = std::min(block_size_, num_rows - row_begin),
+          this_num_cols = std::min(block_size_, num_rows - col_begin);
+      SubMatrix<double> block_products(products, 0, this_num_rows,
+                                       0, this_num_cols);
+      block_products.AddMatMat(
+          1.0, scaled_inputs_->RowRange(row_begin, this_num_rows), kNoTrans,
+          plda_inputs_->RowRange(col_begin, this_num_cols), kTrans, 0.0);
+      for (int32 r = 0; r < this_num_rows; r++) {
+        int32 i = row_begin + r;
+        const double *product_row = block_products.RowData(r);
+        float *score_row = data + static_cast<size_t>(i) * (i + 1) / 2 +
+            col_begin;
+        double row_offset = row_terms[i] + offset_;
+        int32 end = (row_block == col_block ? r + 1 : this_num_cols);
+        for (int32 c = 0; c < end; c++)
+          score_row[c] = product_row[c] + row_terms[col_begin + c] +
+              row_offset;
+      }
+    }
+  }
+
+ private:
+  const MatrixBase<double> *plda_inputs_;
+  const MatrixBase<double> *scaled_inputs_;
+  const Vector<double> *row_terms_;
+  double offset_;
+  int32 block_size_;
+  std::atomic<int32> *next_block_;
+  SpMatrix<float> *scores_;
+};
+
+// Returns sum_d coeffs[d] * sum[d]^2.
+double WeightedSumSq(const double *coeffs, const double *sum, int32 dim) {
+  double ans = 0.0;
+  for (int32 d = 0; d < dim; d++)
+    ans += coeffs[d] * sum[d] * sum[d];
+  return ans;
+}
+
+}  // namespace
+
+PldaPairScorer::PldaPairScorer(const Plda &plda): psi_(plda.psi_) { }
+
+double PldaPairScorer::ComputeSetCoeffs(int32 n,
+                                        Vector<double> *coeffs) const {
+  KALDI_ASSERT(n > 0);
+  int32 dim = Dim();
+  coeffs->Resize(dim, kUndefined);
+  double logdet = 0.0;
+  for (int32 d = 0; d < dim; d++) {
+    double var = 1.0 + n * psi_(d);
+    (*coeffs)(d) = psi_(d) / var;
+    logdet += Log(var);
+  }
+  return -0.5 * logdet;
+}
+
+double PldaPairScorer::SetLogLikelihood(const VectorBase<double> &sum,
+                                        int32 n) const {
+  KALDI_ASSERT(sum.Dim() == Dim());
+  Vector<double> coeffs;
+  double ans = ComputeSetCoeffs(n, &coeffs);
+  return ans + 0.5 * WeightedSumSq(coeffs.Data(), sum.Data(), Dim());
+}
+
+double PldaPairScorer::ScoreSets(const VectorBase<double> &sum_a, int32 n_a,
+                                 const VectorBase<double> &sum_b,
+                                 int32 n_b) const {
+  Vector<double> sum(sum_a);
+  sum.AddVec(1.0, sum_b);
+  return SetLogLikelihood(sum, n_a + n_b) - SetLogLikelihood(sum_a, n_a) -
+      SetLogLikelihood(sum_b, n_b);
+}
+
+void PldaPairScorer::ScoreAllPairs(const MatrixBase<double> &plda_inputs,
+                                   int32 num_threads, int32 block_size,
+                                   SpMatrix<float> *scores) const {
+  KALDI_ASSERT(plda_inputs.NumCols() == Dim() && num_threads >= 0 &&
+               block_size > 0);
+  int32 num_rows = plda_inputs.NumRows();
+  scores->Resize(num_rows, kUndefined);
+  if (num_rows == 0) return;
+  // score(i, j) = L(x_i + x_j, 2) - L(x_i, 1) - L(x_j, 1)
+  //             = x_i . (g_2 * x_j) + v_i + v_j + offset,
+  // with v_i = 0.5 (g_2 - g_1) . x_i^2.
+  Vector<double> coeffs1, coeffs2;
+  double logdet1 = ComputeSetCoeffs(1, &coeffs1),
+      logdet2 = ComputeSetCoeffs(2, &coeffs2);
+  double offset = logdet2 - 2.0 * logdet1;
+  Matrix<double> scaled_inputs(plda_inputs);
+  scaled_inputs.MulColsVec(coeffs2);
+  Vector<double> diff_coeffs(coeffs2);
+  diff_coeffs.AddVec(-1.0, coeffs1);
+  Matrix<double> inputs_sq(plda_inputs);
+  inputs_sq.ApplyPow(2.0);
+  Vector<double> row_terms(num_rows);
+  row_terms.AddMatVec(0.5, inputs_sq, kNoTrans, diff_coeffs, 0.0);
+
+  int32 num_row_blocks = (num_rows + block_size - 1) / block_size,
+      num_blocks = num_row_blocks * (num_row_blocks + 1) / 2;
+  if (num_threads == 0)
+    num_threads = std::max<int32>(1, std::thread::hardware_concurrency());
+  num_threads = std::min(num_threads, num_blocks);
+  std::atomic<int32> next_block(0);
+  PairScoresTask task(&plda_inputs, &scaled_inputs, &row_terms, offset,
+                      block_size, &next_block, scores);
+  if (num_threads == 1) {
+    task();  // No need for a thread, nor for single-threaded BLAS.
+  } else {
+    MultiThreader<PairScoresTask> threader(num_threads, task);
+  }
+}
+
+PldaAgglomerativeClusterer::PldaAgglomerativeClusterer(
+    const PldaClusteringOptions &opts, const Plda &plda):
+    opts_(opts), pair_scorer_(plda), num_active_(0) {
+  KALDI_ASSERT(opts_.num_clusters >= 0 && opts_.num_threads >= 0 &&
+               opts_.block_size > 0);
+}
+
+const double *PldaAgglomerativeClusterer::SetCoeffs(int32 n, double *logdet) {
+  KALDI_ASSERT(n < static_cast<int32>(set_coeffs_.size()));
+  if (set_coeffs_[n].Dim() == 0)
+    set_logdets_[n] = pair_scorer_.ComputeSetCoeffs(n, &set_coeffs_[n]);
+  *logdet = set_logdets_[n];
+  return set_coeffs_[n].Data();
+}
+
+void PldaAgglomerativeClusterer::Init(const MatrixBase<double> &plda_inputs) {
+  int32 num_segments = plda_inputs.NumRows();
+  pair_scorer_.ScoreAllPairs(plda_inputs, opts_.num_threads, opts_.block_size,
+                             &scores_);
+  sums_ = plda_inputs;
+  counts_.assign(num_segments, 1);
+  parents_.resize(num_segments);
+  set_loglikes_.resize(num_segments);
+  num_active_ = num_segments;
+  // Sizes only grow up to num_segments, so the coefficients never move.
+  set_coeffs_.clear();
+  set_coeffs_.resize(num_segments + 1);
+  set_logdets_.resize(num_segments + 1);
+  double logdet;
+  const double *coeffs = SetCoeffs(1, &logdet);
+  for (int32 i = 0; i < num_segments; i++) {
+    parents_[i] = i;
+    set_loglikes_[i] = logdet + 0.5 * WeightedSumSq(coeffs, sums_.RowData(i),
+                                                    pair_scorer_.Dim());
+  }
+  // One pass over the lower triangle finds every row's best partner.
+  best_.assign(num_segments, std::make_pair(
+      -std::numeric_limits<float>::infinity(), -1));
+  const float *data = scores_.Data();
+  for (int32 i = 0; i < num_segments; i++) {
+    const float *row = data + static_cast<size_t>(i) * (i + 1) / 2;
+    std::pair<float, int32> &best_i = best_[i];
+    for (int32 j = 0; j < i; j++) {
+      float score = row[j];
+      if (score > best_i.first) best_i = std::make_pair(score, j);
+      if (score > best_[j].first) best_[j] = std::make_pair(score, i);
+    }
+  }
+}
+
+void PldaAgglomerativeClusterer::RescanBest(int32 i) {
+  std::pair<float, int32> best(-std::numeric_limits<float>::infinity(), -1);
+  int32 num_clusters = counts_.size();
+  for (int32 j = 0; j < num_clusters; j++) {
+    if (j == i || counts_[j] == 0) continue;
+    float score = Score(i, j);
+    if (score > best.first) best = std::make_pair(score, j);
+  }
+  best_[i] = best;
+}
+
+void PldaAgglomerativeClusterer::UpdateRow(int32 a, int32 removed) {
+  int32 num_clusters = counts_.size(), dim = pair_scorer_.Dim(),
+      count_a = counts_[a];
+  const double *sum_a = sums_.RowData(a);
+  double loglike_a = set_loglikes_[a];
+  std::pair<float, int32> best_a(-std::numeric_limits<float>::infinity(), -1);
+  for (int32 c = 0; c < num_clusters; c++) {
+    if (c == a || counts_[c] == 0) continue;
+    double logdet;
+    const double *coeffs = SetCoeffs(count_a + counts_[c], &logdet);
+    const double *sum_c = sums_.RowData(c);
+    double quad = 0.0;
+    for (int32 d = 0; d < dim; d++) {
+      double s = sum_a[d] + sum_c[d];
+      quad += coeffs[d] * s * s;
+    }
+    float score = logdet + 0.5 * quad - loglike_a - set_loglikes_[c];
+    if (a > c) scores_(a, c) = score;
+    else scores_(c, a) = score;
+    if (score > best_a.first) best_a = std::make_pair(score, c);
+    // Only c's score against a changed (and against the removed cluster,
+    // which is gone), so its old best is still an upper bound.
+    std::pair<float, int32> &best_c = best_[c];
+    if (score >= best_c.first)
+      best_c = std::make_pair(score, a);
+    else if (best_c.second == a || best_c.second == removed)
+      best_c.second = -1;
+  }
+  best_[a] = best_a;
+}
+
+void PldaAgglomerativeClusterer::Merge(int32 a, int32 b) {
+  KALDI_ASSERT(a != b && IsActive(a) && IsActive(b));
+  sums_.Row(a).AddVec(1.0, sums_.Row(b));
+  counts_[a] += counts_[b];
+  counts_[b] = 0;
+  parents_[b] = a;
+  num_active_--;
+  double logdet;
+  const double *coeffs = SetCoeffs(counts_[a], &logdet);
+  set_loglikes_[a] = logdet + 0.5 * WeightedSumSq(coeffs, sums_.RowData(a),
+                                                  pair_scorer_.Dim());
+  UpdateRow(a, b);
+}
+
+double PldaAgglomerativeClusterer::BestPair(int32 *a, int32 *b) {
+  KALDI_ASSERT(num_active_ >= 2);
+  int32 num_clusters = counts_.size(), best;
+  while (true) {
+    best = -1;
+    for (int32 i = 0; i < num_clusters; i++)
+      if (counts_[i] > 0 && (best < 0 || best_[i].first > best_[best].first))
+        best = i;
+    // The largest upper bound is the best pair if it is exact; otherwise the
+    // row is scanned and the search repeated.
+    if (best_[best].second >= 0) break;
+    RescanBest(best);
+  }
+  *a = std::min(best, best_[best].second);
+  *b = std::max(best, best_[best].second);
+  return best_[best].first;
+}
+
+int32 PldaAgglomerativeClusterer::Run() {
+  while (num_active_ > 1 && num_active_ > opts_.num_clusters) {
+    int32 a, b;
+    double score = BestPair(&a, &b);
+    if (opts_.num_clusters == 0 && score < opts_.threshold) break;
+    Merge(a, b);
+  }
+  return num_active_;
+}
+
+int32 PldaAgglomerativeClusterer::ClusterOf(int32 segment) const {
+  while (parents_[segment] != segment) segment = parents_[segment];
+  return segment;
+}
+
+int32 PldaAgglomerativeClusterer::Cluster(const MatrixBase<double> &plda_inputs,
+                                          std::vector<int32> *assignments) {
+  Init(plda_inputs);
+  Run();
+  int32 num_segments = NumSegments();
+  // Segments merged early can be many parents away from their cluster, so
+  // the chains are shortened as they are followed.
+  std::vector<int32> roots(parents_);
+  for (int32 i = 0; i < num_segments; i++) {
+    int32 root = i;
+    while (roots[root] != root) root = roots[root];
+    for (int32 j = i; roots[j] != root; ) {
+      int32 next = roots[j];
+      roots[j] = root;
+      j = next;
+    }
+  }
+  std::vector<int32> numbers(num_segments, -1);
+  int32 num_clusters = 0;
+  assignments->resize(num_segments);
+  for (int32 i = 0; i < num_segments; i++) {
+    int32 root = roots[i];
+    if (numbers[root] < 0) numbers[root] = num_clusters++;
+    (*assignments)[i] = numbers[root];
+  }
+  return num_clusters;
+}
+
+}  // namespace kaldi
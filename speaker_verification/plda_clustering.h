@@ -0,0 +1,190 @@
+// speaker_verification/plda_clustering.h
+
+// Copyright (c) 2021 PeachLab. All Rights Reserved.
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_SPEAKER_VERIFICATION_PLDA_CLUSTERING_H_
+#define KALDI_SPEAKER_VERIFICATION_PLDA_CLUSTERING_H_
+
+#include <utility>
+#include <vector>
+
+#include "base/kaldi-common.h"
+#include "matrix/matrix-lib.h"
+#include "speaker_verification/plda.h"
+#include "util/options-itf.h"
+
+namespace kaldi {
+
+struct PldaClusteringOptions {
+  BaseFloat threshold;
+  int32 num_clusters;
+  int32 num_threads;
+  int32 block_size;
+
+  PldaClusteringOptions(): threshold(0.0), num_clusters(0), num_threads(0),
+                           block_size(256) { }
+
+  void Register(OptionsItf *opts) {
+    opts->Register("threshold", &threshold, "Merging stops when no two "
+                   "clusters have a log-likelihood ratio above this.");
+    opts->Register("num-clusters", &num_clusters, "If > 0, merge until there "
+                   "are this many clusters, ignoring --threshold.");
+    opts->Register("num-threads", &num_threads, "Number of threads for the "
+                   "all-pairs score matrix; 0 means one per core.");
+    opts->Register("block-size", &block_size, "Side of the square blocks "
+                   "the score matrix is computed in.");
+  }
+};
+
+/// PldaPairScorer scores sets of utterances against each other, as needed for
+/// clustering.  In the PLDA space (unit within-class variance, diagonal
+/// between-class variance \Psi), the log-likelihood of a set of n utterances
+/// from one speaker, whose PLDA inputs sum to s, is, per dimension and up to
+/// terms that cancel in the ratio,
+///   L(s, n) = -0.5 log(1 + n \Psi) + 0.5 s^2 \Psi / (1 + n \Psi),
+/// and the log-likelihood ratio of two sets being from the same speaker is
+///   L(s_a + s_b, n_a + n_b) - L(s_a, n_a) - L(s_b, n_b).
+/// This is symmetric in a and b, and for n_b = 1 equals
+/// Plda::LogLikelihoodRatio() with the set a as the enrollment.  For single
+/// utterances x_i, with g = \Psi / (1 + 2 \Psi), the ratio is
+///   x_i . (g * x_j) + v_i + v_j + const,
+/// so the all-pairs matrix is one matrix product X diag(g) X^T plus a rank-2
+/// correction; ScoreAllPairs() computes it in square blocks of the lower
+/// triangle, spread over threads.
+class PldaPairScorer {
+ public:
+  explicit PldaPairScorer(const Plda &plda);
+
+  int32 Dim() const { return psi_.Dim(); }
+
+  /// Sets (*scores)(i, j) to the log-likelihood ratio of rows i and j of
+  /// "plda_inputs" (each the PLDA input of one utterance, see
+  /// Plda::TransformIvector()) being from the same speaker.  The matrix is
+  /// symmetric, so it is kept packed; the diagonal is not meaningful.  The
+  /// score matrix is float to keep large N in memory (20k segments take
+  /// 800 MB).
+  void ScoreAllPairs(const MatrixBase<double> &plda_inputs,
+                     int32 num_threads, int32 block_size,
+                     SpMatrix<float> *scores) const;
+
+  /// The log-likelihood ratio of two sets of utterances, given the sums of
+  /// their PLDA inputs and their sizes, being from the same speaker.
+  double ScoreSets(const VectorBase<double> &sum_a, int32 n_a,
+                   const VectorBase<double> &sum_b, int32 n_b) const;
+
+  /// L(s, n) above, summed over dimensions.
+  double SetLogLikelihood(const VectorBase<double> &sum, int32 n) const;
+
+  /// Sets *coeffs to \Psi / (1 + n \Psi) and returns -0.5 logdet(1 + n \Psi),
+  /// the two things L(s, n) needs.
+  double ComputeSetCoeffs(int32 n, Vector<double> *coeffs) const;
+
+ private:
+  Vector<double> psi_;
+};
+
+/// PldaAgglomerativeClusterer does bottom-up clustering of segments (e.g.
+/// sliding-window x-vectors of a recording) for diarization, merging at each
+/// step the two clusters with the highest PLDA log-likelihood ratio.
+/// Clusters are scored as sets (PldaPairScorer::ScoreSets()) from their
+/// sufficient statistics, the sum of their PLDA inputs and their size, so
+/// after a merge only the merged cluster's row of the score matrix changes:
+/// it is recomputed from the merged statistics in O(K D) for K clusters,
+/// instead of rescoring all pairs.  The best score of each cluster is cached
+/// as an upper bound that a merge can leave stale; a stale row is only
+/// rescanned when it comes out on top, so finding the next pair to merge is
+/// O(K) as well.
+class PldaAgglomerativeClusterer {
+ public:
+  PldaAgglomerativeClusterer(const PldaClusteringOptions &opts,
+                             const Plda &plda);
+
+  /// Starts with one cluster per row of "plda_inputs" and computes the
+  /// all-pairs score matrix.
+  void Init(const MatrixBase<double> &plda_inputs);
+
+  /// Merges cluster "b" into cluster "a" (both active and different) and
+  /// updates the score matrix from the merged statistics.  Cluster b becomes
+  /// inactive.
+  void Merge(int32 a, int32 b);
+
+  /// The pair of active clusters with the highest score (a < b), and that
+  /// score; needs at least two active clusters.
+  double BestPair(int32 *a, int32 *b);
+
+  /// Merges until opts.num_clusters clusters are left or, if that is 0, no
+  /// pair scores above opts.threshold.  Returns the number of clusters.
+  int32 Run();
+
+  /// Init(), Run(), and then sets (*assignments)[i] to the cluster of
+  /// segment i, clusters numbered from 0 in order of their first segment.
+  int32 Cluster(const MatrixBase<double> &plda_inputs,
+                std::vector<int32> *assignments);
+
+  /// The cluster segment i is currently in (the index of an active cluster).
+  int32 ClusterOf(int32 segment) const;
+
+  int32 NumSegments() const { return counts_.size(); }
+  int32 NumActiveClusters() const { return num_active_; }
+  bool IsActive(int32 cluster) const { return counts_[cluster] > 0; }
+  int32 ClusterSize(int32 cluster) const { return counts_[cluster]; }
+
+  /// The score of active clusters i != j.
+  float Score(int32 i, int32 j) const {
+    return i > j ? scores_(i, j) : scores_(j, i);
+  }
+
+ private:
+  /// Coefficients of L(s, n) for sets of size n, computed on first use;
+  /// the logdet term goes in *logdet.
+  const double *SetCoeffs(int32 n, double *logdet);
+
+  /// Recomputes row "a" of scores_ and the best partners that depend on it;
+  /// "removed" is the cluster just merged into a, or -1.
+  void UpdateRow(int32 a, int32 removed);
+
+  /// Recomputes best_[i] by scanning row i.
+  void RescanBest(int32 i);
+
+  PldaClusteringOptions opts_;
+  PldaPairScorer pair_scorer_;
+
+  SpMatrix<float> scores_;
+  /// Row i is the sum of the PLDA inputs of cluster i.
+  Matrix<double> sums_;
+  /// Size of each cluster; 0 for clusters merged into another.
+  std::vector<int32> counts_;
+  /// L(s, n) of each cluster.
+  std::vector<double> set_loglikes_;
+  /// For each active cluster, the highest score against another active
+  /// cluster and that cluster; or, if the cluster is -1, an upper bound on
+  /// the highest score.
+  std::vector<std::pair<float, int32> > best_;
+  /// The cluster each cluster was merged into, or itself.
+  std::vector<int32> parents_;
+  int32 num_active_;
+
+  /// Element n is \Psi / (1 + n \Psi), or empty if not yet needed, and
+  /// set_logdets_[n] the matching -0.5 logdet(1 + n \Psi).
+  std::vector<Vector<double> > set_coeffs_;
+  std::vector<double> set_logdets_;
+};
+
+}  // namespace kaldi
+
+#endif  // KALDI_SPEAKER_VERIFICATION_PLDA_CLUSTERING_H_
@@ -0,0 +1,186 @@
+// speaker_verification/plda_clustering_benchmark.cc
+
+// Copyright (c) 2021 PeachLab. All Rights Reserved.
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+// Speed of the all-pairs PLDA score matrix and of agglomerative clustering
+// on synthetic segments, against pair-by-pair Plda::LogLikelihoodRatio().
+
+#include <algorithm>
+#include <functional>
+#include <sstream>
+#include <thread>
+
+#include "base/kaldi-common.h"
+#include "base/timer.h"
+#include "speaker_verification/plda_clustering.h"
+#include "util/parse-options.h"
+#include "util/text-utils.h"
+
+namespace kaldi {
+
+// Makes a PLDA model whose transform is the identity, with between-class
+// variances "psi" spread over [0.5, 5.5], through the model's own Read().
+static void MakeRandomPlda(int32 dim, Plda *plda, Vector<double> *psi) {
+  Vector<double> mean(dim);
+  Matrix<double> transform(dim, dim);
+  transform.SetUnit();
+  psi->Resize(dim);
+  psi->SetRandUniform();
+  psi->Scale(5.0);
+  psi->Add(0.5);
+  std::sort(psi->Data(), psi->Data() + dim, std::greater<double>());
+  std::ostringstream os;
+  bool binary = true;
+  WriteToken(os, binary, "<Plda>");
+  mean.Write(os, binary);
+  transform.Write(os, binary);
+  psi->Write(os, binary);
+  WriteToken(os, binary, "</Plda>");
+  std::istringstream is(os.str());
+  plda->Read(is, binary);
+}
+
+}  // namespace kaldi
+
+int main(int argc, char *argv[]) {
+  using namespace kaldi;
+  try {
+    const char *usage =
+        "Times the all-pairs PLDA score matrix on 1, 2, 4, ... threads and\n"
+        "agglomerative clustering with incremental merges, for recordings of\n"
+        "synthetic segments of each size in --num-segments.\n"
+        "Usage:  plda-clustering-benchmark [options]\n";
+    ParseOptions po(usage);
+    PldaClusteringOptions cluster_opts;
+    int32 dim = 128, num_speakers = 10, max_threads = 0,
+        num_sampled_pairs = 100000;
+    std::string num_segments_str = "1000,2000,5000,10000,20000";
+    cluster_opts.Register(&po);
+    po.Register("dim", &dim, "Dimension of the PLDA inputs.");
+    po.Register("num-speakers", &num_speakers, "Number of speakers in each "
+                "recording.");
+    po.Register("num-segments", &num_segments_str, "Comma-separated list of "
+                "recording sizes, in segments.");
+    po.Register("max-threads", &max_threads, "Largest number of threads to "
+                "try; 0 means one per core.");
+    po.Register("num-sampled-pairs", &num_sampled_pairs, "Number of pairs "
+                "the pair-by-pair time is measured on.");
+    po.Read(argc, argv);
+    std::vector<int32> num_segments_list;
+    if (po.NumArgs() != 0 ||
+        !SplitStringToIntegers(num_segments_str, ",", false,
+                               &num_segments_list)) {
+      po.PrintUsage();
+      exit(1);
+    }
+    if (max_threads == 0)
+      max_threads = std::max<int32>(1, std::thread::hardware_concurrency());
+
+    Plda plda;
+    Vector<double> psi_sqrt;
+    MakeRandomPlda(dim, &plda, &psi_sqrt);
+    psi_sqrt.ApplyPow(0.5);
+    PldaPairScorer pair_scorer(plda);
+
+    for (size_t k = 0; k < num_segments_list.size(); k++) {
+      int32 num_segments = num_segments_list[k];
+      // A speaker is s ~ N(0, Psi) and a segment of it s + N(0, I).
+      Matrix<double> speakers(num_speakers, dim);
+      speakers.SetRandn();
+      speakers.MulColsVec(psi_sqrt);
+      Matrix<double> segments(num_segments, dim);
+      segments.SetRandn();
+      std::vector<int32> labels(num_segments);
+      for (int32 i = 0; i < num_segments; i++) {
+        labels[i] = RandInt(0, num_speakers - 1);
+        segments.Row(i).AddVec(1.0, speakers.Row(labels[i]));
+      }
+      double num_pairs = 0.5 * num_segments * (num_segments - 1.0);
+
+      Timer timer;
+      double sum = 0.0;
+      for (int32 p = 0; p < num_sampled_pairs; p++) {
+        int32 i = RandInt(0, num_segments - 1), j = RandInt(0, num_segments - 1);
+        sum += plda.LogLikelihoodRatio(segments.Row(i), 1, segments.Row(j));
+      }
+      double pair_time = timer.Elapsed() / num_sampled_pairs * num_pairs;
+      KALDI_LOG << num_segments << " segments: pair by pair (estimated from "
+                << num_sampled_pairs << " pairs) " << pair_time << " s.";
+      KALDI_VLOG(2) << "Checksum " << sum;
+
+      SpMatrix<float> scores;
+      double one_thread_time = 0.0;
+      for (int32 num_threads = 1; ; num_threads *= 2) {
+        num_threads = std::min(num_threads, max_threads);
+        timer.Reset();
+        pair_scorer.ScoreAllPairs(segments, num_threads,
+                                  cluster_opts.block_size, &scores);
+        double matrix_time = timer.Elapsed();
+        if (num_threads == 1) one_thread_time = matrix_time;
+        KALDI_LOG << num_segments << " segments: score matrix, "
+                  << num_threads << " threads, " << matrix_time << " s ("
+                  << 2.0 * num_pairs * dim / matrix_time * 1.0e-09
+                  << " GFlops), " << pair_time / matrix_time
+                  << " times pair by pair, " << one_thread_time / matrix_time
+                  << " times one thread.";
+        if (num_threads == max_threads) break;
+      }
+      double max_diff = 0.0;
+      for (int32 p = 0; p < 1000; p++) {
+        int32 i = RandInt(0, num_segments - 1), j = RandInt(0, num_segments - 1);
+        if (i == j) continue;
+        max_diff = std::max(max_diff, std::abs(
+            scores(i, j) - plda.LogLikelihoodRatio(segments.Row(i), 1,
+                                                   segments.Row(j))));
+      }
+      KALDI_LOG << "Largest difference from LogLikelihoodRatio() " << max_diff;
+      scores.Resize(0);
+
+      PldaClusteringOptions opts(cluster_opts);
+      opts.num_clusters = num_speakers;
+      PldaAgglomerativeClusterer clusterer(opts, plda);
+      timer.Reset();
+      clusterer.Init(segments);
+      double init_time = timer.Elapsed();
+      timer.Reset();
+      clusterer.Run();
+      double run_time = timer.Elapsed();
+      int32 num_merges = num_segments - clusterer.NumActiveClusters();
+      // Purity: the fraction of segments whose cluster's majority speaker is
+      // their own.
+      std::vector<std::vector<int32> > counts(
+          num_segments, std::vector<int32>(num_speakers, 0));
+      for (int32 i = 0; i < num_segments; i++)
+        counts[clusterer.ClusterOf(i)][labels[i]]++;
+      int32 num_correct = 0;
+      for (int32 c = 0; c < num_segments; c++)
+        num_correct += *std::max_element(counts[c].begin(), counts[c].end());
+      KALDI_LOG << num_segments << " segments: clustering to "
+                << clusterer.NumActiveClusters() << " clusters: init "
+                << init_time << " s, " << num_merges << " merges "
+                << run_time << " s (" << 1000.0 * run_time / num_merges
+                << " ms per merge, against " << init_time << " s to "
+                << "recompute all pairs), purity "
+                << static_cast<double>(num_correct) / num_segments;
+    }
+    return 0;
+  } catch(const std::exception &e) {
+    std::cerr << e.what();
+    return -1;
+  }
+}
@@ -0,0 +1,290 @@
+// speaker_verification/plda_scorer_benchmark.cc
+
+// Copyright (c) 2021 PeachLab. All Rights Reserved.
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+// Speed of PLDA scoring in float against double, and the largest score
+// difference between them: on synthetic speakers, or on real trials
+// (validation mode).  The double path is Plda::TransformIvector() and
+// PldaScorer; the float path is CompiledXvectorTransform<float> (the PLDA
+// transform alone) and PldaScorerTpl<float>, as XvectorControllerImpl scores.
+
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <sstream>
+
+#include "base/kaldi-common.h"
+#include "base/timer.h"
+#include "speaker_verification/plda.h"
+#include "speaker_verification/xvector_transform.h"
+#include "util/common-utils.h"
+
+namespace kaldi {
+
+// Makes a PLDA model with a random transform and between-class variances
+// spread over [0.1, 1.1] times "psi_scale", through the model's own Read().
+static void MakeRandomPlda(int32 dim, double psi_scale, Plda *plda) {
+  Vector<double> mean(dim), psi(dim);
+  Matrix<double> transform(dim, dim);
+  mean.SetRandn();
+  transform.SetRandn();
+  psi.SetRandUniform();
+  psi.Add(0.1);
+  psi.Scale(psi_scale);
+  std::sort(psi.Data(), psi.Data() + dim, std::greater<double>());
+  std::ostringstream os;
+  bool binary = true;
+  WriteToken(os, binary, "<Plda>");
+  mean.Write(os, binary);
+  transform.Write(os, binary);
+  psi.Write(os, binary);
+  WriteToken(os, binary, "</Plda>");
+  std::istringstream is(os.str());
+  plda->Read(is, binary);
+}
+
+// The PLDA transform on its own, compiled in float.
+static void CompilePldaTransform(const Plda &plda,
+                                 const PldaConfig &plda_config,
+                                 CompiledXvectorTransform<float> *transform) {
+  int32 dim = plda.Dim();
+  Vector<BaseFloat> mean(dim);
+  Matrix<BaseFloat> identity(dim, dim);
+  identity.SetUnit();
+  transform->Compile(mean, identity, false, plda, plda_config);
+}
+
+// Both scoring paths, with the same speakers.
+class ScorerPair {
+ public:
+  ScorerPair(const Plda &plda, const PldaConfig &plda_config):
+      plda_(plda), plda_config_(plda_config),
+      double_scorer_(plda), float_scorer_(plda) {
+    CompilePldaTransform(plda, plda_config, &float_transform_);
+  }
+
+  int32 AddSpeaker(const VectorBase<BaseFloat> &ivector, int32 num_utts) {
+    Vector<double> ivector_dbl(ivector), transformed_dbl(plda_.Dim());
+    plda_.TransformIvector(plda_config_, ivector_dbl, num_utts,
+                           &transformed_dbl);
+    double_scorer_.AddSpeaker(transformed_dbl, num_utts);
+    Vector<float> ivector_flt(ivector), transformed_flt(plda_.Dim());
+    float_transform_.Apply(ivector_flt, num_utts, &transformed_flt);
+    return float_scorer_.AddSpeaker(transformed_flt, num_utts);
+  }
+
+  void TransformTest(const VectorBase<BaseFloat> &ivector,
+                     Vector<double> *transformed_dbl,
+                     Vector<float> *transformed_flt) const {
+    Vector<double> ivector_dbl(ivector);
+    transformed_dbl->Resize(plda_.Dim(), kUndefined);
+    plda_.TransformIvector(plda_config_, ivector_dbl, 1, transformed_dbl);
+    Vector<float> ivector_flt(ivector);
+    transformed_flt->Resize(plda_.Dim(), kUndefined);
+    float_transform_.Apply(ivector_flt, 1, transformed_flt);
+  }
+
+  const PldaScorer &DoubleScorer() const { return double_scorer_; }
+  const PldaScorerTpl<float> &FloatScorer() const { return float_scorer_; }
+
+ private:
+  const Plda &plda_;
+  PldaConfig plda_config_;
+  PldaScorer double_scorer_;
+  CompiledXvectorTransform<float> float_transform_;
+  PldaScorerTpl<float> float_scorer_;
+};
+
+// Scores "trials_rxfilename" ("<speaker> <utterance>" lines) both ways and
+// reports the largest differences.
+static void Validate(const Plda &plda, const PldaConfig &plda_config,
+                     const std::string &train_rspecifier,
+                     const std::string &test_rspecifier,
+                     const std::string &trials_rxfilename,
+                     const std::string &num_utts_rspecifier) {
+  ScorerPair scorers(plda, plda_config);
+  std::map<std::string, int32> speaker_index;
+  RandomAccessInt32Reader num_utts_reader(num_utts_rspecifier);
+  for (SequentialBaseFloatVectorReader train_reader(train_rspecifier);
+       !train_reader.Done(); train_reader.Next()) {
+    int32 num_utts = 1;
+    if (!num_utts_rspecifier.empty()) {
+      if (!num_utts_reader.HasKey(train_reader.Key()))
+        KALDI_ERR << "No number of utterances for " << train_reader.Key();
+      num_utts = num_utts_reader.Value(train_reader.Key());
+    }
+    speaker_index[train_reader.Key()] =
+        scorers.AddSpeaker(train_reader.Value(), num_utts);
+  }
+  RandomAccessBaseFloatVectorReader test_reader(test_rspecifier);
+  Input ki(trials_rxfilename);
+  std::string line;
+  int64 num_trials = 0, num_skipped = 0;
+  double max_diff = 0.0, max_rel_diff = 0.0, sum_diff = 0.0;
+  std::string max_trial;
+  Vector<double> test_dbl, score_dbl(1);
+  Vector<float> test_flt, score_flt(1);
+  while (std::getline(ki.Stream(), line)) {
+    std::vector<std::string> fields;
+    SplitStringToVector(line, " \t", true, &fields);
+    if (fields.size() < 2)
+      KALDI_ERR << "Bad line in trials file: " << line;
+    std::map<std::string, int32>::const_iterator iter =
+        speaker_index.find(fields[0]);
+    if (iter == speaker_index.end() || !test_reader.HasKey(fields[1])) {
+      num_skipped++;
+      continue;
+    }
+    std::vector<int32> indexes(1, iter->second);
+    scorers.TransformTest(test_reader.Value(fields[1]), &test_dbl, &test_flt);
+    scorers.DoubleScorer().ScoreSubset(test_dbl, indexes, &score_dbl);
+    scorers.FloatScorer().ScoreSubset(test_flt, indexes, &score_flt);
+    double diff = std::abs(score_dbl(0) - score_flt(0));
+    sum_diff += diff;
+    if (diff > max_diff) {
+      max_diff = diff;
+      max_trial = fields[0] + " " + fields[1];
+    }
+    max_rel_diff = std::max(max_rel_diff,
+                            diff / std::max(1.0, std::abs(score_dbl(0))));
+    num_trials++;
+  }
+  if (num_skipped > 0)
+    KALDI_WARN << "Skipped " << num_skipped << " trials with a missing "
+               << "speaker or utterance.";
+  if (num_trials == 0) KALDI_ERR << "No trials scored.";
+  KALDI_LOG << num_trials << " trials: largest score difference " << max_diff
+            << " (" << max_trial << "), mean " << sum_diff / num_trials
+            << ", largest relative difference " << max_rel_diff;
+}
+
+}  // namespace kaldi
+
+int main(int argc, char *argv[]) {
+  using namespace kaldi;
+  try {
+    const char *usage =
+        "Measures PLDA scoring in float against double, and the largest\n"
+        "score difference between them.  With no arguments it runs on\n"
+        "synthetic speakers; given a PLDA model, enrollment and test\n"
+        "i-vectors (as for ivector-plda-scoring, i.e. already mean-\n"
+        "subtracted, LDA-transformed and length-normalized) and a trials\n"
+        "list, it validates the float path on those trials.\n"
+        "Usage:  plda-scorer-benchmark [options]\n"
+        " or:  plda-scorer-benchmark [options] <plda> "
+        "<train-ivector-rspecifier> <test-ivector-rspecifier> "
+        "<trials-rxfilename>\n";
+    ParseOptions po(usage);
+    PldaConfig plda_config;
+    int32 dim = 128, num_speakers = 10000, num_tests = 1000,
+        batch_size = 64;
+    BaseFloat psi_scale = 0.5;
+    std::string num_utts_rspecifier;
+    plda_config.Register(&po);
+    po.Register("dim", &dim, "Dimension of the synthetic i-vectors.");
+    po.Register("num-speakers", &num_speakers, "Number of synthetic "
+                "enrolled speakers.");
+    po.Register("num-tests", &num_tests, "Number of synthetic test "
+                "i-vectors.");
+    po.Register("batch-size", &batch_size, "Test i-vectors per ScoreBatch().");
+    po.Register("psi-scale", &psi_scale, "Scale of the synthetic "
+                "between-class variances.");
+    po.Register("num-utts", &num_utts_rspecifier, "Validation: table of the "
+                "number of utterances per enrolled speaker (default 1).");
+    po.Read(argc, argv);
+    if (po.NumArgs() == 4) {
+      Plda plda;
+      ReadKaldiObject(po.GetArg(1), &plda);
+      Validate(plda, plda_config, po.GetArg(2), po.GetArg(3), po.GetArg(4),
+               num_utts_rspecifier);
+      return 0;
+    }
+    if (po.NumArgs() != 0) {
+      po.PrintUsage();
+      exit(1);
+    }
+
+    Plda plda;
+    MakeRandomPlda(dim, psi_scale, &plda);
+    ScorerPair scorers(plda, plda_config);
+    Vector<BaseFloat> ivector(dim);
+    for (int32 k = 0; k < num_speakers; k++) {
+      ivector.SetRandn();
+      scorers.AddSpeaker(ivector, RandInt(1, 5));
+    }
+    Matrix<double> tests_dbl(num_tests, dim);
+    Matrix<float> tests_flt(num_tests, dim);
+    for (int32 i = 0; i < num_tests; i++) {
+      ivector.SetRandn();
+      Vector<double> test_dbl;
+      Vector<float> test_flt;
+      scorers.TransformTest(ivector, &test_dbl, &test_flt);
+      tests_dbl.Row(i).CopyFromVec(test_dbl);
+      tests_flt.Row(i).CopyFromVec(test_flt);
+    }
+
+    // One test at a time, as in verification.
+    Vector<double> scores_dbl(num_speakers);
+    Vector<float> scores_flt(num_speakers);
+    double max_diff = 0.0, double_time = 0.0, float_time = 0.0;
+    for (int32 i = 0; i < num_tests; i++) {
+      Timer timer;
+      scorers.DoubleScorer().Score(tests_dbl.Row(i), &scores_dbl);
+      double_time += timer.Elapsed();
+      timer.Reset();
+      scorers.FloatScorer().Score(tests_flt.Row(i), &scores_flt);
+      float_time += timer.Elapsed();
+      for (int32 k = 0; k < num_speakers; k++)
+        max_diff = std::max(max_diff,
+                            std::abs(scores_dbl(k) - scores_flt(k)));
+    }
+    KALDI_LOG << "Score() against " << num_speakers << " speakers of dim "
+              << dim << ": double " << 1.0e+06 * double_time / num_tests
+              << " us, float " << 1.0e+06 * float_time / num_tests
+              << " us per test (x" << double_time / float_time << ").";
+
+    // Batches of tests, as in scoring against a cohort.
+    double_time = float_time = 0.0;
+    for (int32 i = 0; i + batch_size <= num_tests; i += batch_size) {
+      Matrix<double> batch_scores_dbl(batch_size, num_speakers, kUndefined);
+      Matrix<float> batch_scores_flt(batch_size, num_speakers, kUndefined);
+      Timer timer;
+      scorers.DoubleScorer().ScoreBatch(tests_dbl.RowRange(i, batch_size),
+                                        &batch_scores_dbl);
+      double_time += timer.Elapsed();
+      timer.Reset();
+      scorers.FloatScorer().ScoreBatch(tests_flt.RowRange(i, batch_size),
+                                       &batch_scores_flt);
+      float_time += timer.Elapsed();
+      Matrix<double> diff(batch_scores_flt);
+      diff.AddMat(-1.0, batch_scores_dbl);
+      max_diff = std::max<double>(max_diff, diff.LargestAbsElem());
+    }
+    int32 num_batched = num_tests / batch_size * batch_size;
+    if (num_batched > 0)
+      KALDI_LOG << "ScoreBatch() of " << batch_size << ": double "
+                << 1.0e+06 * double_time / num_batched << " us, float "
+                << 1.0e+06 * float_time / num_batched << " us per test (x"
+                << double_time / float_time << ").";
+    KALDI_LOG << "Largest score difference " << max_diff;
+    return 0;
+  } catch(const std::exception &e) {
+    std::cerr << e.what();
+    return -1;
+  }
+}
@@ -0,0 +1,136 @@
+// speaker_verification/plda_scorer_test.cc
+
+// Copyright (c) 2021 PeachLab. All Rights Reserved.
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <sstream>
+
+#include "speaker_verification/plda.h"
+
+namespace kaldi {
+
+// A PLDA model with a random mean, transform and between-class variances.
+static void MakeRandomPlda(int32 dim, Plda *plda) {
+  Vector<double> mean(dim), psi(dim);
+  Matrix<double> transform(dim, dim);
+  mean.SetRandn();
+  transform.SetRandn();
+  transform.AddToDiag(2.0);
+  psi.SetRandUniform();
+  psi.Scale(5.0);
+  psi.Add(0.1);
+  std::sort(psi.Data(), psi.Data() + dim, std::greater<double>());
+  std::ostringstream os;
+  bool binary = true;
+  WriteToken(os, binary, "<Plda>");
+  mean.Write(os, binary);
+  transform.Write(os, binary);
+  psi.Write(os, binary);
+  WriteToken(os, binary, "</Plda>");
+  std::istringstream is(os.str());
+  plda->Read(is, binary);
+}
+
+// Transformed iVectors, as LogLikelihoodRatio() takes them.
+static void RandomPldaInput(const Plda &plda, int32 num_utts,
+                            Vector<double> *plda_input) {
+  Vector<double> ivector(plda.Dim());
+  ivector.SetRandn();
+  plda_input->Resize(plda.Dim());
+  PldaConfig config;
+  plda.TransformIvector(config, ivector, num_utts, plda_input);
+}
+
+static bool ApproxEqualScore(double a, double b, double tolerance) {
+  return std::abs(a - b) <= tolerance * (1.0 + std::abs(b));
+}
+
+template<typename Real>
+static void UnitTestPldaScorer(double tolerance) {
+  for (int32 iter = 0; iter < 5; iter++) {
+    int32 dim = 10 + Rand() % 50, num_speakers = 1 + Rand() % 20;
+    Plda plda;
+    MakeRandomPlda(dim, &plda);
+    PldaScorerTpl<Real> scorer(plda);
+
+    std::vector<Vector<double> > speakers(num_speakers);
+    std::vector<int32> num_utts(num_speakers);
+    for (int32 k = 0; k < num_speakers; k++) {
+      num_utts[k] = 1 + Rand() % 5;
+      RandomPldaInput(plda, num_utts[k], &(speakers[k]));
+      KALDI_ASSERT(scorer.AddSpeaker(Vector<Real>(speakers[k]), num_utts[k])
+                   == k);
+    }
+    // Replacing a speaker must give the scores of the new one.
+    int32 replaced = Rand() % num_speakers;
+    num_utts[replaced] = 1 + Rand() % 5;
+    RandomPldaInput(plda, num_utts[replaced], &(speakers[replaced]));
+    scorer.SetSpeaker(replaced, Vector<Real>(speakers[replaced]),
+                      num_utts[replaced]);
+
+    int32 num_tests = 1 + Rand() % 4;
+    Matrix<Real> tests(num_tests, dim);
+    Matrix<double> expected(num_tests, num_speakers);
+    for (int32 i = 0; i < num_tests; i++) {
+      Vector<double> test;
+      RandomPldaInput(plda, 1, &test);
+      tests.Row(i).CopyFromVec(test);
+      for (int32 k = 0; k < num_speakers; k++)
+        expected(i, k) = plda.LogLikelihoodRatio(speakers[k], num_utts[k],
+                                                 test);
+    }
+
+    Matrix<Real> batch_scores(num_tests, num_speakers);
+    scorer.ScoreBatch(tests, &batch_scores);
+    std::vector<int32> subset;
+    for (int32 k = num_speakers - 1; k >= 0; k -= 2) subset.push_back(k);
+    for (int32 i = 0; i < num_tests; i++) {
+      Vector<Real> scores(num_speakers);
+      scorer.Score(tests.Row(i), &scores);
+      for (int32 k = 0; k < num_speakers; k++) {
+        KALDI_ASSERT(ApproxEqualScore(scores(k), expected(i, k), tolerance));
+        KALDI_ASSERT(ApproxEqualScore(batch_scores(i, k), expected(i, k),
+                                      tolerance));
+      }
+      Vector<Real> subset_scores(subset.size());
+      scorer.ScoreSubset(tests.Row(i), subset, &subset_scores);
+      for (size_t j = 0; j < subset.size(); j++)
+        KALDI_ASSERT(ApproxEqualScore(subset_scores(j),
+                                      expected(i, subset[j]), tolerance));
+    }
+    int32 speaker = Rand() % num_speakers;
+    Vector<Real> speaker_scores(num_tests);
+    scorer.ScoreSpeaker(speaker, tests, &speaker_scores);
+    for (int32 i = 0; i < num_tests; i++)
+      KALDI_ASSERT(ApproxEqualScore(speaker_scores(i), expected(i, speaker),
+                                    tolerance));
+  }
+}
+
+}  // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  UnitTestPldaScorer<double>(1.0e-6);
+  // Float scores differ from the double ones by about 1e-4 (see plda.h).
+  UnitTestPldaScorer<float>(1.0e-3);
+  KALDI_LOG << "Tests succeeded.";
+  return 0;
+}
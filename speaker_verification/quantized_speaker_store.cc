@@ -0,0 +1,602 @@
+// speaker_verification/quantized_speaker_store.cc
+
+// Copyright (c) 2021 PeachLab. All Rights Reserved.
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <queue>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "speaker_verification/kmeans.h"
+#include "speaker_verification/quantized_speaker_store.h"
+
+namespace kaldi {
+
+// slot_counts_ value of a slot that holds no speaker.
+static const uint16 kFreeSlot = 0xFFFF;
+
+// Number of entries in each product-quantizer look-up table.
+static const int32 kCodebookSize = 256;
+
+// Returns sum_d weights[d] * codes[d]; "dim" is a multiple of 16.
+static inline float DotInt8(const float *weights, const int8 *codes,
+                            int32 dim) {
+#if defined(__AVX2__)
+  __m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps();
+  for (int32 d = 0; d < dim; d += 16) {
+    __m128i bytes = _mm_loadu_si128(
+        reinterpret_cast<const __m128i*>(codes + d));
+    __m256 lo = _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(bytes)),
+        hi = _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(
+            _mm_srli_si128(bytes, 8)));
+    acc0 = _mm256_add_ps(acc0, _mm256_mul_ps(lo, _mm256_loadu_ps(weights + d)));
+    acc1 = _mm256_add_ps(acc1,
+                         _mm256_mul_ps(hi, _mm256_loadu_ps(weights + d + 8)));
+  }
+  acc0 = _mm256_add_ps(acc0, acc1);
+  __m128 sum = _mm_add_ps(_mm256_castps256_ps128(acc0),
+                          _mm256_extractf128_ps(acc0, 1));
+  sum = _mm_hadd_ps(sum, sum);
+  sum = _mm_hadd_ps(sum, sum);
+  return _mm_cvtss_f32(sum);
+#elif defined(__ARM_NEON)
+  float32x4_t acc0 = vdupq_n_f32(0.0f), acc1 = vdupq_n_f32(0.0f),
+      acc2 = vdupq_n_f32(0.0f), acc3 = vdupq_n_f32(0.0f);
+  for (int32 d = 0; d < dim; d += 16) {
+    int8x16_t bytes = vld1q_s8(codes + d);
+    int16x8_t lo = vmovl_s8(vget_low_s8(bytes)),
+        hi = vmovl_s8(vget_high_s8(bytes));
+    acc0 = vmlaq_f32(acc0, vcvtq_f32_s32(vmovl_s16(vget_low_s16(lo))),
+                     vld1q_f32(weights + d));
+    acc1 = vmlaq_f32(acc1, vcvtq_f32_s32(vmovl_s16(vget_high_s16(lo))),
+                     vld1q_f32(weights + d + 4));
+    acc2 = vmlaq_f32(acc2, vcvtq_f32_s32(vmovl_s16(vget_low_s16(hi))),
+                     vld1q_f32(weights + d + 8));
+    acc3 = vmlaq_f32(acc3, vcvtq_f32_s32(vmovl_s16(vget_high_s16(hi))),
+                     vld1q_f32(weights + d + 12));
+  }
+  float32x4_t sum = vaddq_f32(vaddq_f32(acc0, acc1), vaddq_f32(acc2, acc3));
+  float32x2_t pair = vadd_f32(vget_low_f32(sum), vget_high_f32(sum));
+  return vget_lane_f32(vpadd_f32(pair, pair), 0);
+#else
+  float sum0 = 0.0f, sum1 = 0.0f, sum2 = 0.0f, sum3 = 0.0f;
+  for (int32 d = 0; d < dim; d += 4) {
+    sum0 += weights[d] * codes[d];
+    sum1 += weights[d + 1] * codes[d + 1];
+    sum2 += weights[d + 2] * codes[d + 2];
+    sum3 += weights[d + 3] * codes[d + 3];
+  }
+  return (sum0 + sum1) + (sum2 + sum3);
+#endif
+}
+
+// Returns sum_m tables[m * kCodebookSize + codes[m]].
+static inline float SumLookups(const float *tables, const uint8 *codes,
+                               int32 num_subquantizers) {
+  float sum = 0.0f;
+  int32 m = 0;
+#if defined(__AVX2__)
+  const __m256i table_offsets = _mm256_setr_epi32(
+      0, kCodebookSize, 2 * kCodebookSize, 3 * kCodebookSize,
+      4 * kCodebookSize, 5 * kCodebookSize, 6 * kCodebookSize,
+      7 * kCodebookSize);
+  __m256 acc = _mm256_setzero_ps();
+  for (; m + 8 <= num_subquantizers; m += 8) {
+    __m128i bytes = _mm_loadl_epi64(
+        reinterpret_cast<const __m128i*>(codes + m));
+    __m256i indexes = _mm256_add_epi32(_mm256_cvtepu8_epi32(bytes),
+                                       table_offsets);
+    acc = _mm256_add_ps(acc, _mm256_i32gather_ps(
+        tables + m * kCodebookSize, indexes, sizeof(float)));
+  }
+  __m128 acc4 = _mm_add_ps(_mm256_castps256_ps128(acc),
+                           _mm256_extractf128_ps(acc, 1));
+  acc4 = _mm_hadd_ps(acc4, acc4);
+  acc4 = _mm_hadd_ps(acc4, acc4);
+  sum = _mm_cvtss_f32(acc4);
+#endif
+  for (; m < num_subquantizers; m++)
+    sum += tables[m * kCodebookSize + codes[m]];
+  return sum;
+}
+
+BaseFloat ComputeEer(std::vector<BaseFloat> *target_scores,
+                     std::vector<BaseFloat> *nontarget_scores,
+                     BaseFloat *threshold) {
+  KALDI_ASSERT(!target_scores->empty() && !nontarget_scores->empty());
+  std::sort(target_scores->begin(), target_scores->end());
+  std::sort(nontarget_scores->begin(), nontarget_scores->end());
+  size_t target_size = target_scores->size();
+  ssize_t nontarget_size = nontarget_scores->size();
+  // Walk the threshold up through the target scores until the fraction of
+  // targets rejected reaches the fraction of nontargets accepted.
+  size_t target_position = 0;
+  for (; target_position + 1 < target_size; target_position++) {
+    ssize_t nontarget_n = nontarget_size * target_position * 1.0 /
+        target_size,
+        nontarget_position = nontarget_size - 1 - nontarget_n;
+    if (nontarget_position < 0) nontarget_position = 0;
+    if ((*nontarget_scores)[nontarget_position] <
+        (*target_scores)[target_position])
+      break;
+  }
+  if (threshold != NULL) *threshold = (*target_scores)[target_position];
+  return target_position * 1.0 / target_size;
+}
+
+QuantizedSpeakerStore::QuantizedSpeakerStore(
+    const QuantizedSpeakerStoreOptions &opts, const Plda &plda):
+    opts_(opts), plda_(plda), use_pq_(opts.quantizer == "pq"),
+    code_size_(0), code_stride_(0), exact_store_(NULL) {
+  if (opts_.quantizer != "int8" && opts_.quantizer != "pq")
+    KALDI_ERR << "Unknown quantizer \"" << opts_.quantizer
+              << "\"; expected int8 or pq.";
+  KALDI_ASSERT(opts_.num_subquantizers > 0 && opts_.num_kmeans_iters >= 0 &&
+               opts_.num_rerank >= 0);
+}
+
+void QuantizedSpeakerStore::ComputeSpeakerTerms(
+    const VectorBase<double> &plda_input, int32 n, Vector<double> *u,
+    double *bias) const {
+  int32 dim = Dim();
+  KALDI_ASSERT(plda_input.Dim() == dim && n > 0);
+  // Same quantities as PldaScorer::SetSpeaker().
+  const Vector<double> &psi = plda_.psi_;
+  u->Resize(dim, kUndefined);
+  double logdet = 0.0, offset = 0.0;
+  for (int32 d = 0; d < dim; d++) {
+    double mean = n * psi(d) / (n * psi(d) + 1.0) * plda_input(d),
+        variance = 1.0 + psi(d) / (n * psi(d) + 1.0);
+    logdet += Log(variance);
+    (*u)(d) = mean / variance;
+    offset += mean * mean / variance;
+  }
+  *bias = -0.5 * (offset + logdet);
+}
+
+int32 QuantizedSpeakerStore::CountIndex(int32 num_utts) {
+  for (size_t i = 0; i < enroll_counts_.size(); i++)
+    if (enroll_counts_[i] == num_utts) return i;
+  int32 index = enroll_counts_.size();
+  if (index >= kFreeSlot)
+    KALDI_ERR << "Too many distinct enrollment counts in a quantized speaker "
+              << "store (the limit is " << kFreeSlot - 1 << ").";
+  enroll_counts_.push_back(num_utts);
+  const Vector<double> &psi = plda_.psi_;
+  count_inv_vars_.Resize(index + 1, Dim(), kCopyData);
+  for (int32 d = 0; d < Dim(); d++)
+    count_inv_vars_(index, d) =
+        1.0 / (1.0 + psi(d) / (num_utts * psi(d) + 1.0));
+  return index;
+}
+
+void QuantizedSpeakerStore::Train(const MatrixBase<double> &samples,
+                                  int32 num_utts) {
+  int32 dim = Dim(), num_samples = samples.NumRows();
+  KALDI_ASSERT(samples.NumCols() == dim && num_samples > 0);
+  Matrix<double> us(num_samples, dim, kUndefined);
+  for (int32 i = 0; i < num_samples; i++) {
+    Vector<double> u;
+    double bias;
+    ComputeSpeakerTerms(samples.Row(i), num_utts, &u, &bias);
+    us.Row(i).CopyFromVec(u);
+  }
+  if (!use_pq_) {
+    // Each dimension's range over the samples is spread over the 256 codes;
+    // values outside it are clamped.
+    offsets_.Resize(dim, kUndefined);
+    scales_.Resize(dim, kUndefined);
+    for (int32 d = 0; d < dim; d++) {
+      double min = us(0, d), max = us(0, d);
+      for (int32 i = 1; i < num_samples; i++) {
+        min = std::min(min, us(i, d));
+        max = std::max(max, us(i, d));
+      }
+      double scale = (max > min ? (max - min) / 255.0 : 1.0);
+      scales_(d) = scale;
+      offsets_(d) = min + 128.0 * scale;
+    }
+    code_size_ = dim;
+    code_stride_ = (dim + 15) / 16 * 16;
+  } else {
+    int32 num_subquantizers = std::min(opts_.num_subquantizers, dim),
+        codebook_size = std::min(kCodebookSize, num_samples);
+    subspace_offsets_.resize(num_subquantizers + 1);
+    for (int32 m = 0; m <= num_subquantizers; m++)
+      subspace_offsets_[m] = (m * dim) / num_subquantizers;
+    codebooks_.resize(num_subquantizers);
+    for (int32 m = 0; m < num_subquantizers; m++) {
+      int32 offset = subspace_offsets_[m],
+          len = subspace_offsets_[m + 1] - offset;
+      KMeans(us.ColRange(offset, len), codebook_size, opts_.num_kmeans_iters,
+             &(codebooks_[m]));
+    }
+    code_size_ = num_subquantizers;
+    code_stride_ = num_subquantizers;
+  }
+  ClearSpeakers();
+  KALDI_LOG << "Trained " << opts_.quantizer << " speaker quantizer on "
+            << num_samples << " samples; " << BytesPerSpeaker()
+            << " bytes per speaker.";
+}
+
+void QuantizedSpeakerStore::ClearSpeakers() {
+  enroll_counts_.clear();
+  count_inv_vars_.Resize(0, 0);
+  codes_.clear();
+  slot_biases_.clear();
+  slot_counts_.clear();
+  slot_keys_.clear();
+  free_slots_.clear();
+  key_to_slot_.clear();
+}
+
+void QuantizedSpeakerStore::Encode(const VectorBase<double> &u,
+                                   uint8 *code) const {
+  if (!use_pq_) {
+    int8 *int8_code = reinterpret_cast<int8*>(code);
+    for (int32 d = 0; d < code_size_; d++) {
+      double c = std::floor((u(d) - offsets_(d)) / scales_(d) + 0.5);
+      int8_code[d] = static_cast<int8>(std::max(-128.0, std::min(127.0, c)));
+    }
+    for (int32 d = code_size_; d < code_stride_; d++) int8_code[d] = 0;
+  } else {
+    for (int32 m = 0; m < code_size_; m++) {
+      int32 offset = subspace_offsets_[m],
+          len = subspace_offsets_[m + 1] - offset;
+      SubVector<double> sub(u, offset, len);
+      const Matrix<double> &codebook = codebooks_[m];
+      int32 best = 0;
+      double best_dist = 0.0;
+      for (int32 j = 0; j < codebook.NumRows(); j++) {
+        double dist = 0.0;
+        for (int32 d = 0; d < len; d++) {
+          double diff = sub(d) - codebook(j, d);
+          dist += diff * diff;
+        }
+        if (j == 0 || dist < best_dist) {
+          best = j;
+          best_dist = dist;
+        }
+      }
+      code[m] = static_cast<uint8>(best);
+    }
+  }
+}
+
+void QuantizedSpeakerStore::Insert(int64 key,
+                                   const VectorBase<double> &plda_input,
+                                   int32 num_utts) {
+  if (!IsTrained())
+    KALDI_ERR << "Insert() called on an untrained quantized speaker store.";
+  Vector<double> u;
+  double bias;
+  ComputeSpeakerTerms(plda_input, num_utts, &u, &bias);
+  std::vector<uint8> code(code_stride_);
+  Encode(u, &(code[0]));
+  InsertEncoded(key, &(code[0]), bias, num_utts);
+}
+
+void QuantizedSpeakerStore::InsertEncoded(int64 key, const uint8 *code,
+                                          float bias, int32 num_utts) {
+  Remove(key);
+  int32 slot;
+  if (!free_slots_.empty()) {
+    slot = free_slots_.back();
+    free_slots_.pop_back();
+  } else {
+    slot = slot_keys_.size();
+    slot_keys_.push_back(key);
+    slot_biases_.push_back(0.0);
+    slot_counts_.push_back(kFreeSlot);
+    codes_.resize(codes_.size() + code_stride_);
+  }
+  std::copy(code, code + code_stride_, codes_.begin() + static_cast<size_t>(slot) * code_stride_);
+  slot_keys_[slot] = key;
+  slot_biases_[slot] = bias;
+  slot_counts_[slot] = CountIndex(num_utts);
+  key_to_slot_[key] = slot;
+}
+
+bool QuantizedSpeakerStore::Remove(int64 key) {
+  std::unordered_map<int64, int32>::iterator iter = key_to_slot_.find(key);
+  if (iter == key_to_slot_.end()) return false;
+  int32 slot = iter->second;
+  slot_counts_[slot] = kFreeSlot;
+  free_slots_.push_back(slot);
+  key_to_slot_.erase(iter);
+  return true;
+}
+
+void QuantizedSpeakerStore::AttachExactStore(const SpeakerStore *store) {
+  if (store != NULL && store->Dim() != Dim())
+    KALDI_ERR << "Speaker store has dimension " << store->Dim()
+              << " but the PLDA model has dimension " << Dim();
+  exact_store_ = store;
+}
+
+void QuantizedSpeakerStore::PrepareQuery(const VectorBase<double> &plda_input,
+                                         Query *query) const {
+  int32 dim = Dim();
+  KALDI_ASSERT(plda_input.Dim() == dim);
+  // The test-only terms, as in PldaScorer.
+  const Vector<double> &psi = plda_.psi_;
+  double without_class_logdet = 0.0, without_class_quad = 0.0;
+  for (int32 d = 0; d < dim; d++) {
+    without_class_logdet += Log(1.0 + psi(d));
+    without_class_quad += plda_input(d) * plda_input(d) / (1.0 + psi(d));
+  }
+  query->constant = 0.5 * (without_class_logdet + without_class_quad);
+  if (!use_pq_) {
+    query->weights.assign(code_stride_, 0.0f);
+    for (int32 d = 0; d < dim; d++)
+      query->weights[d] = scales_(d) * plda_input(d);
+    query->constant += VecVec(offsets_, plda_input);
+  } else {
+    query->weights.assign(code_size_ * kCodebookSize, 0.0f);
+    for (int32 m = 0; m < code_size_; m++) {
+      int32 offset = subspace_offsets_[m],
+          len = subspace_offsets_[m + 1] - offset;
+      Vector<double> table(codebooks_[m].NumRows());
+      table.AddMatVec(1.0, codebooks_[m], kNoTrans,
+                      plda_input.Range(offset, len), 0.0);
+      float *dest = &(query->weights[m * kCodebookSize]);
+      for (int32 j = 0; j < table.Dim(); j++) dest[j] = table(j);
+    }
+  }
+  Vector<double> input_sq(plda_input);
+  input_sq.ApplyPow(2.0);
+  Vector<double> count_terms(enroll_counts_.size());
+  if (!enroll_counts_.empty())
+    count_terms.AddMatVec(-0.5, count_inv_vars_, kNoTrans, input_sq, 0.0);
+  query->count_terms.resize(count_terms.Dim());
+  for (int32 i = 0; i < count_terms.Dim(); i++)
+    query->count_terms[i] = count_terms(i);
+}
+
+float QuantizedSpeakerStore::CodeDot(const Query &query,
+                                     const uint8 *code) const {
+  if (!use_pq_)
+    return DotInt8(&(query.weights[0]), reinterpret_cast<const int8*>(code),
+                   code_stride_);
+  else
+    return SumLookups(&(query.weights[0]), code, code_size_);
+}
+
+bool QuantizedSpeakerStore::Score(int64 key,
+                                  const VectorBase<double> &plda_input,
+                                  double *score) const {
+  std::unordered_map<int64, int32>::const_iterator iter =
+      key_to_slot_.find(key);
+  if (iter == key_to_slot_.end()) return false;
+  Query query;
+  PrepareQuery(plda_input, &query);
+  *score = ScoreSlot(query, iter->second);
+  return true;
+}
+
+bool QuantizedSpeakerStore::ExactScore(int64 key,
+                                       const VectorBase<double> &plda_input,
+                                       double *score) const {
+  if (exact_store_ == NULL) return false;
+  Vector<float> embedding(Dim(), kUndefined);
+  int32 num_utts;
+  if (!exact_store_->Get(key, &embedding, &num_utts)) return false;
+  Vector<double> enroll(embedding);
+  *score = plda_.LogLikelihoodRatio(enroll, num_utts, plda_input);
+  return true;
+}
+
+void QuantizedSpeakerStore::Search(
+    const VectorBase<double> &plda_input, int32 num_results,
+    std::vector<std::pair<int64, double> > *results) const {
+  results->clear();
+  if (NumSpeakers() == 0 || num_results <= 0) return;
+  Query query;
+  PrepareQuery(plda_input, &query);
+  bool rerank = (exact_store_ != NULL && opts_.num_rerank > 0);
+  size_t num_candidates = std::min<size_t>(
+      rerank ? std::max(num_results, opts_.num_rerank) : num_results,
+      NumSpeakers());
+  // Min-heap of the best candidates so far, so that a gallery of any size
+  // needs no per-query allocation beyond it.
+  typedef std::pair<float, int32> Candidate;
+  std::priority_queue<Candidate, std::vector<Candidate>,
+                      std::greater<Candidate> > heap;
+  int32 num_slots = slot_keys_.size();
+  for (int32 slot = 0; slot < num_slots; slot++) {
+    if (slot_counts_[slot] == kFreeSlot) continue;
+    float score = ScoreSlot(query, slot);
+    if (heap.size() < num_candidates) {
+      heap.push(Candidate(score, slot));
+    } else if (score > heap.top().first) {
+      heap.pop();
+      heap.push(Candidate(score, slot));
+    }
+  }
+  std::vector<std::pair<double, int64> > candidates;
+  candidates.reserve(heap.size());
+  for (; !heap.empty(); heap.pop()) {
+    int64 key = slot_keys_[heap.top().second];
+    double score = heap.top().first;
+    if (rerank) ExactScore(key, plda_input, &score);
+    candidates.push_back(std::make_pair(score, key));
+  }
+  std::sort(candidates.begin(), candidates.end(),
+            std::greater<std::pair<double, int64> >());
+  candidates.resize(std::min<size_t>(num_results, candidates.size()));
+  for (size_t i = 0; i < candidates.size(); i++)
+    results->push_back(std::make_pair(candidates[i].second,
+                                      candidates[i].first));
+}
+
+void QuantizedSpeakerStore::Evaluate(const MatrixBase<double> &test_plda_inputs,
+                                     const std::vector<int64> &keys,
+                                     const std::vector<bool> &is_target,
+                                     QuantizationReport *report) const {
+  KALDI_ASSERT(static_cast<size_t>(test_plda_inputs.NumRows()) ==
+               keys.size() &&
+               keys.size() == is_target.size());
+  if (exact_store_ == NULL)
+    KALDI_ERR << "Evaluate() needs a full-precision store; call "
+              << "AttachExactStore() first.";
+  std::vector<BaseFloat> exact_target, exact_nontarget, quantized_target,
+      quantized_nontarget;
+  *report = QuantizationReport();
+  Query query;
+  for (size_t i = 0; i < keys.size(); i++) {
+    std::unordered_map<int64, int32>::const_iterator iter =
+        key_to_slot_.find(keys[i]);
+    double exact_score;
+    if (iter == key_to_slot_.end() ||
+        !ExactScore(keys[i], test_plda_inputs.Row(i), &exact_score))
+      continue;
+    PrepareQuery(test_plda_inputs.Row(i), &query);
+    double quantized_score = ScoreSlot(query, iter->second),
+        error = std::abs(quantized_score - exact_score);
+    report->num_trials++;
+    report->mean_abs_error += error;
+    report->max_abs_error = std::max(report->max_abs_error, error);
+    (is_target[i] ? exact_target : exact_nontarget).push_back(exact_score);
+    (is_target[i] ? quantized_target : quantized_nontarget).push_back(
+        quantized_score);
+  }
+  if (report->num_trials == 0) {
+    KALDI_WARN << "No trials could be scored.";
+    return;
+  }
+  report->mean_abs_error /= report->num_trials;
+  if (exact_target.empty() || exact_nontarget.empty()) {
+    KALDI_WARN << "Need both target and nontarget trials for the EER.";
+    return;
+  }
+  report->exact_eer = ComputeEer(&exact_target, &exact_nontarget);
+  report->quantized_eer = ComputeEer(&quantized_target, &quantized_nontarget);
+}
+
+void QuantizedSpeakerStore::Write(std::ostream &os, bool binary) const {
+  if (!IsTrained())
+    KALDI_ERR << "Writing an untrained quantized speaker store.";
+  WriteToken(os, binary, "<QuantizedSpeakerStore>");
+  WriteToken(os, binary, opts_.quantizer);
+  if (!use_pq_) {
+    WriteToken(os, binary, "<Offsets>");
+    offsets_.Write(os, binary);
+    WriteToken(os, binary, "<Scales>");
+    scales_.Write(os, binary);
+  } else {
+    WriteToken(os, binary, "<SubspaceOffsets>");
+    WriteIntegerVector(os, binary, subspace_offsets_);
+    WriteToken(os, binary, "<Codebooks>");
+    for (size_t m = 0; m < codebooks_.size(); m++)
+      codebooks_[m].Write(os, binary);
+  }
+
+  // The speakers, in slot order with free slots skipped.
+  std::vector<int64> keys;
+  std::vector<int32> num_utts;
+  std::vector<uint8> codes;
+  std::vector<float> biases;
+  for (size_t slot = 0; slot < slot_keys_.size(); slot++) {
+    if (slot_counts_[slot] == kFreeSlot) continue;
+    keys.push_back(slot_keys_[slot]);
+    num_utts.push_back(enroll_counts_[slot_counts_[slot]]);
+    biases.push_back(slot_biases_[slot]);
+    size_t offset = static_cast<size_t>(slot) * code_stride_;
+    codes.insert(codes.end(), codes_.begin() + offset,
+                 codes_.begin() + offset + code_size_);
+  }
+  WriteToken(os, binary, "<Keys>");
+  WriteIntegerVector(os, binary, keys);
+  WriteToken(os, binary, "<NumUtts>");
+  WriteIntegerVector(os, binary, num_utts);
+  WriteToken(os, binary, "<Codes>");
+  WriteIntegerVector(os, binary, codes);
+  WriteToken(os, binary, "<Biases>");
+  Vector<float> bias_vec(biases.size(), kUndefined);
+  std::copy(biases.begin(), biases.end(), bias_vec.Data());
+  bias_vec.Write(os, binary);
+  WriteToken(os, binary, "</QuantizedSpeakerStore>");
+}
+
+void QuantizedSpeakerStore::Read(std::istream &is, bool binary) {
+  ExpectToken(is, binary, "<QuantizedSpeakerStore>");
+  std::string quantizer;
+  ReadToken(is, binary, &quantizer);
+  if (quantizer != opts_.quantizer)
+    KALDI_ERR << "Reading a " << quantizer << " store into one configured "
+              << "for " << opts_.quantizer;
+  int32 dim = Dim();
+  if (!use_pq_) {
+    ExpectToken(is, binary, "<Offsets>");
+    offsets_.Read(is, binary);
+    ExpectToken(is, binary, "<Scales>");
+    scales_.Read(is, binary);
+    if (offsets_.Dim() != dim || scales_.Dim() != dim)
+      KALDI_ERR << "Quantized speaker store has dimension " << offsets_.Dim()
+                << " but the PLDA model has dimension " << dim;
+    code_size_ = dim;
+    code_stride_ = (dim + 15) / 16 * 16;
+  } else {
+    ExpectToken(is, binary, "<SubspaceOffsets>");
+    ReadIntegerVector(is, binary, &subspace_offsets_);
+    if (subspace_offsets_.size() < 2 || subspace_offsets_.back() != dim)
+      KALDI_ERR << "Quantized speaker store does not match the PLDA model's "
+                << "dimension " << dim;
+    code_size_ = code_stride_ = subspace_offsets_.size() - 1;
+    ExpectToken(is, binary, "<Codebooks>");
+    codebooks_.resize(code_size_);
+    for (int32 m = 0; m < code_size_; m++)
+      codebooks_[m].Read(is, binary);
+  }
+
+  std::vector<int64> keys;
+  std::vector<int32> num_utts;
+  std::vector<uint8> codes;
+  Vector<float> biases;
+  ExpectToken(is, binary, "<Keys>");
+  ReadIntegerVector(is, binary, &keys);
+  ExpectToken(is, binary, "<NumUtts>");
+  ReadIntegerVector(is, binary, &num_utts);
+  ExpectToken(is, binary, "<Codes>");
+  ReadIntegerVector(is, binary, &codes);
+  ExpectToken(is, binary, "<Biases>");
+  biases.Read(is, binary);
+  ExpectToken(is, binary, "</QuantizedSpeakerStore>");
+  size_t num_speakers = keys.size();
+  if (num_utts.size() != num_speakers ||
+      codes.size() != num_speakers * code_size_ ||
+      static_cast<size_t>(biases.Dim()) != num_speakers)
+    KALDI_ERR << "Inconsistent sizes reading quantized speaker store.";
+
+  ClearSpeakers();
+  std::vector<uint8> code(code_stride_, 0);
+  for (size_t i = 0; i < num_speakers; i++) {
+    std::copy(codes.begin() + i * code_size_,
+              codes.begin() + (i + 1) * code_size_, code.begin());
+    InsertEncoded(keys[i], &(code[0]), biases(i), num_utts[i]);
+  }
+}
+
+}  // namespace kaldi
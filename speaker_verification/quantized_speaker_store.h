@@ -0,0 +1,250 @@
+// speaker_verification/quantized_speaker_store.h
+
+// Copyright (c) 2021 PeachLab. All Rights Reserved.
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_SPEAKER_VERIFICATION_QUANTIZED_SPEAKER_STORE_H_
+#define KALDI_SPEAKER_VERIFICATION_QUANTIZED_SPEAKER_STORE_H_
+
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "base/kaldi-common.h"
+#include "matrix/matrix-lib.h"
+#include "speaker_verification/plda.h"
+#include "speaker_verification/speaker_store.h"
+#include "util/options-itf.h"
+
+namespace kaldi {
+
+struct QuantizedSpeakerStoreOptions {
+  std::string quantizer;
+  int32 num_subquantizers;
+  int32 num_kmeans_iters;
+  int32 num_rerank;
+
+  QuantizedSpeakerStoreOptions(): quantizer("int8"), num_subquantizers(32),
+                                  num_kmeans_iters(20), num_rerank(0) { }
+
+  void Register(OptionsItf *opts) {
+    opts->Register("quantizer", &quantizer, "How enrolled speakers are "
+                   "coded: \"int8\" (one byte per dimension) or \"pq\" "
+                   "(product quantization, one byte per subquantizer).");
+    opts->Register("num-subquantizers", &num_subquantizers, "Number of "
+                   "sub-vectors for --quantizer=pq.");
+    opts->Register("num-kmeans-iters", &num_kmeans_iters, "Number of k-means "
+                   "iterations when training the product quantizer.");
+    opts->Register("num-rerank", &num_rerank, "If > 0 and a full-precision "
+                   "SpeakerStore is attached, Search() re-scores this many "
+                   "best candidates exactly from it.");
+  }
+};
+
+/// Equal error rate of "target_scores" against "nontarget_scores", as
+/// Kaldi's compute-eer computes it; both are sorted.  If "threshold" is not
+/// NULL it gets the score at which the EER is reached.
+BaseFloat ComputeEer(std::vector<BaseFloat> *target_scores,
+                     std::vector<BaseFloat> *nontarget_scores,
+                     BaseFloat *threshold = NULL);
+
+/// Accuracy of the quantized scores on a list of trials.
+struct QuantizationReport {
+  int32 num_trials;
+  BaseFloat exact_eer;
+  BaseFloat quantized_eer;
+  /// Absolute differences between quantized and exact scores.
+  double mean_abs_error;
+  double max_abs_error;
+  QuantizationReport(): num_trials(0), exact_eer(0.0), quantized_eer(0.0),
+                        mean_abs_error(0.0), max_abs_error(0.0) { }
+};
+
+/// QuantizedSpeakerStore keeps enrolled speakers in RAM in a few bytes per
+/// dimension, for galleries too large to keep as Vector<double>, and scores
+/// a full-precision test against them directly from the codes.
+///
+/// Writing w for the inverse per-speaker variance and m for the mean (see
+/// PldaScorer), the PLDA log-likelihood ratio of test t against a speaker is
+///   u . t - 0.5 w . t^2 + bias + (test-only terms),   u = w * m.
+/// w depends only on the number of enrollment utterances, so it is kept once
+/// per distinct count; bias is one float per speaker.  Only u is quantized:
+///  - "int8": u_d = offset_d + scale_d c_d per dimension, with c_d an int8;
+///    u . t is then (scale * t) . c plus a per-query constant, and
+///    (scale * t) . c is a float-by-int8 dot product (AVX2 or NEON when
+///    built for them, scalar otherwise).
+///  - "pq": u is cut into sub-vectors, each coded as one of 256 k-means
+///    centroids; u . t is a sum of look-ups in per-query tables (with AVX2
+///    gathers when available).
+/// The query itself is never quantized (asymmetric scoring).  For 128
+/// dimensions a speaker takes 134 bytes with int8 and 38 with 32
+/// subquantizers, against 1 KB for a Vector<double>.
+///
+/// With a full-precision SpeakerStore attached (AttachExactStore()),
+/// Search() re-scores its best candidates exactly from the store's
+/// memory-mapped file, and Evaluate() measures the accuracy lost.
+class QuantizedSpeakerStore {
+ public:
+  QuantizedSpeakerStore(const QuantizedSpeakerStoreOptions &opts,
+                        const Plda &plda);
+
+  /// Trains the quantizer on "samples", one PLDA input (see
+  /// Plda::TransformIvector()) per row, taken as enrollments averaged over
+  /// "num_utts" utterances.  Existing speakers are removed.
+  void Train(const MatrixBase<double> &samples, int32 num_utts);
+
+  bool IsTrained() const { return code_size_ != 0; }
+
+  /// Adds (or replaces) speaker "key", given its PLDA input averaged over
+  /// "num_utts" utterances.
+  void Insert(int64 key, const VectorBase<double> &plda_input,
+              int32 num_utts);
+
+  /// Removes speaker "key"; returns false if it was not present.
+  bool Remove(int64 key);
+
+  bool Contains(int64 key) const { return key_to_slot_.count(key) != 0; }
+
+  int32 NumSpeakers() const { return key_to_slot_.size(); }
+
+  int32 Dim() const { return plda_.Dim(); }
+
+  /// RAM taken by one speaker's code, bias and count index (not counting the
+  /// key map).
+  int32 BytesPerSpeaker() const {
+    return code_stride_ + sizeof(float) + sizeof(uint16);
+  }
+
+  /// Sets "store" (not owned; NULL to detach) as the source of the
+  /// full-precision PLDA inputs, keyed as here.
+  void AttachExactStore(const SpeakerStore *store);
+
+  /// The approximate log-likelihood ratio of the test against speaker
+  /// "key"; returns false if the speaker is not present.
+  bool Score(int64 key, const VectorBase<double> &plda_input,
+             double *score) const;
+
+  /// Finds the (at most) "num_results" best-scoring speakers for the test,
+  /// scoring every speaker from its code.  If opts.num_rerank > 0 and an
+  /// exact store is attached, the best max(num_rerank, num_results) are
+  /// re-scored exactly first.  On exit "results" holds (key, score) pairs,
+  /// best first.
+  void Search(const VectorBase<double> &plda_input, int32 num_results,
+              std::vector<std::pair<int64, double> > *results) const;
+
+  /// Scores the trials "row i of test_plda_inputs against speaker keys[i]"
+  /// both from the codes and exactly from the attached store, and reports
+  /// the EER of each (is_target[i] tells whether trial i is a target trial)
+  /// and the score error.  Trials whose speaker is missing are skipped.
+  void Evaluate(const MatrixBase<double> &test_plda_inputs,
+                const std::vector<int64> &keys,
+                const std::vector<bool> &is_target,
+                QuantizationReport *report) const;
+
+  /// Writes the quantizer and the coded speakers (not the full-precision
+  /// ones).  Read() must be called on a store constructed with the same
+  /// PLDA model.
+  void Write(std::ostream &os, bool binary) const;
+
+  void Read(std::istream &is, bool binary);
+
+ private:
+  /// The query-side quantities shared by all speakers.
+  struct Query {
+    /// int8: scale * t, padded to code_stride_; pq: the look-up tables,
+    /// 256 per subquantizer.
+    std::vector<float> weights;
+    /// The terms that do not depend on the code: the test-only terms and,
+    /// for int8, offset . t.
+    double constant;
+    /// -0.5 w . t^2 for each distinct enrollment count.
+    std::vector<float> count_terms;
+  };
+
+  void PrepareQuery(const VectorBase<double> &plda_input, Query *query) const;
+
+  /// The score of slot "slot" from its code.
+  float ScoreSlot(const Query &query, int32 slot) const {
+    const uint8 *code = &(codes_[static_cast<size_t>(slot) * code_stride_]);
+    return query.constant + query.count_terms[slot_counts_[slot]] +
+        slot_biases_[slot] + CodeDot(query, code);
+  }
+
+  /// u . t (without the int8 offset) for one code.
+  float CodeDot(const Query &query, const uint8 *code) const;
+
+  /// Computes u and bias for a speaker.
+  void ComputeSpeakerTerms(const VectorBase<double> &plda_input,
+                           int32 num_utts, Vector<double> *u,
+                           double *bias) const;
+
+  void Encode(const VectorBase<double> &u, uint8 *code) const;
+
+  /// Returns the index of "num_utts" in enroll_counts_, adding it if new.
+  int32 CountIndex(int32 num_utts);
+
+  /// The exact score of the test against speaker "key" from exact_store_;
+  /// returns false if the store does not have it.
+  bool ExactScore(int64 key, const VectorBase<double> &plda_input,
+                  double *score) const;
+
+  void InsertEncoded(int64 key, const uint8 *code, float bias,
+                     int32 num_utts);
+
+  void ClearSpeakers();
+
+  QuantizedSpeakerStoreOptions opts_;
+  Plda plda_;
+  bool use_pq_;
+
+  /// int8 quantizer: u_d = offsets_(d) + scales_(d) * c_d.
+  Vector<double> offsets_;
+  Vector<double> scales_;
+  /// pq quantizer: subquantizer m covers dimensions
+  /// [subspace_offsets_[m], subspace_offsets_[m + 1]).
+  std::vector<int32> subspace_offsets_;
+  std::vector<Matrix<double> > codebooks_;
+
+  /// Bytes of code per speaker, and the stride they are stored at (for int8
+  /// a multiple of 16, zero-padded, so the SIMD loop needs no tail).
+  int32 code_size_;
+  int32 code_stride_;
+
+  /// The distinct enrollment counts, and w for each (one row per count).
+  std::vector<int32> enroll_counts_;
+  Matrix<double> count_inv_vars_;
+
+  /// Per-slot data.  Slots of removed speakers are reused by Insert().
+  std::vector<uint8> codes_;
+  std::vector<float> slot_biases_;
+  /// Index into enroll_counts_, or kFreeSlot.  16 bits per speaker, so a
+  /// store holds at most 65534 distinct enrollment counts (any number of
+  /// speakers); Insert() fails past that.
+  std::vector<uint16> slot_counts_;
+  std::vector<int64> slot_keys_;
+  std::vector<int32> free_slots_;
+  std::unordered_map<int64, int32> key_to_slot_;
+
+  const SpeakerStore *exact_store_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(QuantizedSpeakerStore);
+};
+
+}  // namespace kaldi
+
+#endif  // KALDI_SPEAKER_VERIFICATION_QUANTIZED_SPEAKER_STORE_H_
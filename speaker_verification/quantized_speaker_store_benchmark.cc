@@ -0,0 +1,219 @@
+// speaker_verification/quantized_speaker_store_benchmark.cc
+
+// Copyright (c) 2021 PeachLab. All Rights Reserved.
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+// Memory, accuracy (EER on held-out trials) and search speed of
+// QuantizedSpeakerStore against full-precision PLDA scoring, on synthetic
+// speakers drawn from a random PLDA model.
+
+#include <algorithm>
+#include <cstdio>
+#include <functional>
+#include <sstream>
+
+#include "base/kaldi-common.h"
+#include "base/timer.h"
+#include "speaker_verification/quantized_speaker_store.h"
+#include "util/parse-options.h"
+
+namespace kaldi {
+
+// Makes a PLDA model whose transform is the identity, with between-class
+// variances "psi" spread over [0.1, 1.1] times "psi_scale", through the
+// model's own Read().
+static void MakeRandomPlda(int32 dim, double psi_scale, Plda *plda,
+                           Vector<double> *psi) {
+  Vector<double> mean(dim);
+  Matrix<double> transform(dim, dim);
+  transform.SetUnit();
+  psi->Resize(dim);
+  psi->SetRandUniform();
+  psi->Add(0.1);
+  psi->Scale(psi_scale);
+  std::sort(psi->Data(), psi->Data() + dim, std::greater<double>());
+  std::ostringstream os;
+  bool binary = true;
+  WriteToken(os, binary, "<Plda>");
+  mean.Write(os, binary);
+  transform.Write(os, binary);
+  psi->Write(os, binary);
+  WriteToken(os, binary, "</Plda>");
+  std::istringstream is(os.str());
+  plda->Read(is, binary);
+}
+
+}  // namespace kaldi
+
+int main(int argc, char *argv[]) {
+  using namespace kaldi;
+  try {
+    const char *usage =
+        "Measures the memory, EER loss and search speed of the quantized\n"
+        "speaker store against full-precision PLDA scoring, on synthetic\n"
+        "data.  <exact-store> is a SpeakerStore file that is created (or\n"
+        "overwritten) to hold the full-precision speakers.\n"
+        "Usage:  quantized-speaker-store-benchmark [options] <exact-store>\n";
+    ParseOptions po(usage);
+    QuantizedSpeakerStoreOptions store_opts;
+    int32 dim = 128, num_speakers = 100000, num_trials = 20000,
+        num_queries = 100, num_utts = 3, num_train = 20000,
+        num_results = 10;
+    BaseFloat psi_scale = 0.5;
+    store_opts.Register(&po);
+    po.Register("dim", &dim, "Dimension of the PLDA inputs.");
+    po.Register("num-speakers", &num_speakers, "Number of enrolled speakers.");
+    po.Register("num-trials", &num_trials, "Number of held-out verification "
+                "trials, half of them target trials.");
+    po.Register("num-queries", &num_queries, "Number of identification "
+                "queries timed.");
+    po.Register("psi-scale", &psi_scale, "Scale of the between-class "
+                "variances; smaller makes speakers harder to tell apart.");
+    po.Register("num-utts", &num_utts, "Utterances per enrolled speaker.");
+    po.Register("num-train", &num_train, "Number of enrolled speakers the "
+                "quantizer is trained on.");
+    po.Register("num-results", &num_results, "Recall is measured at this "
+                "many results.");
+    po.Read(argc, argv);
+    if (po.NumArgs() != 1) {
+      po.PrintUsage();
+      exit(1);
+    }
+    std::string exact_store_filename = po.GetArg(1);
+
+    Plda plda;
+    Vector<double> psi_sqrt;
+    MakeRandomPlda(dim, psi_scale, &plda, &psi_sqrt);
+    psi_sqrt.ApplyPow(0.5);
+    // A speaker is s ~ N(0, Psi); an enrollment averaged over n utterances
+    // adds N(0, I/n) and a test utterance N(0, I).
+    Matrix<double> speakers(num_speakers, dim), enrolled(num_speakers, dim);
+    speakers.SetRandn();
+    speakers.MulColsVec(psi_sqrt);
+    enrolled.SetRandn();
+    enrolled.Scale(1.0 / std::sqrt(static_cast<double>(num_utts)));
+    enrolled.AddMat(1.0, speakers);
+
+    std::remove(exact_store_filename.c_str());
+    SpeakerStore exact_store;
+    if (!exact_store.Open(exact_store_filename, dim))
+      KALDI_ERR << "Could not create " << exact_store_filename;
+    Vector<float> embedding(dim);
+    for (int32 i = 0; i < num_speakers; i++) {
+      embedding.CopyFromVec(enrolled.Row(i));
+      exact_store.Put(i, embedding, num_utts);
+    }
+
+    QuantizedSpeakerStore store(store_opts, plda);
+    Timer timer;
+    store.Train(enrolled.RowRange(0, std::min(num_train, num_speakers)),
+                num_utts);
+    double train_time = timer.Elapsed();
+    timer.Reset();
+    for (int32 i = 0; i < num_speakers; i++)
+      store.Insert(i, enrolled.Row(i), num_utts);
+    double insert_time = timer.Elapsed();
+    store.AttachExactStore(&exact_store);
+    KALDI_LOG << num_speakers << " speakers, dim " << dim << ", "
+              << store_opts.quantizer << ": train " << train_time
+              << " s, insert " << insert_time << " s; "
+              << store.BytesPerSpeaker() << " bytes per speaker against "
+              << dim * sizeof(double) << " as Vector<double> ("
+              << dim * sizeof(double) * 1.0 / store.BytesPerSpeaker()
+              << " times smaller).";
+
+    // Held-out trials: each test is a new utterance, of the claimed speaker
+    // for target trials and of another speaker otherwise.
+    Matrix<double> tests(num_trials, dim);
+    std::vector<int64> keys(num_trials);
+    std::vector<bool> is_target(num_trials);
+    tests.SetRandn();
+    for (int32 t = 0; t < num_trials; t++) {
+      int32 claimed = RandInt(0, num_speakers - 1), actual = claimed;
+      is_target[t] = (t % 2 == 0);
+      while (!is_target[t] && actual == claimed)
+        actual = RandInt(0, num_speakers - 1);
+      tests.Row(t).AddVec(1.0, speakers.Row(actual));
+      keys[t] = claimed;
+    }
+    QuantizationReport report;
+    store.Evaluate(tests, keys, is_target, &report);
+    KALDI_LOG << "Held-out trials " << report.num_trials << ": EER "
+              << 100.0 * report.exact_eer << "% exact, "
+              << 100.0 * report.quantized_eer << "% quantized; score error "
+              << "mean " << report.mean_abs_error << ", max "
+              << report.max_abs_error;
+
+    // Identification against the whole gallery.
+    PldaScorer exact_scorer(plda);
+    for (int32 i = 0; i < num_speakers; i++)
+      exact_scorer.AddSpeaker(enrolled.Row(i), num_utts);
+    QuantizedSpeakerStoreOptions rerank_opts(store_opts);
+    rerank_opts.num_rerank = std::max(rerank_opts.num_rerank,
+                                      10 * num_results);
+    QuantizedSpeakerStore rerank_store(rerank_opts, plda);
+    {
+      std::ostringstream os;
+      store.Write(os, true);
+      std::istringstream is(os.str());
+      rerank_store.Read(is, true);
+      KALDI_ASSERT(rerank_store.NumSpeakers() == num_speakers);
+    }
+    rerank_store.AttachExactStore(&exact_store);
+    double exact_time = 0.0, quantized_time = 0.0, rerank_time = 0.0;
+    int32 hits = 0, rerank_hits = 0;
+    Vector<double> scores(num_speakers);
+    for (int32 q = 0; q < num_queries; q++) {
+      SubVector<double> test(tests, q);
+      timer.Reset();
+      exact_scorer.Score(test, &scores);
+      std::vector<std::pair<double, int32> > exact(num_speakers);
+      for (int32 i = 0; i < num_speakers; i++)
+        exact[i] = std::make_pair(scores(i), i);
+      std::partial_sort(exact.begin(), exact.begin() + num_results,
+                        exact.end(),
+                        std::greater<std::pair<double, int32> >());
+      exact_time += timer.Elapsed();
+      std::vector<std::pair<int64, double> > results, rerank_results;
+      timer.Reset();
+      store.Search(test, num_results, &results);
+      quantized_time += timer.Elapsed();
+      timer.Reset();
+      rerank_store.Search(test, num_results, &rerank_results);
+      rerank_time += timer.Elapsed();
+      for (int32 i = 0; i < num_results; i++) {
+        for (size_t j = 0; j < results.size(); j++)
+          if (results[j].first == exact[i].second) hits++;
+        for (size_t j = 0; j < rerank_results.size(); j++)
+          if (rerank_results[j].first == exact[i].second) rerank_hits++;
+      }
+    }
+    KALDI_LOG << "Search: exact (double, in RAM) "
+              << 1000.0 * exact_time / num_queries << " ms, quantized "
+              << 1000.0 * quantized_time / num_queries << " ms (recall@"
+              << num_results << " "
+              << hits * 1.0 / (num_queries * num_results) << "), with "
+              << rerank_opts.num_rerank << " re-scored from disk "
+              << 1000.0 * rerank_time / num_queries << " ms (recall@"
+              << num_results << " "
+              << rerank_hits * 1.0 / (num_queries * num_results) << ").";
+    return 0;
+  } catch(const std::exception &e) {
+    std::cerr << e.what();
+    return -1;
+  }
+}
@@ -0,0 +1,97 @@
+// speaker_verification/score_normalizer.cc
+
+// Copyright (c) 2021 PeachLab. All Rights Reserved.
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+#include "speaker_verification/score_normalizer.h"
+
+namespace kaldi {
+
+CohortScoreNormalizer::CohortScoreNormalizer(
+    const ScoreNormalizationOptions &opts, const Plda &plda,
+    const MatrixBase<double> &cohort):
+    opts_(opts), cohort_scorer_(plda), empty_scorer_(plda) {
+  KALDI_ASSERT(opts_.top_k >= 0 && opts_.min_stddev > 0.0);
+  if (cohort.NumRows() == 0)
+    KALDI_ERR << "Empty score normalization cohort.";
+  for (int32 i = 0; i < cohort.NumRows(); i++)
+    cohort_scorer_.AddSpeaker(cohort.Row(i), 1);
+  cohort_scorer_.ComputeTestStats(cohort, &cohort_test_stats_,
+                                  &cohort_test_terms_);
+}
+
+void CohortScoreNormalizer::ComputeStats(double *scores, int32 num_scores,
+                                         CohortStats *stats) const {
+  int32 k = num_scores;
+  if (opts_.top_k > 0 && opts_.top_k < num_scores) {
+    k = opts_.top_k;
+    // Moves the k largest scores to the front, in no particular order.
+    std::nth_element(scores, scores + k - 1, scores + num_scores,
+                     std::greater<double>());
+  }
+  double sum = 0.0;
+  for (int32 i = 0; i < k; i++) sum += scores[i];
+  stats->mean = sum / k;
+  double sumsq = 0.0;
+  for (int32 i = 0; i < k; i++)
+    sumsq += (scores[i] - stats->mean) * (scores[i] - stats->mean);
+  stats->stddev = std::max<double>(std::sqrt(sumsq / k), opts_.min_stddev);
+}
+
+void CohortScoreNormalizer::ComputeEnrollStats(
+    const VectorBase<double> &enroll_plda_input, int32 num_enroll_utts,
+    CohortStats *stats) const {
+  PldaScorer enroll_scorer(empty_scorer_);
+  enroll_scorer.AddSpeaker(enroll_plda_input, num_enroll_utts);
+  Vector<double> scores(CohortSize(), kUndefined);
+  SubMatrix<double> scores_col(scores.Data(), CohortSize(), 1, 1);
+  enroll_scorer.ScoreTestStats(cohort_test_stats_, cohort_test_terms_,
+                               &scores_col);
+  ComputeStats(scores.Data(), CohortSize(), stats);
+}
+
+void CohortScoreNormalizer::ComputeTestStats(
+    const VectorBase<double> &test_plda_input, CohortStats *stats) const {
+  Vector<double> scores(CohortSize(), kUndefined);
+  cohort_scorer_.Score(test_plda_input, &scores);
+  ComputeStats(scores.Data(), CohortSize(), stats);
+}
+
+void CohortScoreNormalizer::ComputeTestStatsBatch(
+    const MatrixBase<double> &test_plda_inputs,
+    std::vector<CohortStats> *stats) const {
+  int32 num_tests = test_plda_inputs.NumRows();
+  stats->resize(num_tests);
+  // Blocks of tests keep the score matrix at a few MB for large cohorts.
+  const int32 block_size = 64;
+  Matrix<double> scores;
+  for (int32 begin = 0; begin < num_tests; begin += block_size) {
+    int32 this_block_size = std::min(block_size, num_tests - begin);
+    scores.Resize(this_block_size, CohortSize(), kUndefined);
+    cohort_scorer_.ScoreBatch(test_plda_inputs.RowRange(begin,
+                                                        this_block_size),
+                              &scores);
+    for (int32 i = 0; i < this_block_size; i++)
+      ComputeStats(scores.RowData(i), CohortSize(), &((*stats)[begin + i]));
+  }
+}
+
+}  // namespace kaldi
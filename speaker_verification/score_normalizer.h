@@ -0,0 +1,118 @@
+// speaker_verification/score_normalizer.h
+
+// Copyright (c) 2021 PeachLab. All Rights Reserved.
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_SPEAKER_VERIFICATION_SCORE_NORMALIZER_H_
+#define KALDI_SPEAKER_VERIFICATION_SCORE_NORMALIZER_H_
+
+#include <vector>
+
+#include "base/kaldi-common.h"
+#include "matrix/matrix-lib.h"
+#include "speaker_verification/plda.h"
+#include "util/options-itf.h"
+
+namespace kaldi {
+
+struct ScoreNormalizationOptions {
+  int32 top_k;
+  BaseFloat min_stddev;
+
+  ScoreNormalizationOptions(): top_k(300), min_stddev(1.0e-03) { }
+
+  void Register(OptionsItf *opts) {
+    opts->Register("top-k", &top_k, "Number of highest-scoring cohort "
+                   "speakers the statistics are taken over (adaptive "
+                   "S-norm); 0 means the whole cohort (plain S-norm).");
+    opts->Register("min-stddev", &min_stddev, "Floor on the cohort score "
+                   "standard deviation.");
+  }
+};
+
+/// Mean and standard deviation of one side's scores against the cohort.
+struct CohortStats {
+  double mean;
+  double stddev;
+  CohortStats(): mean(0.0), stddev(1.0) { }
+};
+
+/// CohortScoreNormalizer does symmetric score normalization (S-norm), or its
+/// adaptive form (AS-norm) with top_k > 0:
+///
+///   s' = 0.5 (s - mu_e) / sigma_e + 0.5 (s - mu_t) / sigma_t
+///
+/// where mu_e, sigma_e are the statistics of the enrolled speaker's scores
+/// against a cohort of impostors, and mu_t, sigma_t those of the test; with
+/// top_k > 0 only the top_k highest cohort scores of each side are used,
+/// found with a partial selection (std::nth_element) rather than a sort.
+///
+/// The cohort is kept in PLDA-ready form, both as speakers of a PldaScorer
+/// (for the test side: the scores of many tests against the whole cohort
+/// are one GEMM) and as precomputed test statistics (for the enrollment
+/// side: one GEMV per enrolled speaker).  The enrollment side only changes
+/// when a speaker is enrolled, so callers compute it then with
+/// ComputeEnrollStats() and keep it; scoring then costs one GEMV against
+/// the cohort per test, shared by all enrolled speakers.
+class CohortScoreNormalizer {
+ public:
+  /// "cohort" holds one PLDA input (see Plda::TransformIvector()) per row,
+  /// each for one utterance.
+  CohortScoreNormalizer(const ScoreNormalizationOptions &opts,
+                        const Plda &plda,
+                        const MatrixBase<double> &cohort);
+
+  int32 CohortSize() const { return cohort_scorer_.NumSpeakers(); }
+
+  /// Statistics of the enrolled speaker's scores, the cohort taken as tests.
+  void ComputeEnrollStats(const VectorBase<double> &enroll_plda_input,
+                          int32 num_enroll_utts,
+                          CohortStats *stats) const;
+
+  /// Statistics of the test's scores, the cohort taken as enrolled speakers.
+  void ComputeTestStats(const VectorBase<double> &test_plda_input,
+                        CohortStats *stats) const;
+
+  /// As ComputeTestStats() for each row of "test_plda_inputs", with the
+  /// cohort scores of a block of tests computed in one GEMM.
+  void ComputeTestStatsBatch(const MatrixBase<double> &test_plda_inputs,
+                             std::vector<CohortStats> *stats) const;
+
+  double Normalize(double raw_score, const CohortStats &enroll_stats,
+                   const CohortStats &test_stats) const {
+    return 0.5 * (raw_score - enroll_stats.mean) / enroll_stats.stddev +
+        0.5 * (raw_score - test_stats.mean) / test_stats.stddev;
+  }
+
+ private:
+  /// Mean and standard deviation of the top_k largest elements of
+  /// "scores" (all of them if top_k is 0); "scores" is reordered.
+  void ComputeStats(double *scores, int32 num_scores,
+                    CohortStats *stats) const;
+
+  ScoreNormalizationOptions opts_;
+  PldaScorer cohort_scorer_;
+  /// PldaScorer::ComputeTestStats() of the cohort.
+  Matrix<double> cohort_test_stats_;
+  Vector<double> cohort_test_terms_;
+  /// A scorer with no speakers, copied to score one enrolled speaker.
+  PldaScorer empty_scorer_;
+};
+
+}  // namespace kaldi
+
+#endif  // KALDI_SPEAKER_VERIFICATION_SCORE_NORMALIZER_H_
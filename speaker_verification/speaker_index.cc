@@ -0,0 +1,380 @@
+// speaker_verification/speaker_index.cc
+
+// Copyright (c) 2021 PeachLab. All Rights Reserved.
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <functional>
+
+#include "speaker_verification/kmeans.h"
+#include "speaker_verification/speaker_index.h"
+
+namespace kaldi {
+
+SpeakerIndex::SpeakerIndex(const SpeakerIndexOptions &opts,
+                           const Plda &plda):
+    opts_(opts), scorer_(plda) {
+  KALDI_ASSERT(opts_.num_lists > 0 && opts_.num_subquantizers > 0 &&
+               opts_.num_probes > 0 && opts_.num_candidates > 0);
+}
+
+void SpeakerIndex::Normalize(const VectorBase<double> &transformed_ivector,
+                             Vector<double> *normalized) const {
+  KALDI_ASSERT(transformed_ivector.Dim() == Dim());
+  *normalized = transformed_ivector;
+  double norm = normalized->Norm(2.0);
+  if (norm > 0.0) normalized->Scale(1.0 / norm);
+}
+
+void SpeakerIndex::Train(const MatrixBase<double> &samples) {
+  int32 dim = Dim(), num_samples = samples.NumRows();
+  KALDI_ASSERT(samples.NumCols() == dim && num_samples > 0);
+  int32 num_subquantizers = std::min(opts_.num_subquantizers, dim);
+  int32 num_lists = std::min(opts_.num_lists, num_samples),
+      codebook_size = std::min(256, num_samples);
+
+  Matrix<double> normalized(num_samples, dim, kUndefined);
+  for (int32 i = 0; i < num_samples; i++) {
+    SubVector<double> row(normalized, i);
+    row.CopyFromVec(samples.Row(i));
+    double norm = row.Norm(2.0);
+    if (norm > 0.0) row.Scale(1.0 / norm);
+  }
+
+  KMeans(normalized, num_lists, opts_.num_kmeans_iters, &centroids_);
+  ComputeHalfNorms(centroids_, &centroid_half_norms_);
+
+  // The product quantizer codes the residual from the coarse centroid.
+  std::vector<int32> assignment;
+  AssignToCentroids(normalized, centroids_, centroid_half_norms_, &assignment);
+  for (int32 i = 0; i < num_samples; i++)
+    normalized.Row(i).AddVec(-1.0, centroids_.Row(assignment[i]));
+
+  subspace_offsets_.resize(num_subquantizers + 1);
+  for (int32 m = 0; m <= num_subquantizers; m++)
+    subspace_offsets_[m] = (m * dim) / num_subquantizers;
+  codebooks_.resize(num_subquantizers);
+  codebook_half_norms_.resize(num_subquantizers);
+  for (int32 m = 0; m < num_subquantizers; m++) {
+    int32 offset = subspace_offsets_[m],
+        len = subspace_offsets_[m + 1] - offset;
+    KMeans(normalized.ColRange(offset, len), codebook_size,
+           opts_.num_kmeans_iters, &(codebooks_[m]));
+    ComputeHalfNorms(codebooks_[m], &(codebook_half_norms_[m]));
+  }
+
+  lists_.clear();
+  lists_.resize(num_lists);
+  scorer_.Clear();
+  slot_ivectors_.Resize(0, 0);
+  slot_ids_.clear();
+  slot_num_utts_.clear();
+  slot_lists_.clear();
+  slot_positions_.clear();
+  free_slots_.clear();
+  id_to_slot_.clear();
+  KALDI_LOG << "Trained speaker index on " << num_samples << " samples: "
+            << num_lists << " lists, " << num_subquantizers
+            << " subquantizers of " << codebook_size << " codes.";
+}
+
+int32 SpeakerIndex::Encode(const VectorBase<double> &normalized,
+                           uint8 *codes) const {
+  Vector<double> scores(centroids_.NumRows());
+  scores.AddMatVec(1.0, centroids_, kNoTrans, normalized, 0.0);
+  scores.AddVec(-1.0, centroid_half_norms_);
+  MatrixIndexT list;
+  scores.Max(&list);
+  Vector<double> residual(normalized);
+  residual.AddVec(-1.0, centroids_.Row(list));
+  for (size_t m = 0; m < codebooks_.size(); m++) {
+    int32 offset = subspace_offsets_[m],
+        len = subspace_offsets_[m + 1] - offset;
+    Vector<double> code_scores(codebooks_[m].NumRows());
+    code_scores.AddMatVec(1.0, codebooks_[m], kNoTrans,
+                          residual.Range(offset, len), 0.0);
+    code_scores.AddVec(-1.0, codebook_half_norms_[m]);
+    MatrixIndexT code;
+    code_scores.Max(&code);
+    codes[m] = static_cast<uint8>(code);
+  }
+  return list;
+}
+
+void SpeakerIndex::Insert(int32 id,
+                          const VectorBase<double> &transformed_ivector,
+                          int32 num_utts) {
+  if (!IsTrained())
+    KALDI_ERR << "Insert() called on an untrained speaker index.";
+  Vector<double> normalized;
+  Normalize(transformed_ivector, &normalized);
+  std::vector<uint8> codes(codebooks_.size());
+  int32 list = Encode(normalized, &(codes[0]));
+  InsertEncoded(id, transformed_ivector, num_utts, list, &(codes[0]));
+}
+
+void SpeakerIndex::InsertEncoded(int32 id,
+                                 const VectorBase<double> &transformed_ivector,
+                                 int32 num_utts, int32 list,
+                                 const uint8 *codes) {
+  KALDI_ASSERT(id >= 0 && list >= 0 &&
+               list < static_cast<int32>(lists_.size()));
+  Remove(id);
+  int32 slot;
+  if (!free_slots_.empty()) {
+    slot = free_slots_.back();
+    free_slots_.pop_back();
+    scorer_.SetSpeaker(slot, transformed_ivector, num_utts);
+  } else {
+    slot = scorer_.AddSpeaker(transformed_ivector, num_utts);
+    if (slot == slot_ivectors_.NumRows()) {
+      // Grow geometrically, as PldaScorer does.
+      slot_ivectors_.Resize(std::max<int32>(16, 2 * slot), Dim(), kCopyData);
+    }
+    slot_ids_.push_back(-1);
+    slot_num_utts_.push_back(0);
+    slot_lists_.push_back(0);
+    slot_positions_.push_back(0);
+  }
+  slot_ivectors_.Row(slot).CopyFromVec(transformed_ivector);
+  slot_ids_[slot] = id;
+  slot_num_utts_[slot] = num_utts;
+  InvertedList &inv_list = lists_[list];
+  slot_lists_[slot] = list;
+  slot_positions_[slot] = inv_list.slots.size();
+  inv_list.slots.push_back(slot);
+  inv_list.codes.insert(inv_list.codes.end(), codes,
+                        codes + codebooks_.size());
+  id_to_slot_[id] = slot;
+}
+
+bool SpeakerIndex::Remove(int32 id) {
+  std::unordered_map<int32, int32>::iterator iter = id_to_slot_.find(id);
+  if (iter == id_to_slot_.end()) return false;
+  int32 slot = iter->second;
+  id_to_slot_.erase(iter);
+  // Move the last entry of the list into the removed entry's position.
+  InvertedList &inv_list = lists_[slot_lists_[slot]];
+  size_t code_size = codebooks_.size();
+  int32 pos = slot_positions_[slot], last = inv_list.slots.size() - 1;
+  if (pos != last) {
+    int32 moved_slot = inv_list.slots[last];
+    inv_list.slots[pos] = moved_slot;
+    std::copy(inv_list.codes.begin() + last * code_size,
+              inv_list.codes.begin() + (last + 1) * code_size,
+              inv_list.codes.begin() + pos * code_size);
+    slot_positions_[moved_slot] = pos;
+  }
+  inv_list.slots.pop_back();
+  inv_list.codes.resize(last * code_size);
+  slot_ids_[slot] = -1;
+  free_slots_.push_back(slot);
+  return true;
+}
+
+void SpeakerIndex::SelectTopResults(
+    const std::vector<int32> &slots, const VectorBase<double> &scores,
+    int32 num_results,
+    std::vector<std::pair<int32, double> > *results) const {
+  std::vector<std::pair<double, int32> > scored(slots.size());
+  for (size_t i = 0; i < slots.size(); i++)
+    scored[i] = std::make_pair(scores(i), slot_ids_[slots[i]]);
+  size_t n = std::min<size_t>(std::max(num_results, 0), scored.size());
+  std::partial_sort(scored.begin(), scored.begin() + n, scored.end(),
+                    std::greater<std::pair<double, int32> >());
+  results->resize(n);
+  for (size_t i = 0; i < n; i++)
+    (*results)[i] = std::make_pair(scored[i].second, scored[i].first);
+}
+
+void SpeakerIndex::Search(
+    const VectorBase<double> &transformed_test_ivector, int32 num_results,
+    std::vector<std::pair<int32, double> > *results) const {
+  results->clear();
+  if (NumSpeakers() == 0) return;
+  Vector<double> query;
+  Normalize(transformed_test_ivector, &query);
+
+  // Probe the lists whose centroids have the largest inner product with the
+  // query.
+  int32 num_lists = lists_.size(),
+      num_probes = std::min(opts_.num_probes, num_lists);
+  Vector<double> centroid_scores(num_lists);
+  centroid_scores.AddMatVec(1.0, centroids_, kNoTrans, query, 0.0);
+  std::vector<std::pair<double, int32> > probes(num_lists);
+  for (int32 l = 0; l < num_lists; l++)
+    probes[l] = std::make_pair(centroid_scores(l), l);
+  std::partial_sort(probes.begin(), probes.begin() + num_probes, probes.end(),
+                    std::greater<std::pair<double, int32> >());
+
+  // Look-up table of the query's inner product with every codeword;
+  // since x = c + r, q.x = q.c + sum_m table[m][code_m].
+  int32 num_subquantizers = codebooks_.size();
+  std::vector<Vector<double> > tables(num_subquantizers);
+  for (int32 m = 0; m < num_subquantizers; m++) {
+    int32 offset = subspace_offsets_[m],
+        len = subspace_offsets_[m + 1] - offset;
+    tables[m].Resize(codebooks_[m].NumRows(), kUndefined);
+    tables[m].AddMatVec(1.0, codebooks_[m], kNoTrans,
+                        query.Range(offset, len), 0.0);
+  }
+
+  std::vector<std::pair<double, int32> > candidates;
+  for (int32 p = 0; p < num_probes; p++) {
+    const InvertedList &inv_list = lists_[probes[p].second];
+    double base = probes[p].first;
+    const uint8 *codes = inv_list.codes.empty() ? NULL : &(inv_list.codes[0]);
+    for (size_t i = 0; i < inv_list.slots.size(); i++) {
+      double score = base;
+      for (int32 m = 0; m < num_subquantizers; m++)
+        score += tables[m](codes[m]);
+      codes += num_subquantizers;
+      candidates.push_back(std::make_pair(score, inv_list.slots[i]));
+    }
+  }
+  size_t num_candidates = std::min<size_t>(opts_.num_candidates,
+                                           candidates.size());
+  std::partial_sort(candidates.begin(), candidates.begin() + num_candidates,
+                    candidates.end(),
+                    std::greater<std::pair<double, int32> >());
+
+  // Exact PLDA re-scoring of the shortlist.
+  std::vector<int32> slots(num_candidates);
+  for (size_t i = 0; i < num_candidates; i++)
+    slots[i] = candidates[i].second;
+  Vector<double> scores(num_candidates);
+  scorer_.ScoreSubset(transformed_test_ivector, slots, &scores);
+  SelectTopResults(slots, scores, num_results, results);
+}
+
+void SpeakerIndex::SearchExhaustive(
+    const VectorBase<double> &transformed_test_ivector, int32 num_results,
+    std::vector<std::pair<int32, double> > *results) const {
+  Vector<double> all_scores(scorer_.NumSpeakers());
+  scorer_.Score(transformed_test_ivector, &all_scores);
+  std::vector<int32> slots;
+  slots.reserve(NumSpeakers());
+  for (size_t slot = 0; slot < slot_ids_.size(); slot++)
+    if (slot_ids_[slot] >= 0) slots.push_back(slot);
+  Vector<double> scores(slots.size());
+  for (size_t i = 0; i < slots.size(); i++) scores(i) = all_scores(slots[i]);
+  SelectTopResults(slots, scores, num_results, results);
+}
+
+void SpeakerIndex::Write(std::ostream &os, bool binary) const {
+  if (!IsTrained())
+    KALDI_ERR << "Writing an untrained speaker index.";
+  WriteToken(os, binary, "<SpeakerIndex>");
+  WriteToken(os, binary, "<Centroids>");
+  centroids_.Write(os, binary);
+  WriteToken(os, binary, "<SubspaceOffsets>");
+  WriteIntegerVector(os, binary, subspace_offsets_);
+  WriteToken(os, binary, "<Codebooks>");
+  for (size_t m = 0; m < codebooks_.size(); m++)
+    codebooks_[m].Write(os, binary);
+
+  // The entries, in slot order with free slots skipped.
+  int32 num_speakers = NumSpeakers(), code_size = codebooks_.size();
+  std::vector<int32> ids, num_utts, lists;
+  std::vector<uint8> codes;
+  Matrix<double> ivectors(num_speakers, Dim(), kUndefined);
+  ids.reserve(num_speakers);
+  num_utts.reserve(num_speakers);
+  lists.reserve(num_speakers);
+  codes.reserve(num_speakers * code_size);
+  for (size_t slot = 0; slot < slot_ids_.size(); slot++) {
+    if (slot_ids_[slot] < 0) continue;
+    ivectors.Row(ids.size()).CopyFromVec(slot_ivectors_.Row(slot));
+    ids.push_back(slot_ids_[slot]);
+    num_utts.push_back(slot_num_utts_[slot]);
+    int32 list = slot_lists_[slot];
+    lists.push_back(list);
+    std::vector<uint8>::const_iterator begin = lists_[list].codes.begin() +
+        slot_positions_[slot] * code_size;
+    codes.insert(codes.end(), begin, begin + code_size);
+  }
+  WriteToken(os, binary, "<Ids>");
+  WriteIntegerVector(os, binary, ids);
+  WriteToken(os, binary, "<NumUtts>");
+  WriteIntegerVector(os, binary, num_utts);
+  WriteToken(os, binary, "<Lists>");
+  WriteIntegerVector(os, binary, lists);
+  WriteToken(os, binary, "<Codes>");
+  WriteIntegerVector(os, binary, codes);
+  WriteToken(os, binary, "<Ivectors>");
+  ivectors.Write(os, binary);
+  WriteToken(os, binary, "</SpeakerIndex>");
+}
+
+void SpeakerIndex::Read(std::istream &is, bool binary) {
+  ExpectToken(is, binary, "<SpeakerIndex>");
+  ExpectToken(is, binary, "<Centroids>");
+  centroids_.Read(is, binary);
+  if (centroids_.NumCols() != Dim())
+    KALDI_ERR << "Speaker index has dimension " << centroids_.NumCols()
+              << " but the PLDA model has dimension " << Dim();
+  ComputeHalfNorms(centroids_, &centroid_half_norms_);
+  ExpectToken(is, binary, "<SubspaceOffsets>");
+  ReadIntegerVector(is, binary, &subspace_offsets_);
+  KALDI_ASSERT(subspace_offsets_.size() >= 2 &&
+               subspace_offsets_.back() == Dim());
+  int32 num_subquantizers = subspace_offsets_.size() - 1;
+  ExpectToken(is, binary, "<Codebooks>");
+  codebooks_.resize(num_subquantizers);
+  codebook_half_norms_.resize(num_subquantizers);
+  for (int32 m = 0; m < num_subquantizers; m++) {
+    codebooks_[m].Read(is, binary);
+    ComputeHalfNorms(codebooks_[m], &(codebook_half_norms_[m]));
+  }
+
+  std::vector<int32> ids, num_utts, lists;
+  std::vector<uint8> codes;
+  Matrix<double> ivectors;
+  ExpectToken(is, binary, "<Ids>");
+  ReadIntegerVector(is, binary, &ids);
+  ExpectToken(is, binary, "<NumUtts>");
+  ReadIntegerVector(is, binary, &num_utts);
+  ExpectToken(is, binary, "<Lists>");
+  ReadIntegerVector(is, binary, &lists);
+  ExpectToken(is, binary, "<Codes>");
+  ReadIntegerVector(is, binary, &codes);
+  ExpectToken(is, binary, "<Ivectors>");
+  ivectors.Read(is, binary);
+  ExpectToken(is, binary, "</SpeakerIndex>");
+  size_t num_speakers = ids.size();
+  if (num_utts.size() != num_speakers || lists.size() != num_speakers ||
+      codes.size() != num_speakers * num_subquantizers ||
+      static_cast<size_t>(ivectors.NumRows()) != num_speakers ||
+      (num_speakers != 0 && ivectors.NumCols() != Dim()))
+    KALDI_ERR << "Inconsistent sizes reading speaker index.";
+
+  lists_.clear();
+  lists_.resize(centroids_.NumRows());
+  scorer_.Clear();
+  slot_ivectors_.Resize(0, 0);
+  slot_ids_.clear();
+  slot_num_utts_.clear();
+  slot_lists_.clear();
+  slot_positions_.clear();
+  free_slots_.clear();
+  id_to_slot_.clear();
+  for (size_t i = 0; i < num_speakers; i++)
+    InsertEncoded(ids[i], ivectors.Row(i), num_utts[i], lists[i],
+                  &(codes[i * num_subquantizers]));
+}
+
+}  // namespace kaldi
@@ -0,0 +1,168 @@
+// speaker_verification/speaker_index.h
+
+// Copyright (c) 2021 PeachLab. All Rights Reserved.
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_SPEAKER_VERIFICATION_SPEAKER_INDEX_H_
+#define KALDI_SPEAKER_VERIFICATION_SPEAKER_INDEX_H_
+
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "base/kaldi-common.h"
+#include "matrix/matrix-lib.h"
+#include "speaker_verification/plda.h"
+#include "util/options-itf.h"
+
+namespace kaldi {
+
+struct SpeakerIndexOptions {
+  int32 num_lists;
+  int32 num_subquantizers;
+  int32 num_kmeans_iters;
+  int32 num_probes;
+  int32 num_candidates;
+
+  SpeakerIndexOptions(): num_lists(1024), num_subquantizers(16),
+                         num_kmeans_iters(20), num_probes(16),
+                         num_candidates(100) { }
+
+  void Register(OptionsItf *opts) {
+    opts->Register("num-lists", &num_lists, "Number of coarse clusters "
+                   "(inverted lists) of the index.");
+    opts->Register("num-subquantizers", &num_subquantizers, "Number of "
+                   "sub-vectors in the product quantizer; each is coded in "
+                   "one byte.");
+    opts->Register("num-kmeans-iters", &num_kmeans_iters, "Number of k-means "
+                   "iterations when training the quantizers.");
+    opts->Register("num-probes", &num_probes, "Number of inverted lists "
+                   "searched per query.");
+    opts->Register("num-candidates", &num_candidates, "Number of approximate "
+                   "nearest neighbours that are re-scored with exact PLDA.");
+  }
+};
+
+
+/// SpeakerIndex is an approximate nearest-neighbour index over enrolled
+/// speakers for open-set identification, returning the best-scoring speakers
+/// by PLDA log-likelihood ratio without scoring every speaker.
+///
+/// It is an inverted-file index with product quantization (IVF-PQ) over the
+/// length-normalized, PLDA-transformed enrollment iVectors (the ones passed to
+/// Plda::LogLikelihoodRatio()).  A query is compared with the coarse centroids,
+/// the "num_probes" nearest inverted lists are scanned using inner products
+/// approximated from the PQ codes, and the best "num_candidates" of those are
+/// re-scored exactly with a PldaScorer.  The exact iVectors are kept for the
+/// re-scoring, so the index itself is not lossy, only the shortlist is.
+///
+/// Speakers are identified by caller-chosen ids; Insert() and Remove() may be
+/// called at any time after Train().
+class SpeakerIndex {
+ public:
+  SpeakerIndex(const SpeakerIndexOptions &opts, const Plda &plda);
+
+  /// Trains the coarse quantizer and the product quantizer on "samples", one
+  /// transformed iVector per row (typically the enrolled speakers themselves
+  /// or a representative subset).  Must be called before Insert() unless the
+  /// index was read from disk.  Existing entries are removed.
+  void Train(const MatrixBase<double> &samples);
+
+  bool IsTrained() const { return centroids_.NumRows() != 0; }
+
+  /// Adds (or replaces) speaker "id", given its transformed iVector averaged
+  /// over "num_utts" utterances.
+  void Insert(int32 id, const VectorBase<double> &transformed_ivector,
+              int32 num_utts);
+
+  /// Removes speaker "id"; returns false if it was not present.
+  bool Remove(int32 id);
+
+  bool Contains(int32 id) const { return id_to_slot_.count(id) != 0; }
+
+  int32 NumSpeakers() const { return id_to_slot_.size(); }
+
+  int32 Dim() const { return scorer_.Dim(); }
+
+  /// Finds the (at most) "num_results" best-scoring speakers for the test
+  /// iVector.  On exit "results" holds (id, PLDA log-likelihood ratio) pairs,
+  /// best first.
+  void Search(const VectorBase<double> &transformed_test_ivector,
+              int32 num_results,
+              std::vector<std::pair<int32, double> > *results) const;
+
+  /// As Search(), but scores every speaker exactly; for testing and for
+  /// measuring the recall of Search().
+  void SearchExhaustive(const VectorBase<double> &transformed_test_ivector,
+                        int32 num_results,
+                        std::vector<std::pair<int32, double> > *results) const;
+
+  /// Writes the quantizers and all entries (including the exact iVectors).
+  /// The PLDA model is not written; Read() must be called on an index
+  /// constructed with the same model.
+  void Write(std::ostream &os, bool binary) const;
+
+  void Read(std::istream &is, bool binary);
+
+ private:
+  /// Maps the transformed iVector to the unit-length vector that is indexed.
+  void Normalize(const VectorBase<double> &transformed_ivector,
+                 Vector<double> *normalized) const;
+
+  /// Returns the inverted list for "normalized" and writes its PQ codes
+  /// (num_subquantizers bytes) to "codes".
+  int32 Encode(const VectorBase<double> &normalized, uint8 *codes) const;
+
+  /// Adds an entry whose list and codes are already known.
+  void InsertEncoded(int32 id, const VectorBase<double> &transformed_ivector,
+                     int32 num_utts, int32 list, const uint8 *codes);
+
+  void SelectTopResults(const std::vector<int32> &slots,
+                        const VectorBase<double> &scores, int32 num_results,
+                        std::vector<std::pair<int32, double> > *results) const;
+
+  struct InvertedList {
+    std::vector<int32> slots;
+    std::vector<uint8> codes;  // num_subquantizers bytes per entry.
+  };
+
+  SpeakerIndexOptions opts_;
+
+  Matrix<double> centroids_;  // num_lists by dim.
+  Vector<double> centroid_half_norms_;  // 0.5 * |c|^2 for each centroid.
+  /// Subquantizer m covers dimensions [subspace_offsets_[m],
+  /// subspace_offsets_[m + 1]); its codebook has up to 256 rows.
+  std::vector<int32> subspace_offsets_;
+  std::vector<Matrix<double> > codebooks_;
+  std::vector<Vector<double> > codebook_half_norms_;
+  std::vector<InvertedList> lists_;
+
+  /// Per-slot data.  Slots of removed speakers are reused by Insert().
+  /// scorer_ holds the exact PLDA terms for each slot.
+  PldaScorer scorer_;
+  Matrix<double> slot_ivectors_;
+  std::vector<int32> slot_ids_;  // -1 for free slots.
+  std::vector<int32> slot_num_utts_;
+  std::vector<int32> slot_lists_;
+  std::vector<int32> slot_positions_;  // position within lists_[slot_lists_].
+  std::vector<int32> free_slots_;
+  std::unordered_map<int32, int32> id_to_slot_;
+};
+
+}  // namespace kaldi
+
+#endif  // KALDI_SPEAKER_VERIFICATION_SPEAKER_INDEX_H_
@@ -0,0 +1,179 @@
+// speaker_verification/speaker_index_benchmark.cc
+
+// Copyright (c) 2021 PeachLab. All Rights Reserved.
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+// Recall and latency of SpeakerIndex::Search() against exhaustive PLDA
+// scoring, on synthetic speakers drawn from a random PLDA model.
+
+#include <algorithm>
+#include <functional>
+#include <sstream>
+
+#include "base/kaldi-common.h"
+#include "base/timer.h"
+#include "speaker_verification/speaker_index.h"
+#include "util/parse-options.h"
+
+namespace kaldi {
+
+// Makes a PLDA model whose transform is the identity, with between-class
+// variances "psi" spread over [0.5, 5.5], through the model's own Read().
+static void MakeRandomPlda(int32 dim, Plda *plda, Vector<double> *psi) {
+  Vector<double> mean(dim);
+  Matrix<double> transform(dim, dim);
+  transform.SetUnit();
+  psi->Resize(dim);
+  psi->SetRandUniform();
+  psi->Scale(5.0);
+  psi->Add(0.5);
+  std::sort(psi->Data(), psi->Data() + dim, std::greater<double>());
+  std::ostringstream os;
+  bool binary = true;
+  WriteToken(os, binary, "<Plda>");
+  mean.Write(os, binary);
+  transform.Write(os, binary);
+  psi->Write(os, binary);
+  WriteToken(os, binary, "</Plda>");
+  std::istringstream is(os.str());
+  plda->Read(is, binary);
+}
+
+static double Percentile(std::vector<double> times, double p) {
+  std::sort(times.begin(), times.end());
+  size_t index = static_cast<size_t>(p * (times.size() - 1) + 0.5);
+  return times[index];
+}
+
+}  // namespace kaldi
+
+int main(int argc, char *argv[]) {
+  using namespace kaldi;
+  try {
+    const char *usage =
+        "Measures recall and latency of the approximate speaker index against\n"
+        "exhaustive PLDA scoring, on synthetic data.\n"
+        "Usage:  speaker-index-benchmark [options]\n";
+    ParseOptions po(usage);
+    SpeakerIndexOptions index_opts;
+    int32 dim = 128, num_speakers = 100000, num_queries = 200,
+        num_utts = 3, num_results = 10, num_removed = 1000,
+        num_train = 20000;
+    index_opts.Register(&po);
+    po.Register("dim", &dim, "Dimension of the transformed iVectors.");
+    po.Register("num-speakers", &num_speakers, "Number of enrolled speakers.");
+    po.Register("num-queries", &num_queries, "Number of test iVectors.");
+    po.Register("num-utts", &num_utts, "Utterances per enrolled speaker.");
+    po.Register("num-results", &num_results, "Recall is measured at this "
+                "many results.");
+    po.Register("num-train", &num_train, "Number of enrolled speakers the "
+                "quantizers are trained on.");
+    po.Register("num-removed", &num_removed, "Number of speakers removed and "
+                "re-inserted before searching, to exercise deletion.");
+    po.Read(argc, argv);
+    if (po.NumArgs() != 0) {
+      po.PrintUsage();
+      exit(1);
+    }
+
+    Plda plda;
+    Vector<double> psi_sqrt;
+    MakeRandomPlda(dim, &plda, &psi_sqrt);
+    psi_sqrt.ApplyPow(0.5);
+    // In the transformed space a speaker is s ~ N(0, Psi); an enrollment
+    // average over n utterances adds N(0, I/n) and a test utterance N(0, I).
+    Matrix<double> speakers(num_speakers, dim), enrolled(num_speakers, dim);
+    speakers.SetRandn();
+    speakers.MulColsVec(psi_sqrt);
+    enrolled.SetRandn();
+    enrolled.Scale(1.0 / std::sqrt(static_cast<double>(num_utts)));
+    enrolled.AddMat(1.0, speakers);
+
+    SpeakerIndex index(index_opts, plda);
+    Timer timer;
+    index.Train(enrolled.RowRange(0, std::min(num_train, num_speakers)));
+    double train_time = timer.Elapsed();
+    timer.Reset();
+    for (int32 i = 0; i < num_speakers; i++)
+      index.Insert(i, enrolled.Row(i), num_utts);
+    for (int32 i = 0; i < std::min(num_removed, num_speakers); i++) {
+      index.Remove(i);
+      index.Insert(i, enrolled.Row(i), num_utts);
+    }
+    double insert_time = timer.Elapsed();
+
+    std::vector<double> exact_times, approx_times;
+    int32 top1_hits = 0, topk_hits = 0, topk_total = 0, correct_speaker = 0;
+    for (int32 q = 0; q < num_queries; q++) {
+      int32 target = RandInt(0, num_speakers - 1);
+      Vector<double> test(dim);
+      test.SetRandn();
+      test.AddVec(1.0, speakers.Row(target));
+      std::vector<std::pair<int32, double> > exact, approx;
+      Timer t1;
+      index.SearchExhaustive(test, num_results, &exact);
+      exact_times.push_back(t1.Elapsed());
+      Timer t2;
+      index.Search(test, num_results, &approx);
+      approx_times.push_back(t2.Elapsed());
+      if (!approx.empty() && approx[0].first == exact[0].first) top1_hits++;
+      if (!approx.empty() && approx[0].first == target) correct_speaker++;
+      for (size_t i = 0; i < exact.size(); i++) {
+        topk_total++;
+        for (size_t j = 0; j < approx.size(); j++)
+          if (approx[j].first == exact[i].first) { topk_hits++; break; }
+      }
+    }
+
+    KALDI_LOG << "Speakers " << num_speakers << ", dim " << dim
+              << ": train " << train_time << " s, insert " << insert_time
+              << " s.";
+    KALDI_LOG << "Exhaustive search: median "
+              << 1000.0 * Percentile(exact_times, 0.5) << " ms, p95 "
+              << 1000.0 * Percentile(exact_times, 0.95) << " ms.";
+    KALDI_LOG << "Index search: median "
+              << 1000.0 * Percentile(approx_times, 0.5) << " ms, p95 "
+              << 1000.0 * Percentile(approx_times, 0.95) << " ms.";
+    KALDI_LOG << "Recall@1 " << static_cast<double>(top1_hits) / num_queries
+              << ", recall@" << num_results << " "
+              << static_cast<double>(topk_hits) / topk_total
+              << ", identification accuracy "
+              << static_cast<double>(correct_speaker) / num_queries;
+
+    // Round trip through the on-disk format.
+    std::ostringstream os;
+    index.Write(os, true);
+    SpeakerIndex index2(index_opts, plda);
+    std::istringstream is(os.str());
+    index2.Read(is, true);
+    KALDI_ASSERT(index2.NumSpeakers() == index.NumSpeakers());
+    {
+      Vector<double> test(dim);
+      test.SetRandn();
+      std::vector<std::pair<int32, double> > results, results2;
+      index.Search(test, num_results, &results);
+      index2.Search(test, num_results, &results2);
+      KALDI_ASSERT(results == results2);
+    }
+    KALDI_LOG << "Index size on disk " << os.str().size() / (1024.0 * 1024.0)
+              << " MB.";
+    return 0;
+  } catch(const std::exception &e) {
+    std::cerr << e.what();
+    return -1;
+  }
+}
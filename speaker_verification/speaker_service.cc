@@ -0,0 +1,748 @@
+// speaker_verification/speaker_service.cc
+
+// Copyright (c) 2021 PeachLab. All Rights Reserved.
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <utility>
+
+#include "speaker_verification/speaker_service.h"
+#include "util/kaldi-io.h"
+#include "util/kaldi-thread.h"
+
+namespace kaldi {
+
+// One worker of SpeakerModel::ExtractXvectors(); MultiThreader gives each
+// thread its own copy, which runs its batch of utterances through a network
+// replica borrowed for the call, in one XvectorExtractor::ExtractXvectors().
+class SpeakerModel::ExtractXvectorsTask: public MultiThreadable {
+ public:
+  ExtractXvectorsTask(ExtractorPool *extractors,
+                      const std::vector<Matrix<BaseFloat> > *features,
+                      const std::vector<std::vector<int32> > *batches,
+                      std::atomic<int32> *num_xvectors,
+                      std::vector<Vector<BaseFloat> > *xvectors):
+      extractors_(extractors), features_(features), batches_(batches),
+      num_xvectors_(num_xvectors), xvectors_(xvectors) { }
+
+  void operator() () {
+    const std::vector<int32> &batch = (*batches_)[thread_id_];
+    std::vector<const Matrix<BaseFloat>*> batch_features;
+    batch_features.reserve(batch.size());
+    for (size_t i = 0; i < batch.size(); i++)
+      batch_features.push_back(&((*features_)[batch[i]]));
+    std::vector<Vector<BaseFloat> > batch_xvectors;
+    std::unique_ptr<XvectorExtractor> extractor = extractors_->Acquire();
+    (*num_xvectors_) += extractor->ExtractXvectors(batch_features,
+                                                   &batch_xvectors);
+    extractors_->Release(std::move(extractor));
+    for (size_t i = 0; i < batch.size(); i++)
+      (*xvectors_)[batch[i]].Swap(&(batch_xvectors[i]));
+  }
+
+ private:
+  ExtractorPool *extractors_;
+  const std::vector<Matrix<BaseFloat> > *features_;
+  const std::vector<std::vector<int32> > *batches_;
+  std::atomic<int32> *num_xvectors_;
+  std::vector<Vector<BaseFloat> > *xvectors_;
+};
+
+SpeakerModel::SpeakerModel(const NnetComputerFactory &nnet_factory,
+                           const Vector<BaseFloat> &mean,
+                           const Matrix<BaseFloat> &transform,
+                           const Plda &plda,
+                           const XvectorExtractorOptions &extractor_opts):
+    extractor_opts_(extractor_opts), plda_(plda),
+    extractors_(nnet_factory ?
+                    new ExtractorPool(nnet_factory, extractor_opts) : NULL) {
+  bool normalize_lda_length = true;
+  PldaConfig plda_config;
+  post_transform_.Compile(mean, transform, normalize_lda_length, plda_,
+                          plda_config);
+  if (extractors_ != nullptr) extractors_->Release(extractors_->Acquire());
+}
+
+// Plda's copy constructor is explicit, so the model can't be returned by
+// value; plda_ is copy-constructed from this.
+static std::unique_ptr<Plda> ReadBundlePlda(const ModelBundle &bundle) {
+  std::unique_ptr<Plda> plda(new Plda());
+  ReadBundleObject(bundle, kBundlePlda, plda.get());
+  return plda;
+}
+
+SpeakerModel::SpeakerModel(const NnetComputerFactory &nnet_factory,
+                           std::shared_ptr<const ModelBundle> bundle,
+                           const XvectorExtractorOptions &extractor_opts):
+    bundle_(bundle), extractor_opts_(extractor_opts),
+    plda_(*ReadBundlePlda(*bundle)),
+    extractors_(nnet_factory ?
+                    new ExtractorPool(nnet_factory, extractor_opts) : NULL) {
+  ReadBundleObject(*bundle_, kBundleXvectorTransform, &post_transform_);
+  if (post_transform_.Dim() != plda_.Dim())
+    KALDI_ERR << "The x-vector transform and the PLDA model in "
+              << bundle_->Filename() << " do not match.";
+  if (extractors_ != nullptr) extractors_->Release(extractors_->Acquire());
+}
+
+int32 SpeakerModel::ExtractXvectors(
+    const std::vector<Matrix<BaseFloat> > &features,
+    std::vector<Vector<BaseFloat> > *xvectors, int32 num_threads) const {
+  if (extractors_ == nullptr)
+    KALDI_ERR << "This SpeakerModel was created without a network.";
+  int32 num_utts = features.size();
+  num_threads = std::max(1, std::min(num_threads, num_utts));
+  if (num_threads == 1) {
+    // All utterances go through the network in one batch.
+    std::unique_ptr<XvectorExtractor> extractor = extractors_->Acquire();
+    int32 num_xvectors = extractor->ExtractXvectors(features, xvectors);
+    extractors_->Release(std::move(extractor));
+    return num_xvectors;
+  }
+  // One batch per thread, of about the same number of frames: the longest
+  // utterance goes first, each to the batch with the fewest frames so far.
+  std::vector<int32> utts(num_utts);
+  for (int32 i = 0; i < num_utts; i++) utts[i] = i;
+  std::stable_sort(utts.begin(), utts.end(), [&features](int32 a, int32 b) {
+    return features[a].NumRows() > features[b].NumRows();
+  });
+  std::vector<std::vector<int32> > batches(num_threads);
+  std::vector<int64> batch_frames(num_threads, 0);
+  for (int32 i = 0; i < num_utts; i++) {
+    int32 batch = std::min_element(batch_frames.begin(), batch_frames.end()) -
+        batch_frames.begin();
+    batches[batch].push_back(utts[i]);
+    batch_frames[batch] += features[utts[i]].NumRows();
+  }
+  xvectors->clear();
+  xvectors->resize(num_utts);
+  std::atomic<int32> num_xvectors(0);
+  ExtractXvectorsTask task(extractors_.get(), &features, &batches,
+                           &num_xvectors, xvectors);
+  {
+    MultiThreader<ExtractXvectorsTask> threader(num_threads, task);
+  }
+  return num_xvectors;
+}
+
+int32 SpeakerModel::XvectorsToPldaInput(
+    const std::vector<Vector<BaseFloat> > &xvectors,
+    Vector<double> *plda_input) const {
+  int32 num_utts = xvectors.size();
+  if (num_utts == 0) return 0;
+  // The same sum as SpeakerGallery::EnrollXvectorStats() is given, so that
+  // both enroll the same PLDA input.
+  Vector<double> xvector_sum(post_transform_.InputDim());
+  for (int32 i = 0; i < num_utts; i++) {
+    Vector<double> xvector(xvectors[i]);
+    xvector_sum.AddVec(1.0, xvector);
+  }
+  XvectorSumToPldaInput(xvector_sum, num_utts, plda_input);
+  return num_utts;
+}
+
+void SpeakerModel::XvectorSumToPldaInput(const VectorBase<double> &xvector_sum,
+                                         int32 num_utts,
+                                         Vector<double> *plda_input) const {
+  KALDI_ASSERT(num_utts > 0);
+  Vector<double> xvector_mean(xvector_sum);
+  xvector_mean.Scale(1.0 / num_utts);
+  plda_input->Resize(post_transform_.Dim(), kUndefined);
+  post_transform_.Apply(xvector_mean, num_utts, plda_input);
+}
+
+void SpeakerModel::XvectorsToPldaInputs(
+    const std::vector<Vector<BaseFloat> > &xvectors,
+    Matrix<double> *plda_inputs) const {
+  int32 num_utts = xvectors.size();
+  if (num_utts == 0) {
+    plda_inputs->Resize(0, 0);
+    return;
+  }
+  Matrix<BaseFloat> stacked(num_utts, post_transform_.InputDim(), kUndefined);
+  for (int32 i = 0; i < num_utts; i++)
+    stacked.Row(i).CopyFromVec(xvectors[i]);
+  XvectorsToPldaInputs(stacked, plda_inputs);
+}
+
+void SpeakerModel::XvectorsToPldaInputs(const MatrixBase<BaseFloat> &xvectors,
+                                        Matrix<double> *plda_inputs) const {
+  Matrix<double> xvectors_dbl(xvectors);
+  plda_inputs->Resize(xvectors.NumRows(), post_transform_.Dim(), kUndefined);
+  post_transform_.ApplyBatch(xvectors_dbl, 1, plda_inputs);
+}
+
+
+// The stats store holds each double x-vector sum as two float halves, the
+// sum rounded to float followed by the rounding error, which together keep
+// about 48 bits of the sum's 53 instead of float's 24.
+static void SplitXvectorSum(const VectorBase<double> &xvector_sum,
+                            Vector<float> *split_sum) {
+  int32 dim = xvector_sum.Dim();
+  split_sum->Resize(2 * dim, kUndefined);
+  for (int32 i = 0; i < dim; i++) {
+    float high = static_cast<float>(xvector_sum(i));
+    (*split_sum)(i) = high;
+    (*split_sum)(dim + i) = static_cast<float>(xvector_sum(i) - high);
+  }
+}
+
+static void JoinXvectorSum(const VectorBase<float> &split_sum,
+                           Vector<double> *xvector_sum) {
+  int32 dim = split_sum.Dim() / 2;
+  xvector_sum->Resize(dim, kUndefined);
+  for (int32 i = 0; i < dim; i++)
+    (*xvector_sum)(i) = static_cast<double>(split_sum(i)) +
+        static_cast<double>(split_sum(dim + i));
+}
+
+SpeakerGallery::SpeakerGallery(const Plda &plda):
+    plda_(plda), next_speaker_id_(0), scorer_(plda), index_size_(0),
+    index_trained_size_(0) { }
+
+int32 SpeakerGallery::SpeakerSlot(int32 speaker_id) const {
+  std::unordered_map<int32, int32>::const_iterator iter =
+      speaker_slots_.find(speaker_id);
+  return (iter == speaker_slots_.end() ? -1 : iter->second);
+}
+
+void SpeakerGallery::Clear() {
+  slot_speakers_.clear();
+  speaker_slots_.clear();
+  next_speaker_id_ = 0;
+  speakers_.clear();
+  num_utts_.clear();
+  xvector_sums_.clear();
+  speaker_store_.reset();
+  stats_store_.reset();
+  scorer_.Clear();
+  cohort_stats_.clear();
+  speaker_index_.reset();
+  index_size_ = 0;
+  index_trained_size_ = 0;
+}
+
+void SpeakerGallery::GetPldaInput(int32 slot,
+                                  VectorBase<double> *plda_input) const {
+  if (speaker_store_ == nullptr) {
+    plda_input->CopyFromVec(speakers_[slot]);
+  } else {
+    const float *row = speaker_store_->EmbeddingData(slot_speakers_[slot]);
+    plda_input->CopyFromVec(SubVector<float>(const_cast<float*>(row),
+                                             speaker_store_->Dim()));
+  }
+}
+
+bool SpeakerGallery::GetXvectorSum(int32 slot,
+                                   Vector<double> *xvector_sum) const {
+  xvector_sum->Resize(0);
+  if (speaker_store_ == nullptr) {
+    *xvector_sum = xvector_sums_[slot];
+  } else if (stats_store_ != nullptr) {
+    int32 speaker_id = slot_speakers_[slot];
+    // A count that differs means the stores were written apart; don't
+    // trust the sum.
+    if (stats_store_->NumUtts(speaker_id) == num_utts_[slot]) {
+      const float *row = stats_store_->EmbeddingData(speaker_id);
+      JoinXvectorSum(SubVector<float>(const_cast<float*>(row),
+                                      stats_store_->Dim()),
+                     xvector_sum);
+    }
+  }
+  return xvector_sum->Dim() != 0;
+}
+
+int32 SpeakerGallery::EnrollPldaInput(int32 speaker_id,
+                                      const VectorBase<double> &plda_input,
+                                      int32 num_utts) {
+  int32 slot = SpeakerSlot(speaker_id);
+  if (slot < 0) {
+    if (speaker_id < 0) speaker_id = next_speaker_id_;
+    next_speaker_id_ = std::max(next_speaker_id_, speaker_id + 1);
+    slot = NumSlots();
+    slot_speakers_.push_back(speaker_id);
+    speaker_slots_[speaker_id] = slot;
+    num_utts_.push_back(num_utts);
+    if (speaker_store_ == nullptr) {
+      speakers_.resize(slot + 1);
+      xvector_sums_.resize(slot + 1);
+    }
+  } else {
+    num_utts_[slot] = num_utts;
+  }
+  if (speaker_store_ == nullptr) {
+    speakers_[slot] = plda_input;
+  } else {
+    Vector<float> embedding(plda_input);
+    speaker_store_->Put(speaker_id, embedding, num_utts);
+  }
+  // Slots past the scorer's and the index's are added by Fill(), in order.
+  Vector<BaseFloat> scorer_input(plda_input);
+  if (slot < scorer_.NumSpeakers()) {
+    scorer_.SetSpeaker(slot, scorer_input, num_utts);
+    UpdateCohortStats(slot, plda_input);
+  } else if (slot == scorer_.NumSpeakers()) {
+    scorer_.AddSpeaker(scorer_input, num_utts);
+    UpdateCohortStats(slot, plda_input);
+  }
+  if (slot < index_size_)
+    speaker_index_->Insert(speaker_id, plda_input, num_utts);
+  return speaker_id;
+}
+
+int32 SpeakerGallery::Enroll(int32 speaker_id,
+                             const VectorBase<double> &plda_input,
+                             int32 num_utts) {
+  std::unique_lock<std::shared_timed_mutex> lock(mutex_);
+  speaker_id = EnrollPldaInput(speaker_id, plda_input, num_utts);
+  if (speaker_store_ == nullptr) {
+    xvector_sums_[SpeakerSlot(speaker_id)].Resize(0);
+  } else if (stats_store_ != nullptr) {
+    stats_store_->Remove(speaker_id);
+  }
+  return speaker_id;
+}
+
+int32 SpeakerGallery::EnrollXvectorStats(const SpeakerModel &model,
+                                         int32 speaker_id,
+                                         const VectorBase<double> &xvector_sum,
+                                         int32 num_utts, bool accumulate) {
+  Vector<double> total_sum(xvector_sum);
+  std::unique_lock<std::shared_timed_mutex> lock(mutex_);
+  int32 slot = SpeakerSlot(speaker_id);
+  if (accumulate && slot >= 0) {
+    Vector<double> old_sum;
+    if (!GetXvectorSum(slot, &old_sum)) {
+      KALDI_WARN << "Speaker " << speaker_id << " was enrolled without "
+                 << "x-vector statistics; enroll it again from all its "
+                 << "utterances instead.";
+      return -1;
+    }
+    total_sum.AddVec(1.0, old_sum);
+    num_utts += num_utts_[slot];
+  }
+  Vector<double> plda_input;
+  model.XvectorSumToPldaInput(total_sum, num_utts, &plda_input);
+  speaker_id = EnrollPldaInput(speaker_id, plda_input, num_utts);
+  if (speaker_store_ == nullptr) {
+    xvector_sums_[SpeakerSlot(speaker_id)].Swap(&total_sum);
+  } else if (stats_store_ != nullptr) {
+    Vector<float> split_sum;
+    SplitXvectorSum(total_sum, &split_sum);
+    stats_store_->Put(speaker_id, split_sum, num_utts);
+  }
+  return speaker_id;
+}
+
+int32 SpeakerGallery::NumSpeakers() const {
+  std::shared_lock<std::shared_timed_mutex> lock(mutex_);
+  return NumSlots();
+}
+
+std::vector<int32> SpeakerGallery::SpeakerIds() const {
+  std::shared_lock<std::shared_timed_mutex> lock(mutex_);
+  return slot_speakers_;
+}
+
+bool SpeakerGallery::IsFilled(bool index) const {
+  if (scorer_.NumSpeakers() != NumSlots()) return false;
+  if (!index || index_opts_ == nullptr) return true;
+  return speaker_index_ != nullptr && index_size_ == NumSlots() &&
+      NumSlots() < 2 * index_trained_size_;
+}
+
+void SpeakerGallery::Fill(bool index) const {
+  int32 num_slots = NumSlots();
+  Vector<double> plda_input(plda_.Dim());
+  for (int32 slot = scorer_.NumSpeakers(); slot < num_slots; slot++) {
+    GetPldaInput(slot, &plda_input);
+    scorer_.AddSpeaker(Vector<BaseFloat>(plda_input), num_utts_[slot]);
+    UpdateCohortStats(slot, plda_input);
+  }
+  if (!index || index_opts_ == nullptr) return;
+  if (speaker_index_ == nullptr || num_slots >= 2 * index_trained_size_) {
+    Matrix<double> samples(num_slots, plda_.Dim(), kUndefined);
+    for (int32 slot = 0; slot < num_slots; slot++) {
+      SubVector<double> sample(samples, slot);
+      GetPldaInput(slot, &sample);
+    }
+    speaker_index_.reset(new SpeakerIndex(*index_opts_, plda_));
+    speaker_index_->Train(samples);
+    index_size_ = 0;
+    index_trained_size_ = num_slots;
+  }
+  for (int32 slot = index_size_; slot < num_slots; slot++) {
+    GetPldaInput(slot, &plda_input);
+    speaker_index_->Insert(slot_speakers_[slot], plda_input,
+                           num_utts_[slot]);
+  }
+  index_size_ = num_slots;
+}
+
+std::shared_lock<std::shared_timed_mutex> SpeakerGallery::LockFilled(
+    bool index) const {
+  std::shared_lock<std::shared_timed_mutex> lock(mutex_);
+  // Readers only read; the first one after an enrollment fills in the
+  // rest exclusively.  Others may enroll in between, hence the loop.
+  while (!IsFilled(index)) {
+    lock.unlock();
+    {
+      std::unique_lock<std::shared_timed_mutex> fill_lock(mutex_);
+      Fill(index);
+    }
+    lock.lock();
+  }
+  return lock;
+}
+
+void SpeakerGallery::Score(const VectorBase<double> &plda_input,
+                           Vector<double> *scores) const {
+  std::shared_lock<std::shared_timed_mutex> lock = LockFilled(false);
+  Vector<BaseFloat> test_input(plda_input),
+      raw_scores(scorer_.NumSpeakers(), kUndefined);
+  scorer_.Score(test_input, &raw_scores);
+  scores->Resize(raw_scores.Dim(), kUndefined);
+  scores->CopyFromVec(raw_scores);
+  if (score_normalizer_ != nullptr) {
+    // One GEMV against the cohort for the test; the enrollment side was
+    // computed when each speaker was enrolled.
+    CohortStats test_stats;
+    score_normalizer_->ComputeTestStats(plda_input, &test_stats);
+    for (int32 slot = 0; slot < scores->Dim(); slot++)
+      (*scores)(slot) = score_normalizer_->Normalize(
+          (*scores)(slot), cohort_stats_[slot], test_stats);
+  }
+}
+
+bool SpeakerGallery::ScoreSpeaker(int32 speaker_id,
+                                  const MatrixBase<double> &plda_inputs,
+                                  Vector<double> *scores) const {
+  std::shared_lock<std::shared_timed_mutex> lock = LockFilled(false);
+  int32 slot = SpeakerSlot(speaker_id);
+  if (slot < 0) return false;
+  Matrix<BaseFloat> test_inputs(plda_inputs);
+  Vector<BaseFloat> raw_scores(test_inputs.NumRows(), kUndefined);
+  scorer_.ScoreSpeaker(slot, test_inputs, &raw_scores);
+  scores->Resize(raw_scores.Dim(), kUndefined);
+  scores->CopyFromVec(raw_scores);
+  if (score_normalizer_ != nullptr && scores->Dim() != 0) {
+    std::vector<CohortStats> test_stats;
+    score_normalizer_->ComputeTestStatsBatch(plda_inputs, &test_stats);
+    for (int32 i = 0; i < scores->Dim(); i++)
+      (*scores)(i) = score_normalizer_->Normalize(
+          (*scores)(i), cohort_stats_[slot], test_stats[i]);
+  }
+  return true;
+}
+
+void SpeakerGallery::Identify(
+    const VectorBase<double> &plda_input, int32 num_results,
+    std::vector<std::pair<int32, double> > *results) const {
+  results->clear();
+  if (num_results <= 0) return;
+  std::shared_lock<std::shared_timed_mutex> lock = LockFilled(true);
+  if (NumSlots() == 0) return;
+  if (index_opts_ != nullptr) {
+    speaker_index_->Search(plda_input, num_results, results);
+    return;
+  }
+  Vector<BaseFloat> test_input(plda_input),
+      scores(scorer_.NumSpeakers(), kUndefined);
+  scorer_.Score(test_input, &scores);
+  for (int32 slot = 0; slot < scores.Dim(); slot++)
+    results->push_back(std::make_pair(slot_speakers_[slot], scores(slot)));
+  num_results = std::min<int32>(num_results, results->size());
+  std::partial_sort(results->begin(), results->begin() + num_results,
+                    results->end(),
+                    [](const std::pair<int32, double> &a,
+                       const std::pair<int32, double> &b) {
+                      return a.second > b.second;
+                    });
+  results->resize(num_results);
+}
+
+void SpeakerGallery::SetSpeakerIndex(const SpeakerIndexOptions &opts) {
+  std::unique_lock<std::shared_timed_mutex> lock(mutex_);
+  index_opts_.reset(new SpeakerIndexOptions(opts));
+  speaker_index_.reset();
+  index_size_ = 0;
+  index_trained_size_ = 0;
+}
+
+void SpeakerGallery::SetScoreNormalizationCohort(
+    const MatrixBase<double> &cohort_plda_inputs,
+    const ScoreNormalizationOptions &opts) {
+  std::unique_lock<std::shared_timed_mutex> lock(mutex_);
+  score_normalizer_.reset(new CohortScoreNormalizer(opts, plda_,
+                                                    cohort_plda_inputs));
+  // The speakers not in the scorer yet get theirs in Fill().
+  cohort_stats_.clear();
+  Vector<double> plda_input(plda_.Dim());
+  for (int32 slot = 0; slot < scorer_.NumSpeakers(); slot++) {
+    GetPldaInput(slot, &plda_input);
+    UpdateCohortStats(slot, plda_input);
+  }
+}
+
+void SpeakerGallery::UpdateCohortStats(
+    int32 slot, const VectorBase<double> &plda_input) const {
+  if (score_normalizer_ == nullptr) return;
+  if (static_cast<int32>(cohort_stats_.size()) <= slot)
+    cohort_stats_.resize(slot + 1);
+  score_normalizer_->ComputeEnrollStats(plda_input, num_utts_[slot],
+                                        &(cohort_stats_[slot]));
+}
+
+bool SpeakerGallery::GetSpeaker(int32 speaker_id, Vector<double> *plda_input,
+                                int32 *num_utts) const {
+  std::shared_lock<std::shared_timed_mutex> lock(mutex_);
+  int32 slot = SpeakerSlot(speaker_id);
+  if (slot < 0) return false;
+  plda_input->Resize(plda_.Dim(), kUndefined);
+  GetPldaInput(slot, plda_input);
+  if (num_utts != NULL) *num_utts = num_utts_[slot];
+  return true;
+}
+
+bool SpeakerGallery::GetSpeakerStats(int32 speaker_id,
+                                     Vector<double> *xvector_sum,
+                                     int32 *num_utts) const {
+  std::shared_lock<std::shared_timed_mutex> lock(mutex_);
+  int32 slot = SpeakerSlot(speaker_id);
+  if (slot < 0 || !GetXvectorSum(slot, xvector_sum)) return false;
+  *num_utts = num_utts_[slot];
+  return true;
+}
+
+bool SpeakerGallery::OpenStore(const std::string &filename,
+                               int32 xvector_dim) {
+  std::unique_ptr<SpeakerStore> store(new SpeakerStore());
+  if (!store->Open(filename, plda_.Dim())) return false;
+  std::vector<int64> keys;
+  store->GetKeys(&keys);
+  for (size_t i = 0; i < keys.size(); i++) {
+    if (keys[i] < 0 || keys[i] > std::numeric_limits<int32>::max()) {
+      KALDI_WARN << "Speaker store " << filename << " has key " << keys[i]
+                 << ", which is not a speaker id; not using it.";
+      return false;
+    }
+  }
+  std::unique_ptr<SpeakerStore> stats_store(new SpeakerStore());
+  if (!stats_store->Open(filename + ".stats", 2 * xvector_dim)) {
+    KALDI_WARN << "Not keeping x-vector statistics of the speakers in "
+               << filename;
+    stats_store.reset();
+  }
+  // Only the records' metadata is read here.  The PLDA inputs and the
+  // statistics stay in the mapping; Fill() reads the former on the first
+  // score.
+  std::sort(keys.begin(), keys.end());
+  std::unique_lock<std::shared_timed_mutex> lock(mutex_);
+  Clear();
+  int32 num_speakers = keys.size();
+  slot_speakers_.resize(num_speakers);
+  num_utts_.resize(num_speakers);
+  for (int32 slot = 0; slot < num_speakers; slot++) {
+    slot_speakers_[slot] = static_cast<int32>(keys[slot]);
+    speaker_slots_[slot_speakers_[slot]] = slot;
+    num_utts_[slot] = store->NumUtts(keys[slot]);
+  }
+  if (num_speakers > 0) next_speaker_id_ = slot_speakers_.back() + 1;
+  speaker_store_ = std::move(store);
+  stats_store_ = std::move(stats_store);
+  return true;
+}
+
+bool SpeakerGallery::Write(const std::string &wxfilename, bool binary) const {
+  Output output;
+  bool write_kaldi_header = true;
+  if (!output.Open(wxfilename, binary, write_kaldi_header)) return false;
+  std::ostream &os = output.Stream();
+  std::shared_lock<std::shared_timed_mutex> lock(mutex_);
+  int32 num_speakers = NumSlots();
+  WriteToken(os, binary, "<num_enrolled_features>");
+  WriteBasicType(os, binary, num_speakers);
+  WriteToken(os, binary, "</num_enrolled_features>");
+
+  WriteToken(os, binary, "<enrolled_features>");
+  Vector<double> plda_input(plda_.Dim());
+  for (int32 slot = 0; slot < num_speakers; slot++) {
+    GetPldaInput(slot, &plda_input);
+    plda_input.Write(os, binary);
+  }
+  WriteToken(os, binary, "</enrolled_features>");
+
+  WriteToken(os, binary, "<num_utts>");
+  for (int32 slot = 0; slot < num_speakers; slot++)
+    WriteBasicType(os, binary, num_utts_[slot]);
+  WriteToken(os, binary, "</num_utts>");
+
+  // Empty for speakers enrolled without them.
+  WriteToken(os, binary, "<xvector_sums>");
+  for (int32 slot = 0; slot < num_speakers; slot++) {
+    Vector<double> xvector_sum;
+    GetXvectorSum(slot, &xvector_sum);
+    xvector_sum.Write(os, binary);
+  }
+  WriteToken(os, binary, "</xvector_sums>");
+
+  WriteToken(os, binary, "<speaker_ids>");
+  WriteIntegerVector(os, binary, slot_speakers_);
+  WriteToken(os, binary, "</speaker_ids>");
+  return output.Close();
+}
+
+bool SpeakerGallery::Read(const std::string &rxfilename) {
+  bool binary;
+  Input input;
+  if (!input.Open(rxfilename, &binary)) return false;
+  std::istream &is = input.Stream();
+  int32 num_speakers = 0;
+  ExpectToken(is, binary, "<num_enrolled_features>");
+  ReadBasicType(is, binary, &num_speakers);
+  ExpectToken(is, binary, "</num_enrolled_features>");
+
+  std::unique_lock<std::shared_timed_mutex> lock(mutex_);
+  Clear();
+  ExpectToken(is, binary, "<enrolled_features>");
+  speakers_.resize(num_speakers);
+  for (int32 slot = 0; slot < num_speakers; slot++)
+    speakers_[slot].Read(is, binary);
+  ExpectToken(is, binary, "</enrolled_features>");
+
+  ExpectToken(is, binary, "<num_utts>");
+  num_utts_.resize(num_speakers);
+  for (int32 slot = 0; slot < num_speakers; slot++)
+    ReadBasicType(is, binary, &(num_utts_[slot]));
+  ExpectToken(is, binary, "</num_utts>");
+
+  // Files written before the statistics were kept end here.
+  xvector_sums_.resize(num_speakers);
+  if (PeekToken(is, binary) == 'x') {
+    ExpectToken(is, binary, "<xvector_sums>");
+    for (int32 slot = 0; slot < num_speakers; slot++)
+      xvector_sums_[slot].Read(is, binary);
+    ExpectToken(is, binary, "</xvector_sums>");
+  }
+
+  // ... and those written before the ids were, here: speaker i is row i.
+  slot_speakers_.resize(num_speakers);
+  for (int32 slot = 0; slot < num_speakers; slot++)
+    slot_speakers_[slot] = slot;
+  if (PeekToken(is, binary) == 's') {
+    ExpectToken(is, binary, "<speaker_ids>");
+    ReadIntegerVector(is, binary, &slot_speakers_);
+    ExpectToken(is, binary, "</speaker_ids>");
+    if (static_cast<int32>(slot_speakers_.size()) != num_speakers)
+      KALDI_ERR << "Bad speaker ids in " << rxfilename;
+  }
+  for (int32 slot = 0; slot < num_speakers; slot++) {
+    if (!speaker_slots_.insert(std::make_pair(slot_speakers_[slot],
+                                              slot)).second)
+      KALDI_ERR << "Speaker " << slot_speakers_[slot] << " is twice in "
+                << rxfilename;
+    next_speaker_id_ = std::max(next_speaker_id_, slot_speakers_[slot] + 1);
+  }
+  return true;
+}
+
+
+SpeakerSession::SpeakerSession(std::shared_ptr<const SpeakerModel> model,
+                               std::shared_ptr<SpeakerGallery> gallery):
+    model_(model), gallery_(gallery) {
+  KALDI_ASSERT(model_ != nullptr && gallery_ != nullptr);
+}
+
+bool SpeakerSession::FeedEnrollingFeature(const Matrix<BaseFloat> &feature) {
+  std::vector<Matrix<BaseFloat> > features(1, feature);
+  std::vector<Vector<BaseFloat> > xvectors;
+  if (model_->ExtractXvectors(features, &xvectors) == 0) return false;
+  feeded_xvectors_.push_back(xvectors[0]);
+  return true;
+}
+
+void SpeakerSession::FeedEnrollingXvector(const Vector<BaseFloat> &xvector) {
+  feeded_xvectors_.push_back(xvector);
+}
+
+int32 SpeakerSession::EnrollFromFeeded(int32 speaker_id) {
+  if (feeded_xvectors_.empty()) return -1;
+  speaker_id = EnrollXvectors(feeded_xvectors_, speaker_id);
+  feeded_xvectors_.clear();
+  return speaker_id;
+}
+
+int32 SpeakerSession::EnrollSpeaker(
+    const std::vector<Matrix<BaseFloat> > &features, int32 speaker_id,
+    bool accumulate, int32 num_threads) {
+  std::vector<Vector<BaseFloat> > xvectors;
+  model_->ExtractXvectors(features, &xvectors, num_threads);
+  return EnrollXvectors(xvectors, speaker_id, accumulate);
+}
+
+int32 SpeakerSession::EnrollXvectors(
+    const std::vector<Vector<BaseFloat> > &xvectors, int32 speaker_id,
+    bool accumulate) {
+  Vector<double> xvector_sum;
+  int32 num_utts = 0;
+  for (size_t i = 0; i < xvectors.size(); i++) {
+    if (xvectors[i].Dim() == 0) continue;
+    if (xvector_sum.Dim() == 0) xvector_sum.Resize(xvectors[i].Dim());
+    Vector<double> xvector(xvectors[i]);
+    xvector_sum.AddVec(1.0, xvector);
+    num_utts++;
+  }
+  if (num_utts == 0) return -1;
+  return gallery_->EnrollXvectorStats(*model_, speaker_id, xvector_sum,
+                                      num_utts, accumulate);
+}
+
+std::vector<BaseFloat> SpeakerSession::ComputeSpeakerConfidences(
+    const std::vector<Matrix<BaseFloat> > &features,
+    int32 num_threads) const {
+  Vector<double> plda_input, scores;
+  if (ComputeTestPldaInput(features, &plda_input, num_threads) == 0)
+    return std::vector<BaseFloat>();
+  gallery_->Score(plda_input, &scores);
+  return std::vector<BaseFloat>(scores.Data(), scores.Data() + scores.Dim());
+}
+
+int32 SpeakerSession::ComputeTestPldaInput(
+    const std::vector<Matrix<BaseFloat> > &features,
+    Vector<double> *plda_input, int32 num_threads) const {
+  // Drop the utterances that were too short to give an x-vector.
+  std::vector<Vector<BaseFloat> > xvectors, nonempty_xvectors;
+  model_->ExtractXvectors(features, &xvectors, num_threads);
+  for (size_t i = 0; i < xvectors.size(); i++)
+    if (xvectors[i].Dim() != 0) nonempty_xvectors.push_back(xvectors[i]);
+  return model_->XvectorsToPldaInput(nonempty_xvectors, plda_input);
+}
+
+void SpeakerSession::ScoreXvectors(
+    const std::vector<Vector<BaseFloat> > &xvectors,
+    Vector<double> *scores) const {
+  Vector<double> plda_input;
+  if (model_->XvectorsToPldaInput(xvectors, &plda_input) == 0) {
+    scores->Resize(0);
+    return;
+  }
+  gallery_->Score(plda_input, scores);
+}
+
+}  // namespace kaldi
@@ -0,0 +1,344 @@
+// speaker_verification/speaker_service.h
+
+// Copyright (c) 2021 PeachLab. All Rights Reserved.
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_SPEAKER_VERIFICATION_SPEAKER_SERVICE_H_
+#define KALDI_SPEAKER_VERIFICATION_SPEAKER_SERVICE_H_
+
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "base/kaldi-common.h"
+#include "matrix/matrix-lib.h"
+#include "speaker_verification/extractor_pool.h"
+#include "speaker_verification/model_bundle.h"
+#include "speaker_verification/nnet_computer_factory.h"
+#include "speaker_verification/plda.h"
+#include "speaker_verification/score_normalizer.h"
+#include "speaker_verification/speaker_index.h"
+#include "speaker_verification/speaker_store.h"
+#include "speaker_verification/xvector_extractor.h"
+#include "speaker_verification/xvector_transform.h"
+
+// The classes here are what XvectorControllerImpl is built on, split into
+// parts that can be used by many requests at once:
+//
+//  - SpeakerModel holds everything that is fixed once loaded (the x-vector
+//    network, the mean and LDA transform, the PLDA model).  It is immutable
+//    and shared between threads through a std::shared_ptr<const SpeakerModel>.
+//  - SpeakerGallery holds the enrolled speakers.  Any number of threads may
+//    score against it while others enroll; it is guarded by a reader-writer
+//    lock, so scoring only excludes the (short) updates.
+//  - SpeakerSession holds the state of one client, i.e. the x-vectors fed so
+//    far for an enrollment in progress.  Sessions are cheap; each one must be
+//    used by one thread at a time.
+
+namespace kaldi {
+
+class SpeakerModel {
+ public:
+  /// The network comes from "nnet_factory" (e.g. TFliteNnetFactory(), or the
+  /// stand-in network of the benchmarks and tests,
+  /// goat::RandomTdnnNnetComputer).  It may be empty if only the x-vector
+  /// level functions (XvectorsToPldaInput()) will be used.  The network is
+  /// loaded now, so that a bad one fails here.
+  SpeakerModel(const NnetComputerFactory &nnet_factory,
+               const Vector<BaseFloat> &mean,
+               const Matrix<BaseFloat> &transform,
+               const Plda &plda,
+               const XvectorExtractorOptions &extractor_opts =
+                   XvectorExtractorOptions());
+
+  /// Loads the compiled x-vector transform and the PLDA model from a bundle
+  /// (see make-model-bundle), which is kept open as long as the model; the
+  /// network is the bundle's, through e.g. TFliteNnetFactory(bundle).
+  SpeakerModel(const NnetComputerFactory &nnet_factory,
+               std::shared_ptr<const ModelBundle> bundle,
+               const XvectorExtractorOptions &extractor_opts =
+                   XvectorExtractorOptions());
+
+  /// As XvectorExtractor::ExtractXvectors(), with the utterances spread over
+  /// up to "num_threads" threads, each with a batch of about the same number
+  /// of frames and a network replica borrowed from an ExtractorPool; the
+  /// x-vectors stay in utterance order.  The replicas are kept for later
+  /// calls, so each thread costs the memory of one.  Thread-safe.
+  int32 ExtractXvectors(const std::vector<Matrix<BaseFloat> > &features,
+                        std::vector<Vector<BaseFloat> > *xvectors,
+                        int32 num_threads = 1) const;
+
+  /// Averages the x-vectors of one speaker, applies mean subtraction, LDA,
+  /// length normalization and the PLDA transform, and returns the number of
+  /// x-vectors (0 if "xvectors" is empty, in which case "plda_input" is not
+  /// set).  The result is what SpeakerGallery enrolls and scores.
+  int32 XvectorsToPldaInput(const std::vector<Vector<BaseFloat> > &xvectors,
+                            Vector<double> *plda_input) const;
+
+  /// As XvectorsToPldaInput(), from the sum of "num_utts" x-vectors (see
+  /// SpeakerGallery::EnrollXvectorStats()).
+  void XvectorSumToPldaInput(const VectorBase<double> &xvector_sum,
+                             int32 num_utts,
+                             Vector<double> *plda_input) const;
+
+  /// As XvectorsToPldaInput(), but each x-vector is taken as a speaker of
+  /// its own: row i of "plda_inputs" is the PLDA input of xvectors[i].  All
+  /// x-vectors must be non-empty.  The transforms run as one GEMM.
+  void XvectorsToPldaInputs(const std::vector<Vector<BaseFloat> > &xvectors,
+                            Matrix<double> *plda_inputs) const;
+
+  /// As above, one x-vector per row (e.g. a score normalization cohort).
+  void XvectorsToPldaInputs(const MatrixBase<BaseFloat> &xvectors,
+                            Matrix<double> *plda_inputs) const;
+
+  const Plda &GetPlda() const { return plda_; }
+
+  /// The dimension of the raw x-vectors.
+  int32 XvectorDim() const { return post_transform_.InputDim(); }
+
+  const XvectorExtractorOptions &ExtractorOptions() const {
+    return extractor_opts_;
+  }
+
+ private:
+  class ExtractXvectorsTask;
+
+  /// If not NULL, the model was loaded from it.
+  const std::shared_ptr<const ModelBundle> bundle_;
+  const XvectorExtractorOptions extractor_opts_;
+  const Plda plda_;
+  CompiledXvectorTransform<double> post_transform_;
+
+  /// NULL if the model was created without a network.
+  const std::unique_ptr<ExtractorPool> extractors_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(SpeakerModel);
+};
+
+
+/// Speakers are kept by id; ids need not be contiguous.  Enrolling an id
+/// that is not enrolled uses it, and a negative one picks the next unused
+/// id.  Each enrolled speaker also has a slot, 0..NumSpeakers()-1, in the
+/// order of enrollment (or of the ids, for a store or file), which is the
+/// order of the scores and of SpeakerIds().
+///
+/// The speakers are scored as PldaScorerTpl<BaseFloat> does, whose scores
+/// differ from Plda::LogLikelihoodRatio() by about 1e-4.  Its per-speaker
+/// terms, the speakers' cohort statistics and the speaker index are built
+/// lazily, on the first call that needs them after an enrollment.
+class SpeakerGallery {
+ public:
+  explicit SpeakerGallery(const Plda &plda);
+
+  /// Enrolls a speaker from the output of SpeakerModel::XvectorsToPldaInput(),
+  /// replacing the speaker if "speaker_id" is enrolled.  The speaker has no
+  /// x-vector statistics, since they can't be traced back from a PLDA
+  /// input.  Returns the speaker's id.
+  int32 Enroll(int32 speaker_id, const VectorBase<double> &plda_input,
+               int32 num_utts);
+
+  /// Enrolls a speaker from the sum of the raw x-vectors of "num_utts"
+  /// utterances, which the gallery keeps so that utterances can be added
+  /// later without the audio of the earlier ones: with "accumulate", they
+  /// are added to the speaker's statistics (if it is enrolled) and its PLDA
+  /// input is derived again from the total.  Returns the speaker's id, or
+  /// -1 if accumulating onto a speaker that has no statistics.
+  int32 EnrollXvectorStats(const SpeakerModel &model, int32 speaker_id,
+                           const VectorBase<double> &xvector_sum,
+                           int32 num_utts, bool accumulate);
+
+  int32 NumSpeakers() const;
+
+  /// The ids of the speakers, by slot.
+  std::vector<int32> SpeakerIds() const;
+
+  /// Outputs the PLDA log-likelihood ratio of the test speaker against each
+  /// enrolled speaker, normalized if there is a cohort; "scores" is resized
+  /// to the number of speakers at the time of the call.
+  void Score(const VectorBase<double> &plda_input,
+             Vector<double> *scores) const;
+
+  /// Scores many test speakers (the rows of "plda_inputs") against speaker
+  /// "speaker_id" alone, as Score() would, with the test side computed for
+  /// all of them in one go; returns false if there is no such speaker.
+  bool ScoreSpeaker(int32 speaker_id, const MatrixBase<double> &plda_inputs,
+                    Vector<double> *scores) const;
+
+  /// The (at most) "num_results" best-scoring speakers for a test PLDA
+  /// input, as (speaker id, PLDA log-likelihood ratio) pairs, best first.
+  /// The scores are not normalized.  Every speaker is scored unless
+  /// SetSpeakerIndex() was called.
+  void Identify(const VectorBase<double> &plda_input, int32 num_results,
+                std::vector<std::pair<int32, double> > *results) const;
+
+  /// Makes Identify() search a SpeakerIndex, which scores only a shortlist
+  /// of the speakers.  The index is trained on the speakers enrolled at the
+  /// first search, and again once they have doubled; speakers enrolled in
+  /// between are added to it.
+  void SetSpeakerIndex(const SpeakerIndexOptions &opts);
+
+  /// Turns on S-norm / AS-norm of the scores of Score() against a cohort of
+  /// impostors, given as PLDA inputs (see
+  /// SpeakerModel::XvectorsToPldaInputs()).
+  void SetScoreNormalizationCohort(const MatrixBase<double> &cohort_plda_inputs,
+                                   const ScoreNormalizationOptions &opts);
+
+  /// Copies out an enrolled speaker; returns false if there is none with
+  /// this id.
+  bool GetSpeaker(int32 speaker_id, Vector<double> *plda_input,
+                  int32 *num_utts) const;
+
+  /// The statistics the speaker's PLDA input is derived from; false if
+  /// there is no such speaker or it has none.
+  bool GetSpeakerStats(int32 speaker_id, Vector<double> *xvector_sum,
+                       int32 *num_utts) const;
+
+  /// Uses a memory-mapped SpeakerStore, keyed by speaker id, for the
+  /// speakers, creating it if it does not exist; it replaces the speakers
+  /// enrolled so far.  Opening reads only the records' metadata: the PLDA
+  /// inputs are read from the mapping when the speakers are first scored.
+  /// Speakers enrolled afterwards are written through to the store.  Their
+  /// x-vector statistics go to a second store, filename + ".stats", which
+  /// keeps the double sums (as two floats per element) of "xvector_dim".
+  bool OpenStore(const std::string &filename, int32 xvector_dim);
+
+  /// Writes the speakers, with their ids and statistics.
+  bool Write(const std::string &wxfilename, bool binary) const;
+
+  /// Replaces the speakers with those in a file from Write(); they are no
+  /// longer written through to a store.
+  bool Read(const std::string &rxfilename);
+
+ private:
+  // All of these are called with mutex_ held.
+  int32 NumSlots() const { return slot_speakers_.size(); }
+  int32 SpeakerSlot(int32 speaker_id) const;
+  void Clear();
+  // From speakers_, or the store's mapping if one is open.
+  void GetPldaInput(int32 slot, VectorBase<double> *plda_input) const;
+  // Empty (and false) if the speaker has no statistics.
+  bool GetXvectorSum(int32 slot, Vector<double> *xvector_sum) const;
+  int32 EnrollPldaInput(int32 speaker_id, const VectorBase<double> &plda_input,
+                        int32 num_utts);
+  // Keeps cohort_stats_ in step with scorer_.
+  void UpdateCohortStats(int32 slot,
+                         const VectorBase<double> &plda_input) const;
+  // Whether scorer_ (and, with "index", speaker_index_) holds every slot.
+  bool IsFilled(bool index) const;
+  // Adds the slots that scorer_ does not have yet and, with "index", trains
+  // speaker_index_ if needed and adds the slots it does not have yet.
+  // Called with mutex_ held exclusively.
+  void Fill(bool index) const;
+  // A shared lock of mutex_ under which IsFilled(index).
+  std::shared_lock<std::shared_timed_mutex> LockFilled(bool index) const;
+
+  mutable std::shared_timed_mutex mutex_;
+  const Plda plda_;
+  std::vector<int32> slot_speakers_;
+  std::unordered_map<int32, int32> speaker_slots_;
+  // The id given to a speaker enrolled with a negative one.
+  int32 next_speaker_id_;
+  // The PLDA inputs by slot; empty while a store is open.
+  std::vector<Vector<double> > speakers_;
+  std::vector<int32> num_utts_;
+  // Sum of the raw x-vectors of each speaker's num_utts_ utterances; empty
+  // if unknown.  Empty while a store is open.
+  std::vector<Vector<double> > xvector_sums_;
+  // Optional on-disk home of the PLDA inputs and num_utts_, by id.
+  std::unique_ptr<SpeakerStore> speaker_store_;
+  // ... and of xvector_sums_, with the counts as num_utts.
+  std::unique_ptr<SpeakerStore> stats_store_;
+
+  // Cached per-speaker PLDA terms of slots 0..scorer_.NumSpeakers()-1, so
+  // that Score() scores all speakers in one GEMV.
+  mutable PldaScorerTpl<BaseFloat> scorer_;
+  std::unique_ptr<CohortScoreNormalizer> score_normalizer_;
+  // Cohort statistics of each speaker in scorer_.
+  mutable std::vector<CohortStats> cohort_stats_;
+  // Set by SetSpeakerIndex().  The index holds slots 0..index_size_-1 and
+  // was trained on index_trained_size_ speakers.
+  std::unique_ptr<SpeakerIndexOptions> index_opts_;
+  mutable std::unique_ptr<SpeakerIndex> speaker_index_;
+  mutable int32 index_size_;
+  mutable int32 index_trained_size_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(SpeakerGallery);
+};
+
+
+class SpeakerSession {
+ public:
+  SpeakerSession(std::shared_ptr<const SpeakerModel> model,
+                 std::shared_ptr<SpeakerGallery> gallery);
+
+  /// Adds one utterance to the enrollment in progress; returns false if it
+  /// was too short to give an x-vector.
+  bool FeedEnrollingFeature(const Matrix<BaseFloat> &feature);
+
+  void FeedEnrollingXvector(const Vector<BaseFloat> &xvector);
+
+  int32 NumFeededXvectors() const { return feeded_xvectors_.size(); }
+
+  /// Enrolls the utterances fed so far as "speaker_id" (see
+  /// SpeakerGallery::EnrollXvectorStats()) and starts a new enrollment.
+  /// Returns the speaker's id, or -1 if nothing was fed.
+  int32 EnrollFromFeeded(int32 speaker_id);
+
+  /// Enrolls the utterances in "features" in one go, extracting their
+  /// x-vectors on up to "num_threads" threads; returns the speaker's id, or
+  /// -1 if none of them gave an x-vector.  With "accumulate", they are
+  /// added to the speaker's earlier utterances.
+  int32 EnrollSpeaker(const std::vector<Matrix<BaseFloat> > &features,
+                      int32 speaker_id, bool accumulate = false,
+                      int32 num_threads = 1);
+
+  /// As EnrollSpeaker(), from x-vectors already extracted; empty ones are
+  /// skipped.
+  int32 EnrollXvectors(const std::vector<Vector<BaseFloat> > &xvectors,
+                       int32 speaker_id, bool accumulate = false);
+
+  /// Scores the utterances in "features", taken as one test speaker, against
+  /// all enrolled speakers.  The output is empty if none of them gave an
+  /// x-vector.
+  std::vector<BaseFloat> ComputeSpeakerConfidences(
+      const std::vector<Matrix<BaseFloat> > &features,
+      int32 num_threads = 1) const;
+
+  /// The first half of ComputeSpeakerConfidences(), for callers that keep
+  /// the test's PLDA input (see EmbeddingCache); returns the number of
+  /// utterances that gave an x-vector.
+  int32 ComputeTestPldaInput(const std::vector<Matrix<BaseFloat> > &features,
+                             Vector<double> *plda_input,
+                             int32 num_threads = 1) const;
+
+  /// As ComputeSpeakerConfidences(), from x-vectors.
+  void ScoreXvectors(const std::vector<Vector<BaseFloat> > &xvectors,
+                     Vector<double> *scores) const;
+
+ private:
+  std::shared_ptr<const SpeakerModel> model_;
+  std::shared_ptr<SpeakerGallery> gallery_;
+  std::vector<Vector<BaseFloat> > feeded_xvectors_;
+};
+
+}  // namespace kaldi
+
+#endif  // KALDI_SPEAKER_VERIFICATION_SPEAKER_SERVICE_H_
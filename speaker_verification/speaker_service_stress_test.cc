@@ -0,0 +1,234 @@
+// speaker_verification/speaker_service_stress_test.cc
+
+// Copyright (c) 2021 PeachLab. All Rights Reserved.
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+// Many sessions verifying and enrolling concurrently against one shared
+// SpeakerModel and SpeakerGallery.  Speakers enrolled before the threads start
+// are never modified, so their scores must come out as they do single-threaded;
+// speakers enrolled by a thread must end up holding what that
+// thread last enrolled.
+
+#include <atomic>
+#include <sstream>
+#include <thread>
+
+#include "base/kaldi-common.h"
+#include "base/timer.h"
+#include "speaker_verification/speaker_service.h"
+#include "util/parse-options.h"
+
+namespace kaldi {
+
+// A PLDA model with identity transform and random between-class variances.
+static void MakeRandomPlda(int32 dim, Plda *plda) {
+  Vector<double> mean(dim), psi(dim);
+  Matrix<double> transform(dim, dim);
+  transform.SetUnit();
+  psi.SetRandUniform();
+  psi.Scale(5.0);
+  psi.Add(0.5);
+  std::ostringstream os;
+  bool binary = true;
+  WriteToken(os, binary, "<Plda>");
+  mean.Write(os, binary);
+  transform.Write(os, binary);
+  psi.Write(os, binary);
+  WriteToken(os, binary, "</Plda>");
+  std::istringstream is(os.str());
+  plda->Read(is, binary);
+}
+
+static void RandomXvectors(const VectorBase<BaseFloat> &speaker, int32 num,
+                           std::vector<Vector<BaseFloat> > *xvectors) {
+  xvectors->resize(num);
+  for (int32 i = 0; i < num; i++) {
+    (*xvectors)[i].Resize(speaker.Dim());
+    (*xvectors)[i].SetRandn();
+    (*xvectors)[i].AddVec(2.0, speaker);
+  }
+}
+
+struct ThreadResult {
+  int64 num_verifications;
+  int64 num_enrollments;
+  int64 num_errors;
+  // Speakers enrolled by this thread and the PLDA input last enrolled.
+  std::vector<int32> own_ids;
+  std::vector<Vector<double> > own_inputs;
+  ThreadResult(): num_verifications(0), num_enrollments(0), num_errors(0) { }
+};
+
+}  // namespace kaldi
+
+int main(int argc, char *argv[]) {
+  using namespace kaldi;
+  try {
+    const char *usage =
+        "Stress test of concurrent verification and enrollment sessions\n"
+        "sharing one speaker model and gallery.\n"
+        "Usage:  speaker-service-stress-test [options]\n";
+    ParseOptions po(usage);
+    int32 dim = 128, num_threads = 16, num_ops = 400, num_initial = 500,
+        num_tests = 50;
+    BaseFloat enroll_fraction = 0.2;
+    po.Register("dim", &dim, "X-vector dimension.");
+    po.Register("num-threads", &num_threads, "Number of concurrent sessions.");
+    po.Register("num-ops", &num_ops, "Operations per session.");
+    po.Register("num-initial", &num_initial, "Speakers enrolled up front.");
+    po.Register("num-tests", &num_tests, "Distinct test utterances.");
+    po.Register("enroll-fraction", &enroll_fraction, "Fraction of operations "
+                "that are enrollments.");
+    po.Read(argc, argv);
+    if (po.NumArgs() != 0) {
+      po.PrintUsage();
+      exit(1);
+    }
+
+    Plda plda;
+    MakeRandomPlda(dim, &plda);
+    Vector<BaseFloat> mean(dim);
+    Matrix<BaseFloat> transform(dim, dim);
+    transform.SetUnit();
+    std::shared_ptr<const SpeakerModel> model(
+        new SpeakerModel(NnetComputerFactory(), mean, transform, plda));
+    std::shared_ptr<SpeakerGallery> gallery(new SpeakerGallery(plda));
+
+    Matrix<BaseFloat> speakers(num_initial, dim);
+    speakers.SetRandn();
+    {
+      SpeakerSession session(model, gallery);
+      for (int32 s = 0; s < num_initial; s++) {
+        std::vector<Vector<BaseFloat> > xvectors;
+        RandomXvectors(speakers.Row(s), 3, &xvectors);
+        for (size_t i = 0; i < xvectors.size(); i++)
+          session.FeedEnrollingXvector(xvectors[i]);
+        KALDI_ASSERT(session.EnrollFromFeeded(-1) == s);
+      }
+    }
+    // Test utterances and their single-threaded scores.
+    std::vector<std::vector<Vector<BaseFloat> > > tests(num_tests);
+    std::vector<Vector<double> > reference_scores(num_tests);
+    {
+      SpeakerSession session(model, gallery);
+      for (int32 t = 0; t < num_tests; t++) {
+        RandomXvectors(speakers.Row(RandInt(0, num_initial - 1)), 1,
+                       &(tests[t]));
+        session.ScoreXvectors(tests[t], &(reference_scores[t]));
+      }
+    }
+
+    std::vector<ThreadResult> results(num_threads);
+    std::atomic<bool> start(false);
+    std::vector<std::thread> threads;
+    for (int32 thread = 0; thread < num_threads; thread++) {
+      threads.push_back(std::thread([&, thread]() {
+        while (!start) std::this_thread::yield();
+        ThreadResult &result = results[thread];
+        SpeakerSession session(model, gallery);
+        for (int32 op = 0; op < num_ops; op++) {
+          if (RandUniform() < enroll_fraction) {
+            Vector<BaseFloat> speaker(dim);
+            speaker.SetRandn();
+            std::vector<Vector<BaseFloat> > xvectors;
+            RandomXvectors(speaker, RandInt(1, 4), &xvectors);
+            for (size_t i = 0; i < xvectors.size(); i++)
+              session.FeedEnrollingXvector(xvectors[i]);
+            Vector<double> plda_input;
+            model->XvectorsToPldaInput(xvectors, &plda_input);
+            // Half of the time, re-enroll one of our own speakers.
+            bool update = (!result.own_ids.empty() && RandInt(0, 1) == 0);
+            int32 index = update ? RandInt(0, result.own_ids.size() - 1) : -1,
+                id = session.EnrollFromFeeded(update ? result.own_ids[index]
+                                                     : -1);
+            if (update) {
+              if (id != result.own_ids[index]) result.num_errors++;
+              result.own_inputs[index] = plda_input;
+            } else {
+              if (id < num_initial) result.num_errors++;
+              result.own_ids.push_back(id);
+              result.own_inputs.push_back(plda_input);
+            }
+            result.num_enrollments++;
+          } else {
+            int32 t = RandInt(0, num_tests - 1);
+            Vector<double> scores;
+            session.ScoreXvectors(tests[t], &scores);
+            if (scores.Dim() < num_initial ||
+                !scores.Range(0, num_initial).ApproxEqual(
+                    reference_scores[t], 1.0e-10))
+              result.num_errors++;
+            result.num_verifications++;
+          }
+        }
+      }));
+    }
+    Timer timer;
+    start = true;
+    for (size_t i = 0; i < threads.size(); i++) threads[i].join();
+    double elapsed = timer.Elapsed();
+
+    int64 num_verifications = 0, num_enrollments = 0, num_errors = 0,
+        num_new_speakers = 0;
+    for (int32 thread = 0; thread < num_threads; thread++) {
+      const ThreadResult &result = results[thread];
+      num_verifications += result.num_verifications;
+      num_enrollments += result.num_enrollments;
+      num_errors += result.num_errors;
+      num_new_speakers += result.own_ids.size();
+      for (size_t i = 0; i < result.own_ids.size(); i++) {
+        Vector<double> plda_input;
+        int32 num_utts;
+        if (!gallery->GetSpeaker(result.own_ids[i], &plda_input, &num_utts) ||
+            !plda_input.ApproxEqual(result.own_inputs[i], 0.0))
+          num_errors++;
+      }
+    }
+    if (gallery->NumSpeakers() != num_initial + num_new_speakers) num_errors++;
+
+    // The final gallery scores as Plda::LogLikelihoodRatio() does, up to
+    // the roundoff of its float scorer.
+    {
+      SpeakerSession session(model, gallery);
+      Vector<double> test_input, scores;
+      model->XvectorsToPldaInput(tests[0], &test_input);
+      session.ScoreXvectors(tests[0], &scores);
+      for (int32 s = 0; s < gallery->NumSpeakers(); s++) {
+        Vector<double> plda_input;
+        int32 num_utts;
+        gallery->GetSpeaker(s, &plda_input, &num_utts);
+        double ref = plda.LogLikelihoodRatio(plda_input, num_utts,
+                                             test_input);
+        if (!ApproxEqual(ref, scores(s), 1.0e-03)) num_errors++;
+      }
+    }
+
+    KALDI_LOG << num_threads << " sessions: " << num_verifications
+              << " verifications and " << num_enrollments
+              << " enrollments in " << elapsed << " s ("
+              << (num_verifications + num_enrollments) / elapsed
+              << " requests/s); " << gallery->NumSpeakers()
+              << " speakers at the end.";
+    if (num_errors != 0)
+      KALDI_ERR << num_errors << " inconsistent results.";
+    std::cout << "Test OK.\n";
+    return 0;
+  } catch(const std::exception &e) {
+    std::cerr << e.what();
+    return -1;
+  }
+}
@@ -0,0 +1,437 @@
+// speaker_verification/speaker_store.cc
+
+// Copyright (c) 2021 PeachLab. All Rights Reserved.
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <fcntl.h>
+#include <libgen.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <utility>
+
+#include "speaker_verification/speaker_store.h"
+
+namespace kaldi {
+
+static const char kSpeakerStoreMagic[8] = { 'K', 'S', 'P', 'K', 'S', 'T',
+                                            'O', 'R' };
+static const uint32 kSpeakerStoreFormat = 1;
+static const size_t kSpeakerStoreAlignment = 64;
+
+enum RecordState {
+  kRecordEmpty = 0,
+  kRecordLive = 1,
+  kRecordRetired = 2
+};
+
+struct SpeakerStore::Header {
+  char magic[8];
+  uint32 format;
+  uint32 dim;
+  uint32 row_stride;  // bytes per embedding row; a multiple of 64.
+  uint32 records_per_segment;
+  uint64 num_records;  // records written, live or retired.
+  char padding[32];
+};
+
+struct SpeakerStore::RecordMeta {
+  int64 key;
+  int32 num_utts;
+  uint32 version;
+  uint32 checksum;  // of key, num_utts, version and the embedding.
+  uint32 state;     // a RecordState; written last.
+  uint64 reserved;
+};
+
+static size_t RoundUpToAlignment(size_t bytes) {
+  return (bytes + kSpeakerStoreAlignment - 1) / kSpeakerStoreAlignment *
+      kSpeakerStoreAlignment;
+}
+
+// 32-bit FNV-1a.
+static uint32 Fnv1a(const void *data, size_t size, uint32 hash) {
+  const unsigned char *bytes = static_cast<const unsigned char*>(data);
+  for (size_t i = 0; i < size; i++) {
+    hash ^= bytes[i];
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+static uint32 RecordChecksum(int64 key, int32 num_utts, uint32 version,
+                             const float *embedding, int32 dim) {
+  uint32 hash = 2166136261u;
+  hash = Fnv1a(&key, sizeof(key), hash);
+  hash = Fnv1a(&num_utts, sizeof(num_utts), hash);
+  hash = Fnv1a(&version, sizeof(version), hash);
+  return Fnv1a(embedding, sizeof(float) * dim, hash);
+}
+
+SpeakerStore::SpeakerStore(): fd_(-1), data_(NULL), mapped_size_(0),
+                              sync_writes_(false) {
+  KALDI_COMPILE_TIME_ASSERT(sizeof(Header) == kSpeakerStoreAlignment);
+  KALDI_COMPILE_TIME_ASSERT(sizeof(RecordMeta) == 32);
+}
+
+SpeakerStore::Header *SpeakerStore::GetHeader() const {
+  return reinterpret_cast<Header*>(data_);
+}
+
+int32 SpeakerStore::Dim() const {
+  KALDI_ASSERT(IsOpen());
+  return GetHeader()->dim;
+}
+
+int64 SpeakerStore::NumRecords() const {
+  KALDI_ASSERT(IsOpen());
+  return GetHeader()->num_records;
+}
+
+size_t SpeakerStore::SegmentBytes() const {
+  const Header *header = GetHeader();
+  size_t records = header->records_per_segment;
+  return RoundUpToAlignment(records * sizeof(RecordMeta)) +
+      records * header->row_stride;
+}
+
+int64 SpeakerStore::Capacity() const {
+  size_t num_segments = (mapped_size_ - sizeof(Header)) / SegmentBytes();
+  return num_segments * GetHeader()->records_per_segment;
+}
+
+SpeakerStore::RecordMeta *SpeakerStore::Meta(int64 record) const {
+  const Header *header = GetHeader();
+  int64 segment = record / header->records_per_segment,
+      index = record % header->records_per_segment;
+  char *base = data_ + sizeof(Header) + segment * SegmentBytes();
+  return reinterpret_cast<RecordMeta*>(base) + index;
+}
+
+float *SpeakerStore::Row(int64 record) const {
+  const Header *header = GetHeader();
+  int64 segment = record / header->records_per_segment,
+      index = record % header->records_per_segment;
+  char *base = data_ + sizeof(Header) + segment * SegmentBytes() +
+      RoundUpToAlignment(header->records_per_segment * sizeof(RecordMeta));
+  return reinterpret_cast<float*>(base + index * header->row_stride);
+}
+
+bool SpeakerStore::Map(size_t size) {
+  if (data_ != NULL) munmap(data_, mapped_size_);
+  data_ = NULL;
+  mapped_size_ = 0;
+  void *data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+  if (data == MAP_FAILED) {
+    KALDI_WARN << "Could not mmap " << filename_ << ": " << strerror(errno);
+    return false;
+  }
+  data_ = static_cast<char*>(data);
+  mapped_size_ = size;
+  return true;
+}
+
+void SpeakerStore::SyncRange(const void *begin, size_t size) {
+  if (!sync_writes_) return;
+  // msync needs a page-aligned start.
+  size_t page = sysconf(_SC_PAGESIZE);
+  uintptr_t start = reinterpret_cast<uintptr_t>(begin) / page * page,
+      end = reinterpret_cast<uintptr_t>(begin) + size;
+  if (msync(reinterpret_cast<void*>(start), end - start, MS_SYNC) != 0)
+    KALDI_ERR << "msync failed on " << filename_ << ": " << strerror(errno);
+}
+
+bool SpeakerStore::IsStoreFile(const std::string &filename) {
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0) return false;
+  char magic[sizeof(kSpeakerStoreMagic)];
+  bool ans = (read(fd, magic, sizeof(magic)) == sizeof(magic) &&
+              memcmp(magic, kSpeakerStoreMagic, sizeof(magic)) == 0);
+  close(fd);
+  return ans;
+}
+
+bool SpeakerStore::Open(const std::string &filename, int32 dim, bool create,
+                        bool sync_writes, int32 records_per_segment) {
+  Close();
+  filename_ = filename;
+  sync_writes_ = sync_writes;
+  fd_ = open(filename.c_str(), O_RDWR | (create ? O_CREAT : 0), 0644);
+  if (fd_ < 0) {
+    KALDI_WARN << "Could not open speaker store " << filename << ": "
+               << strerror(errno);
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd_, &st) != 0) {
+    KALDI_WARN << "Could not stat " << filename << ": " << strerror(errno);
+    Close();
+    return false;
+  }
+  if (st.st_size == 0) {  // A new store.
+    if (dim <= 0 || records_per_segment <= 0) {
+      KALDI_WARN << "Creating speaker store " << filename
+                 << " needs a positive dimension.";
+      Close();
+      return false;
+    }
+    Header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, kSpeakerStoreMagic, sizeof(header.magic));
+    header.format = kSpeakerStoreFormat;
+    header.dim = dim;
+    header.row_stride = RoundUpToAlignment(sizeof(float) * dim);
+    header.records_per_segment = records_per_segment;
+    header.num_records = 0;
+    if (pwrite(fd_, &header, sizeof(header), 0) != sizeof(header) ||
+        (sync_writes_ && fsync(fd_) != 0)) {
+      KALDI_WARN << "Could not write header of " << filename << ": "
+                 << strerror(errno);
+      Close();
+      return false;
+    }
+    st.st_size = sizeof(header);
+  }
+  if (static_cast<size_t>(st.st_size) < sizeof(Header) ||
+      !Map(st.st_size)) {
+    KALDI_WARN << "Speaker store " << filename << " is truncated.";
+    Close();
+    return false;
+  }
+  const Header *header = GetHeader();
+  if (memcmp(header->magic, kSpeakerStoreMagic, sizeof(header->magic)) != 0 ||
+      header->format != kSpeakerStoreFormat) {
+    KALDI_WARN << filename << " is not a speaker store (or has an "
+               << "unsupported format).";
+    Close();
+    return false;
+  }
+  if (dim > 0 && header->dim != static_cast<uint32>(dim)) {
+    KALDI_WARN << "Speaker store " << filename << " has dimension "
+               << header->dim << ", expected " << dim;
+    Close();
+    return false;
+  }
+  if (header->num_records > static_cast<uint64>(Capacity())) {
+    KALDI_WARN << "Speaker store " << filename << " is truncated: "
+               << header->num_records << " records, room for "
+               << Capacity();
+    Close();
+    return false;
+  }
+  // Index the live records.  If a crash came between appending a new
+  // version of a speaker and retiring the old one, both are live; the newer
+  // one wins.
+  int64 num_records = header->num_records;
+  key_to_record_.reserve(num_records);
+  for (int64 r = 0; r < num_records; r++) {
+    const RecordMeta *meta = Meta(r);
+    if (meta->state != kRecordLive) continue;
+    std::pair<std::unordered_map<int64, int64>::iterator, bool> ans =
+        key_to_record_.insert(std::make_pair(meta->key, r));
+    if (!ans.second && Meta(ans.first->second)->version < meta->version)
+      ans.first->second = r;
+  }
+  return true;
+}
+
+void SpeakerStore::Close() {
+  if (data_ != NULL) munmap(data_, mapped_size_);
+  if (fd_ >= 0) close(fd_);
+  data_ = NULL;
+  mapped_size_ = 0;
+  fd_ = -1;
+  key_to_record_.clear();
+}
+
+void SpeakerStore::Reserve(int64 num_records) {
+  if (num_records <= Capacity()) return;
+  int64 records_per_segment = GetHeader()->records_per_segment,
+      num_segments = (num_records + records_per_segment - 1) /
+      records_per_segment;
+  size_t size = sizeof(Header) + num_segments * SegmentBytes();
+  // New space reads as zeros, i.e. kRecordEmpty.
+  if (ftruncate(fd_, size) != 0)
+    KALDI_ERR << "Could not grow speaker store " << filename_ << ": "
+              << strerror(errno);
+  if (!Map(size))
+    KALDI_ERR << "Could not remap speaker store " << filename_;
+}
+
+int64 SpeakerStore::Append(int64 key, const float *embedding, int32 num_utts,
+                           uint32 version) {
+  int64 record = GetHeader()->num_records;
+  Reserve(record + 1);
+  int32 dim = Dim();
+  float *row = Row(record);
+  memcpy(row, embedding, sizeof(float) * dim);
+  RecordMeta *meta = Meta(record);
+  meta->key = key;
+  meta->num_utts = num_utts;
+  meta->version = version;
+  meta->checksum = RecordChecksum(key, num_utts, version, row, dim);
+  meta->reserved = 0;
+  SyncRange(row, sizeof(float) * dim);
+  SyncRange(meta, sizeof(RecordMeta));
+  meta->state = kRecordLive;
+  SyncRange(meta, sizeof(RecordMeta));
+  // Only now does the record become part of the store.
+  GetHeader()->num_records = record + 1;
+  SyncRange(GetHeader(), sizeof(Header));
+  return record;
+}
+
+void SpeakerStore::Put(int64 key, const VectorBase<float> &embedding,
+                       int32 num_utts) {
+  KALDI_ASSERT(IsOpen() && embedding.Dim() == Dim());
+  std::unordered_map<int64, int64>::iterator iter = key_to_record_.find(key);
+  uint32 version = 1;
+  int64 old_record = -1;
+  if (iter != key_to_record_.end()) {
+    old_record = iter->second;
+    version = Meta(old_record)->version + 1;
+  }
+  int64 record = Append(key, embedding.Data(), num_utts, version);
+  if (old_record >= 0) {
+    RecordMeta *old_meta = Meta(old_record);
+    old_meta->state = kRecordRetired;
+    SyncRange(&(old_meta->state), sizeof(old_meta->state));
+  }
+  key_to_record_[key] = record;
+}
+
+bool SpeakerStore::Remove(int64 key) {
+  KALDI_ASSERT(IsOpen());
+  std::unordered_map<int64, int64>::iterator iter = key_to_record_.find(key);
+  if (iter == key_to_record_.end()) return false;
+  RecordMeta *meta = Meta(iter->second);
+  meta->state = kRecordRetired;
+  SyncRange(&(meta->state), sizeof(meta->state));
+  key_to_record_.erase(iter);
+  return true;
+}
+
+bool SpeakerStore::Get(int64 key, VectorBase<float> *embedding,
+                       int32 *num_utts) const {
+  const float *data = EmbeddingData(key);
+  if (data == NULL) return false;
+  KALDI_ASSERT(embedding->Dim() == Dim());
+  memcpy(embedding->Data(), data, sizeof(float) * Dim());
+  if (num_utts != NULL)
+    *num_utts = Meta(key_to_record_.find(key)->second)->num_utts;
+  return true;
+}
+
+int32 SpeakerStore::NumUtts(int64 key) const {
+  std::unordered_map<int64, int64>::const_iterator iter =
+      key_to_record_.find(key);
+  return (iter == key_to_record_.end() ? -1 : Meta(iter->second)->num_utts);
+}
+
+const float *SpeakerStore::EmbeddingData(int64 key) const {
+  std::unordered_map<int64, int64>::const_iterator iter =
+      key_to_record_.find(key);
+  return (iter == key_to_record_.end() ? NULL : Row(iter->second));
+}
+
+void SpeakerStore::GetKeys(std::vector<int64> *keys) const {
+  std::vector<std::pair<int64, int64> > records;
+  records.reserve(key_to_record_.size());
+  for (std::unordered_map<int64, int64>::const_iterator iter =
+           key_to_record_.begin(); iter != key_to_record_.end(); ++iter)
+    records.push_back(std::make_pair(iter->second, iter->first));
+  std::sort(records.begin(), records.end());
+  keys->resize(records.size());
+  for (size_t i = 0; i < records.size(); i++)
+    (*keys)[i] = records[i].second;
+}
+
+int64 SpeakerStore::Verify() const {
+  KALDI_ASSERT(IsOpen());
+  int64 num_bad = 0;
+  int32 dim = Dim();
+  for (std::unordered_map<int64, int64>::const_iterator iter =
+           key_to_record_.begin(); iter != key_to_record_.end(); ++iter) {
+    const RecordMeta *meta = Meta(iter->second);
+    if (meta->checksum != RecordChecksum(meta->key, meta->num_utts,
+                                         meta->version, Row(iter->second),
+                                         dim)) {
+      KALDI_WARN << "Checksum mismatch for speaker " << meta->key
+                 << " (record " << iter->second << ") in " << filename_;
+      num_bad++;
+    }
+  }
+  return num_bad;
+}
+
+bool SpeakerStore::Sync() {
+  KALDI_ASSERT(IsOpen());
+  if (msync(data_, mapped_size_, MS_SYNC) != 0) {
+    KALDI_WARN << "msync failed on " << filename_ << ": " << strerror(errno);
+    return false;
+  }
+  return true;
+}
+
+bool SpeakerStore::Compact() {
+  KALDI_ASSERT(IsOpen());
+  std::string filename = filename_, tmp_filename = filename_ + ".compact";
+  bool sync_writes = sync_writes_;
+  int32 dim = Dim(), records_per_segment = GetHeader()->records_per_segment;
+  unlink(tmp_filename.c_str());  // left over from an interrupted Compact().
+  {
+    SpeakerStore compacted;
+    if (!compacted.Open(tmp_filename, dim, true, false, records_per_segment))
+      return false;
+    std::vector<int64> keys;
+    GetKeys(&keys);
+    compacted.Reserve(keys.size());
+    for (size_t i = 0; i < keys.size(); i++) {
+      const RecordMeta *meta = Meta(key_to_record_[keys[i]]);
+      compacted.Append(meta->key, EmbeddingData(keys[i]), meta->num_utts,
+                       meta->version);
+    }
+    // The new file must be durable before it replaces the old one.
+    if (!compacted.Sync() || fsync(compacted.fd_) != 0) {
+      KALDI_WARN << "Could not flush " << tmp_filename;
+      compacted.Close();
+      unlink(tmp_filename.c_str());
+      return false;
+    }
+  }
+  if (rename(tmp_filename.c_str(), filename.c_str()) != 0) {
+    KALDI_WARN << "Could not rename " << tmp_filename << " to " << filename
+               << ": " << strerror(errno);
+    unlink(tmp_filename.c_str());
+    return false;
+  }
+  // Make the rename itself durable.
+  std::vector<char> dir_buf(filename.begin(), filename.end());
+  dir_buf.push_back('\0');
+  int dir_fd = open(dirname(&(dir_buf[0])), O_RDONLY);
+  if (dir_fd >= 0) {
+    fsync(dir_fd);
+    close(dir_fd);
+  }
+  return Open(filename, dim, false, sync_writes, records_per_segment);
+}
+
+}  // namespace kaldi
@@ -0,0 +1,147 @@
+// speaker_verification/speaker_store.h
+
+// Copyright (c) 2021 PeachLab. All Rights Reserved.
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_SPEAKER_VERIFICATION_SPEAKER_STORE_H_
+#define KALDI_SPEAKER_VERIFICATION_SPEAKER_STORE_H_
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "base/kaldi-common.h"
+#include "matrix/matrix-lib.h"
+
+namespace kaldi {
+
+/// SpeakerStore is an on-disk database of enrolled speakers that is
+/// memory-mapped rather than parsed, so opening it costs one pass over the
+/// (small) per-record metadata no matter how large the embeddings are.
+///
+/// File layout: a 64-byte header followed by segments of
+/// records_per_segment records.  Each segment holds the metadata of its
+/// records (32 bytes each) followed by their embeddings, stored as floats in
+/// rows of a fixed stride that is a multiple of 64 bytes.  All rows are
+/// therefore 64-byte aligned, and the rows of a segment form a strided
+/// matrix.  The file grows one segment at a time; nothing is moved.
+///
+/// Records are only ever appended.  Put() of a key that is already present
+/// appends a record with a higher version and then retires the old record
+/// in place (a single 4-byte store), and Remove() just retires it.  The
+/// header's record count is updated only after the record is written, so a
+/// crash leaves either the old or the new state.  With sync_writes, each step
+/// is also flushed to disk before the next one, which makes this hold across
+/// power loss too.  Compact() rewrites the live records to a temporary file
+/// and renames it over the original.
+///
+/// This class is not thread-safe.
+class SpeakerStore {
+ public:
+  SpeakerStore();
+  ~SpeakerStore() { Close(); }
+
+  /// Opens "filename", creating it if it does not exist and "create" is
+  /// true.  If "dim" is nonzero it must match the dimension of an existing
+  /// store; it is required when creating one.  Returns false (with a
+  /// warning) on failure.
+  bool Open(const std::string &filename, int32 dim, bool create = true,
+            bool sync_writes = false, int32 records_per_segment = 4096);
+
+  void Close();
+
+  bool IsOpen() const { return data_ != NULL; }
+
+  /// Returns true if "filename" exists and starts with the store's magic.
+  static bool IsStoreFile(const std::string &filename);
+
+  int32 Dim() const;
+
+  /// Number of live speakers.
+  int32 NumSpeakers() const { return key_to_record_.size(); }
+
+  /// Number of records in the file, including retired ones.
+  int64 NumRecords() const;
+
+  /// Adds the speaker, or replaces it if "key" is already present.
+  void Put(int64 key, const VectorBase<float> &embedding,
+           int32 num_utts);
+
+  /// Retires speaker "key"; returns false if it was not present.
+  bool Remove(int64 key);
+
+  bool Contains(int64 key) const { return key_to_record_.count(key) != 0; }
+
+  /// Copies out speaker "key"; returns false if it is not present.
+  bool Get(int64 key, VectorBase<float> *embedding,
+           int32 *num_utts) const;
+
+  /// The utterance count of speaker "key", or -1 if it is not present.
+  /// Only the record's metadata is read.
+  int32 NumUtts(int64 key) const;
+
+  /// Returns a pointer into the mapping for speaker "key" (Dim() floats,
+  /// 64-byte aligned), or NULL.  Valid until the next Put() or Compact().
+  const float *EmbeddingData(int64 key) const;
+
+  /// Outputs the keys of the live speakers, in the order they were written.
+  void GetKeys(std::vector<int64> *keys) const;
+
+  /// Checks the checksums of all live records; returns the number of bad
+  /// ones, logging each.  This reads every embedding, so it is not done by
+  /// Open().
+  int64 Verify() const;
+
+  /// Flushes the mapping to disk.
+  bool Sync();
+
+  /// Rewrites the file with only the live records.  Returns false if it
+  /// fails, in which case the original file is left as it was.
+  bool Compact();
+
+ private:
+  struct Header;
+  struct RecordMeta;
+
+  Header *GetHeader() const;
+  RecordMeta *Meta(int64 record) const;
+  float *Row(int64 record) const;
+  int64 Capacity() const;
+  size_t SegmentBytes() const;
+
+  /// Grows the file so that it can hold at least "num_records" records.
+  void Reserve(int64 num_records);
+  bool Map(size_t size);
+  void SyncRange(const void *begin, size_t size);
+
+  /// Appends a record and returns its index.
+  int64 Append(int64 key, const float *embedding, int32 num_utts,
+               uint32 version);
+
+  std::string filename_;
+  int fd_;
+  char *data_;
+  size_t mapped_size_;
+  bool sync_writes_;
+  std::unordered_map<int64, int64> key_to_record_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(SpeakerStore);
+};
+
+}  // namespace kaldi
+
+#endif  // KALDI_SPEAKER_VERIFICATION_SPEAKER_STORE_H_
@@ -0,0 +1,135 @@
+// speaker_verification/speaker_store_benchmark.cc
+
+// Copyright (c) 2021 PeachLab. All Rights Reserved.
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+// Build, reopen, update and compact times of a SpeakerStore, checking the
+// contents after each step.
+
+#include <cstdio>
+
+#include "base/kaldi-common.h"
+#include "base/timer.h"
+#include "speaker_verification/speaker_store.h"
+#include "util/parse-options.h"
+
+namespace kaldi {
+
+// The embedding of speaker "key" at version "version", cheap to recompute.
+static void MakeEmbedding(int64 key, int32 version, VectorBase<float> *v) {
+  for (int32 d = 0; d < v->Dim(); d++)
+    (*v)(d) = static_cast<float>((key * 31 + d * 7 + version) % 1000) / 1000;
+}
+
+static void CheckStore(const SpeakerStore &store, int32 num_speakers,
+                       int32 num_updated, int32 num_removed) {
+  KALDI_ASSERT(store.NumSpeakers() == num_speakers - num_removed);
+  Vector<float> expected(store.Dim()), actual(store.Dim());
+  for (int32 key = 0; key < num_speakers; key++) {
+    int32 num_utts;
+    bool removed = (key % 10 == 1 && key / 10 < num_removed);
+    KALDI_ASSERT(store.Get(key, &actual, &num_utts) == !removed);
+    if (removed) continue;
+    int32 version = (key % 10 == 0 && key / 10 < num_updated ? 1 : 0);
+    MakeEmbedding(key, version, &expected);
+    KALDI_ASSERT(actual.ApproxEqual(expected, 0.0) &&
+                 num_utts == 3 + version);
+    KALDI_ASSERT(reinterpret_cast<size_t>(store.EmbeddingData(key)) % 64 == 0);
+  }
+  KALDI_ASSERT(store.Verify() == 0);
+}
+
+}  // namespace kaldi
+
+int main(int argc, char *argv[]) {
+  using namespace kaldi;
+  try {
+    const char *usage =
+        "Measures how long it takes to create, open, update and compact a\n"
+        "speaker store, and checks its contents after each step.\n"
+        "Usage:  speaker-store-benchmark [options] <store-file>\n";
+    ParseOptions po(usage);
+    int32 dim = 512, num_speakers = 1000000;
+    bool sync_writes = false;
+    po.Register("dim", &dim, "Embedding dimension.");
+    po.Register("num-speakers", &num_speakers, "Number of speakers.");
+    po.Register("sync-writes", &sync_writes, "Flush each write to disk.");
+    po.Read(argc, argv);
+    if (po.NumArgs() != 1) {
+      po.PrintUsage();
+      exit(1);
+    }
+    std::string filename = po.GetArg(1);
+    std::remove(filename.c_str());
+    int32 num_changed = num_speakers / 10;
+
+    Vector<float> embedding(dim);
+    Timer timer;
+    {
+      SpeakerStore store;
+      if (!store.Open(filename, dim, true, sync_writes))
+        KALDI_ERR << "Could not create " << filename;
+      for (int32 key = 0; key < num_speakers; key++) {
+        MakeEmbedding(key, 0, &embedding);
+        store.Put(key, embedding, 3);
+      }
+      store.Sync();
+    }
+    double create_time = timer.Elapsed();
+
+    timer.Reset();
+    SpeakerStore store;
+    if (!store.Open(filename, dim, false))
+      KALDI_ERR << "Could not open " << filename;
+    double open_time = timer.Elapsed();
+    CheckStore(store, num_speakers, 0, 0);
+
+    // Update every tenth speaker and remove the ones after them.
+    timer.Reset();
+    for (int32 i = 0; i < num_changed; i++) {
+      MakeEmbedding(10 * i, 1, &embedding);
+      store.Put(10 * i, embedding, 4);
+      store.Remove(10 * i + 1);
+    }
+    double update_time = timer.Elapsed();
+    CheckStore(store, num_speakers, num_changed, num_changed);
+    store.Close();
+    if (!store.Open(filename, dim, false))
+      KALDI_ERR << "Could not reopen " << filename;
+    CheckStore(store, num_speakers, num_changed, num_changed);
+
+    int64 records_before = store.NumRecords();
+    timer.Reset();
+    if (!store.Compact())
+      KALDI_ERR << "Compaction failed";
+    double compact_time = timer.Elapsed();
+    KALDI_ASSERT(store.NumRecords() == store.NumSpeakers());
+    CheckStore(store, num_speakers, num_changed, num_changed);
+
+    KALDI_LOG << "Speakers " << num_speakers << ", dim " << dim
+              << ": create " << create_time << " s, open " << open_time
+              << " s, " << num_changed << " updates and removals "
+              << update_time << " s, compaction of " << records_before
+              << " records " << compact_time << " s.";
+    store.Close();
+    std::remove(filename.c_str());
+    return 0;
+  } catch(const std::exception &e) {
+    std::cerr << e.what();
+    return -1;
+  }
+}
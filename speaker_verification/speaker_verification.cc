@@ -6,6 +6,16 @@
 
 #define kSpeakerId 0
 
+// Optional: impostor x-vectors for score normalization.
+static void LoadCohort(const std::string& model_path) {
+  std::string cohort_file = model_path + "/cohort.mat";
+  std::ifstream fin4(cohort_file);
+  if (fin4.good()) {
+    SpeakerVerificationClient::GetInstance()->LoadScoreNormalizationCohort(
+        cohort_file);
+  }
+}
+
 bool SpeakerVerificationInitModel(const char* model_dir) {
   std::string model_path(model_dir);
   std::string nnet_file = model_path + "/final.raw";
@@ -14,6 +24,15 @@ bool SpeakerVerificationInitModel(const char* model_dir) {
   std::string mean_file = model_path + "/mean.vec";
   std::string xvector_file = model_path + "/enroll.xvector";
 
+  // A bundle made by make-model-bundle replaces the four model files.
+  std::string bundle_file = model_path + "/model.bundle";
+  if (kaldi::ModelBundle::IsBundleFile(bundle_file)) {
+    bool have_enrolled = SpeakerVerificationClient::GetInstance()
+        ->InitFromBundle(bundle_file, xvector_file);
+    LoadCohort(model_path);
+    return have_enrolled;
+  }
+
   std::ifstream fin0(nnet_file);
   std::ifstream fin1(plda_file);
   std::ifstream fin2(trans_file);
@@ -23,11 +42,10 @@ bool SpeakerVerificationInitModel(const char* model_dir) {
     return false;
   }
 
-  return SpeakerVerificationClient::GetInstance()->Init(nnet_file,
-                                                        plda_file,
-                                                        trans_file,
-                                                        mean_file,
-                                                        xvector_file);
+  bool have_enrolled = SpeakerVerificationClient::GetInstance()->Init(
+      nnet_file, plda_file, trans_file, mean_file, xvector_file);
+  LoadCohort(model_path);
+  return have_enrolled;
 }
 
 bool FeedEnrollingSpeakerWave(char* wave_data, int length) {
@@ -49,6 +67,44 @@ bool VerifySpeaker(char* wave_data, int length) {
   return is_speaker;
 }
 
+int VerifySpeakerBatch(char** wave_data, const int* lengths, int num_waves,
+                       float* scores, bool* is_speaker) {
+  return SpeakerVerificationClient::GetInstance()->VerifySpeakerBatch(
+      wave_data, lengths, num_waves, kSpeakerId, scores, is_speaker);
+}
+
+int VerifySpeakerFiles(const char** wave_paths, int num_files,
+                       float* scores, bool* is_speaker) {
+  return SpeakerVerificationClient::GetInstance()->VerifySpeakerFiles(
+      wave_paths, num_files, kSpeakerId, scores, is_speaker);
+}
+
+int EnrollSpeakerBatch(char** wave_data, const int* lengths, int num_waves) {
+  return SpeakerVerificationClient::GetInstance()->EnrollSpeakerBatch(
+      wave_data, lengths, num_waves, kSpeakerId);
+}
+
+int UpdateEnrolledSpeakerBatch(char** wave_data, const int* lengths,
+                               int num_waves) {
+  return SpeakerVerificationClient::GetInstance()->AddSpeakerUtteranceBatch(
+      wave_data, lengths, num_waves, kSpeakerId);
+}
+
+void SetEmbeddingCacheCapacity(int capacity) {
+  kaldi::EmbeddingCacheOptions opts;
+  opts.capacity = capacity;
+  SpeakerVerificationClient::GetInstance()->SetEmbeddingCache(opts);
+}
+
+void GetEmbeddingCacheStats(long long* num_hits, long long* num_misses,
+                            long long* num_evictions) {
+  kaldi::EmbeddingCacheStats stats =
+      SpeakerVerificationClient::GetInstance()->GetEmbeddingCacheStats();
+  if (num_hits != NULL) *num_hits = stats.num_hits;
+  if (num_misses != NULL) *num_misses = stats.num_misses;
+  if (num_evictions != NULL) *num_evictions = stats.num_evictions;
+}
+
 float GetVersion() { //todo: replace this fake function
   std::cout << "verison check is zero" << std::endl;
   return 0;
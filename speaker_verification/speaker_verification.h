@@ -8,6 +8,11 @@
 extern "C" {
 #endif
 
+// If model_dir has a model.bundle (see make-model-bundle) it is used in
+// place of final.raw, plda, transform.mat and mean.vec.
+// If model_dir has a cohort.mat (impostor x-vectors, one per row), scores
+// are normalized against it (adaptive S-norm), and the threshold applies to
+// normalized scores.
 bool SpeakerVerificationInitModel(const char* model_dir);
 
 bool FeedEnrollingSpeakerWave(char* wave_data, int length);
@@ -20,6 +25,42 @@ bool VerifySpeaker(char* wave_data, int length);
 
 bool ReadEnrolledXvector(const char* xvector_path);
 
+// Batch versions of VerifySpeaker(), for many utterances at once: they run
+// the frontend, network and scoring in parallel on all cores.  scores[i]
+// receives the confidence of utterance i (-INFINITY if it was too short,
+// silent or could not be read) and, if is_speaker is not NULL, is_speaker[i]
+// whether it reaches the threshold.  They return the number of utterances
+// scored, or -1 if the model is not loaded or no speaker is enrolled.
+int VerifySpeakerBatch(char** wave_data, const int* lengths, int num_waves,
+                       float* scores, bool* is_speaker);
+
+int VerifySpeakerFiles(const char** wave_paths, int num_files,
+                       float* scores, bool* is_speaker);
+
+// Enrolls the speaker from many utterances at once, as calling
+// FeedEnrollingSpeakerWave() on each and then
+// EnrollSpeakerFromHaveFeededFeatures() does.  Returns the number of
+// utterances used, or -1 if the model is not loaded.
+int EnrollSpeakerBatch(char** wave_data, const int* lengths, int num_waves);
+
+// Adds utterances to the enrolled speaker: the enrollment becomes the one
+// EnrollSpeakerBatch() would give on the old and new utterances together,
+// without processing the old ones again.  Returns the number of new
+// utterances used, or -1 if the model is not loaded or the speaker was
+// enrolled in a way that kept no statistics (from a file written before
+// they were kept, or directly from a PLDA input).
+int UpdateEnrolledSpeakerBatch(char** wave_data, const int* lengths,
+                               int num_waves);
+
+// Keeps the PLDA inputs of the last "capacity" utterances passed to
+// VerifySpeaker(), so that the same audio sent again (a retry, a repeated
+// prompt) is only hashed and scored.  0 turns the cache off (the default).
+void SetEmbeddingCacheCapacity(int capacity);
+
+// Counters of the cache since it was turned on; any pointer may be NULL.
+void GetEmbeddingCacheStats(long long* num_hits, long long* num_misses,
+                            long long* num_evictions);
+
 bool DestoryModel();
 
 float GetVersion();
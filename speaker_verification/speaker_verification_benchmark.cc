@@ -0,0 +1,424 @@
+// speaker_verification/speaker_verification_benchmark.cc
+
+// Copyright (c) 2021 PeachLab. All Rights Reserved.
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+// End-to-end cost of the stages SpeakerVerificationClient runs for each
+// request (embedding cache, frontend, network and x-vector transform, PLDA
+// scoring) for the enroll, verify and identify workloads, on synthetic audio
+// and with a stand-in network (goat::RandomTdnnNnetComputer) of the shape of
+// the Kaldi x-vector TDNN, so that it runs without a model.  The requests go
+// through one XvectorControllerImpl, as the client's do: the network
+// replicas come from the SpeakerModel's ExtractorPool, multi-utterance
+// enrollments are spread over --utt-threads threads, the speakers are kept
+// in a SpeakerStore (--speaker-store) and, in a last pass, the scores are
+// normalized against a cohort.  Requests are taken by --num-threads threads
+// from a shared counter, each thread with its own frontend, as the client's
+// callers would.
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <sstream>
+#include <thread>
+
+#include "base/kaldi-common.h"
+#include "base/timer.h"
+#include "frontend/frontend.h"
+#include "inference/random_tdnn_nnet_computer.h"
+#include "matrix/blas-threading.h"
+#include "speaker_verification/embedding_cache.h"
+#include "speaker_verification/plda.h"
+#include "speaker_verification/xvector_controller_impl.h"
+#include "util/parse-options.h"
+
+namespace kaldi {
+
+enum Stage { kCache = 0, kFrontend, kEmbedding, kScoring, kTotal,
+             kNumStages };
+
+// "embedding" is the network and the x-vector transform, and for
+// enrollments also adding the speaker to the gallery (and its store).
+static const char *kStageNames[kNumStages] = {
+  "cache lookup", "frontend", "embedding", "scoring", "total" };
+
+// Seconds spent in each stage, one entry per request.
+struct StageTimes {
+  std::vector<double> times[kNumStages];
+
+  void Append(const StageTimes &other) {
+    for (int32 s = 0; s < kNumStages; s++)
+      times[s].insert(times[s].end(), other.times[s].begin(),
+                      other.times[s].end());
+  }
+};
+
+// What one request thread needs of its own; the model, the gallery and the
+// embedding cache are shared.
+struct Worker {
+  explicit Worker(const XvectorFrontendOptions &frontend_opts):
+      frontend(frontend_opts) { }
+  XvectorFrontend frontend;
+  StageTimes stage_times;
+};
+
+// Bursts of loud noise ("speech") separated by quiet pauses, as in
+// frontend-benchmark.
+static void MakeWaveform(BaseFloat seconds, BaseFloat sample_freq,
+                         BaseFloat speech_ratio, Vector<BaseFloat> *waveform) {
+  waveform->Resize(static_cast<int32>(seconds * sample_freq));
+  int32 i = 0;
+  while (i < waveform->Dim()) {
+    bool speech = RandUniform() < speech_ratio;
+    int32 len = static_cast<int32>((0.2 + RandUniform()) * sample_freq);
+    BaseFloat amplitude = speech ? 3000.0 : 10.0;
+    for (int32 end = std::min(i + len, waveform->Dim()); i < end; i++)
+      (*waveform)(i) = amplitude * RandGauss();
+  }
+}
+
+// A PLDA model with a random transform and between-class variances, through
+// the model's own Read().
+static void MakeRandomPlda(int32 dim, Plda *plda) {
+  Vector<double> mean(dim), psi(dim);
+  Matrix<double> transform(dim, dim);
+  mean.SetRandn();
+  transform.SetRandn();
+  psi.SetRandUniform();
+  psi.Scale(5.0);
+  std::sort(psi.Data(), psi.Data() + dim, std::greater<double>());
+  std::ostringstream os;
+  bool binary = true;
+  WriteToken(os, binary, "<Plda>");
+  mean.Write(os, binary);
+  transform.Write(os, binary);
+  psi.Write(os, binary);
+  WriteToken(os, binary, "</Plda>");
+  std::istringstream is(os.str());
+  plda->Read(is, binary);
+}
+
+// Reads a "Name:   123 kB" line of /proc/self/status.
+static double ProcStatusKb(const std::string &name) {
+  std::ifstream is("/proc/self/status");
+  std::string line;
+  while (std::getline(is, line)) {
+    if (line.compare(0, name.size() + 1, name + ":") == 0)
+      return atof(line.c_str() + name.size() + 1);
+  }
+  return 0.0;
+}
+
+static double Percentile(std::vector<double> times, double p) {
+  std::sort(times.begin(), times.end());
+  size_t index = static_cast<size_t>(p * (times.size() - 1) + 0.5);
+  return times[index];
+}
+
+// Runs requests 0 .. num_requests - 1 on the workers, each thread taking the
+// next request from a shared counter, and returns the wall-clock time.
+static double RunRequests(
+    int32 num_requests, std::vector<std::unique_ptr<Worker> > *workers,
+    const std::function<void(int32, Worker*)> &request) {
+  std::atomic<int32> next_request(0);
+  auto run = [&](Worker *worker) {
+    // Single-threaded BLAS inside the workers, so the threads use the cores.
+    std::unique_ptr<BlasWorkerScope> blas_scope;
+    if (workers->size() > 1) blas_scope.reset(new BlasWorkerScope());
+    int32 r;
+    while ((r = next_request++) < num_requests) request(r, worker);
+  };
+  Timer timer;
+  std::vector<std::thread> threads;
+  for (size_t t = 1; t < workers->size(); t++)
+    threads.push_back(std::thread(run, (*workers)[t].get()));
+  run((*workers)[0].get());
+  for (size_t t = 0; t < threads.size(); t++) threads[t].join();
+  return timer.Elapsed();
+}
+
+static void Report(const std::string &workload, int32 num_requests,
+                   int32 num_failed, int32 num_utts, BaseFloat utt_seconds,
+                   int32 num_threads, double seconds,
+                   const std::vector<std::unique_ptr<Worker> > &workers) {
+  StageTimes stage_times;
+  for (size_t t = 0; t < workers.size(); t++)
+    stage_times.Append(workers[t]->stage_times);
+  KALDI_LOG << workload << ": " << num_requests << " requests ("
+            << num_utts << " utterances) on " << num_threads
+            << " threads in " << seconds << " s: "
+            << num_requests / seconds << " requests/s, real-time factor "
+            << seconds / (num_utts * utt_seconds) << "; " << num_failed
+            << " got no x-vector (too little speech).";
+  for (int32 s = 0; s < kNumStages; s++) {
+    const std::vector<double> &times = stage_times.times[s];
+    if (times.empty()) continue;
+    KALDI_LOG << "  " << kStageNames[s] << ": p50 "
+              << 1000.0 * Percentile(times, 0.5) << " ms, p90 "
+              << 1000.0 * Percentile(times, 0.9) << " ms, p99 "
+              << 1000.0 * Percentile(times, 0.99) << " ms, max "
+              << 1000.0 * Percentile(times, 1.0) << " ms.";
+  }
+}
+
+}  // namespace kaldi
+
+int main(int argc, char *argv[]) {
+  using namespace kaldi;
+  try {
+    const char *usage =
+        "Measures the latency of each stage of enrolling, verifying and\n"
+        "identifying speakers (embedding cache, frontend, network and\n"
+        "x-vector transform, PLDA scoring), the throughput at the given\n"
+        "concurrency and the peak memory, on synthetic audio with a stand-in\n"
+        "network, through XvectorControllerImpl.  The speakers are enrolled\n"
+        "first; verify scores a test utterance against the enrolled\n"
+        "speakers, identify searches for the best-scoring ones, and verify\n"
+        "is then run again with cohort score normalization.\n"
+        "Usage:  speaker-verification-benchmark [options]\n";
+    ParseOptions po(usage);
+    XvectorFrontendOptions frontend_opts;
+    XvectorExtractorOptions extractor_opts;
+    goat::RandomTdnnOptions nnet_opts;
+    EmbeddingCacheOptions cache_opts;
+    ScoreNormalizationOptions norm_opts;
+    int32 num_threads = 1, utt_threads = 1, num_speakers = 100,
+        enroll_utts = 3, num_requests = 200, num_distinct_utts = 50,
+        lda_dim = 128, num_results = 10, cohort_size = 1000;
+    BaseFloat utt_seconds = 3.0, speech_ratio = 0.6;
+    std::string store_filename = "/tmp/speaker-verification-benchmark.store";
+    // The MFCCs of the Kaldi x-vector recipes.
+    frontend_opts.mfcc_opts.num_ceps = 30;
+    frontend_opts.mfcc_opts.mel_opts.num_bins = 30;
+    frontend_opts.Register(&po);
+    extractor_opts.Register(&po);
+    nnet_opts.Register(&po);
+    cache_opts.Register(&po);
+    norm_opts.Register(&po);
+    po.Register("num-threads", &num_threads, "Number of requests served "
+                "at a time.");
+    po.Register("utt-threads", &utt_threads, "Number of threads each "
+                "enrollment's utterances are spread over (0 for one per "
+                "core), see XvectorControllerImpl::SetNumThreads().");
+    po.Register("num-speakers", &num_speakers, "Number of speakers enrolled.");
+    po.Register("enroll-utts", &enroll_utts, "Utterances per enrollment.");
+    po.Register("num-requests", &num_requests, "Number of verify and of "
+                "identify requests.");
+    po.Register("num-results", &num_results, "Number of speakers each "
+                "identify request returns.");
+    po.Register("cohort-size", &cohort_size, "Number of impostors the "
+                "normalized verify requests are scored against (0 skips "
+                "them).");
+    po.Register("utt-seconds", &utt_seconds, "Length of the utterances.");
+    po.Register("speech-ratio", &speech_ratio, "Proportion of each "
+                "utterance that is loud.");
+    po.Register("num-distinct-utts", &num_distinct_utts, "Number of "
+                "different synthetic utterances the requests cycle through; "
+                "repeats of one are embedding cache hits.");
+    po.Register("lda-dim", &lda_dim, "Dimension of the PLDA space.");
+    po.Register("speaker-store", &store_filename, "File of the speaker "
+                "store the speakers are enrolled into (overwritten, and "
+                "removed at the end); empty to keep them in memory only.");
+    po.Read(argc, argv);
+    if (po.NumArgs() != 0 || num_threads < 1 || utt_threads < 0 ||
+        num_speakers < 1 || enroll_utts < 1 || num_distinct_utts < 1 ||
+        cohort_size < 0) {
+      po.PrintUsage();
+      exit(1);
+    }
+    nnet_opts.feat_dim = frontend_opts.mfcc_opts.num_ceps;
+
+    BaseFloat sample_freq = frontend_opts.mfcc_opts.frame_opts.samp_freq;
+    std::vector<Vector<BaseFloat> > waveforms(num_distinct_utts);
+    for (int32 i = 0; i < num_distinct_utts; i++)
+      MakeWaveform(utt_seconds, sample_freq, speech_ratio, &(waveforms[i]));
+
+    double base_rss_kb = ProcStatusKb("VmRSS");
+    Plda plda;
+    MakeRandomPlda(lda_dim, &plda);
+    Vector<BaseFloat> mean(nnet_opts.xvector_dim);
+    mean.SetRandn();
+    Matrix<BaseFloat> lda_transform(lda_dim, nnet_opts.xvector_dim + 1);
+    lda_transform.SetRandn();
+    NnetComputerFactory nnet_factory = [&nnet_opts]() {
+      return std::unique_ptr<goat::NnetComputerInterface>(
+          new goat::RandomTdnnNnetComputer(nnet_opts));
+    };
+    std::shared_ptr<const SpeakerModel> model = std::make_shared<SpeakerModel>(
+        nnet_factory, mean, lda_transform, plda, extractor_opts);
+    XvectorControllerImpl controller(model);
+    controller.SetNumThreads(utt_threads);
+    std::unique_ptr<EmbeddingCache> cache;
+    if (cache_opts.capacity > 0) cache.reset(new EmbeddingCache(cache_opts));
+    // Any nonzero version will do; the model does not change.
+    const uint64 model_version = 1;
+    if (!store_filename.empty()) {
+      std::remove(store_filename.c_str());
+      std::remove((store_filename + ".stats").c_str());
+      if (!controller.OpenSpeakerStore(store_filename))
+        KALDI_ERR << "Could not create the speaker store " << store_filename;
+    }
+    std::vector<std::unique_ptr<Worker> > workers(num_threads);
+    for (int32 t = 0; t < num_threads; t++)
+      workers[t].reset(new Worker(frontend_opts));
+    KALDI_LOG << "Model and " << num_threads << " workers: +"
+              << (ProcStatusKb("VmRSS") - base_rss_kb) / 1024.0 << " MB.";
+
+    // The frontend of each utterance of a request, as
+    // XvectorController::MakeFeature() does.
+    auto make_features = [&](Worker *worker, int32 first_utt, int32 num_utts,
+                             StageTimes *times,
+                             std::vector<Matrix<BaseFloat> > *features) {
+      Timer timer;
+      features->resize(num_utts);
+      for (int32 u = 0; u < num_utts; u++)
+        worker->frontend.ComputeFeatures(
+            waveforms[(first_utt + u) % num_distinct_utts], sample_freq,
+            &((*features)[u]));
+      times->times[kFrontend].push_back(timer.Elapsed());
+    };
+
+    // Requests whose utterances gave no x-vector stop after the network,
+    // as they do in the client.
+    std::atomic<int32> num_failed(0);
+
+    // Enroll: one request per speaker, its utterances on --utt-threads
+    // threads.
+    auto enroll = [&](int32 speaker, Worker *worker) {
+      StageTimes *times = &(worker->stage_times);
+      Timer total_timer;
+      std::vector<Matrix<BaseFloat> > features;
+      make_features(worker, speaker * enroll_utts, enroll_utts, times,
+                    &features);
+      Timer timer;
+      if (controller.EnrollSpeaker(features, speaker) < 0) {
+        num_failed++;
+        return;
+      }
+      times->times[kEmbedding].push_back(timer.Elapsed());
+      times->times[kTotal].push_back(total_timer.Elapsed());
+    };
+    double seconds = RunRequests(num_speakers, &workers, enroll);
+    Report("enroll", num_speakers, num_failed, num_speakers * enroll_utts,
+           utt_seconds, num_threads, seconds, workers);
+    if (controller.NumEnrolledSpeakers() == 0)
+      KALDI_ERR << "No speaker was enrolled.";
+    if (!store_filename.empty()) {
+      // What a restarted service pays before its first score: mapping the
+      // store, then reading the speakers into the scorer.
+      XvectorControllerImpl reopened(model);
+      Timer timer;
+      if (!reopened.OpenSpeakerStore(store_filename))
+        KALDI_ERR << "Could not reopen the speaker store " << store_filename;
+      double open_seconds = timer.Elapsed();
+      timer.Reset();
+      reopened.ScoreTestPldaInput(Vector<BaseFloat>(plda.Dim()));
+      KALDI_LOG << "Reopening the store of " << reopened.NumEnrolledSpeakers()
+                << " speakers: " << 1000.0 * open_seconds << " ms, first "
+                << "score " << 1000.0 * timer.Elapsed() << " ms.";
+    }
+
+    // One test utterance per request: looked up in the embedding cache by
+    // its samples, as the client does by its PCM bytes, and only on a miss
+    // run through the frontend and the network.
+    auto test_plda_input = [&](int32 request, Worker *worker,
+                               StageTimes *times,
+                               Vector<BaseFloat> *plda_input) {
+      const Vector<BaseFloat> &waveform =
+          waveforms[request % num_distinct_utts];
+      uint64 key = 0;
+      if (cache != nullptr) {
+        Timer timer;
+        key = EmbeddingCache::Key(waveform.Data(),
+                                  waveform.Dim() * sizeof(BaseFloat),
+                                  sample_freq, model_version);
+        bool hit = cache->Lookup(key, plda_input);
+        times->times[kCache].push_back(timer.Elapsed());
+        if (hit) return true;
+      }
+      std::vector<Matrix<BaseFloat> > features;
+      make_features(worker, request, 1, times, &features);
+      Timer timer;
+      if (controller.ComputeTestPldaInput(features, plda_input) == 0)
+        return false;
+      times->times[kEmbedding].push_back(timer.Elapsed());
+      if (cache != nullptr) cache->Insert(key, *plda_input);
+      return true;
+    };
+
+    enum Workload { kVerify = 0, kIdentify, kNormalizedVerify,
+                    kNumWorkloads };
+    const char *workload_names[kNumWorkloads] = {
+      "verify", "identify", "verify with score normalization" };
+    for (int32 workload = 0; workload < kNumWorkloads && num_requests > 0;
+         workload++) {
+      if (workload == kNormalizedVerify) {
+        if (cohort_size == 0) break;
+        Matrix<BaseFloat> cohort_xvectors(cohort_size, model->XvectorDim());
+        cohort_xvectors.SetRandn();
+        Timer timer;
+        controller.SetScoreNormalizationCohort(cohort_xvectors, norm_opts);
+        KALDI_LOG << "Score normalization against " << cohort_size
+                  << " impostors, for " << controller.NumEnrolledSpeakers()
+                  << " speakers: " << 1000.0 * timer.Elapsed() << " ms.";
+      }
+      for (int32 t = 0; t < num_threads; t++)
+        workers[t]->stage_times = StageTimes();
+      num_failed = 0;
+      auto test = [&](int32 request, Worker *worker) {
+        StageTimes *times = &(worker->stage_times);
+        Timer total_timer;
+        Vector<BaseFloat> plda_input;
+        if (!test_plda_input(request, worker, times, &plda_input)) {
+          num_failed++;
+          return;
+        }
+        Timer timer;
+        if (workload == kIdentify) {
+          std::vector<std::pair<int32, BaseFloat> > results;
+          controller.IdentifySpeakers(plda_input, num_results, &results);
+        } else {
+          controller.ScoreTestPldaInput(plda_input);
+        }
+        times->times[kScoring].push_back(timer.Elapsed());
+        times->times[kTotal].push_back(total_timer.Elapsed());
+      };
+      seconds = RunRequests(num_requests, &workers, test);
+      Report(workload_names[workload], num_requests, num_failed,
+             num_requests, utt_seconds, num_threads, seconds, workers);
+    }
+    if (cache != nullptr) {
+      EmbeddingCacheStats stats = cache->Stats();
+      KALDI_LOG << "Embedding cache: " << stats.num_hits << " hits, "
+                << stats.num_misses << " misses (hit rate "
+                << stats.HitRate() << "), " << stats.num_entries
+                << " entries.";
+    }
+    if (!store_filename.empty()) {
+      std::remove(store_filename.c_str());
+      std::remove((store_filename + ".stats").c_str());
+    }
+    KALDI_LOG << "Peak RSS " << ProcStatusKb("VmHWM") / 1024.0 << " MB.";
+    return 0;
+  } catch(const std::exception &e) {
+    std::cerr << e.what();
+    return -1;
+  }
+}
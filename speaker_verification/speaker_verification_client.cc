@@ -2,6 +2,7 @@
 // Author : goat.zhou@qq.com (Yang Zhou)
 
 #include "speaker_verification/speaker_verification_client.h"
+#include "speaker_verification/tflite_nnet_factory.h"
 #include "speaker_verification/xvector_controller.h"
 
 bool SpeakerVerificationClient::ReadEnrolledXvector(const std::string xvector_path) {
@@ -19,6 +20,12 @@ SpeakerVerificationClient* SpeakerVerificationClient::GetInstance() {
   return &instance;
 }
 
+bool SpeakerVerificationClient::LoadScoreNormalizationCohort(
+    const std::string cohort_path) {
+  if (!model_is_ready_) return false;
+  return xvector_controller_->LoadScoreNormalizationCohort(cohort_path);
+}
+
 bool SpeakerVerificationClient::HaveSpeakerEnrolled() {
   return have_enrolled_;
 }
@@ -30,19 +37,76 @@ bool SpeakerVerificationClient::Init(
     std::string mean_rxfilename,
     std::string xvector_file) {
   xvector_file_ = xvector_file;
-  xvector_controller_.reset(new XvectorController(nnet_rxfilename,
-                                                  plda_rxfilename,
-                                                  transform_rxfilename,
-                                                  mean_rxfilename));
-	threshold_ = xvector_controller_.get_threshold();
+  kaldi::Vector<BaseFloat> mean;
+  kaldi::ReadKaldiObject(mean_rxfilename, &mean);
+  kaldi::Matrix<BaseFloat> transform;
+  kaldi::ReadKaldiObject(transform_rxfilename, &transform);
+  kaldi::Plda plda;
+  kaldi::ReadKaldiObject(plda_rxfilename, &plda);
+  speaker_model_.reset(new kaldi::SpeakerModel(
+      kaldi::TFliteNnetFactory(nnet_rxfilename), mean, transform, plda));
+  xvector_controller_.reset(new goat::XvectorController(speaker_model_));
+  batch_verifier_.reset(new kaldi::BatchVerifier(
+      kaldi::BatchVerifierOptions(), kaldi::XvectorFrontendOptions(),
+      speaker_model_));
+  std::vector<std::string> model_files = {nnet_rxfilename, plda_rxfilename,
+                                           transform_rxfilename,
+                                           mean_rxfilename};
+  if (!kaldi::HashModelFiles(model_files, &model_version_)) {
+    model_version_ = 0;  // Nothing is cached without a version.
+  }
+  if (embedding_cache_ != nullptr) embedding_cache_->Clear();
   model_is_ready_ = true;
-  std::ifstream fi(xvector_file);
-  if (fi.good()) {
-    ReadEnrolledXvector(xvector_file);
+  return LoadEnrolledSpeakers();
+}
+
+bool SpeakerVerificationClient::InitFromBundle(std::string bundle_filename,
+                                               std::string xvector_file) {
+  xvector_file_ = xvector_file;
+  std::shared_ptr<kaldi::ModelBundle> bundle(new kaldi::ModelBundle());
+  // Only the header and the section table are checked: hashing every
+  // section would read the whole network at each start.  make-model-bundle
+  // verifies the sections when it writes the bundle.
+  if (!bundle->Open(bundle_filename, false)) return false;
+  {
+    kaldi::BundleSectionInput input(*bundle, kaldi::kBundleThreshold);
+    kaldi::ReadBasicType(input.Stream(), true, &threshold_);
+  }
+  kaldi::XvectorFrontendOptions frontend_opts;
+  {
+    kaldi::ParseOptions po("");
+    frontend_opts.Register(&po);
+    kaldi::ReadBundleOptions(*bundle, kaldi::kBundleFrontendConfig, &po);
+  }
+  speaker_model_.reset(new kaldi::SpeakerModel(
+      kaldi::TFliteNnetFactory(bundle), bundle));
+  xvector_controller_.reset(new goat::XvectorController(speaker_model_,
+                                                        frontend_opts));
+  batch_verifier_.reset(new kaldi::BatchVerifier(
+      kaldi::BatchVerifierOptions(), frontend_opts, speaker_model_));
+  model_version_ = bundle->ContentHash();
+  if (embedding_cache_ != nullptr) embedding_cache_->Clear();
+  model_is_ready_ = true;
+  return LoadEnrolledSpeakers();
+}
+
+bool SpeakerVerificationClient::LoadEnrolledSpeakers() {
+  std::ifstream fi(xvector_file_);
+  bool is_store = kaldi::SpeakerStore::IsStoreFile(xvector_file_);
+  if (!is_store && fi.good()) {
+    ReadEnrolledXvector(xvector_file_);
     have_enrolled_ = true;
 		return true;
   }
-  return false; 
+  // A file that doesn't exist yet becomes a store, so that the speakers
+  // enrolled from now on are kept.
+  if (xvector_file_.empty() ||
+      !xvector_controller_->OpenSpeakerStore(xvector_file_)) {
+    have_enrolled_ = false;
+    return false;
+  }
+  have_enrolled_ = (xvector_controller_->NumEnrolledSpeakers() > 0);
+  return have_enrolled_;
 }
 
 // consider only one channel
@@ -74,7 +138,7 @@ int SpeakerVerificationClient::EnrollSpeaker(char* wave_data, int len) {
   return spk_id;
 }
 
-bool SpeakerVerificationClient::FeedEnrollingSpeakerFeature(char* wave_data, int len) {
+bool SpeakerVerificationClient::FeedEnrollingSpeakerWave(char* wave_data, int len) {
   if (!model_is_ready_) return false;
   kaldi::Matrix<BaseFloat> data;
   AcceptWaveData(wave_data, len, &data);
@@ -82,7 +146,7 @@ bool SpeakerVerificationClient::FeedEnrollingSpeakerFeature(char* wave_data, int
 }
 
 bool SpeakerVerificationClient::EnrollSpeakerAndUpdateTemplate(int speaker_id) {
-  xvector_controller_->EnrollSpeakerFromStoredFeature(speaker_id);
+  xvector_controller_->EnrollSpeakerFromFeededFeatures(speaker_id);
   have_enrolled_ = true;
   return true;
 }
@@ -94,16 +158,146 @@ bool SpeakerVerificationClient::VerifySpeaker(char* wave_data, int len) {
 
 float SpeakerVerificationClient::GetSpeakerConfidence(char* wave_data, int len) {
   if (!model_is_ready_ || !have_enrolled_) return -1;
-  kaldi::Matrix<BaseFloat> data;
-  AcceptWaveData(wave_data, len, &data);
-  std::vector<kaldi::Matrix<BaseFloat>> waves;
-  waves.push_back(data);
-  std::vector<BaseFloat> score = xvector_controller_->ComputeSpeakerConfidences(waves);
+  kaldi::Vector<BaseFloat> plda_input;
+  bool use_cache = (embedding_cache_ != nullptr && model_version_ != 0);
+  kaldi::uint64 cache_key = 0;
+  if (use_cache) {
+    cache_key = kaldi::EmbeddingCache::Key(
+        wave_data, len, batch_verifier_->SampleFrequency(), model_version_);
+  }
+  if (!use_cache || !embedding_cache_->Lookup(cache_key, &plda_input)) {
+    kaldi::Matrix<BaseFloat> data;
+    AcceptWaveData(wave_data, len, &data);
+    std::vector<kaldi::Matrix<BaseFloat>> waves;
+    waves.push_back(data);
+    if (xvector_controller_->ComputeTestPldaInput(waves, &plda_input) == 0) {
+      return threshold_ + 1;
+    }
+    if (use_cache) {
+      embedding_cache_->Insert(cache_key, plda_input);
+    }
+  }
+  std::vector<BaseFloat> score =
+      xvector_controller_->ScoreTestPldaInput(plda_input);
   if (score.size() == 0) { return threshold_ + 1; }
   return score[0];
 }
 
+void SpeakerVerificationClient::SetEmbeddingCache(
+    const kaldi::EmbeddingCacheOptions& opts) {
+  if (opts.capacity <= 0) {
+    embedding_cache_.reset();
+  } else {
+    embedding_cache_.reset(new kaldi::EmbeddingCache(opts));
+  }
+}
+
+kaldi::EmbeddingCacheStats
+SpeakerVerificationClient::GetEmbeddingCacheStats() const {
+  if (embedding_cache_ == nullptr) return kaldi::EmbeddingCacheStats();
+  return embedding_cache_->Stats();
+}
+
+void SpeakerVerificationClient::ExtractBatchXvectors(
+    char** wave_data, const int* lens, int num_waves,
+    std::vector<kaldi::Vector<BaseFloat>>* xvectors) {
+  // The 16-bit samples are converted in the worker threads.
+  BaseFloat sample_freq = batch_verifier_->SampleFrequency();
+  kaldi::BatchVerifier::WaveformLoader loader =
+      [wave_data, lens, sample_freq](int32 utt,
+                                     kaldi::Vector<BaseFloat>* waveform,
+                                     BaseFloat* utt_sample_freq) {
+    const short* samples = reinterpret_cast<const short*>(wave_data[utt]);
+    int32 num_samples = lens[utt] / 2;
+    waveform->Resize(num_samples, kaldi::kUndefined);
+    for (int32 i = 0; i < num_samples; ++i) {
+      (*waveform)(i) = samples[i];
+    }
+    *utt_sample_freq = sample_freq;
+    return true;
+  };
+  batch_verifier_->ExtractXvectors(num_waves, loader, xvectors);
+}
+
+int SpeakerVerificationClient::ScoreBatchXvectors(
+    const std::vector<kaldi::Vector<BaseFloat>>& xvectors,
+    int speaker_id, float* scores, bool* is_speaker) {
+  int num_scored = batch_verifier_->ScoreXvectors(
+      xvectors, xvector_controller_->Gallery(), speaker_id, scores);
+  if (num_scored < 0) return -1;
+  if (is_speaker != NULL) {
+    for (size_t i = 0; i < xvectors.size(); ++i) {
+      is_speaker[i] = (scores[i] >= threshold_);
+    }
+  }
+  return num_scored;
+}
+
+int SpeakerVerificationClient::VerifySpeakerBatch(char** wave_data,
+                                                  const int* lens,
+                                                  int num_waves,
+                                                  int speaker_id,
+                                                  float* scores,
+                                                  bool* is_speaker) {
+  if (!model_is_ready_ || !have_enrolled_) return -1;
+  std::vector<kaldi::Vector<BaseFloat>> xvectors;
+  ExtractBatchXvectors(wave_data, lens, num_waves, &xvectors);
+  return ScoreBatchXvectors(xvectors, speaker_id, scores, is_speaker);
+}
+
+int SpeakerVerificationClient::VerifySpeakerFiles(const char** wave_paths,
+                                                  int num_files,
+                                                  int speaker_id,
+                                                  float* scores,
+                                                  bool* is_speaker) {
+  if (!model_is_ready_ || !have_enrolled_) return -1;
+  std::vector<std::string> wav_filenames(wave_paths, wave_paths + num_files);
+  std::vector<kaldi::Vector<BaseFloat>> xvectors;
+  batch_verifier_->ExtractXvectors(wav_filenames, &xvectors);
+  return ScoreBatchXvectors(xvectors, speaker_id, scores, is_speaker);
+}
+
+int SpeakerVerificationClient::EnrollSpeakerBatch(char** wave_data,
+                                                  const int* lens,
+                                                  int num_waves,
+                                                  int speaker_id) {
+  return EnrollXvectorBatch(wave_data, lens, num_waves, speaker_id, false);
+}
+
+int SpeakerVerificationClient::AddSpeakerUtteranceBatch(char** wave_data,
+                                                        const int* lens,
+                                                        int num_waves,
+                                                        int speaker_id) {
+  return EnrollXvectorBatch(wave_data, lens, num_waves, speaker_id, true);
+}
+
+int SpeakerVerificationClient::EnrollXvectorBatch(char** wave_data,
+                                                  const int* lens,
+                                                  int num_waves,
+                                                  int speaker_id,
+                                                  bool accumulate) {
+  if (!model_is_ready_) return -1;
+  std::vector<kaldi::Vector<BaseFloat>> xvectors;
+  ExtractBatchXvectors(wave_data, lens, num_waves, &xvectors);
+  int num_utt = 0;
+  for (size_t i = 0; i < xvectors.size(); ++i) {
+    if (xvectors[i].Dim() != 0) num_utt++;
+  }
+  if (num_utt == 0) return 0;
+  // The controller keeps the x-vector sum, so that more utterances can be
+  // added later without extracting these again.
+  if (xvector_controller_->EnrollSpeakerFromXvectors(xvectors, speaker_id,
+                                                     accumulate) < 0) {
+    return -1;
+  }
+  have_enrolled_ = true;
+  return num_utt;
+}
+
 bool SpeakerVerificationClient::DestoryClient() {
+  batch_verifier_.reset();
+  if (embedding_cache_ != nullptr) embedding_cache_->Clear();
+  speaker_model_.reset();
   xvector_controller_.reset();
   have_enrolled_ = false;
   model_is_ready_ = false;
@@ -4,6 +4,10 @@
 #ifndef SPEAKER_VERIFICATION_CLIENT_H_
 #define SPEAKER_VERIFICATION_CLIENT_H_
 
+#include "speaker_verification/batch_verifier.h"
+#include "speaker_verification/embedding_cache.h"
+#include "speaker_verification/model_bundle.h"
+#include "speaker_verification/speaker_service.h"
 #include "speaker_verification/xvector_controller.h"
 
 class SpeakerVerificationClient {
@@ -14,6 +18,10 @@ class SpeakerVerificationClient {
     std::string transform_rxfilename,
     std::string mean_rxfilename,
     std::string xvector_file);
+  // As Init(), from a bundle made by make-model-bundle, which also carries
+  // the threshold and the frontend options.  Only the bundle's header and
+  // section table are checked here, not the sections' checksums.
+  bool InitFromBundle(std::string bundle_filename, std::string xvector_file);
   bool FeedEnrollingSpeakerWave(char* wave_data, int len);
   bool EnrollSpeakerAndUpdateTemplate(int speaker_id);
   int EnrollSpeaker(char* wave_data, int len);
@@ -23,16 +31,50 @@ class SpeakerVerificationClient {
   float GetThreshold() { return threshold_; }
   bool DestoryClient();
   bool ReadEnrolledXvector(const std::string xvector_path);
+  // Scores are S-norm / AS-norm normalized against this cohort from then on;
+  // the threshold must be for normalized scores.
+  bool LoadScoreNormalizationCohort(const std::string cohort_path);
+  // Batch versions, see speaker_verification.h.
+  int VerifySpeakerBatch(char** wave_data, const int* lens, int num_waves,
+                         int speaker_id, float* scores, bool* is_speaker);
+  int VerifySpeakerFiles(const char** wave_paths, int num_files,
+                         int speaker_id, float* scores, bool* is_speaker);
+  int EnrollSpeakerBatch(char** wave_data, const int* lens, int num_waves,
+                         int speaker_id);
+  int AddSpeakerUtteranceBatch(char** wave_data, const int* lens,
+                               int num_waves, int speaker_id);
+  // GetSpeakerConfidence() remembers the PLDA input of recent utterances,
+  // keyed by their bytes and the model, and reuses it when the same audio
+  // comes again.  A capacity of 0 turns the cache off (the default).
+  void SetEmbeddingCache(const kaldi::EmbeddingCacheOptions& opts);
+  kaldi::EmbeddingCacheStats GetEmbeddingCacheStats() const;
 
  private:
   void AcceptWaveData(short* wave_data, int len, kaldi::Matrix<BaseFloat>* data);
   void AcceptWaveData(char* wave_data, int len, kaldi::Matrix<BaseFloat>* data);
   bool WriteEnrolledXvector(const std::string xvector_path);
+  // Opens xvector_file_ as a speaker store (creating it if it does not
+  // exist) or reads it as enrolled x-vectors; returns whether any speaker
+  // is enrolled.
+  bool LoadEnrolledSpeakers();
+  void ExtractBatchXvectors(char** wave_data, const int* lens, int num_waves,
+                            std::vector<kaldi::Vector<BaseFloat>>* xvectors);
+  int EnrollXvectorBatch(char** wave_data, const int* lens, int num_waves,
+                         int speaker_id, bool accumulate);
+  int ScoreBatchXvectors(const std::vector<kaldi::Vector<BaseFloat>>& xvectors,
+                         int speaker_id, float* scores, bool* is_speaker);
 
-  std::unique_ptr<XvectorController> xvector_controller_;
+  std::unique_ptr<goat::XvectorController> xvector_controller_;
+  // Loaded once, and shared by the controller and the batch calls.
+  std::shared_ptr<const kaldi::SpeakerModel> speaker_model_;
+  std::unique_ptr<kaldi::BatchVerifier> batch_verifier_;
+  std::unique_ptr<kaldi::EmbeddingCache> embedding_cache_;
+  // Hash of the model files, part of the cache keys.
+  kaldi::uint64 model_version_ = 0;
   bool have_enrolled_  = false;
   bool model_is_ready_ = false;
-  float threshold_;
+  // Only a bundle carries a threshold; 0 is the neutral PLDA log-ratio.
+  float threshold_ = 0.0;
   std::string xvector_file_;
 };
 
@@ -0,0 +1,187 @@
+// speaker_verification/streaming_verifier.cc
+
+// Copyright (c) 2021 PeachLab. All Rights Reserved.
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <vector>
+
+#include "speaker_verification/streaming_verifier.h"
+
+namespace kaldi {
+
+StreamingVerifier::StreamingVerifier(const StreamingVerifierOptions &opts,
+                                     const MfccOptions &mfcc_opts,
+                                     std::shared_ptr<const SpeakerModel> model,
+                                     const SpeakerGallery &gallery,
+                                     int32 speaker_id):
+    opts_(opts), model_(model), enroll_num_utts_(0),
+    mfcc_computer_(mfcc_opts),
+    window_function_(mfcc_computer_.GetFrameOptions()),
+    waveform_offset_(0), num_mfcc_frames_(0), num_cmn_frames_(0),
+    chunk_frames_(0), num_chunks_(0), num_frames_(0), score_(0.0),
+    decision_(kVerificationUndecided) {
+  KALDI_ASSERT(model_ != nullptr && opts_.cmn_window >= 0);
+  if (!gallery.GetSpeaker(speaker_id, &enroll_plda_input_, &enroll_num_utts_))
+    KALDI_ERR << "Speaker " << speaker_id << " is not enrolled.";
+}
+
+void StreamingVerifier::ComputeMfcc(bool flush, Matrix<BaseFloat> *features) {
+  const FrameExtractionOptions &frame_opts = mfcc_computer_.GetFrameOptions();
+  int64 num_samples_total = waveform_offset_ + waveform_remainder_.Dim();
+  int32 num_frames_new = NumFrames(num_samples_total, frame_opts, flush);
+  if (num_frames_new > num_mfcc_frames_)
+    features->Resize(num_frames_new - num_mfcc_frames_, mfcc_computer_.Dim(),
+                     kUndefined);
+  else
+    features->Resize(0, 0);
+  Vector<BaseFloat> window;
+  bool need_raw_log_energy = mfcc_computer_.NeedRawLogEnergy();
+  for (int32 frame = num_mfcc_frames_; frame < num_frames_new; frame++) {
+    BaseFloat raw_log_energy = 0.0, vtln_warp = 1.0;
+    ExtractWindow(waveform_offset_, waveform_remainder_, frame, frame_opts,
+                  window_function_, &window,
+                  need_raw_log_energy ? &raw_log_energy : NULL);
+    SubVector<BaseFloat> feature(*features, frame - num_mfcc_frames_);
+    mfcc_computer_.Compute(raw_log_energy, vtln_warp, &window, &feature);
+  }
+  num_mfcc_frames_ = std::max(num_mfcc_frames_, num_frames_new);
+  // Keep only the samples that later frames need.
+  int64 first_sample_of_next_frame = FirstSampleOfFrame(num_mfcc_frames_,
+                                                        frame_opts);
+  int32 samples_to_discard = std::min<int64>(
+      first_sample_of_next_frame - waveform_offset_,
+      waveform_remainder_.Dim());
+  if (samples_to_discard > 0) {
+    int32 new_num_samples = waveform_remainder_.Dim() - samples_to_discard;
+    Vector<BaseFloat> new_remainder(new_num_samples, kUndefined);
+    new_remainder.CopyFromVec(waveform_remainder_.Range(samples_to_discard,
+                                                        new_num_samples));
+    waveform_offset_ += samples_to_discard;
+    waveform_remainder_.Swap(&new_remainder);
+  }
+}
+
+void StreamingVerifier::ApplyCmn(MatrixBase<BaseFloat> *features) {
+  if (opts_.cmn_window == 0) return;
+  int32 dim = features->NumCols();
+  if (cmn_history_.NumRows() == 0) {
+    cmn_history_.Resize(opts_.cmn_window, dim);
+    cmn_sum_.Resize(dim);
+  }
+  Vector<double> frame(dim);
+  for (int32 r = 0; r < features->NumRows(); r++) {
+    // The mean is over the last cmn_window frames, this one included.
+    SubVector<BaseFloat> slot(cmn_history_,
+                              num_cmn_frames_ % opts_.cmn_window);
+    if (num_cmn_frames_ >= opts_.cmn_window) {
+      frame.CopyFromVec(slot);
+      cmn_sum_.AddVec(-1.0, frame);
+    }
+    slot.CopyFromVec(features->Row(r));
+    frame.CopyFromVec(slot);
+    cmn_sum_.AddVec(1.0, frame);
+    num_cmn_frames_++;
+    int32 count = std::min(num_cmn_frames_, opts_.cmn_window);
+    frame.CopyFromVec(cmn_sum_);
+    features->Row(r).AddVec(-1.0 / count, frame);
+  }
+}
+
+VerificationDecision StreamingVerifier::AcceptWaveform(
+    BaseFloat sampling_rate, const VectorBase<BaseFloat> &waveform) {
+  if (decision_ != kVerificationUndecided) return decision_;
+  BaseFloat expected_sampling_rate =
+      mfcc_computer_.GetFrameOptions().samp_freq;
+  if (sampling_rate != expected_sampling_rate)
+    KALDI_ERR << "Sampling frequency mismatch, expected "
+              << expected_sampling_rate << ", got " << sampling_rate;
+  if (waveform.Dim() == 0) return decision_;
+  Vector<BaseFloat> appended(waveform_remainder_.Dim() + waveform.Dim(),
+                             kUndefined);
+  appended.Range(0, waveform_remainder_.Dim()).CopyFromVec(
+      waveform_remainder_);
+  appended.Range(waveform_remainder_.Dim(), waveform.Dim()).CopyFromVec(
+      waveform);
+  waveform_remainder_.Swap(&appended);
+  Matrix<BaseFloat> features;
+  ComputeMfcc(false, &features);
+  ApplyCmn(&features);
+  return AcceptFeatures(features);
+}
+
+VerificationDecision StreamingVerifier::AcceptFeatures(
+    const MatrixBase<BaseFloat> &features) {
+  int32 chunk_size = model_->ExtractorOptions().chunk_size;
+  if (chunk_.NumRows() == 0 && features.NumRows() != 0)
+    chunk_.Resize(chunk_size, features.NumCols(), kUndefined);
+  for (int32 r = 0; r < features.NumRows(); r++) {
+    if (decision_ != kVerificationUndecided) break;
+    chunk_.Row(chunk_frames_++).CopyFromVec(features.Row(r));
+    num_frames_++;
+    if (chunk_frames_ == chunk_size) {
+      ProcessChunk();
+      chunk_frames_ = 0;
+    }
+  }
+  return decision_;
+}
+
+void StreamingVerifier::ProcessChunk() {
+  std::vector<Matrix<BaseFloat> > chunks(1, chunk_);
+  std::vector<Vector<BaseFloat> > xvectors;
+  if (model_->ExtractXvectors(chunks, &xvectors) == 0) return;
+  // All chunks have the same number of frames, so the frame-weighted average
+  // of the chunk embeddings is their mean.
+  if (num_chunks_ == 0) xvector_sum_.Resize(xvectors[0].Dim());
+  xvector_sum_.AddVec(1.0, xvectors[0]);
+  num_chunks_++;
+
+  std::vector<Vector<BaseFloat> > average(1, xvector_sum_);
+  average[0].Scale(1.0 / num_chunks_);
+  Vector<double> test_plda_input;
+  model_->XvectorsToPldaInput(average, &test_plda_input);
+  score_ = model_->GetPlda().LogLikelihoodRatio(enroll_plda_input_,
+                                                enroll_num_utts_,
+                                                test_plda_input);
+  if (num_chunks_ >= opts_.min_decision_chunks) {
+    if (score_ >= opts_.threshold + opts_.early_decision_margin)
+      decision_ = kVerificationAccepted;
+    else if (score_ <= opts_.threshold - opts_.early_decision_margin)
+      decision_ = kVerificationRejected;
+  }
+  KALDI_VLOG(2) << "Chunk " << num_chunks_ << ": score " << score_;
+}
+
+VerificationDecision StreamingVerifier::InputFinished() {
+  if (decision_ != kVerificationUndecided) return decision_;
+  if (waveform_offset_ + waveform_remainder_.Dim() != 0) {
+    Matrix<BaseFloat> features;
+    ComputeMfcc(true, &features);
+    ApplyCmn(&features);
+    AcceptFeatures(features);
+    if (decision_ != kVerificationUndecided) return decision_;
+  }
+  // Frames short of a whole chunk are dropped, as in XvectorExtractor.
+  if (num_chunks_ == 0 || score_ < opts_.threshold)
+    decision_ = kVerificationRejected;
+  else
+    decision_ = kVerificationAccepted;
+  return decision_;
+}
+
+}  // namespace kaldi
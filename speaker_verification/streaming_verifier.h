@@ -0,0 +1,148 @@
+// speaker_verification/streaming_verifier.h
+
+// Copyright (c) 2021 PeachLab. All Rights Reserved.
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_SPEAKER_VERIFICATION_STREAMING_VERIFIER_H_
+#define KALDI_SPEAKER_VERIFICATION_STREAMING_VERIFIER_H_
+
+#include <memory>
+
+#include "base/kaldi-common.h"
+#include "feat/feature-mfcc.h"
+#include "feat/feature-window.h"
+#include "matrix/matrix-lib.h"
+#include "speaker_verification/speaker_service.h"
+#include "util/options-itf.h"
+
+namespace kaldi {
+
+struct StreamingVerifierOptions {
+  BaseFloat threshold;
+  BaseFloat early_decision_margin;
+  int32 min_decision_chunks;
+  int32 cmn_window;
+
+  StreamingVerifierOptions(): threshold(0.0), early_decision_margin(10.0),
+                              min_decision_chunks(2), cmn_window(300) { }
+
+  void Register(OptionsItf *opts) {
+    opts->Register("threshold", &threshold, "PLDA log-likelihood ratio at or "
+                   "above which the speaker is accepted.");
+    opts->Register("early-decision-margin", &early_decision_margin,
+                   "Decide before the end of the input once the score is "
+                   "this far above or below --threshold.");
+    opts->Register("min-decision-chunks", &min_decision_chunks, "Number of "
+                   "x-vector chunks needed before an early decision.");
+    opts->Register("cmn-window", &cmn_window, "Window, in frames, of the "
+                   "causal sliding mean normalization applied to the MFCCs "
+                   "(0 to disable).  Only used by AcceptWaveform().");
+  }
+};
+
+enum VerificationDecision {
+  kVerificationUndecided,
+  kVerificationAccepted,
+  kVerificationRejected
+};
+
+/// StreamingVerifier verifies one utterance against one enrolled speaker as
+/// the audio arrives.  Each time a chunk's worth of frames is available its
+/// embedding is computed and added to a running average, which is scored
+/// against the speaker with Plda::LogLikelihoodRatio().  Once the score is
+/// early_decision_margin away from the threshold (after at least
+/// min_decision_chunks chunks) the decision is made, and further input is
+/// ignored.
+///
+/// Input is either features, via AcceptFeatures(), or waveform, via
+/// AcceptWaveform(); don't mix the two.  Chunks are the same as in
+/// XvectorExtractor, so a verifier fed with AcceptFeatures() that runs to
+/// the end gives the same score as SpeakerSession on the same features,
+/// e.g. those of XvectorFrontend.  AcceptWaveform() only approximates that:
+/// XvectorFrontend's centered mean normalization and its energy VAD (whose
+/// threshold depends on the mean energy of the whole utterance) need all of
+/// the utterance, so here the mean normalization is causal and there is no
+/// VAD.
+class StreamingVerifier {
+ public:
+  /// Copies the enrollment of "speaker_id" from "gallery", which must have
+  /// it.
+  StreamingVerifier(const StreamingVerifierOptions &opts,
+                    const MfccOptions &mfcc_opts,
+                    std::shared_ptr<const SpeakerModel> model,
+                    const SpeakerGallery &gallery,
+                    int32 speaker_id);
+
+  VerificationDecision AcceptWaveform(BaseFloat sampling_rate,
+                                      const VectorBase<BaseFloat> &waveform);
+
+  /// One feature vector per row, as the network expects them.
+  VerificationDecision AcceptFeatures(const MatrixBase<BaseFloat> &features);
+
+  /// Call at the end of the utterance; a decision that is still pending is
+  /// made by comparing the score with the threshold.  With no complete
+  /// chunk at all, the speaker is rejected.
+  VerificationDecision InputFinished();
+
+  VerificationDecision Decision() const { return decision_; }
+
+  /// The score after the last chunk (0 before the first one).
+  BaseFloat Score() const { return score_; }
+
+  int32 NumChunks() const { return num_chunks_; }
+
+  /// Number of feature frames processed so far.
+  int32 NumFramesProcessed() const { return num_frames_; }
+
+ private:
+  void ComputeMfcc(bool flush, Matrix<BaseFloat> *features);
+  void ApplyCmn(MatrixBase<BaseFloat> *features);
+  void ProcessChunk();
+
+  StreamingVerifierOptions opts_;
+  std::shared_ptr<const SpeakerModel> model_;
+  Vector<double> enroll_plda_input_;
+  int32 enroll_num_utts_;
+
+  // Waveform to MFCC.
+  MfccComputer mfcc_computer_;
+  FeatureWindowFunction window_function_;
+  Vector<BaseFloat> waveform_remainder_;
+  int64 waveform_offset_;
+  int32 num_mfcc_frames_;
+
+  // Causal CMN: ring buffer of the last cmn_window frames and their sum.
+  Matrix<BaseFloat> cmn_history_;
+  Vector<double> cmn_sum_;
+  int32 num_cmn_frames_;
+
+  // Frames of the chunk being collected.
+  Matrix<BaseFloat> chunk_;
+  int32 chunk_frames_;
+
+  Vector<BaseFloat> xvector_sum_;
+  int32 num_chunks_;
+  int32 num_frames_;
+  BaseFloat score_;
+  VerificationDecision decision_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(StreamingVerifier);
+};
+
+}  // namespace kaldi
+
+#endif  // KALDI_SPEAKER_VERIFICATION_STREAMING_VERIFIER_H_
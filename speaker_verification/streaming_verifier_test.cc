@@ -0,0 +1,137 @@
+// speaker_verification/streaming_verifier_test.cc
+
+// Copyright (c) 2021 PeachLab. All Rights Reserved.
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+
+#include "frontend/frontend.h"
+#include "inference/random_tdnn_nnet_computer.h"
+#include "speaker_verification/streaming_verifier.h"
+
+namespace kaldi {
+
+// A PLDA model with identity transform and random between-class variances.
+static void MakeRandomPlda(int32 dim, Plda *plda) {
+  Vector<double> mean(dim), psi(dim);
+  Matrix<double> transform(dim, dim);
+  transform.SetUnit();
+  psi.SetRandUniform();
+  psi.Scale(5.0);
+  psi.Add(0.5);
+  std::sort(psi.Data(), psi.Data() + dim, std::greater<double>());
+  std::ostringstream os;
+  bool binary = true;
+  WriteToken(os, binary, "<Plda>");
+  mean.Write(os, binary);
+  transform.Write(os, binary);
+  psi.Write(os, binary);
+  WriteToken(os, binary, "</Plda>");
+  std::istringstream is(os.str());
+  plda->Read(is, binary);
+}
+
+// Noise bursts between silences, so that the frontend's VAD drops frames.
+static void RandomWaveform(BaseFloat samp_freq, Vector<BaseFloat> *waveform) {
+  int32 num_samples = samp_freq * (2 + Rand() % 4);
+  waveform->Resize(num_samples);
+  int32 burst = samp_freq / 2;
+  for (int32 start = 0; start < num_samples; start += burst) {
+    int32 size = std::min(burst, num_samples - start);
+    SubVector<BaseFloat> part(*waveform, start, size);
+    part.SetRandn();
+    part.Scale((start / burst) % 3 == 2 ? 1.0 : 1000.0);
+  }
+}
+
+// Fed with AcceptFeatures() to the end, the verifier must give the score of
+// SpeakerSession on the same features.
+static void UnitTestStreamingVerifierScore() {
+  XvectorFrontendOptions frontend_opts;
+  XvectorFrontend frontend(frontend_opts);
+  BaseFloat samp_freq = frontend_opts.mfcc_opts.frame_opts.samp_freq;
+  goat::RandomTdnnOptions nnet_opts;
+  nnet_opts.feat_dim = frontend.Dim();
+  nnet_opts.hidden_dim = 64;
+  nnet_opts.stats_dim = 128;
+  nnet_opts.xvector_dim = 32;
+  int32 plda_dim = 16;
+  Vector<BaseFloat> mean(nnet_opts.xvector_dim);
+  mean.SetRandn();
+  Matrix<BaseFloat> transform(plda_dim, nnet_opts.xvector_dim);
+  transform.SetRandn();
+  Plda plda;
+  MakeRandomPlda(plda_dim, &plda);
+  XvectorExtractorOptions extractor_opts;
+  extractor_opts.chunk_size = 50;
+  NnetComputerFactory nnet_factory = [nnet_opts]() {
+    return std::unique_ptr<goat::NnetComputerInterface>(
+        new goat::RandomTdnnNnetComputer(nnet_opts));
+  };
+  std::shared_ptr<const SpeakerModel> model(new SpeakerModel(
+      nnet_factory, mean, transform, plda, extractor_opts));
+  std::shared_ptr<SpeakerGallery> gallery(new SpeakerGallery(plda));
+  SpeakerSession session(model, gallery);
+
+  std::vector<Matrix<BaseFloat> > enroll_features(2);
+  for (size_t i = 0; i < enroll_features.size(); i++) {
+    Vector<BaseFloat> waveform;
+    RandomWaveform(samp_freq, &waveform);
+    frontend.ComputeFeatures(waveform, samp_freq, &(enroll_features[i]));
+  }
+  int32 speaker_id = session.EnrollSpeaker(enroll_features, -1);
+  KALDI_ASSERT(speaker_id >= 0);
+
+  for (int32 iter = 0; iter < 5; iter++) {
+    Vector<BaseFloat> waveform;
+    RandomWaveform(samp_freq, &waveform);
+    std::vector<Matrix<BaseFloat> > test_features(1);
+    frontend.ComputeFeatures(waveform, samp_freq, &(test_features[0]));
+    std::vector<BaseFloat> scores =
+        session.ComputeSpeakerConfidences(test_features);
+    KALDI_ASSERT(scores.size() == 1);
+
+    StreamingVerifierOptions opts;
+    opts.early_decision_margin = 1.0e10;  // Run to the end.
+    StreamingVerifier verifier(opts, frontend_opts.mfcc_opts, model,
+                               *gallery, speaker_id);
+    const Matrix<BaseFloat> &features = test_features[0];
+    for (int32 start = 0; start < features.NumRows(); ) {
+      int32 size = std::min<int32>(1 + Rand() % 80,
+                                   features.NumRows() - start);
+      verifier.AcceptFeatures(features.RowRange(start, size));
+      start += size;
+    }
+    verifier.InputFinished();
+    KALDI_ASSERT(verifier.NumChunks() ==
+                 features.NumRows() / extractor_opts.chunk_size);
+    KALDI_ASSERT(std::abs(verifier.Score() - scores[0]) <=
+                 1.0e-3 * (1.0 + std::abs(scores[0])));
+  }
+}
+
+}  // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  UnitTestStreamingVerifierScore();
+  KALDI_LOG << "Tests succeeded.";
+  return 0;
+}
@@ -0,0 +1,50 @@
+// speaker_verification/tflite_nnet_factory.cc
+
+// Copyright (c) 2021 PeachLab. All Rights Reserved.
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "inference/tflite_nnet_computer.h"
+#include "speaker_verification/tflite_nnet_factory.h"
+
+namespace kaldi {
+
+NnetComputerFactory TFliteNnetFactory(const std::string &nnet_rxfilename) {
+  return [nnet_rxfilename]() {
+    std::unique_ptr<goat::NnetComputerInterface> computer(
+        new goat::TFliteNnetComputer());
+    computer->Init(nnet_rxfilename);
+    return computer;
+  };
+}
+
+NnetComputerFactory TFliteNnetFactory(
+    std::shared_ptr<const ModelBundle> bundle) {
+  return [bundle]() {
+    const char *nnet_data;
+    size_t nnet_size;
+    if (!bundle->GetSection(kBundleNnet, &nnet_data, &nnet_size))
+      KALDI_ERR << "Model bundle " << bundle->Filename()
+                << " has no network.";
+    std::unique_ptr<goat::NnetComputerInterface> computer(
+        new goat::TFliteNnetComputer());
+    computer->InitFromBuffer(nnet_data, nnet_size);
+    return computer;
+  };
+}
+
+}  // namespace kaldi
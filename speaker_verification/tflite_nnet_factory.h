@@ -0,0 +1,42 @@
+// speaker_verification/tflite_nnet_factory.h
+
+// Copyright (c) 2021 PeachLab. All Rights Reserved.
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef KALDI_SPEAKER_VERIFICATION_TFLITE_NNET_FACTORY_H_
+#define KALDI_SPEAKER_VERIFICATION_TFLITE_NNET_FACTORY_H_
+
+#include <memory>
+#include <string>
+
+#include "speaker_verification/model_bundle.h"
+#include "speaker_verification/nnet_computer_factory.h"
+
+namespace kaldi {
+
+/// TFLite backends running the network in "nnet_rxfilename".
+NnetComputerFactory TFliteNnetFactory(const std::string &nnet_rxfilename);
+
+/// TFLite backends running the network from the kBundleNnet section of
+/// "bundle", in place; the factory keeps the bundle open.
+NnetComputerFactory TFliteNnetFactory(
+    std::shared_ptr<const ModelBundle> bundle);
+
+}  // namespace kaldi
+
+#endif  // KALDI_SPEAKER_VERIFICATION_TFLITE_NNET_FACTORY_H_
@@ -1,64 +1,148 @@
 #include "speaker_verification/xvector_controller.h"
 #include "speaker_verification/xvector_controller_impl.h"
 
+#include <atomic>
+
+#include "util/kaldi-thread.h"
+
 using std::vector;
 using std::string;
 
+namespace {
+
+// One worker of MakeFeature(); MultiThreader gives each thread its own copy,
+// and so its own frontend.
+class MakeFeatureTask: public kaldi::MultiThreadable {
+ public:
+  MakeFeatureTask(const kaldi::XvectorFrontend& frontend,
+                  BaseFloat sample_freq,
+                  const vector<Matrix<BaseFloat>>* wave_features,
+                  std::atomic<int32>* next_utt,
+                  vector<Matrix<BaseFloat>>* frontend_features)
+      : frontend_(frontend), sample_freq_(sample_freq),
+        wave_features_(wave_features), next_utt_(next_utt),
+        frontend_features_(frontend_features) { }
+
+  void operator() () {
+    int32 num_utts = wave_features_->size();
+    int32 utt;
+    while ((utt = (*next_utt_)++) < num_utts) {
+      frontend_.ComputeFeatures((*wave_features_)[utt].Row(0), sample_freq_,
+                                &((*frontend_features_)[utt]));
+    }
+  }
+
+ private:
+  kaldi::XvectorFrontend frontend_;
+  BaseFloat sample_freq_;
+  const vector<Matrix<BaseFloat>>* wave_features_;
+  std::atomic<int32>* next_utt_;
+  vector<Matrix<BaseFloat>>* frontend_features_;
+};
+
+}  // namespace
+
+namespace goat {
+
 XvectorController::XvectorController(
-    const string& mean_xvector_rxfilename,
-    const string& nnet_rxfilename,
-    const string& plda_rxfilename,
-    const string& transform_rxfilename) {
-  KALDI_LOG << "the file have get: "<< nnet_rxfilename << " " << mean_xvector_rxfilename;
-  Vector<BaseFloat> mean;
-  ReadKaldiObject(mean_xvector_rxfilename, &mean);
-  Matrix<BaseFloat> transform;
-  ReadKaldiObject(transform_rxfilename, &transform);
-  KALDI_LOG << "mean & transform init";
-  Plda plda;
-  ReadKaldiObject(plda_rxfilename, &plda);
-
-  KALDI_LOG << "nnet & plad init";
-  xvector_controller_impl_.reset(
-    new XvectorControllerImpl(nnet_rxfilename, plda, transform, mean));
-  xvector_frontend_.reset(
-    new XvectorFrontend(vad_opts, sliding_window_cmn_opts, mfcc_opts));
+    std::shared_ptr<const SpeakerModel> model,
+    const kaldi::XvectorFrontendOptions& frontend_opts)
+    : xvector_controller_impl_(new XvectorControllerImpl(model)),
+      xvector_frontend_(new kaldi::XvectorFrontend(frontend_opts)),
+      sample_freq_(frontend_opts.mfcc_opts.frame_opts.samp_freq) {
 }
 
 void XvectorController::MakeFeature(
     const std::vector<Matrix<BaseFloat>>& wave_features,
     std::vector<Matrix<BaseFloat>>* frontend_features) {
-  frontend_features->reserve(wave_features.size());
-  for (int32 i = 0; i < wave_features.size(); ++i) {
-    Matrix<BaseFloat> result_feature;
-    xvector_frontend_->ComputeFeatures(wave_features[i], &result_feature);
-    frontend_features->push_back(result_feature);
+  // Each utterance's features are computed in place, in utterance order.
+  int32 num_utts = wave_features.size();
+  frontend_features->clear();
+  frontend_features->resize(num_utts);
+  int32 num_threads = xvector_controller_impl_->NumThreads(num_utts);
+  if (num_threads == 1) {
+    for (int32 i = 0; i < num_utts; ++i) {
+      xvector_frontend_->ComputeFeatures(wave_features[i].Row(0), sample_freq_,
+                                         &((*frontend_features)[i]));
+    }
+    return;
+  }
+  std::atomic<int32> next_utt(0);
+  MakeFeatureTask task(*xvector_frontend_, sample_freq_, &wave_features,
+                       &next_utt, frontend_features);
+  {
+    kaldi::MultiThreader<MakeFeatureTask> threader(num_threads, task);
   }
 }
 
+void XvectorController::SetNumThreads(int32 num_threads) {
+  xvector_controller_impl_->SetNumThreads(num_threads);
+}
+
 int32 XvectorController::EnrollSpeaker(const vector<Matrix<BaseFloat>>& features,
     int32 speaker_id) {
   vector<Matrix<BaseFloat>> enroll_mfcc_features;
-  MakeMFCC(features, &enroll_mfcc_features);
+  MakeFeature(features, &enroll_mfcc_features);
   return xvector_controller_impl_->EnrollSpeaker(enroll_mfcc_features, 
                                                  speaker_id);
 }
 
+int32 XvectorController::AddSpeakerUtterances(
+    const vector<Matrix<BaseFloat>>& features, int32 speaker_id) {
+  vector<Matrix<BaseFloat>> enroll_mfcc_features;
+  MakeFeature(features, &enroll_mfcc_features);
+  return xvector_controller_impl_->AddSpeakerUtterances(enroll_mfcc_features,
+                                                        speaker_id);
+}
+
+int32 XvectorController::EnrollSpeakerFromXvectors(
+    const vector<Vector<BaseFloat>>& xvectors, int32 speaker_id,
+    bool accumulate) {
+  return xvector_controller_impl_->EnrollSpeakerFromXvectors(
+      xvectors, speaker_id, accumulate);
+}
+
 bool XvectorController::FeedEnrollingSpeakerFeature(const Matrix<BaseFloat>& feature) {
   Matrix<BaseFloat> mfcc_feature;
-  xvector_frontend_->ComputeFeatures(feature, &mfcc_feature);
+  xvector_frontend_->ComputeFeatures(feature.Row(0), sample_freq_,
+                                     &mfcc_feature);
   return xvector_controller_impl_->FeedEnrollingSpeakerFeature(mfcc_feature);
 }
 
 vector<BaseFloat> XvectorController::ComputeSpeakerConfidences(
     const vector<Matrix<BaseFloat>>& features) {
   vector<Matrix<BaseFloat>> test_mfcc_features;
-  MakeMFCC(features, &test_mfcc_features);
+  MakeFeature(features, &test_mfcc_features);
   return xvector_controller_impl_->ComputeSpeakerConfidences(test_mfcc_features);
 }
 
-int32 XvectorController::EnrollSpeakerFromStoredFeature(int32 speaker_id) {
-  return xvector_controller_impl_->EnrollSpeakerFromStoredFeature(speaker_id);
+int32 XvectorController::ComputeTestPldaInput(
+    const vector<Matrix<BaseFloat>>& features,
+    Vector<BaseFloat>* plda_input) {
+  vector<Matrix<BaseFloat>> test_mfcc_features;
+  MakeFeature(features, &test_mfcc_features);
+  return xvector_controller_impl_->ComputeTestPldaInput(test_mfcc_features,
+                                                        plda_input);
+}
+
+vector<BaseFloat> XvectorController::ScoreTestPldaInput(
+    const VectorBase<BaseFloat>& plda_input) const {
+  return xvector_controller_impl_->ScoreTestPldaInput(plda_input);
+}
+
+void XvectorController::IdentifySpeakers(
+    const VectorBase<BaseFloat>& plda_input, int32 num_results,
+    vector<std::pair<int32, BaseFloat>>* results) const {
+  xvector_controller_impl_->IdentifySpeakers(plda_input, num_results,
+                                             results);
+}
+
+void XvectorController::SetSpeakerIndex(const SpeakerIndexOptions& opts) {
+  xvector_controller_impl_->SetSpeakerIndex(opts);
+}
+
+int32 XvectorController::EnrollSpeakerFromFeededFeatures(int32 speaker_id) {
+  return xvector_controller_impl_->EnrollSpeakerFromFeededFeature(speaker_id);
 }
 
 bool XvectorController::WriteEnrolledFeature(const std::string& Wxfilename) {
@@ -69,3 +153,44 @@ bool XvectorController::ReadEnrolledFeature(const std::string& Rxfilename) {
   return xvector_controller_impl_->ReadEnrolledFeature(Rxfilename);
 }
 
+bool XvectorController::OpenSpeakerStore(const std::string& filename) {
+  return xvector_controller_impl_->OpenSpeakerStore(filename);
+}
+
+int32 XvectorController::NumEnrolledSpeakers() const {
+  return xvector_controller_impl_->NumEnrolledSpeakers();
+}
+
+std::vector<int32> XvectorController::EnrolledSpeakerIds() const {
+  return xvector_controller_impl_->EnrolledSpeakerIds();
+}
+
+bool XvectorController::GetEnrolledSpeaker(int32 speaker_id,
+                                           Vector<double>* plda_input,
+                                           int32* num_utt) const {
+  return xvector_controller_impl_->GetEnrolledSpeaker(speaker_id, plda_input,
+                                                      num_utt);
+}
+
+int32 XvectorController::EnrollSpeakerFromPldaInput(
+    const VectorBase<double>& plda_input, int32 num_utt, int32 speaker_id) {
+  return xvector_controller_impl_->EnrollSpeakerFromPldaInput(plda_input,
+                                                              num_utt,
+                                                              speaker_id);
+}
+
+bool XvectorController::LoadScoreNormalizationCohort(
+    const std::string& cohort_rxfilename,
+    const ScoreNormalizationOptions& opts) {
+  Matrix<BaseFloat> cohort_xvectors;
+  ReadKaldiObject(cohort_rxfilename, &cohort_xvectors);
+  if (cohort_xvectors.NumRows() == 0) return false;
+  xvector_controller_impl_->SetScoreNormalizationCohort(cohort_xvectors, opts);
+  return true;
+}
+
+const kaldi::SpeakerGallery& XvectorController::Gallery() const {
+  return *(xvector_controller_impl_->Gallery());
+}
+
+}  // namespace goat
@@ -1,7 +1,7 @@
 #ifndef XVECTOR_CONTROLLER_H_
 #define XVECTOR_CONTROLLER_H_
 
-#include "feat/frontend.h"
+#include "frontend/frontend.h"
 #include "speaker_verification/xvector_controller_impl.h"
 #include "util/common-utils.h"
 #include "speaker_verification/plda.h"
@@ -13,23 +13,67 @@ namespace goat {
 
 class XvectorController {
   public:
-    XvectorController(
-		  const std::string& mean_xvector_rxfilename,
-      const std::string& nnet_rxfilename,
-      const std::string& plda_rxfilename,
-      const std::string& transform_rxfilename);
+    // Runs a model that is already loaded (see SpeakerModel; the
+    // application picks the network backend), and may be shared with other
+    // users of it.  "frontend_opts" should be those of the model's
+    // frontend config, e.g. a bundle's (see make-model-bundle).
+    explicit XvectorController(std::shared_ptr<const SpeakerModel> model,
+                               const kaldi::XvectorFrontendOptions&
+                                   frontend_opts =
+                                       kaldi::XvectorFrontendOptions());
+    // Multi-utterance calls run the frontend and the network of the
+    // utterances on this many threads (1 by default; 0 for one per core),
+    // each with its own replica of the network.
+    void SetNumThreads(int32 num_threads);
     int32 EnrollSpeaker(const std::vector<Matrix<BaseFloat>>& features, int32 speaker_id);
     int32 EnrollSpeakerFromFeededFeatures(int32 speaker_id);
+    // Adds utterances to an enrolled speaker, see XvectorControllerImpl.
+    int32 AddSpeakerUtterances(const std::vector<Matrix<BaseFloat>>& features,
+                               int32 speaker_id);
+    int32 EnrollSpeakerFromXvectors(
+        const std::vector<Vector<BaseFloat>>& xvectors, int32 speaker_id,
+        bool accumulate = false);
     bool FeedEnrollingSpeakerFeature(const Matrix<BaseFloat>& feature);
     bool ReadEnrolledFeature(const std::string& Wxfilename);
     bool WriteEnrolledFeature(const std::string& Rxfilename);
+    bool OpenSpeakerStore(const std::string& filename);
+    int32 NumEnrolledSpeakers() const;
+    // The order of the scores, see XvectorControllerImpl.
+    std::vector<int32> EnrolledSpeakerIds() const;
+    bool GetEnrolledSpeaker(int32 speaker_id, Vector<double>* plda_input,
+                            int32* num_utt) const;
+    int32 EnrollSpeakerFromPldaInput(const VectorBase<double>& plda_input,
+                                     int32 num_utt, int32 speaker_id);
+    // Reads a matrix of cohort x-vectors, one impostor per row, and
+    // normalizes the scores against it from then on.
+    bool LoadScoreNormalizationCohort(
+        const std::string& cohort_rxfilename,
+        const ScoreNormalizationOptions& opts = ScoreNormalizationOptions());
+    // The enrolled speakers, for callers that score them in other ways
+    // (see BatchVerifier).
+    const kaldi::SpeakerGallery& Gallery() const;
     std::vector<BaseFloat> ComputeSpeakerConfidences(const std::vector<Matrix<BaseFloat>>& features);
+    // The two halves of ComputeSpeakerConfidences(), see
+    // XvectorControllerImpl.
+    int32 ComputeTestPldaInput(const std::vector<Matrix<BaseFloat>>& features,
+                               Vector<BaseFloat>* plda_input);
+    std::vector<BaseFloat> ScoreTestPldaInput(
+        const VectorBase<BaseFloat>& plda_input) const;
+    // The best-scoring speakers for a test PLDA input, optionally searched
+    // in a SpeakerIndex; see XvectorControllerImpl.
+    void IdentifySpeakers(
+        const VectorBase<BaseFloat>& plda_input, int32 num_results,
+        std::vector<std::pair<int32, BaseFloat>>* results) const;
+    void SetSpeakerIndex(const SpeakerIndexOptions& opts);
 
   private:
+    // The waveforms are the first rows of "wave_features", at the sampling
+    // rate of the frontend options.
     void MakeFeature(const std::vector<Matrix<BaseFloat>>& wave_features,
                   std::vector<Matrix<BaseFloat>>* frontend_features);
     std::unique_ptr<XvectorControllerImpl> xvector_controller_impl_; 
-    std::unique_ptr<Frontend> xvector_frontend_; 
+    std::unique_ptr<kaldi::XvectorFrontend> xvector_frontend_; 
+    BaseFloat sample_freq_;
 };
 
 }  // namespace goat
@@ -1,56 +1,100 @@
 #ifndef XVECTOR_CONTROLLER_IMPL_H_
 #define XVECTOR_CONTROLLER_IMPL_H_
 
-#include "speaker_verification/xvector_extractor.h"
+#include <memory>
+#include <utility>
+
 #include "base/kaldi-common.h"
 #include "util/common-utils.h"
-#include "speaker_verification/plda.h"
+#include "speaker_verification/score_normalizer.h"
+#include "speaker_verification/speaker_index.h"
+#include "speaker_verification/speaker_service.h"
 
 typedef kaldi::BaseFloat BaseFloat;
 typedef kaldi::int32 int32;
 #define kEmptyEnroll -1
 
+// The controller's view of a SpeakerModel and a SpeakerGallery (see
+// speaker_service.h), which may be shared with other users of the same
+// model, e.g. a BatchVerifier.  Enrolling by feeding utterances one at a
+// time goes through a SpeakerSession of its own.
 class XvectorControllerImpl {
   public:
-    XvectorControllerImpl(const Vector<BaseFloat>& mean_xvector,
-		                      const std::string& nnet,
-		                      const Plda& plda,
-                          const Matrix<BaseFloat>& transform);
+    // Enrolls into "gallery", or into a gallery of its own if it is NULL.
+    explicit XvectorControllerImpl(
+        std::shared_ptr<const SpeakerModel> model,
+        std::shared_ptr<SpeakerGallery> gallery = nullptr);
+    // Calls with several utterances (multi-prompt enrollment) run them on
+    // this many threads (1 by default; 0 for one per core), see
+    // SpeakerModel::ExtractXvectors().
+    void SetNumThreads(int32 num_threads);
+    // The number of threads used for "num_utts" utterances.
+    int32 NumThreads(int32 num_utts) const;
     int32 EnrollSpeaker(const std::vector<Matrix<BaseFloat>>& features, int32 speaker_id);
+    // Adds utterances to an enrolled speaker (or enrolls a new one if
+    // speaker_id is not enrolled) without the audio of its earlier ones, see
+    // SpeakerGallery::EnrollXvectorStats().  Returns -1 if no utterance
+    // gave an x-vector, or if the speaker was enrolled without statistics
+    // (from a PLDA input, or from a file written before they were kept).
+    int32 AddSpeakerUtterances(const std::vector<Matrix<BaseFloat>>& features,
+                               int32 speaker_id);
+    // As EnrollSpeaker() (or, with "accumulate", AddSpeakerUtterances())
+    // from x-vectors already extracted; empty ones are skipped.
+    int32 EnrollSpeakerFromXvectors(
+        const std::vector<Vector<BaseFloat>>& xvectors, int32 speaker_id,
+        bool accumulate = false);
+    // The statistics the speaker's PLDA input is derived from; false if
+    // there is no such speaker or it has none.
+    bool GetSpeakerStats(int32 speaker_id, Vector<double>* xvector_sum,
+                         int32* num_utts) const;
     int32 EnrollSpeakerFromFeededFeature(int32 speaker_id);
     std::vector<BaseFloat> ComputeSpeakerConfidences(
 		    const std::vector<Matrix<BaseFloat>>& features) const;
+    // ComputeSpeakerConfidences() in two steps, so that callers can cache
+    // the test's PLDA input (see EmbeddingCache) and skip the first step.
+    // ComputeTestPldaInput() returns the number of utterances used.
+    int32 ComputeTestPldaInput(const std::vector<Matrix<BaseFloat>>& features,
+                               Vector<BaseFloat>* plda_input) const;
+    std::vector<BaseFloat> ScoreTestPldaInput(
+        const VectorBase<BaseFloat>& plda_input) const;
+    // The (at most) "num_results" best-scoring enrolled speakers for a test
+    // PLDA input, see SpeakerGallery::Identify().
+    void IdentifySpeakers(
+        const VectorBase<BaseFloat>& plda_input, int32 num_results,
+        std::vector<std::pair<int32, BaseFloat>>* results) const;
+    void SetSpeakerIndex(const SpeakerIndexOptions& opts);
     bool FeedEnrollingSpeakerFeature(const Matrix<BaseFloat>& feature);
 		// todo extract this two api
-    bool WriteEnrolledFeature(const std::string& Wxfilename, 
+    bool WriteEnrolledFeature(const std::string& Wxfilename,
 		                          const bool is_binary = true) const;
     bool ReadEnrolledFeature(const std::string& Rxfilename);
+    // Keeps the enrolled speakers in a memory-mapped SpeakerStore, see
+    // SpeakerGallery::OpenStore().
+    bool OpenSpeakerStore(const std::string& filename);
+    int32 NumEnrolledSpeakers() const { return gallery_->NumSpeakers(); }
+    // The scores of ComputeSpeakerConfidences() are in this order.  Speaker
+    // ids need not be contiguous: EnrollSpeaker() with an id that is not
+    // enrolled uses it, and with a negative one picks the next unused id.
+    std::vector<int32> EnrolledSpeakerIds() const {
+      return gallery_->SpeakerIds();
+    }
+    // For callers that compute PLDA inputs themselves: copies out an enrolled speaker, or enrolls one as EnrollSpeaker() does.
+    bool GetEnrolledSpeaker(int32 speaker_id, Vector<double>* plda_input,
+                            int32* num_utt) const;
+    int32 EnrollSpeakerFromPldaInput(const VectorBase<double>& plda_input,
+                                     int32 num_utt, int32 speaker_id);
+    // Turns on S-norm / AS-norm of the scores from ComputeSpeakerConfidences()
+    // against a cohort of impostors, one x-vector per row.
+    void SetScoreNormalizationCohort(const Matrix<BaseFloat>& cohort_xvectors,
+                                     const ScoreNormalizationOptions& opts);
+    const std::shared_ptr<const SpeakerModel>& Model() const { return model_; }
+    const std::shared_ptr<SpeakerGallery>& Gallery() const { return gallery_; }
   private:
-    void XvectorPostTransform(Vector<BaseFloat>* xvector);
-    void NormalizeLength(Vector<BaseFloat>* ivector);
-    void MeanVectors(const std::vector<Vector<BaseFloat>>& vectors, 
-		     Vector<BaseFloat>* mean_vector);
-    void LDATransform(const Vector<BaseFloat>& input_ivector,
-        Vector<BaseFloat>* transform_vector);
-    void PLDATransform(Vector<BaseFloat>* ivector, int32 num_utt);
-    bool Feature2Xvector(const Matrix<BaseFloat>& feature,
-        Vector<BaseFloat>* xvector);
-    int32 Xvectors2PldaInput(const std::vector<Vector<BaseFloat>>& xvectors,
-        Vector<BaseFloat>* xvector_transform);
-    void EnrollPldaInput(const Vector<BaseFloat>& enroll_xvector_transform);
-    int32 Feature2PldaInput(const std::vector<Matrix<BaseFloat>>& features,
-        Vector<BaseFloat>* xvector_transform);
-    int32 EnrollPldaInput(const Vector<BaseFloat>& xvector_trans, int32 num_utt,
-                         int32 speaker_id);
-
-    const Plda plda_;
-    const Matrix<BaseFloat> transform_;
-    const Vector<BaseFloat> mean_;
-    std::vector<Vector<double>> enrolled_speakers_;
-    std::vector<int32> num_utts_;
-    std::vector<Vector<BaseFloat>> feeded_xvector;
-    std::unique_ptr<XvectorExtractor> xvector_extractor_; 
+    std::shared_ptr<const SpeakerModel> model_;
+    std::shared_ptr<SpeakerGallery> gallery_;
+    // Holds the utterances fed so far by FeedEnrollingSpeakerFeature().
+    SpeakerSession session_;
+    int32 num_threads_ = 1;
 };
 
 #endif //  XVECTOR_CONTROLLER_IMPL_H_
-
@@ -1,63 +1,122 @@
 #include "speaker_verification/xvector_extractor.h"
 
-XvectorExtractor::XvectorExtractor(const std::string& nnet_model) {
-	nnet_computer_->Init(nnet_model);
+XvectorExtractor::XvectorExtractor(
+    std::unique_ptr<goat::NnetComputerInterface> nnet_computer,
+    const XvectorExtractorOptions& opts)
+    : opts_(opts), nnet_computer_(std::move(nnet_computer)) {
+  KALDI_ASSERT(opts_.chunk_size > 0 && opts_.max_batch_size >= 0);
+  KALDI_ASSERT(nnet_computer_ != nullptr);
 }
 
-void XvectorExtractor::ExtractEmbedding(const kaldi::MatrixBase<BaseFloat>& features,
-                                      Vector<BaseFloat>* xvector) {
-  Timer time;
-	nnet_computer_->FeedForward(features, xvector);
-  float second = time.Elapsed();
-  KALDI_LOG << "nnet compute time: " << second;
+void XvectorExtractor::Warmup(int32 feat_dim) {
+  nnet_computer_->Warmup(std::max(opts_.chunk_size, opts_.min_chunk_size),
+                         feat_dim, opts_.max_batch_size);
 }
 
-bool XvectorExtractor::ExtractXvector(const Matrix<BaseFloat>& features, 
-                                      Vector<BaseFloat>* xvector) {
-  int32 num_rows = features.NumRows(); 
-  int32 feat_dim = features.NumCols();
-	int32 this_chunk_size = kChunkSize;
-  int32 min_chunk_size = kMinChunkSize;
-  bool pad_input = true;
-  //xvector->Resize(xvector_dim, kSetZero);
-
-  int32 num_chunks = floor(
-      num_rows / static_cast<BaseFloat>(this_chunk_size));
-  if (num_chunks == 0) return false;
-  Vector<BaseFloat> xvector_avg(xvector_dim, kSetZero);
-  BaseFloat tot_weight = 0.0;
-
-  for (int32 chunk_indx = 0; chunk_indx < num_chunks; chunk_indx++) {
-      // If we're nearing the end of the input, we may need to shift the
-      // offset back so that we can get this_chunk_size frames of input to
-      // the nnet.
-    int32 offset = std::min(
-        this_chunk_size, num_rows - chunk_indx * this_chunk_size);
-    if (!pad_input && offset < min_chunk_size)
-          continue;
-    SubMatrix<BaseFloat> sub_features(
-      features, chunk_indx * this_chunk_size, offset, 0, feat_dim);
-    Vector<BaseFloat> xvector;
-    tot_weight += offset;
-    // Pad input if the offset is less than the minimum chunk size
-    if (pad_input && offset < min_chunk_size) {
-      Matrix<BaseFloat> padded_features(min_chunk_size, feat_dim);
-      int32 left_context = (min_chunk_size - offset) / 2;
-      int32 right_context = min_chunk_size - offset - left_context;
-      for (int32 i = 0; i < left_context; i++) {
-        padded_features.Row(i).CopyFromVec(sub_features.Row(0));
-      }
-      for (int32 i = 0; i < right_context; i++) {
-        padded_features.Row(min_chunk_size - i - 1).CopyFromVec(sub_features.Row(offset - 1));
-      }
-      padded_features.Range(left_context, offset, 0, feat_dim).CopyFromMat(sub_features);
-      ExtractEmbedding(padded_features, &xvector);
-    } else {
-      ExtractEmbedding(sub_features, &xvector);
+void XvectorExtractor::CopyChunk(const MatrixBase<BaseFloat>& chunk,
+                                 SubMatrix<BaseFloat>* dest) const {
+  int32 offset = chunk.NumRows();
+  int32 num_frames = dest->NumRows();
+  int32 feat_dim = chunk.NumCols();
+  int32 left_context = (num_frames - offset) / 2;
+  int32 right_context = num_frames - offset - left_context;
+  for (int32 i = 0; i < left_context; i++) {
+    dest->Row(i).CopyFromVec(chunk.Row(0));
+  }
+  for (int32 i = 0; i < right_context; i++) {
+    dest->Row(num_frames - i - 1).CopyFromVec(chunk.Row(offset - 1));
+  }
+  dest->Range(left_context, offset, 0, feat_dim).CopyFromMat(chunk);
+}
+
+int32 XvectorExtractor::ExtractXvectors(
+    const std::vector<const Matrix<BaseFloat>*>& features,
+    std::vector<Vector<BaseFloat>>* xvectors) {
+  int32 num_utts = features.size();
+  int32 this_chunk_size = opts_.chunk_size;
+  xvectors->clear();
+  xvectors->resize(num_utts);
+  if (num_utts == 0) return 0;
+  if (!opts_.pad_input && this_chunk_size < opts_.min_chunk_size) return 0;
+  // Chunks shorter than the minimum are padded, so every chunk in the batch
+  // has the same number of frames.
+  int32 chunk_frames = std::max(this_chunk_size, opts_.min_chunk_size);
+  // Utterances with no frames (e.g. nothing left after VAD) may be 0 x 0.
+  int32 feat_dim = 0;
+  for (int32 u = 0; u < num_utts && feat_dim == 0; u++)
+    feat_dim = features[u]->NumCols();
+
+  // The chunks of utterance u are [chunk_offsets[u], chunk_offsets[u + 1])
+  // in the stacked batch.  Only whole chunks are used.
+  std::vector<int32> chunk_offsets(num_utts + 1, 0);
+  for (int32 u = 0; u < num_utts; u++) {
+    KALDI_ASSERT(features[u]->NumRows() == 0 ||
+                 features[u]->NumCols() == feat_dim);
+    chunk_offsets[u + 1] = chunk_offsets[u] +
+        features[u]->NumRows() / this_chunk_size;
+  }
+  int32 num_chunks = chunk_offsets[num_utts];
+  if (num_chunks == 0) return 0;
+  int32 max_batch_size = (opts_.max_batch_size > 0 ? opts_.max_batch_size :
+                          num_chunks);
+
+  // The chunks are written straight into the network's input and its
+  // outputs are read in place (see NnetComputerInterface::BatchInput()).
+  // Chunks are weighted by their number of frames, which is the same for all
+  // of them, so the weighted average is the plain mean.
+  Timer time;
+  int32 utt = 0;
+  for (int32 start = 0; start < num_chunks; start += max_batch_size) {
+    int32 batch_size = std::min(max_batch_size, num_chunks - start);
+    SubMatrix<BaseFloat> batch = nnet_computer_->BatchInput(
+        batch_size, chunk_frames, feat_dim);
+    for (int32 c = start; c < start + batch_size; c++) {
+      while (chunk_offsets[utt + 1] <= c) utt++;
+      SubMatrix<BaseFloat> chunk(*features[utt],
+                                 (c - chunk_offsets[utt]) * this_chunk_size,
+                                 this_chunk_size, 0, feat_dim);
+      SubMatrix<BaseFloat> dest(batch, (c - start) * chunk_frames,
+                                chunk_frames, 0, feat_dim);
+      CopyChunk(chunk, &dest);
+    }
+    SubMatrix<BaseFloat> outputs = nnet_computer_->RunBatch();
+    // The utterances with chunks in this batch.
+    int32 first_utt = utt;
+    while (first_utt > 0 && chunk_offsets[first_utt] > start) first_utt--;
+    for (int32 u = first_utt; u <= utt; u++) {
+      int32 begin = std::max(chunk_offsets[u], start),
+          end = std::min(chunk_offsets[u + 1], start + batch_size);
+      if (begin >= end) continue;
+      Vector<BaseFloat>& xvector = (*xvectors)[u];
+      if (xvector.Dim() == 0) xvector.Resize(outputs.NumCols());
+      xvector.AddRowSumMat(1.0 / (chunk_offsets[u + 1] - chunk_offsets[u]),
+                           outputs.RowRange(begin - start, end - begin));
     }
-      xvector_avg.AddVec(offset, xvector);
   }
-  xvector_avg.Scale(1.0 / tot_weight);
-  xvector->CopyFromVec(xvector_avg);
+  KALDI_VLOG(1) << "nnet compute time for " << num_chunks << " chunks: "
+                << time.Elapsed();
+
+  int32 num_done = 0;
+  for (int32 u = 0; u < num_utts; u++)
+    if (chunk_offsets[u + 1] > chunk_offsets[u]) num_done++;
+  return num_done;
+}
+
+int32 XvectorExtractor::ExtractXvectors(
+    const std::vector<Matrix<BaseFloat>>& features,
+    std::vector<Vector<BaseFloat>>* xvectors) {
+  std::vector<const Matrix<BaseFloat>*> feature_ptrs(features.size());
+  for (size_t i = 0; i < features.size(); ++i) {
+    feature_ptrs[i] = &(features[i]);
+  }
+  return ExtractXvectors(feature_ptrs, xvectors);
+}
+
+bool XvectorExtractor::ExtractXvector(const Matrix<BaseFloat>& features,
+                                      Vector<BaseFloat>* xvector) {
+  std::vector<const Matrix<BaseFloat>*> feature_ptrs(1, &features);
+  std::vector<Vector<BaseFloat>> xvectors;
+  if (ExtractXvectors(feature_ptrs, &xvectors) == 0) return false;
+  xvector->Swap(&(xvectors[0]));
   return true;
 }
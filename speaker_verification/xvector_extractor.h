@@ -7,23 +7,64 @@
 #include "util/common-utils.h"
 
 #include <memory>
+#include <vector>
 
-const int32 kChunkSize = 100;
-const int32 kMinChunkSize = 20;
 using kaldi::Matrix;
 using kaldi::Vector;
 using namespace kaldi;
 
+struct XvectorExtractorOptions {
+  int32 chunk_size;
+  int32 min_chunk_size;
+  bool pad_input;
+  int32 max_batch_size;
+
+  XvectorExtractorOptions(): chunk_size(100), min_chunk_size(20),
+                             pad_input(true), max_batch_size(64) { }
+
+  void Register(OptionsItf *opts) {
+    opts->Register("chunk-size", &chunk_size, "The x-vector is the average "
+                   "of the network outputs on chunks of this many frames.");
+    opts->Register("min-chunk-size", &min_chunk_size, "Chunks shorter than "
+                   "this are padded (if --pad-input) or skipped.");
+    opts->Register("pad-input", &pad_input, "Pad chunks shorter than "
+                   "--min-chunk-size by repeating their edge frames.");
+    opts->Register("max-batch-size", &max_batch_size, "Maximum number of "
+                   "chunks run in one inference call (0 for no limit).");
+  }
+};
+
 class XvectorExtractor {
   public:
-   explicit  XvectorExtractor(const std::string& nnet_model);
+   // Runs "nnet_computer", which must be initialized (see NnetComputerFactory
+   // for the models' TFLite backends, goat::RandomTdnnNnetComputer for the
+   // stand-in network of the benchmarks).
+   explicit XvectorExtractor(
+       std::unique_ptr<goat::NnetComputerInterface> nnet_computer,
+       const XvectorExtractorOptions& opts = XvectorExtractorOptions());
    bool ExtractXvector(const Matrix<BaseFloat>& features, Vector<BaseFloat>* xvector);
+   // Extracts the x-vectors of several utterances, running the chunks of all
+   // of them in as few batches as possible.  Utterances too short for one
+   // chunk get an empty x-vector.  Returns the number of non-empty ones.
+   int32 ExtractXvectors(const std::vector<Matrix<BaseFloat>>& features,
+                         std::vector<Vector<BaseFloat>>* xvectors);
+   // As above, for utterances that are not in one vector.
+   int32 ExtractXvectors(const std::vector<const Matrix<BaseFloat>*>& features,
+                         std::vector<Vector<BaseFloat>>* xvectors);
+   // Prepares the network for the batches ExtractXvectors() will run on
+   // "feat_dim"-dimensional features (see NnetComputerInterface::Warmup()).
+   void Warmup(int32 feat_dim);
+   // E.g. for the counters of the backend.
+   const goat::NnetComputerInterface& NnetComputer() const {
+     return *nnet_computer_;
+   }
 
   private:
-    void ExtractEmbedding(const kaldi::MatrixBase<BaseFloat>& features,
-		                      Vector<BaseFloat>* xvector);
-    std::unique_ptr<NnetComputerInterface> nnet_computer_;
+    // Copies a chunk into "dest", padding it to dest->NumRows() frames.
+    void CopyChunk(const MatrixBase<BaseFloat>& chunk,
+                   SubMatrix<BaseFloat>* dest) const;
+    XvectorExtractorOptions opts_;
+    std::unique_ptr<goat::NnetComputerInterface> nnet_computer_;
 };
 
 #endif  // #define XVECTOR_EXTRACTOR_H_
-
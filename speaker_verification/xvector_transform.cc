@@ -0,0 +1,182 @@
+// speaker_verification/xvector_transform.cc
+
+// Copyright (c) 2021 PeachLab. All Rights Reserved.
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cmath>
+
+#include "matrix/matrix-functions.h"
+#include "speaker_verification/xvector_transform.h"
+
+namespace kaldi {
+
+template<typename Real>
+void CompiledXvectorTransform<Real>::Compile(
+    const VectorBase<BaseFloat> &mean,
+    const MatrixBase<BaseFloat> &lda_transform,
+    bool normalize_lda_length,
+    const Plda &plda,
+    const PldaConfig &plda_config) {
+  int32 in_dim = mean.Dim(), dim = lda_transform.NumRows();
+  KALDI_ASSERT(dim == plda.Dim() &&
+               (lda_transform.NumCols() == in_dim ||
+                lda_transform.NumCols() == in_dim + 1));
+  // The LDA stage as y = T x + t, with the mean folded into t.
+  Matrix<double> lda_linear(lda_transform.Range(0, dim, 0, in_dim));
+  Vector<double> lda_offset(dim), mean_dbl(mean);
+  if (lda_transform.NumCols() == in_dim + 1)
+    lda_offset.CopyColFromMat(lda_transform, in_dim);
+  lda_offset.AddMatVec(-1.0, lda_linear, kNoTrans, mean_dbl, 1.0);
+
+  dim_ = dim;
+  normalize_lda_length_ = normalize_lda_length;
+  plda_config_ = plda_config;
+  psi_.Resize(dim);
+  psi_.CopyFromVec(plda.psi_);
+  if (normalize_lda_length) {
+    linear_.Resize(dim, in_dim, kUndefined);
+    linear_.CopyFromMat(lda_linear);
+    offset_.Resize(dim, kUndefined);
+    offset_.CopyFromVec(lda_offset);
+    plda_linear_.Resize(dim, dim, kUndefined);
+    plda_linear_.CopyFromMat(plda.transform_);
+    plda_offset_.Resize(dim, kUndefined);
+    plda_offset_.CopyFromVec(plda.offset_);
+  } else {
+    // A (T x + t) + b = (A T) x + (A t + b).
+    Matrix<double> linear(dim, in_dim);
+    linear.AddMatMat(1.0, plda.transform_, kNoTrans, lda_linear, kNoTrans,
+                     0.0);
+    Vector<double> offset(plda.offset_);
+    offset.AddMatVec(1.0, plda.transform_, kNoTrans, lda_offset, 1.0);
+    linear_.Resize(dim, in_dim, kUndefined);
+    linear_.CopyFromMat(linear);
+    offset_.Resize(dim, kUndefined);
+    offset_.CopyFromVec(offset);
+    plda_linear_.Resize(0, 0);
+    plda_offset_.Resize(0);
+  }
+}
+
+template<typename Real>
+void CompiledXvectorTransform<Real>::PldaLengthNorm(
+    int32 num_examples, MatrixBase<Real> *plda_inputs) const {
+  // As in Plda::TransformIvector().
+  if (!plda_config_.normalize_length) return;
+  if (plda_config_.simple_length_norm) {
+    NormalizeRowLengths<Real>(NULL, plda_inputs);
+  } else {
+    Vector<Real> inv_covar(psi_);
+    inv_covar.Add(1.0 / num_examples);
+    inv_covar.InvertElements();
+    NormalizeRowLengths(&inv_covar, plda_inputs);
+  }
+}
+
+template<typename Real>
+void CompiledXvectorTransform<Real>::ApplyBatch(
+    const MatrixBase<Real> &xvectors, int32 num_examples,
+    MatrixBase<Real> *plda_inputs) const {
+  KALDI_ASSERT(IsCompiled() && num_examples > 0 &&
+               xvectors.NumCols() == InputDim() &&
+               plda_inputs->NumRows() == xvectors.NumRows() &&
+               plda_inputs->NumCols() == dim_);
+  int32 num_rows = xvectors.NumRows();
+  if (num_rows == 0) return;
+  if (!normalize_lda_length_) {
+    plda_inputs->CopyRowsFromVec(offset_);
+    plda_inputs->AddMatMat(1.0, xvectors, kNoTrans, linear_, kTrans, 1.0);
+  } else {
+    Matrix<Real> lda_outputs(num_rows, dim_, kUndefined);
+    lda_outputs.CopyRowsFromVec(offset_);
+    lda_outputs.AddMatMat(1.0, xvectors, kNoTrans, linear_, kTrans, 1.0);
+    NormalizeRowLengths<Real>(NULL, &lda_outputs);
+    plda_inputs->CopyRowsFromVec(plda_offset_);
+    plda_inputs->AddMatMat(1.0, lda_outputs, kNoTrans, plda_linear_, kTrans,
+                           1.0);
+  }
+  PldaLengthNorm(num_examples, plda_inputs);
+}
+
+template<typename Real>
+void CompiledXvectorTransform<Real>::Apply(const VectorBase<Real> &xvector,
+                                           int32 num_examples,
+                                           VectorBase<Real> *plda_input) const {
+  KALDI_ASSERT(IsCompiled() && num_examples > 0 &&
+               xvector.Dim() == InputDim() && plda_input->Dim() == dim_);
+  if (!normalize_lda_length_) {
+    plda_input->CopyFromVec(offset_);
+    plda_input->AddMatVec(1.0, linear_, kNoTrans, xvector, 1.0);
+  } else {
+    Vector<Real> lda_output(offset_);
+    lda_output.AddMatVec(1.0, linear_, kNoTrans, xvector, 1.0);
+    // The length normalization is the alpha of the PLDA GEMV.
+    Real norm = lda_output.Norm(2.0),
+        scale = (norm == 0.0 ? 1.0 : std::sqrt(static_cast<Real>(dim_)) / norm);
+    plda_input->CopyFromVec(plda_offset_);
+    plda_input->AddMatVec(scale, plda_linear_, kNoTrans, lda_output, 1.0);
+  }
+  SubMatrix<Real> out(plda_input->Data(), 1, dim_, dim_);
+  PldaLengthNorm(num_examples, &out);
+}
+
+template<typename Real>
+void CompiledXvectorTransform<Real>::Write(std::ostream &os,
+                                           bool binary) const {
+  KALDI_ASSERT(IsCompiled());
+  WriteToken(os, binary, "<CompiledXvectorTransform>");
+  WriteToken(os, binary, "<NormalizeLdaLength>");
+  WriteBasicType(os, binary, normalize_lda_length_);
+  WriteToken(os, binary, "<NormalizeLength>");
+  WriteBasicType(os, binary, plda_config_.normalize_length);
+  WriteToken(os, binary, "<SimpleLengthNorm>");
+  WriteBasicType(os, binary, plda_config_.simple_length_norm);
+  linear_.Write(os, binary);
+  offset_.Write(os, binary);
+  plda_linear_.Write(os, binary);
+  plda_offset_.Write(os, binary);
+  psi_.Write(os, binary);
+  WriteToken(os, binary, "</CompiledXvectorTransform>");
+}
+
+template<typename Real>
+void CompiledXvectorTransform<Real>::Read(std::istream &is, bool binary) {
+  ExpectToken(is, binary, "<CompiledXvectorTransform>");
+  ExpectToken(is, binary, "<NormalizeLdaLength>");
+  ReadBasicType(is, binary, &normalize_lda_length_);
+  ExpectToken(is, binary, "<NormalizeLength>");
+  ReadBasicType(is, binary, &plda_config_.normalize_length);
+  ExpectToken(is, binary, "<SimpleLengthNorm>");
+  ReadBasicType(is, binary, &plda_config_.simple_length_norm);
+  linear_.Read(is, binary);
+  offset_.Read(is, binary);
+  plda_linear_.Read(is, binary);
+  plda_offset_.Read(is, binary);
+  psi_.Read(is, binary);
+  ExpectToken(is, binary, "</CompiledXvectorTransform>");
+  dim_ = linear_.NumRows();
+  if (dim_ == 0 || offset_.Dim() != dim_ || psi_.Dim() != dim_ ||
+      (normalize_lda_length_ && (plda_linear_.NumRows() != dim_ ||
+                                 plda_linear_.NumCols() != dim_ ||
+                                 plda_offset_.Dim() != dim_)))
+    KALDI_ERR << "Inconsistent dimensions reading CompiledXvectorTransform.";
+}
+
+template class CompiledXvectorTransform<float>;
+template class CompiledXvectorTransform<double>;
+
+}  // namespace kaldi
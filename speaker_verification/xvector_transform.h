@@ -0,0 +1,97 @@
+// speaker_verification/xvector_transform.h
+
+// Copyright (c) 2021 PeachLab. All Rights Reserved.
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_SPEAKER_VERIFICATION_XVECTOR_TRANSFORM_H_
+#define KALDI_SPEAKER_VERIFICATION_XVECTOR_TRANSFORM_H_
+
+#include "base/kaldi-common.h"
+#include "matrix/matrix-lib.h"
+#include "speaker_verification/plda.h"
+
+namespace kaldi {
+
+/// CompiledXvectorTransform maps raw x-vectors to the input of PLDA scoring,
+/// i.e. it does what these steps do one after the other:
+///
+///    y = LDA (x - mean)                     (affine)
+///    y *= sqrt(dim) / |y|                   (if normalize_lda_length)
+///    z = Plda::TransformIvector(y, n)       (affine, then PLDA length norm)
+///
+/// with the affine maps merged when the model is loaded.  The mean is folded
+/// into the LDA offset, so the LDA stage is one GEMV (GEMM for a batch) with
+/// its length normalization as an epilogue.  That normalization only scales
+/// y, so it is applied as the alpha of the PLDA GEMV rather than as a pass of
+/// its own, and the PLDA length normalization is the final epilogue.  The
+/// normalization in between is what keeps the two affine maps apart; without
+/// it (normalize_lda_length == false) they are merged into a single one.
+template<typename Real>
+class CompiledXvectorTransform {
+ public:
+  CompiledXvectorTransform(): dim_(0), normalize_lda_length_(false) { }
+
+  /// "lda_transform" is Dim() x InputDim(), or Dim() x (InputDim() + 1) with
+  /// the offset in the last column; "mean" has dimension InputDim().
+  void Compile(const VectorBase<BaseFloat> &mean,
+               const MatrixBase<BaseFloat> &lda_transform,
+               bool normalize_lda_length,
+               const Plda &plda,
+               const PldaConfig &plda_config);
+
+  bool IsCompiled() const { return dim_ != 0; }
+
+  int32 InputDim() const { return linear_.NumCols(); }
+
+  int32 Dim() const { return dim_; }
+
+  /// Transforms one x-vector, taken as an average over "num_examples"
+  /// utterances (this affects the PLDA length normalization).
+  void Apply(const VectorBase<Real> &xvector, int32 num_examples,
+             VectorBase<Real> *plda_input) const;
+
+  /// Transforms each row of "xvectors"; "plda_inputs" must be
+  /// xvectors.NumRows() by Dim().
+  void ApplyBatch(const MatrixBase<Real> &xvectors, int32 num_examples,
+                  MatrixBase<Real> *plda_inputs) const;
+
+  /// The compiled maps, so that they can be loaded without the mean, LDA
+  /// and PLDA models (see ModelBundle).  Either precision reads what either
+  /// wrote.
+  void Write(std::ostream &os, bool binary) const;
+
+  void Read(std::istream &is, bool binary);
+
+ private:
+  void PldaLengthNorm(int32 num_examples, MatrixBase<Real> *plda_inputs) const;
+
+  int32 dim_;
+  bool normalize_lda_length_;
+  PldaConfig plda_config_;
+  /// The first affine map: the LDA transform (mean included), or, without
+  /// normalize_lda_length_, LDA and PLDA transforms together.
+  Matrix<Real> linear_;
+  Vector<Real> offset_;
+  /// The PLDA transform, used only with normalize_lda_length_.
+  Matrix<Real> plda_linear_;
+  Vector<Real> plda_offset_;
+  Vector<Real> psi_;
+};
+
+}  // namespace kaldi
+
+#endif  // KALDI_SPEAKER_VERIFICATION_XVECTOR_TRANSFORM_H_
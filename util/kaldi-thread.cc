@@ -20,6 +20,7 @@
 
 #include "base/kaldi-common.h"
 #include "util/kaldi-thread.h"
+#include "matrix/blas-threading.h"
 
 namespace kaldi {
 int32 g_num_threads = 8;  // Initialize this global variable.
@@ -28,6 +29,11 @@ MultiThreadable::~MultiThreadable() {
   // default implementation does nothing
 }
 
+void RunBlasWorker(MultiThreadable *c) {
+  BlasWorkerScope worker_scope;
+  (*c)();
+}
+
 
 
 }  // end namespace kaldi
@@ -87,6 +87,10 @@ class MultiThreadable {
   // Have additional member variables as needed.
 };
 
+// Runs (*c)() inside a BlasWorkerScope (see matrix/blas-threading.h), which
+// this header does not include.  MultiThreader runs its threads with it.
+void RunBlasWorker(MultiThreadable *c);
+
 
 class ExampleClass: public MultiThreadable {
  public:
@@ -129,7 +133,9 @@ class MultiThreader {
       for (int32 i = 0; i < threads_.size(); i++) {
         cvec_[i].thread_id_ = i;
         cvec_[i].num_threads_ = threads_.size();
-        threads_[i] = std::thread(std::ref(cvec_[i]));
+        // Worker threads get single-threaded BLAS under the automatic
+        // policy (see matrix/blas-threading.h).
+        threads_[i] = std::thread(RunBlasWorker, &(cvec_[i]));
       }
     }
   }
@@ -461,7 +461,12 @@ void ParseOptions::ReadConfigFile(const std::string &filename) {
   if (!is.good()) {
     KALDI_ERR << "Cannot open config file: " << filename;
   }
+  ReadConfigStream(is, filename);
+}
+
 
+void ParseOptions::ReadConfigStream(std::istream &is,
+                                    const std::string &filename) {
   std::string line, key, value;
   int32 line_number = 0;
   while (std::getline(is, line)) {
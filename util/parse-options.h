@@ -117,6 +117,9 @@ class ParseOptions : public OptionsItf {
   /// program.
   void ReadConfigFile(const std::string &filename);
 
+  /// As ReadConfigFile(), from a stream; "filename" is only for messages.
+  void ReadConfigStream(std::istream &is, const std::string &filename);
+
   /// Number of positional parameters (c.f. argc-1).
   int NumArgs() const;
 